@@ -0,0 +1,351 @@
+#include "allocprof.hpp"
+
+#ifdef CMM_PROFILE_ALLOC
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <mutex>
+#include <new>
+#include <string>
+#include <vector>
+
+namespace cminusminus{
+
+/*
+Every block carries a header saying how big it is and which entry of
+the table it is charged to. Blocks of profiled classes whose dynamic
+type is not known yet are also on a pending list: that of the thread
+that allocated them, as only it knows when they have been built. When
+a thread ends, its list goes onto the finished list, whose blocks any
+thread may classify.
+*/
+
+namespace {
+
+struct alignas(16) Header{
+	size_t size;
+	size_t entry;
+	DynamicType dynamicType;
+	Header * prev;
+	Header * next;
+};
+
+/* What allocations are charged to: a type, or a caller */
+struct Entry{
+	const void * key;
+	bool isType;
+	size_t count;
+	size_t bytes;
+	size_t live;
+	size_t peak;
+};
+
+const size_t tableSize = 4096;
+/* Entry 0 is for the profiler's own allocations, which are not
+   counted; entry 1 takes whatever does not fit in the table */
+const size_t selfEntry = 0;
+const size_t overflowEntry = 1;
+
+Entry table[tableSize];
+std::mutex lock;
+Header finished;
+size_t totalLive = 0;
+size_t totalPeak = 0;
+thread_local bool reporting = false;
+
+/* The calling thread's pending list. Plain data, so that it is there
+   for every allocation; retired once the thread's list has gone onto
+   the finished list, after which its blocks are no longer put on one
+   (they are charged to their base class) */
+struct ThreadPending{
+	Header list;
+	bool retired;
+};
+thread_local ThreadPending pending;
+
+/* Hands the thread's pending list on when the thread ends */
+struct RetireAtExit{
+	~RetireAtExit();
+	bool armed;
+};
+thread_local RetireAtExit retireAtExit;
+
+/* Each list is circular, through its own header; one never used has
+   null links */
+void link(Header& list, Header * header){
+	if (list.next == nullptr){ list.next = list.prev = &list; }
+	header->next = list.next;
+	header->prev = &list;
+	list.next->prev = header;
+	list.next = header;
+}
+
+/* Move every block on from to the end of to */
+void splice(Header& from, Header& to){
+	if (from.next == nullptr || from.next == &from){ return; }
+	if (to.next == nullptr){ to.next = to.prev = &to; }
+	from.next->prev = to.prev;
+	to.prev->next = from.next;
+	from.prev->next = &to;
+	to.prev = from.prev;
+	from.next = from.prev = &from;
+}
+
+RetireAtExit::~RetireAtExit(){
+	std::lock_guard<std::mutex> guard(lock);
+	splice(pending.list, finished);
+	pending.retired = true;
+}
+
+size_t entryFor(const void * key, bool isType){
+	if (reporting){ return selfEntry; }
+	size_t h = (reinterpret_cast<uintptr_t>(key) >> 4) % (tableSize - 2);
+	for (size_t probe = 0; probe < tableSize - 2; probe++){
+		size_t i = 2 + (h + probe) % (tableSize - 2);
+		if (table[i].key == key && table[i].isType == isType){ return i; }
+		if (table[i].key == nullptr){
+			table[i].key = key;
+			table[i].isType = isType;
+			return i;
+		}
+	}
+	return overflowEntry;
+}
+
+void charge(size_t entry, size_t size){
+	Entry& e = table[entry];
+	e.count++;
+	e.bytes += size;
+	e.live += size;
+	e.peak = std::max(e.peak, e.live);
+	if (entry != selfEntry){
+		totalLive += size;
+		totalPeak = std::max(totalPeak, totalLive);
+	}
+}
+
+void * allocate(size_t size, const void * key, bool isType,
+	DynamicType dynamicType){
+	void * raw = std::malloc(sizeof(Header) + size);
+	if (raw == nullptr){ return nullptr; }
+	Header * header = static_cast<Header *>(raw);
+	header->size = size;
+	header->dynamicType = dynamicType;
+	header->prev = nullptr;
+	header->next = nullptr;
+	bool queue = dynamicType != nullptr && !pending.retired;
+	//Made on first use, so before taking the lock
+	if (queue){ retireAtExit.armed = true; }
+	std::lock_guard<std::mutex> guard(lock);
+	header->entry = entryFor(key, isType);
+	charge(header->entry, size);
+	if (queue){ link(pending.list, header); }
+	return header + 1;
+}
+
+void release(void * obj){
+	if (obj == nullptr){ return; }
+	Header * header = static_cast<Header *>(obj) - 1;
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		table[header->entry].live -= header->size;
+		if (header->entry != selfEntry){ totalLive -= header->size; }
+		if (header->next != nullptr){
+			header->prev->next = header->next;
+			header->next->prev = header->prev;
+		}
+	}
+	std::free(header);
+}
+
+void * allocateOrThrow(size_t size, const void * caller){
+	void * obj = allocate(size, caller, false, nullptr);
+	if (obj == nullptr){ throw std::bad_alloc(); }
+	return obj;
+}
+
+std::string demangle(const char * name){
+	int status = 0;
+	char * plain = abi::__cxa_demangle(name, nullptr, nullptr, &status);
+	if (plain == nullptr){ return name; }
+	std::string result = plain;
+	std::free(plain);
+	return result;
+}
+
+/* What an allocation made from inside function fn was for */
+std::string callerClass(const std::string& fn){
+	if (fn.find("_List_node") != std::string::npos){
+		return "std::list node";
+	}
+	if (fn.find("_Rb_tree_node") != std::string::npos){
+		return "std::map/set node";
+	}
+	if (fn.find("_Hash_node") != std::string::npos){
+		return "std::unordered_map/set node";
+	}
+	if (fn.find("allocator<char>") != std::string::npos){
+		return "std::string payload";
+	}
+	if (fn.find("allocator<") != std::string::npos){
+		size_t start = fn.find("allocator<") + 10;
+		size_t depth = 1;
+		size_t end = start;
+		while (end < fn.size() && depth > 0){
+			if (fn[end] == '<'){ depth++; }
+			if (fn[end] == '>'){ depth--; }
+			end++;
+		}
+		return "container storage of " + fn.substr(start, end - start - 1);
+	}
+	return "new in " + fn.substr(0, fn.find('('));
+}
+
+std::string entryName(const Entry& e){
+	if (e.isType){
+		return demangle(static_cast<const std::type_info *>(e.key)->name());
+	}
+	Dl_info info;
+	if (dladdr(e.key, &info) == 0 || info.dli_sname == nullptr){
+		return "new in ?";
+	}
+	return callerClass(demangle(info.dli_sname));
+}
+
+struct Row{
+	std::string name;
+	size_t count;
+	size_t bytes;
+	size_t live;
+	size_t peak;
+};
+
+/* Charge each block on list to its dynamic type, and empty the list.
+   The lock must be held */
+void classify(Header& list){
+	if (list.next == nullptr){ return; }
+	Header * header = list.next;
+	while (header != &list){
+		Header * next = header->next;
+		const std::type_info& type = header->dynamicType(header + 1);
+		size_t entry = entryFor(&type, true);
+		if (entry != header->entry){
+			Entry& from = table[header->entry];
+			from.count--;
+			from.bytes -= header->size;
+			from.live -= header->size;
+			Entry& to = table[entry];
+			to.count++;
+			to.bytes += header->size;
+			to.live += header->size;
+			to.peak = std::max(to.peak, to.live);
+			header->entry = entry;
+		}
+		header->prev = nullptr;
+		header->next = nullptr;
+		header = next;
+	}
+	list.next = list.prev = &list;
+}
+
+void report(){
+	//Every thread has ended by now, the main one included
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		classify(finished);
+	}
+	//What reporting itself allocates is not counted
+	reporting = true;
+	std::vector<Entry> entries(tableSize - overflowEntry);
+	size_t peak;
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		std::copy(table + overflowEntry, table + tableSize, entries.begin());
+		peak = totalPeak;
+	}
+	std::vector<Row> rows;
+	for (const Entry& e : entries){
+		if (e.count == 0){ continue; }
+		std::string name = &e == &entries[0] ? "(table full)" : entryName(e);
+		auto found = std::find_if(rows.begin(), rows.end(),
+			[&](const Row& row){ return row.name == name; });
+		if (found == rows.end()){
+			rows.push_back(Row{name, e.count, e.bytes, e.live, e.peak});
+		} else {
+			found->count += e.count;
+			found->bytes += e.bytes;
+			found->live += e.live;
+			found->peak += e.peak;
+		}
+	}
+	std::sort(rows.begin(), rows.end(), [](const Row& x, const Row& y){
+		return x.bytes != y.bytes ? x.bytes > y.bytes : x.name < y.name;
+	});
+	Row total{"total", 0, 0, 0, peak};
+	std::fprintf(stderr, "%12s %14s %14s %14s  %s\n",
+		"count", "bytes", "live bytes", "peak live", "allocated as");
+	for (const Row& row : rows){
+		std::fprintf(stderr, "%12zu %14zu %14zu %14zu  %s\n",
+			row.count, row.bytes, row.live, row.peak, row.name.c_str());
+		total.count += row.count;
+		total.bytes += row.bytes;
+		total.live += row.live;
+	}
+	std::fprintf(stderr, "%12zu %14zu %14zu %14zu  %s\n",
+		total.count, total.bytes, total.live, total.peak, "total");
+}
+
+/* Report once everything else has run */
+struct ReportAtExit{
+	~ReportAtExit(){ report(); }
+} reportAtExit;
+
+}
+
+void * profiledNew(size_t size, const std::type_info& base,
+	DynamicType dynamicType){
+	void * obj = allocate(size, &base, true, dynamicType);
+	if (obj == nullptr){ throw std::bad_alloc(); }
+	return obj;
+}
+
+void classifyAllocations(){
+	std::lock_guard<std::mutex> guard(lock);
+	if (!pending.retired){ classify(pending.list); }
+	classify(finished);
+}
+
+}
+
+using cminusminus::allocateOrThrow;
+using cminusminus::allocate;
+using cminusminus::release;
+
+void * operator new(size_t size){
+	return allocateOrThrow(size, __builtin_return_address(0));
+}
+
+void * operator new[](size_t size){
+	return allocateOrThrow(size, __builtin_return_address(0));
+}
+
+void * operator new(size_t size, const std::nothrow_t&) noexcept{
+	return allocate(size, __builtin_return_address(0), false, nullptr);
+}
+
+void * operator new[](size_t size, const std::nothrow_t&) noexcept{
+	return allocate(size, __builtin_return_address(0), false, nullptr);
+}
+
+void operator delete(void * obj) noexcept{ release(obj); }
+void operator delete[](void * obj) noexcept{ release(obj); }
+void operator delete(void * obj, size_t) noexcept{ release(obj); }
+void operator delete[](void * obj, size_t) noexcept{ release(obj); }
+void operator delete(void * obj, const std::nothrow_t&) noexcept{ release(obj); }
+void operator delete[](void * obj, const std::nothrow_t&) noexcept{ release(obj); }
+
+#endif
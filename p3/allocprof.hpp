@@ -0,0 +1,61 @@
+#ifndef CMINUSMINUS_ALLOCPROF_HPP
+#define CMINUSMINUS_ALLOCPROF_HPP
+
+#include <cstddef>
+#include <typeinfo>
+
+/*
+The allocation profiler, built in by make PROFILE_ALLOC=1 (which
+defines CMM_PROFILE_ALLOC; rebuild from clean when switching). It
+replaces the global operator new and delete, and at exit writes to
+stderr a histogram of allocation counts and bytes, largest first,
+with the live bytes left and the high-water mark of live bytes.
+
+Objects of a class marked with CMM_PROFILED_CLASS (and of every class
+derived from it) are charged to their dynamic type. Nothing is known
+about an object but its base class until its constructor has run, so
+they are charged to the base at first and moved to their own type at
+the next call to classifyAllocations on the thread that allocated
+them (or on any thread, once that one has ended): call it where
+everything the calling thread has allocated so far is fully built.
+Other threads may be in the middle of building objects meanwhile.
+Until then their bytes count toward the base's peak, which overstates
+it.
+
+Anything else is charged to where operator new was called from,
+which for the standard containers names what was allocated: a
+std::string payload, a std::list node, vector storage and so on.
+
+Without CMM_PROFILE_ALLOC all of this compiles to nothing.
+*/
+
+namespace cminusminus{
+
+#ifdef CMM_PROFILE_ALLOC
+
+typedef const std::type_info& (*DynamicType)(const void * obj);
+
+void * profiledNew(size_t size, const std::type_info& base,
+	DynamicType dynamicType);
+void classifyAllocations();
+
+#define CMM_PROFILED_CLASS(Base) \
+	static void * operator new(size_t size){ \
+		return cminusminus::profiledNew(size, typeid(Base), \
+			[](const void * obj) -> const std::type_info& { \
+				return typeid(*static_cast<const Base *>(obj)); \
+			}); \
+	} \
+	static void operator delete(void * obj){ ::operator delete(obj); }
+
+#else
+
+inline void classifyAllocations(){ }
+
+#define CMM_PROFILED_CLASS(Base)
+
+#endif
+
+}
+
+#endif
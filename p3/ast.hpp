@@ -1,9 +1,13 @@
 #ifndef CMINUSMINUS_AST_HPP
 #define CMINUSMINUS_AST_HPP
 
+#include <functional>
 #include <ostream>
 #include <list>
+#include <vector>
+#include "budget.hpp"
 #include "tokens.hpp"
+#include "types.hpp"
 #include <cassert>
 
 
@@ -19,6 +23,36 @@ class TypeNode;
 class StmtNode;
 class IDNode;
 class FormalDeclNode;
+class ASTWriter;
+class SymbolTable;
+class SemSymbol;
+class TypeAnalysis;
+class IRBuilder;
+class FlowBuilder;
+class WorkStack;
+class Opd;
+class ASTNode;
+
+/**
+* \class UnparseWork
+* What an unparse step leaves for later: subtrees to unparse and text
+* to write after them, in the order they are to appear
+**/
+class UnparseWork{
+public:
+void node(ASTNode * n, int indent = 0){
+	items.push_back(Item{n, indent, nullptr});
+}
+void text(const char * t){ items.push_back(Item{nullptr, 0, t}); }
+private:
+friend class ASTNode;
+struct Item{
+ASTNode * node;
+int indent;
+const char * text;
+};
+std::vector<Item> items;
+};
 
 /**
 * \class ASTNode
@@ -26,14 +60,49 @@ class FormalDeclNode;
 **/
 class ASTNode{
 public:
-ASTNode(Position * p) : myPos(p){ }
-virtual void unparse(std::ostream& out, int indent) = 0;
+/** Counted against the thread's NodeBudget, if it has one **/
+ASTNode(Position * p) : myPos(p){
+	if (NodeBudget::active()){ NodeBudget::charge(p); }
+}
+/** Deletes the node's own position, but none of its children:
+    see deleteTree **/
+virtual ~ASTNode();
+CMM_PROFILED_CLASS(ASTNode)
+/** Write this subtree as source. Iterative (see unparse.cpp), so
+    any depth of nesting is fine **/
+void unparse(std::ostream& out, int indent);
+/** Write the start of this node, and queue the rest (subtrees and
+    text after them) on rest, in order **/
+virtual void unparseStep(std::ostream& out, UnparseWork& rest, int indent) = 0;
+/** Append this subtree to a binary AST file (see serialize.hpp) **/
+virtual void serialize(ASTWriter& out) = 0;
+/** Link the names of this node to their declarations, reporting
+    undeclared and redeclared names, and queue its subtrees on symTab
+    (see SymbolTable::analyze). Returns false on an error here.
+    Nodes that contain no names have nothing to do. **/
+virtual bool nameAnalysis(SymbolTable * symTab){ return true; }
+/** Check the types in this subtree, recording each expression's
+    type and any errors in ta. Operands and bodies are queued on ta,
+    with what depends on them (type_analysis.cpp) **/
+virtual void typeAnalysis(TypeAnalysis * ta){ }
+/** Move this node's children to children, leaving it with none,
+    so that it can be deleted on its own (release.cpp) **/
+virtual void release(std::vector<ASTNode *>& children){ }
 Position * pos() { return myPos; }
 std::string posStr() { return pos()->span(); }
 protected:
 Position * myPos;
 };
 
+/* Delete root and everything under it. Iterative, so any depth of
+   nesting is fine. Only for trees built without sharing nodes (see
+   ASTInterner), in which every node has one parent */
+void deleteTree(ASTNode * root);
+
+/* Given each top-level declaration as soon as it is parsed, in place
+   of the program's list of them (see stream.hpp) */
+typedef std::function<void(DeclNode *)> DeclSink;
+
 /**
 * \class ProgramNode
 * Class that contains the entire abstract syntax tree for a program.
@@ -44,7 +113,13 @@ Position * myPos;
 class ProgramNode : public ASTNode{
 public:
 ProgramNode(std::list<DeclNode *> * globalsIn) ;
-void unparse(std::ostream& out, int indent) override;
+void unparseStep(std::ostream& out, UnparseWork& rest, int indent) override;
+void release(std::vector<ASTNode *>& children) override;
+void serialize(ASTWriter& out) override;
+bool nameAnalysis(SymbolTable * symTab) override;
+/** Fold constants and prune dead branches in place (simplify.cpp) **/
+void simplify();
+std::list<DeclNode *> * getGlobals() const { return myGlobals; }
 private:
 std::list<DeclNode * > * myGlobals;
 };
@@ -52,7 +127,21 @@ std::list<DeclNode * > * myGlobals;
 class StmtNode : public ASTNode{
 public:
 StmtNode(Position * p) : ASTNode(p){ }
-void unparse(std::ostream& out, int indent) override = 0;
+void unparseStep(std::ostream& out, UnparseWork& rest, int indent) override = 0;
+/** Append the simplified form of this statement to out: usually
+    the statement itself, but a dead branch appends nothing. Bodies
+    are simplified in steps queued on work, and out must last until
+    those are done **/
+virtual void simplify(std::list<StmtNode *>& out, WorkStack& work){
+	out.push_back(this);
+}
+/** Append this statement's IR to the current procedure, queueing
+    that of its subtrees on ir (lower.cpp) **/
+virtual void lower(IRBuilder& ir) = 0;
+/** Append this statement's reads and writes of variables, and its
+    control flow, to the function's flow graph, queueing those of its
+    subtrees on fb (flow.cpp) **/
+virtual void flow(FlowBuilder& fb){ }
 };
 
 
@@ -63,7 +152,7 @@ void unparse(std::ostream& out, int indent) override = 0;
 class DeclNode : public StmtNode{
 public:
 DeclNode(Position * p) : StmtNode(p) { }
-void unparse(std::ostream& out, int indent) override = 0;
+void unparseStep(std::ostream& out, UnparseWork& rest, int indent) override = 0;
 };
 
 /**  \class ExpNode
@@ -72,6 +161,25 @@ void unparse(std::ostream& out, int indent) override = 0;
 * should inherit from this abstract superclass.
 **/
 class ExpNode : public ASTNode{
+public:
+/** An equivalent expression with constants folded. May be this
+    node (with simplified operands) or a new node. Walks the operands
+    without recursing (simplify.cpp) **/
+ExpNode * simplify();
+/** Fold this node, whose operands are already simplified **/
+virtual ExpNode * fold(){ return this; }
+/** Append the slots holding the operands simplify works on **/
+virtual void operands(std::vector<ExpNode **>& slots){ }
+/** Append the IR that computes this expression, queueing that of
+    its operands on ir, and push its value onto ir's value stack **/
+virtual void lower(IRBuilder& ir) = 0;
+/** Append IR that jumps to label when this (bool) expression's
+    value is onTrue, and otherwise falls through. Operands are queued
+    as for lower **/
+virtual void lowerBranch(IRBuilder& ir, Opd label, bool onTrue);
+/** Append the variables this expression reads and writes, in
+    evaluation order, to the function's flow graph (flow.cpp) **/
+virtual void flow(FlowBuilder& fb){ }
 protected:
 ExpNode(Position * p) : ASTNode(p){ }
 };
@@ -79,29 +187,45 @@ ExpNode(Position * p) : ASTNode(p){ }
 class TrueNode : public ExpNode{
 public:
 TrueNode(Position * p) : ExpNode(p) { }
-void unparse(std::ostream& out, int indent) override;
+void unparseStep(std::ostream& out, UnparseWork& rest, int indent) override;
+void serialize(ASTWriter& out) override;
+void lower(IRBuilder& ir) override;
+void lowerBranch(IRBuilder& ir, Opd label, bool onTrue) override;
+void typeAnalysis(TypeAnalysis * ta) override;
 };
 
 class FalseNode : public ExpNode{
 public:
 FalseNode(Position * p) : ExpNode(p){ }
-void unparse(std::ostream& out, int indent) override;
+void unparseStep(std::ostream& out, UnparseWork& rest, int indent) override;
+void serialize(ASTWriter& out) override;
+void lower(IRBuilder& ir) override;
+void lowerBranch(IRBuilder& ir, Opd label, bool onTrue) override;
+void typeAnalysis(TypeAnalysis * ta) override;
 };
 
 class StrLitNode : public ExpNode{
 public:
-StrLitNode(Position * p, std::string Val)
+StrLitNode(Position * p, StrSlice Val)
 : ExpNode(p), stringVal(Val){ }
-void unparse(std::ostream& out, int indent) override;
+void unparseStep(std::ostream& out, UnparseWork& rest, int indent) override;
+void serialize(ASTWriter& out) override;
+void lower(IRBuilder& ir) override;
+void typeAnalysis(TypeAnalysis * ta) override;
 private:
-std::string stringVal;
+/* Points into the buffer the AST was built from */
+StrSlice stringVal;
 };
 
 class IntLitNode : public ExpNode{
 public:
 IntLitNode(Position * p, int Val)
 : ExpNode(p), numval(Val){ }
-void unparse(std::ostream& out, int indent) override;
+int num() const { return numval; }
+void unparseStep(std::ostream& out, UnparseWork& rest, int indent) override;
+void serialize(ASTWriter& out) override;
+void lower(IRBuilder& ir) override;
+void typeAnalysis(TypeAnalysis * ta) override;
 private:
 int numval;
 };
@@ -111,7 +235,11 @@ class ShortLitNode : public ExpNode{
 public:
 ShortLitNode(Position * p, int Val)
 : ExpNode(p), shortVal(Val){ }
-void unparse(std::ostream& out, int indent) override;
+short num() const { return shortVal; }
+void unparseStep(std::ostream& out, UnparseWork& rest, int indent) override;
+void serialize(ASTWriter& out) override;
+void lower(IRBuilder& ir) override;
+void typeAnalysis(TypeAnalysis * ta) override;
 private:
 short shortVal;
 };
@@ -121,34 +249,59 @@ class UnaryExpNode : public ExpNode{
 public:
 UnaryExpNode(Position * p, ExpNode * Expression)
 : ExpNode(p), expression(Expression) { }
-void unparse(std::ostream& out, int indent) override = 0;
-private:
+void unparseStep(std::ostream& out, UnparseWork& rest, int indent) override = 0;
+void release(std::vector<ASTNode *>& children) override;
+bool nameAnalysis(SymbolTable * symTab) override;
+void flow(FlowBuilder& fb) override;
+ExpNode * getExp() const { return expression; }
+void operands(std::vector<ExpNode **>& slots) override;
+protected:
 ExpNode * expression;
 };
 
 class NegNode : public UnaryExpNode{
 public:
 NegNode(Position * p, ExpNode * Expression) : UnaryExpNode(p, Expression) { }
-void unparse(std::ostream& out, int indent) override;
+void unparseStep(std::ostream& out, UnparseWork& rest, int indent) override;
+void serialize(ASTWriter& out) override;
+void lower(IRBuilder& ir) override;
+void typeAnalysis(TypeAnalysis * ta) override;
+ExpNode * fold() override;
 };
 
 class NotNode : public UnaryExpNode{
 public:
 NotNode(Position * p, ExpNode * Expression) : UnaryExpNode(p, Expression) { }
-void unparse(std::ostream& out, int indent) override;
+void unparseStep(std::ostream& out, UnparseWork& rest, int indent) override;
+void serialize(ASTWriter& out) override;
+void lower(IRBuilder& ir) override;
+void lowerBranch(IRBuilder& ir, Opd label, bool onTrue) override;
+void typeAnalysis(TypeAnalysis * ta) override;
+ExpNode * fold() override;
 };
 
 class RefNode : public UnaryExpNode{
 public:
 RefNode(Position * p, ExpNode * Expression) : UnaryExpNode(p, Expression) { }
-void unparse(std::ostream& out, int indent) override;
+void unparseStep(std::ostream& out, UnparseWork& rest, int indent) override;
+void serialize(ASTWriter& out) override;
+void lower(IRBuilder& ir) override;
+void flow(FlowBuilder& fb) override;
+void typeAnalysis(TypeAnalysis * ta) override;
 };
 
 class CallExpNode : public ExpNode{
 public:
-CallExpNode(Position * p, IDNode * Name) : ExpNode(p), nameFunc(Name) { }
+CallExpNode(Position * p, IDNode * Name) : ExpNode(p), nameFunc(Name), arguments(nullptr) { }
 CallExpNode(Position * p, IDNode * Name, std::list<ExpNode *> * Arguments) : ExpNode(p), nameFunc(Name), arguments(Arguments) { }
-void unparse(std::ostream& out, int indent) override;
+void unparseStep(std::ostream& out, UnparseWork& rest, int indent) override;
+void release(std::vector<ASTNode *>& children) override;
+void serialize(ASTWriter& out) override;
+void lower(IRBuilder& ir) override;
+void flow(FlowBuilder& fb) override;
+bool nameAnalysis(SymbolTable * symTab) override;
+void typeAnalysis(TypeAnalysis * ta) override;
+void operands(std::vector<ExpNode **>& slots) override;
 private:
 IDNode * nameFunc;
 std::list<ExpNode * > * arguments;
@@ -158,7 +311,14 @@ class CallStmtNode : public StmtNode{
 public:
 CallStmtNode(Position * p, CallExpNode * func)
 : StmtNode(p), Function(func) { }
-void unparse(std::ostream& out, int indent) override;
+void unparseStep(std::ostream& out, UnparseWork& rest, int indent) override;
+void release(std::vector<ASTNode *>& children) override;
+void serialize(ASTWriter& out) override;
+void lower(IRBuilder& ir) override;
+void flow(FlowBuilder& fb) override;
+bool nameAnalysis(SymbolTable * symTab) override;
+void typeAnalysis(TypeAnalysis * ta) override;
+void simplify(std::list<StmtNode *>& out, WorkStack& work) override;
 private:
 CallExpNode * Function;
 };
@@ -173,19 +333,37 @@ protected:
 TypeNode(Position * p) : ASTNode(p){
 }
 public:
-virtual void unparse(std::ostream& out, int indent) = 0;
+virtual void unparseStep(std::ostream& out, UnparseWork& rest, int indent) = 0;
+/** The type this node denotes **/
+virtual DataType getType() = 0;
 };
 
 class LValNode : public ExpNode{
 public:
 LValNode(Position * p) : ExpNode(p){}
-void unparse(std::ostream& out, int indent) override = 0;
+void unparseStep(std::ostream& out, UnparseWork& rest, int indent) override = 0;
+/** An lval is at most an id under a @, so it lowers on the spot **/
+void lower(IRBuilder& ir) override;
+/** Append IR that loads this location's value; returns it **/
+virtual Opd lowerLoad(IRBuilder& ir) = 0;
+/** Append IR that stores value into this location **/
+virtual void lowerStore(IRBuilder& ir, Opd value) = 0;
+/** Append IR that computes this location's address **/
+virtual Opd lowerAddr(IRBuilder& ir) = 0;
+/** Append a store into this location to the flow graph **/
+virtual void flowStore(FlowBuilder& fb) = 0;
 };
 
 class PostDecStmtNode : public StmtNode{
 public:
 PostDecStmtNode(Position * p, LValNode * Variable) : StmtNode(p), variable(Variable) { }
-void unparse(std::ostream& out, int indent) override;
+void unparseStep(std::ostream& out, UnparseWork& rest, int indent) override;
+void release(std::vector<ASTNode *>& children) override;
+void serialize(ASTWriter& out) override;
+void lower(IRBuilder& ir) override;
+void flow(FlowBuilder& fb) override;
+bool nameAnalysis(SymbolTable * symTab) override;
+void typeAnalysis(TypeAnalysis * ta) override;
 private:
 LValNode * variable;
 };
@@ -193,7 +371,13 @@ LValNode * variable;
 class PostIncStmtNode : public StmtNode{
 public:
 PostIncStmtNode(Position * p, LValNode * Variable) : StmtNode(p), variable(Variable) { }
-void unparse(std::ostream& out, int indent) override;
+void unparseStep(std::ostream& out, UnparseWork& rest, int indent) override;
+void release(std::vector<ASTNode *>& children) override;
+void serialize(ASTWriter& out) override;
+void lower(IRBuilder& ir) override;
+void flow(FlowBuilder& fb) override;
+bool nameAnalysis(SymbolTable * symTab) override;
+void typeAnalysis(TypeAnalysis * ta) override;
 private:
 LValNode * variable;
 };
@@ -201,7 +385,13 @@ LValNode * variable;
 class ReadStmtNode : public StmtNode{
 public:
 ReadStmtNode(Position * p, LValNode * Variable) : StmtNode(p), variable(Variable) { }
-void unparse(std::ostream& out, int indent) override;
+void unparseStep(std::ostream& out, UnparseWork& rest, int indent) override;
+void release(std::vector<ASTNode *>& children) override;
+void serialize(ASTWriter& out) override;
+void lower(IRBuilder& ir) override;
+void flow(FlowBuilder& fb) override;
+bool nameAnalysis(SymbolTable * symTab) override;
+void typeAnalysis(TypeAnalysis * ta) override;
 private:
 LValNode * variable;
 };
@@ -209,7 +399,14 @@ LValNode * variable;
 class WriteStmtNode : public StmtNode{
 public:
 WriteStmtNode(Position * p, ExpNode * Expression) : StmtNode(p), expression(Expression) { }
-void unparse(std::ostream& out, int indent) override;
+void unparseStep(std::ostream& out, UnparseWork& rest, int indent) override;
+void release(std::vector<ASTNode *>& children) override;
+void serialize(ASTWriter& out) override;
+void lower(IRBuilder& ir) override;
+void flow(FlowBuilder& fb) override;
+bool nameAnalysis(SymbolTable * symTab) override;
+void typeAnalysis(TypeAnalysis * ta) override;
+void simplify(std::list<StmtNode *>& out, WorkStack& work) override;
 private:
 ExpNode * expression;
 };
@@ -217,8 +414,15 @@ ExpNode * expression;
 class ReturnStmtNode : public StmtNode{
 public:
 ReturnStmtNode(Position * p, ExpNode * Expression) : StmtNode(p), expression(Expression) { }
-ReturnStmtNode(Position * p) : StmtNode(p) {}
-void unparse(std::ostream& out, int indent) override;
+ReturnStmtNode(Position * p) : StmtNode(p), expression(nullptr) {}
+void unparseStep(std::ostream& out, UnparseWork& rest, int indent) override;
+void release(std::vector<ASTNode *>& children) override;
+void serialize(ASTWriter& out) override;
+void lower(IRBuilder& ir) override;
+void flow(FlowBuilder& fb) override;
+bool nameAnalysis(SymbolTable * symTab) override;
+void typeAnalysis(TypeAnalysis * ta) override;
+void simplify(std::list<StmtNode *>& out, WorkStack& work) override;
 private:
 ExpNode * expression;
 };
@@ -227,7 +431,14 @@ class WhileStmtNode : public StmtNode{
 public:
 WhileStmtNode(Position * p, ExpNode * Condition, std::list<StmtNode *> * body)
 : StmtNode(p), condition(Condition), WhileBody(body) { }
-void unparse(std::ostream& out, int indent) override;
+void unparseStep(std::ostream& out, UnparseWork& rest, int indent) override;
+void release(std::vector<ASTNode *>& children) override;
+void serialize(ASTWriter& out) override;
+void lower(IRBuilder& ir) override;
+void flow(FlowBuilder& fb) override;
+bool nameAnalysis(SymbolTable * symTab) override;
+void typeAnalysis(TypeAnalysis * ta) override;
+void simplify(std::list<StmtNode *>& out, WorkStack& work) override;
 private:
 ExpNode * condition;
 std::list<StmtNode* > * WhileBody;
@@ -237,7 +448,14 @@ class IfStmtNode : public StmtNode{
 public:
 IfStmtNode(Position * p, ExpNode * Condition, std::list<StmtNode *> * body)
 : StmtNode(p), condition(Condition), IfBody(body) { }
-void unparse(std::ostream& out, int indent) override;
+void unparseStep(std::ostream& out, UnparseWork& rest, int indent) override;
+void release(std::vector<ASTNode *>& children) override;
+void serialize(ASTWriter& out) override;
+void lower(IRBuilder& ir) override;
+void flow(FlowBuilder& fb) override;
+bool nameAnalysis(SymbolTable * symTab) override;
+void typeAnalysis(TypeAnalysis * ta) override;
+void simplify(std::list<StmtNode *>& out, WorkStack& work) override;
 private:
 ExpNode * condition;
 std::list<StmtNode * > * IfBody;
@@ -247,7 +465,14 @@ class IfElseStmtNode : public StmtNode{
 public:
 IfElseStmtNode(Position *p, ExpNode * Condition, std::list<StmtNode *> * tbody, std::list<StmtNode *> * fbody)
 : StmtNode(p), condition(Condition), IfTrueBody(tbody), IfFalseBody(fbody) { }
-void unparse(std::ostream& out, int indent) override;
+void unparseStep(std::ostream& out, UnparseWork& rest, int indent) override;
+void release(std::vector<ASTNode *>& children) override;
+void serialize(ASTWriter& out) override;
+void lower(IRBuilder& ir) override;
+void flow(FlowBuilder& fb) override;
+bool nameAnalysis(SymbolTable * symTab) override;
+void typeAnalysis(TypeAnalysis * ta) override;
+void simplify(std::list<StmtNode *>& out, WorkStack& work) override;
 private:
 ExpNode * condition;
 std::list<StmtNode * > * IfTrueBody;
@@ -260,28 +485,60 @@ std::list<StmtNode * > * IfFalseBody;
 class IDNode : public LValNode{
 public:
 IDNode(Position * p, std::string nameIn)
-: LValNode(p), name(nameIn){ }
-void unparse(std::ostream& out, int indent);
+: LValNode(p), name(nameIn), mySymbol(nullptr){ }
+const std::string& getName() const { return name; }
+/** The declaration this name refers to, once name analysis has run **/
+SemSymbol * getSymbol() const { return mySymbol; }
+void attachSymbol(SemSymbol * symbolIn){ mySymbol = symbolIn; }
+void unparseStep(std::ostream& out, UnparseWork& rest, int indent);
+void serialize(ASTWriter& out) override;
+Opd lowerLoad(IRBuilder& ir) override;
+void lowerStore(IRBuilder& ir, Opd value) override;
+Opd lowerAddr(IRBuilder& ir) override;
+void flow(FlowBuilder& fb) override;
+void flowStore(FlowBuilder& fb) override;
+bool nameAnalysis(SymbolTable * symTab) override;
+void typeAnalysis(TypeAnalysis * ta) override;
 private:
 /** The name of the identifier **/
 std::string name;
+SemSymbol * mySymbol;
 };
 
+/** A dereference of a pointer variable, as in @p **/
 class DerefNode : public LValNode{
 public:
-DerefNode(Position * p, std::string nameIn)
-: LValNode(p), name(nameIn){ }
-void unparse(std::ostream& out, int indent);
+DerefNode(Position * p, IDNode * idIn)
+: LValNode(p), myId(idIn){ }
+void unparseStep(std::ostream& out, UnparseWork& rest, int indent);
+void release(std::vector<ASTNode *>& children) override;
+void serialize(ASTWriter& out) override;
+Opd lowerLoad(IRBuilder& ir) override;
+void lowerStore(IRBuilder& ir, Opd value) override;
+Opd lowerAddr(IRBuilder& ir) override;
+void flow(FlowBuilder& fb) override;
+void flowStore(FlowBuilder& fb) override;
+bool nameAnalysis(SymbolTable * symTab) override;
+void typeAnalysis(TypeAnalysis * ta) override;
 private:
-/** The name of the identifier **/
-std::string name;
+/** The pointer being dereferenced **/
+IDNode * myId;
 };
 
 class IndexNode : public LValNode{
 public:
 IndexNode(Position * p, IDNode * id, IDNode * name)
 : LValNode(p), Id_being_accessed(id), field_Name_being_accessed(name) { }
-void unparse(std::ostream& out, int indent) override;
+void unparseStep(std::ostream& out, UnparseWork& rest, int indent) override;
+void release(std::vector<ASTNode *>& children) override;
+void serialize(ASTWriter& out) override;
+Opd lowerLoad(IRBuilder& ir) override;
+void lowerStore(IRBuilder& ir, Opd value) override;
+Opd lowerAddr(IRBuilder& ir) override;
+void flow(FlowBuilder& fb) override;
+void flowStore(FlowBuilder& fb) override;
+bool nameAnalysis(SymbolTable * symTab) override;
+void typeAnalysis(TypeAnalysis * ta) override;
 private:
 IDNode * Id_being_accessed;
 IDNode * field_Name_being_accessed;
@@ -297,7 +554,14 @@ VarDeclNode(Position * p, TypeNode * type, IDNode * id)
 assert (myType != nullptr);
 assert (myId != nullptr);
 }
-void unparse(std::ostream& out, int indent);
+TypeNode * getTypeNode() const { return myType; }
+IDNode * ID() const { return myId; }
+void unparseStep(std::ostream& out, UnparseWork& rest, int indent);
+void release(std::vector<ASTNode *>& children) override;
+void serialize(ASTWriter& out) override;
+void lower(IRBuilder& ir) override;
+void flow(FlowBuilder& fb) override;
+bool nameAnalysis(SymbolTable * symTab) override;
 protected:
 TypeNode * myType;
 IDNode * myId;
@@ -307,7 +571,8 @@ class FormalDeclNode : public VarDeclNode{
 public:
 FormalDeclNode(Position * p, TypeNode * type, IDNode * id)
 : VarDeclNode(p, type, id) { }
-void unparse(std::ostream& out, int indent) override;
+void unparseStep(std::ostream& out, UnparseWork& rest, int indent) override;
+void serialize(ASTWriter& out) override;
 //private:
 //TypeNode * myType;
 //IDNode * myId;
@@ -319,7 +584,18 @@ FnDeclNode(Position * p, TypeNode * type, IDNode * id, std::list<StmtNode * > *
 : DeclNode(p), myType(type), myId(id), parameters(nullptr), functionBody(funcBody) { }
 FnDeclNode(Position * p, TypeNode * type, IDNode * id, std::list<FormalDeclNode * > * paramIn, std::list<StmtNode * > * funcBody)
 : DeclNode(p), myType(type), myId(id), parameters(paramIn), functionBody(funcBody) { }
-void unparse(std::ostream& out, int indent) override;
+TypeNode * getRetTypeNode() const { return myType; }
+IDNode * ID() const { return myId; }
+/** The formal parameters; nullptr when there are none **/
+std::list<FormalDeclNode *> * getFormals() const { return parameters; }
+std::list<StmtNode *> * getBody() const { return functionBody; }
+void unparseStep(std::ostream& out, UnparseWork& rest, int indent) override;
+void release(std::vector<ASTNode *>& children) override;
+void serialize(ASTWriter& out) override;
+void lower(IRBuilder& ir) override;
+bool nameAnalysis(SymbolTable * symTab) override;
+void typeAnalysis(TypeAnalysis * ta) override;
+void simplify(std::list<StmtNode *>& out, WorkStack& work) override;
 private:
 TypeNode * myType;
 IDNode * myId;
@@ -330,7 +606,14 @@ std::list<StmtNode * > * functionBody;
 class AssignExpNode : public ExpNode{
 public:
 AssignExpNode(Position * p, LValNode * Variable, ExpNode * Expression) : ExpNode(p), variable(Variable), expression(Expression) { }
-void unparse(std::ostream& out, int indent) override;
+void unparseStep(std::ostream& out, UnparseWork& rest, int indent) override;
+void release(std::vector<ASTNode *>& children) override;
+void serialize(ASTWriter& out) override;
+void lower(IRBuilder& ir) override;
+void flow(FlowBuilder& fb) override;
+bool nameAnalysis(SymbolTable * symTab) override;
+void typeAnalysis(TypeAnalysis * ta) override;
+void operands(std::vector<ExpNode **>& slots) override;
 private:
 LValNode * variable;
 ExpNode * expression;
@@ -339,7 +622,14 @@ ExpNode * expression;
 class AssignStmtNode : public StmtNode{
 public:
 AssignStmtNode(Position * p, AssignExpNode * Assignment) : StmtNode(p), assignment(Assignment) { }
-void unparse(std::ostream& out, int indent) override;
+void unparseStep(std::ostream& out, UnparseWork& rest, int indent) override;
+void release(std::vector<ASTNode *>& children) override;
+void serialize(ASTWriter& out) override;
+void lower(IRBuilder& ir) override;
+void flow(FlowBuilder& fb) override;
+bool nameAnalysis(SymbolTable * symTab) override;
+void typeAnalysis(TypeAnalysis * ta) override;
+void simplify(std::list<StmtNode *>& out, WorkStack& work) override;
 private:
 AssignExpNode * assignment;
 };
@@ -347,31 +637,45 @@ AssignExpNode * assignment;
 class IntTypeNode : public TypeNode{
 public:
 IntTypeNode(Position * p) : TypeNode(p){ }
-void unparse(std::ostream& out, int indent);
+void unparseStep(std::ostream& out, UnparseWork& rest, int indent);
+void serialize(ASTWriter& out) override;
+DataType getType() override;
 };
 
 class BoolTypeNode : public TypeNode{
 public:
 BoolTypeNode(Position * p) : TypeNode(p){ }
-void unparse(std::ostream& out, int indent) override;
+void unparseStep(std::ostream& out, UnparseWork& rest, int indent) override;
+void serialize(ASTWriter& out) override;
+DataType getType() override;
 };
 
 class VoidTypeNode : public TypeNode{
 public:
 VoidTypeNode(Position * p) : TypeNode(p) { }
-void unparse(std::ostream& out, int indent) override;
+void unparseStep(std::ostream& out, UnparseWork& rest, int indent) override;
+void serialize(ASTWriter& out) override;
+DataType getType() override;
 };
 
 class StringTypeNode : public TypeNode{
 public:
 StringTypeNode(Position * p) : TypeNode(p) { }
-void unparse(std::ostream& out, int indent) override;
+void unparseStep(std::ostream& out, UnparseWork& rest, int indent) override;
+void serialize(ASTWriter& out) override;
+DataType getType() override;
 };
 
 class BinaryExpNode : public ExpNode {
 public:
 BinaryExpNode(Position * p, ExpNode * leftNode, ExpNode * rightNode) : ExpNode(p), leftNode(leftNode), rightNode(rightNode) {}
-void unparse(std::ostream& out, int indent) override = 0;
+void unparseStep(std::ostream& out, UnparseWork& rest, int indent) override = 0;
+void release(std::vector<ASTNode *>& children) override;
+bool nameAnalysis(SymbolTable * symTab) override;
+void flow(FlowBuilder& fb) override;
+ExpNode * getLeft() const { return leftNode; }
+ExpNode * getRight() const { return rightNode; }
+void operands(std::vector<ExpNode **>& slots) override;
 protected:
 ExpNode * leftNode;
 ExpNode * rightNode;
@@ -380,85 +684,151 @@ ExpNode * rightNode;
 class AndNode : public BinaryExpNode {
 public:
 AndNode(Position * p, ExpNode * leftNode, ExpNode * rightNode) : BinaryExpNode(p, leftNode, rightNode) {}
-void unparse(std::ostream&, int indent) override;
+void unparseStep(std::ostream& out, UnparseWork& rest, int indent) override;
+void serialize(ASTWriter& out) override;
+void lower(IRBuilder& ir) override;
+void lowerBranch(IRBuilder& ir, Opd label, bool onTrue) override;
+void flow(FlowBuilder& fb) override;
+void typeAnalysis(TypeAnalysis * ta) override;
+ExpNode * fold() override;
 };
 
 class DivideNode : public BinaryExpNode {
 public:
 DivideNode(Position * p, ExpNode * leftNode, ExpNode * rightNode) : BinaryExpNode(p, leftNode, rightNode) {}
-void unparse(std::ostream& out, int indent) override;
+void unparseStep(std::ostream& out, UnparseWork& rest, int indent) override;
+void serialize(ASTWriter& out) override;
+void lower(IRBuilder& ir) override;
+void typeAnalysis(TypeAnalysis * ta) override;
+ExpNode * fold() override;
 };
 
 class EqualsNode : public BinaryExpNode {
 public:
 EqualsNode(Position * p, ExpNode * leftNode, ExpNode * rightNode) : BinaryExpNode(p, leftNode, rightNode) {}
-void unparse(std::ostream& out, int indent) override;
+void unparseStep(std::ostream& out, UnparseWork& rest, int indent) override;
+void serialize(ASTWriter& out) override;
+void lower(IRBuilder& ir) override;
+void lowerBranch(IRBuilder& ir, Opd label, bool onTrue) override;
+void typeAnalysis(TypeAnalysis * ta) override;
+ExpNode * fold() override;
 };
 
 class GreaterEqNode : public BinaryExpNode {
 public:
 GreaterEqNode(Position * p, ExpNode * leftNode, ExpNode * rightNode) : BinaryExpNode(p, leftNode, rightNode) {}
-void unparse(std::ostream& out, int indent) override;
+void unparseStep(std::ostream& out, UnparseWork& rest, int indent) override;
+void serialize(ASTWriter& out) override;
+void lower(IRBuilder& ir) override;
+void lowerBranch(IRBuilder& ir, Opd label, bool onTrue) override;
+void typeAnalysis(TypeAnalysis * ta) override;
+ExpNode * fold() override;
 };
 
 class GreaterNode : public BinaryExpNode {
 public:
 GreaterNode(Position * p, ExpNode * leftNode, ExpNode * rightNode) : BinaryExpNode(p, leftNode, rightNode) {}
-void unparse(std::ostream& out, int indent) override;
+void unparseStep(std::ostream& out, UnparseWork& rest, int indent) override;
+void serialize(ASTWriter& out) override;
+void lower(IRBuilder& ir) override;
+void lowerBranch(IRBuilder& ir, Opd label, bool onTrue) override;
+void typeAnalysis(TypeAnalysis * ta) override;
+ExpNode * fold() override;
 };
 
 class LessEqNode : public BinaryExpNode {
 public:
 LessEqNode(Position * p, ExpNode * leftNode, ExpNode * rightNode) : BinaryExpNode(p, leftNode, rightNode) {}
-void unparse(std::ostream& out, int indent) override;
+void unparseStep(std::ostream& out, UnparseWork& rest, int indent) override;
+void serialize(ASTWriter& out) override;
+void lower(IRBuilder& ir) override;
+void lowerBranch(IRBuilder& ir, Opd label, bool onTrue) override;
+void typeAnalysis(TypeAnalysis * ta) override;
+ExpNode * fold() override;
 };
 
 class LessNode : public BinaryExpNode {
 public:
 LessNode(Position * p, ExpNode * leftNode, ExpNode * rightNode) : BinaryExpNode(p, leftNode, rightNode) {}
-void unparse(std::ostream& out, int indent) override;
+void unparseStep(std::ostream& out, UnparseWork& rest, int indent) override;
+void serialize(ASTWriter& out) override;
+void lower(IRBuilder& ir) override;
+void lowerBranch(IRBuilder& ir, Opd label, bool onTrue) override;
+void typeAnalysis(TypeAnalysis * ta) override;
+ExpNode * fold() override;
 };
 
 class MinusNode : public BinaryExpNode {
 public:
 MinusNode(Position * p, ExpNode * leftNode, ExpNode * rightNode) : BinaryExpNode(p, leftNode, rightNode) {}
-void unparse(std::ostream& out, int indent) override;
+void unparseStep(std::ostream& out, UnparseWork& rest, int indent) override;
+void serialize(ASTWriter& out) override;
+void lower(IRBuilder& ir) override;
+void typeAnalysis(TypeAnalysis * ta) override;
+ExpNode * fold() override;
 };
 
 class NotEqualsNode : public BinaryExpNode {
 public:
 NotEqualsNode(Position * p, ExpNode * leftNode, ExpNode * rightNode) : BinaryExpNode(p, leftNode, rightNode) {}
-void unparse(std::ostream& out, int indent) override;
+void unparseStep(std::ostream& out, UnparseWork& rest, int indent) override;
+void serialize(ASTWriter& out) override;
+void lower(IRBuilder& ir) override;
+void lowerBranch(IRBuilder& ir, Opd label, bool onTrue) override;
+void typeAnalysis(TypeAnalysis * ta) override;
+ExpNode * fold() override;
 };
 
 class OrNode : public BinaryExpNode {
 public:
 OrNode(Position * p, ExpNode * leftNode, ExpNode * rightNode) : BinaryExpNode(p, leftNode, rightNode) {}
-void unparse(std::ostream& out, int indent) override;
+void unparseStep(std::ostream& out, UnparseWork& rest, int indent) override;
+void serialize(ASTWriter& out) override;
+void lower(IRBuilder& ir) override;
+void lowerBranch(IRBuilder& ir, Opd label, bool onTrue) override;
+void flow(FlowBuilder& fb) override;
+void typeAnalysis(TypeAnalysis * ta) override;
+ExpNode * fold() override;
 };
 
 class PlusNode : public BinaryExpNode {
 public:
 PlusNode(Position * p, ExpNode * leftNode, ExpNode * rightNode) : BinaryExpNode(p, leftNode, rightNode) {}
-void unparse(std::ostream& out, int indent) override;
+void unparseStep(std::ostream& out, UnparseWork& rest, int indent) override;
+void serialize(ASTWriter& out) override;
+void lower(IRBuilder& ir) override;
+void typeAnalysis(TypeAnalysis * ta) override;
+ExpNode * fold() override;
 };
 
 class TimesNode : public BinaryExpNode {
 public:
 TimesNode(Position * p, ExpNode * leftNode, ExpNode * rightNode) : BinaryExpNode(p, leftNode, rightNode) {}
-void unparse(std::ostream& out, int indent) override;
+void unparseStep(std::ostream& out, UnparseWork& rest, int indent) override;
+void serialize(ASTWriter& out) override;
+void lower(IRBuilder& ir) override;
+void typeAnalysis(TypeAnalysis * ta) override;
+ExpNode * fold() override;
 };
 
 class PtrTypeNode : public TypeNode{
 public:
-PtrTypeNode(Position * p) : TypeNode(p){ }
-  void unparse(std::ostream& out, int indent) override;
+PtrTypeNode(Position * p, TypeNode * baseIn) : TypeNode(p), myBase(baseIn){ }
+  void unparseStep(std::ostream& out, UnparseWork& rest, int indent) override;
+  void release(std::vector<ASTNode *>& children) override;
+  void serialize(ASTWriter& out) override;
+  DataType getType() override;
+private:
+/** The type pointed to **/
+TypeNode * myBase;
 };
 
 class ShortTypeNode : public TypeNode{
 public:
 ShortTypeNode(Position * p) : TypeNode(p){ }
-  void unparse(std::ostream& out, int indent) override;
+  void unparseStep(std::ostream& out, UnparseWork& rest, int indent) override;
+  void serialize(ASTWriter& out) override;
+  DataType getType() override;
 };
 
 
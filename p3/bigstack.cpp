@@ -0,0 +1,117 @@
+#include <algorithm>
+#include "bigstack.hpp"
+#include "errors.hpp"
+
+namespace cminusminus{
+
+/* Stack per level. Unoptimized, the parser takes up to about 1.5KB
+   of stack for each parenthesis or brace (a call's, the most), so
+   this leaves a margin of over two */
+static const size_t stackPerLevel = 4096;
+/* Levels for the phases themselves, below the parser */
+static const size_t baseLevels = 64;
+
+size_t stackForDepth(size_t levels){
+	return (baseLevels + levels) * stackPerLevel;
+}
+
+NestingScan::NestingScan()
+: myState(CODE), myOpen(0), myLevels(0){ }
+
+void NestingScan::scan(const char * text, size_t len){
+	for (size_t i = 0; i < len; i++){
+		char c = text[i];
+		switch (myState){
+		case STRING:
+			if (c == '\\'){
+				myState = ESCAPE;
+			} else if (c == '"' || c == '\n'){
+				myState = CODE;
+			}
+			continue;
+		case ESCAPE:
+			myState = c == '\n' ? CODE : STRING;
+			continue;
+		case COMMENT:
+			if (c == '\n'){ myState = CODE; }
+			continue;
+		case CODE:
+			break;
+		}
+		switch (c){
+		case '(': case '{':
+			myOpen++;
+			myLevels = std::max(myLevels, myOpen);
+			break;
+		case ')': case '}':
+			if (myOpen > 0){ myOpen--; }
+			break;
+		case '#':
+			myState = COMMENT;
+			break;
+		case '"':
+			myState = STRING;
+			break;
+		}
+	}
+}
+
+size_t nestingBound(const char * src, size_t len){
+	NestingScan scan;
+	scan.scan(src, len);
+	return scan.levels();
+}
+
+size_t currentStackSize(){
+	pthread_attr_t attr;
+	size_t size = 0;
+	if (pthread_getattr_np(pthread_self(), &attr) == 0){
+		pthread_attr_getstacksize(&attr, &size);
+		pthread_attr_destroy(&attr);
+	}
+	return size;
+}
+
+StackThread::StackThread(size_t stackBytes, std::function<void()> fn)
+: myFn(fn), myJoined(false){
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	pthread_attr_setstacksize(&attr, stackBytes);
+	int err = pthread_create(&myThread, &attr, start, this);
+	pthread_attr_destroy(&attr);
+	if (err != 0){
+		myJoined = true;
+		throw new InternalError("Could not start a thread");
+	}
+}
+
+StackThread::~StackThread(){
+	if (!myJoined){ pthread_join(myThread, nullptr); }
+}
+
+void * StackThread::start(void * self){
+	StackThread * thread = static_cast<StackThread *>(self);
+	try {
+		thread->myFn();
+	} catch (...){
+		thread->myError = std::current_exception();
+	}
+	return nullptr;
+}
+
+void StackThread::join(){
+	pthread_join(myThread, nullptr);
+	myJoined = true;
+	if (myError){ std::rethrow_exception(myError); }
+}
+
+void runWithStack(size_t stackBytes, std::function<void()> fn){
+	if (stackBytes <= currentStackSize()){
+		fn();
+		return;
+	}
+	StackThread thread(stackBytes, fn);
+	thread.join();
+}
+
+}
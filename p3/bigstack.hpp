@@ -0,0 +1,79 @@
+#ifndef CMINUSMINUS_BIGSTACK_HPP
+#define CMINUSMINUS_BIGSTACK_HPP
+
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <pthread.h>
+
+/*
+Room for deep recursion. The tree walks keep their work on the heap
+(see WorkStack), and bison's stack is a heap vector, so neither cares
+how deep a tree is: a - b - c - ... of 100000 terms is as safe as a
+- b. The hand-written parser is the one place left that recurses, once
+for each parenthesis and brace it is inside. Rather than cap those,
+the phases run on a thread whose stack is sized from how deeply the
+source nests them, found before parsing by a scan (see NestingScan).
+A program that nests no deeper than usual runs on the thread it is
+given.
+*/
+
+namespace cminusminus{
+
+/* A stack big enough to parse source nested levels deep */
+size_t stackForDepth(size_t levels);
+
+/**
+* \class NestingScan
+* How deeply some source nests parentheses and braces, from one pass
+* over its bytes, which may come in pieces. Those in comments and
+* string literals do not count.
+**/
+class NestingScan{
+public:
+	NestingScan();
+	/* Take in the next len bytes of the source */
+	void scan(const char * text, size_t len);
+	/* The deepest nesting, in levels, of the source taken in so far */
+	size_t levels() const { return myLevels; }
+private:
+	enum State { CODE, STRING, ESCAPE, COMMENT };
+	State myState;
+	size_t myOpen;
+	size_t myLevels;
+};
+
+/* NestingScan's levels for the len bytes at src */
+size_t nestingBound(const char * src, size_t len);
+
+/* The size of the calling thread's stack */
+size_t currentStackSize();
+
+/**
+* \class StackThread
+* A thread, like std::thread, but with a stack of a given size
+**/
+class StackThread{
+public:
+	StackThread(size_t stackBytes, std::function<void()> fn);
+	/* Joins, if join has not been called */
+	~StackThread();
+	StackThread(const StackThread&) = delete;
+	StackThread& operator=(const StackThread&) = delete;
+	/* Wait for the thread, and rethrow whatever it threw */
+	void join();
+private:
+	static void * start(void * self);
+	pthread_t myThread;
+	std::function<void()> myFn;
+	std::exception_ptr myError;
+	bool myJoined;
+};
+
+/* Run fn with at least stackBytes of stack, and wait for it: on
+   this thread if its stack is big enough, otherwise on a new one */
+void runWithStack(size_t stackBytes, std::function<void()> fn);
+
+}
+
+#endif
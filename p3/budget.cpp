@@ -0,0 +1,86 @@
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include "budget.hpp"
+#include "errors.hpp"
+
+namespace cminusminus{
+
+static size_t orNone(size_t limit){
+	return limit == 0 ? std::numeric_limits<size_t>::max() : limit;
+}
+
+bool parseLimit(const char * spec, CompileLimits& limits){
+	const char * eq = strchr(spec, '=');
+	if (eq == nullptr || eq[1] == '\0'){ return false; }
+	std::string name(spec, static_cast<size_t>(eq - spec));
+	//strtoul would take a sign (negating -1 to the largest value) or space
+	if (eq[1] < '0' || eq[1] > '9'){ return false; }
+	char * end;
+	errno = 0;
+	unsigned long parsed = strtoul(eq + 1, &end, 10);
+	if (*end != '\0' || errno == ERANGE || parsed == 0){ return false; }
+	size_t value = parsed;
+	if (name == "bytes"){
+		limits.inputBytes = value;
+	} else if (name == "tokens"){
+		limits.tokens = value;
+	} else if (name == "nodes"){
+		limits.nodes = value;
+	} else if (name == "depth"){
+		limits.depth = value;
+	} else if (name == "diagnostics"){
+		limits.diagnostics = value;
+	} else if (name == "ms"){
+		limits.milliseconds = value;
+	} else {
+		return false;
+	}
+	return true;
+}
+
+Budget::Budget(const CompileLimits& limits)
+: myLimits(limits), myBytes(orNone(limits.inputBytes)),
+  myTokens(orNone(limits.tokens)), myNodes(orNone(limits.nodes)),
+  myDepth(orNone(limits.depth)),
+  myDiagnostics(orNone(limits.diagnostics)),
+  myTimed(limits.milliseconds != 0),
+  myDeadline(std::chrono::steady_clock::now()
+    + std::chrono::milliseconds(limits.milliseconds)){
+}
+
+void Budget::checkClock(const Position& pos) const{
+	if (myTimed && std::chrono::steady_clock::now() > myDeadline){
+		exceeded(pos, "Took longer than", myLimits.milliseconds, "ms");
+	}
+}
+
+void Budget::exceeded(const Position& pos, const char * what,
+	size_t limit, const char * unit){
+	throw new LimitError(pos, std::string(what) + " "
+		+ std::to_string(limit) + " " + unit);
+}
+
+thread_local NodeBudget * NodeBudget::current = nullptr;
+
+NodeBudget::NodeBudget(const Budget * budget)
+: myBudget(budget), myCount(0), myOuter(current){
+	if (myBudget != nullptr){ current = this; }
+}
+
+NodeBudget::~NodeBudget(){
+	if (myBudget != nullptr){ current = myOuter; }
+}
+
+void NodeBudget::charge(const Position * pos){
+	NodeBudget * budget = current;
+	budget->myCount++;
+	Position at = pos == nullptr ? Position() : *pos;
+	budget->myBudget->checkNodes(at, budget->myCount);
+	if (budget->myCount % clockInterval == 0){
+		budget->myBudget->checkClock(at);
+	}
+}
+
+}
@@ -0,0 +1,139 @@
+#ifndef CMINUSMINUS_BUDGET_HPP
+#define CMINUSMINUS_BUDGET_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include "position.hpp"
+
+/*
+Resource limits for compiling untrusted input. Each is off (0) unless
+set: the input's size in bytes, how many tokens it lexes to, how many
+AST nodes parsing it makes, how deeply its braces and parentheses
+nest, how many lexical errors it has, and the wall-clock time taken.
+
+A Budget is the limits plus a deadline, and never changes once made,
+so the threads of one compilation can share it. The counting is done
+where the things counted are made: the Scanner counts tokens, bytes,
+nesting and lexical errors as it lexes, and the parse counts nodes
+(see NodeBudget). The clock is read every so many tokens or nodes,
+and between phases, so a time limit is overrun by at most that much
+work. Going over any limit throws a LimitError, which ends the
+compilation with a LIMIT diagnostic.
+*/
+
+namespace cminusminus{
+
+struct CompileLimits{
+	CompileLimits() : inputBytes(0), tokens(0), nodes(0), depth(0),
+	  diagnostics(0), milliseconds(0){ }
+	size_t inputBytes;
+	size_t tokens;
+	size_t nodes;
+	size_t depth;
+	size_t diagnostics;
+	size_t milliseconds;
+};
+
+/* Set the limit named in spec, as in "tokens=100000" (names: bytes,
+   tokens, nodes, depth, diagnostics, ms). Returns false if spec is
+   not one of those, or its value is not a whole number from 1 up */
+bool parseLimit(const char * spec, CompileLimits& limits);
+
+/**
+* \class Budget
+* One compilation's limits, with its clock started
+**/
+class Budget{
+public:
+	/* The clock starts now */
+	Budget(const CompileLimits& limits);
+
+	const CompileLimits& limits() const { return myLimits; }
+
+	/* Each of these throws a LimitError, naming pos, if count is
+	   over its limit */
+	void checkInput(size_t bytes, const Position& pos = Position()) const {
+		if (bytes > myBytes){
+			exceeded(pos, "Input longer than", myBytes, "bytes");
+		}
+	}
+	void checkTokens(const Position& pos, size_t count) const {
+		if (count > myTokens){
+			exceeded(pos, "More than", myTokens, "tokens");
+		}
+	}
+	void checkNodes(const Position& pos, size_t count) const {
+		if (count > myNodes){
+			exceeded(pos, "More than", myNodes, "AST nodes");
+		}
+	}
+	void checkDepth(const Position& pos, size_t depth) const {
+		if (depth > myDepth){
+			exceeded(pos, "Nested more than", myDepth, "levels deep");
+		}
+	}
+	void checkDiagnostics(const Position& pos, size_t count) const {
+		if (count > myDiagnostics){
+			exceeded(pos, "More than", myDiagnostics, "lexical errors");
+		}
+	}
+	/* Throws once the time is up */
+	void checkClock(const Position& pos) const;
+	void checkClock() const { checkClock(Position()); }
+
+	/* Whether tokens, nesting or errors are limited: those can only
+	   be counted by lexing the input in order */
+	bool countsLexing() const {
+		return myLimits.tokens != 0 || myLimits.depth != 0
+			|| myLimits.diagnostics != 0;
+	}
+
+private:
+	[[noreturn]] static void exceeded(const Position& pos,
+		const char * what, size_t limit, const char * unit);
+
+	CompileLimits myLimits;
+	/* The limits, with none as the largest size_t, so that each
+	   check is one comparison */
+	size_t myBytes;
+	size_t myTokens;
+	size_t myNodes;
+	size_t myDepth;
+	size_t myDiagnostics;
+	bool myTimed;
+	std::chrono::steady_clock::time_point myDeadline;
+};
+
+/* How many tokens or nodes go by between reads of the clock */
+const size_t clockInterval = 1024;
+
+/**
+* \class NodeBudget
+* While one lives, every AST node made on its thread is counted
+* against budget's node limit (see ASTNode's constructor). They nest:
+* the innermost is the one charged. One with a null budget counts
+* nothing
+**/
+class NodeBudget{
+public:
+	NodeBudget(const Budget * budget);
+	~NodeBudget();
+	NodeBudget(const NodeBudget&) = delete;
+	NodeBudget& operator=(const NodeBudget&) = delete;
+
+	/* Count a node made at pos against the current NodeBudget */
+	static void charge(const Position * pos);
+	/* Whether there is one on this thread */
+	static bool active(){ return current != nullptr; }
+private:
+	static thread_local NodeBudget * current;
+
+	const Budget * myBudget;
+	size_t myCount;
+	NodeBudget * myOuter;
+};
+
+}
+
+#endif
@@ -0,0 +1,294 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <fstream>
+#include <sstream>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+#include "cache.hpp"
+#include "errors.hpp"
+
+namespace cminusminus{
+
+static const char entrySuffix[] = ".entry";
+
+namespace {
+
+/* Holds the cache directory's lock for as long as it lives */
+class DirLock{
+public:
+	DirLock(const std::string& dir){
+		std::string path = dir + "/lock";
+		myFd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0666);
+		if (myFd >= 0){ flock(myFd, LOCK_EX); }
+	}
+	~DirLock(){
+		if (myFd >= 0){ close(myFd); }
+	}
+	DirLock(const DirLock&) = delete;
+	DirLock& operator=(const DirLock&) = delete;
+private:
+	int myFd;
+};
+
+/* Reads an entry, failing on anything short or malformed */
+class EntryReader{
+public:
+	EntryReader(const std::string& bytes)
+	: myCur(bytes.data()), myEnd(bytes.data() + bytes.size()){ }
+	bool byte(unsigned char& b){
+		if (myCur == myEnd){ return false; }
+		b = static_cast<unsigned char>(*myCur++);
+		return true;
+	}
+	bool blob(bool& present, std::string& into){
+		unsigned char flag;
+		if (!byte(flag)){ return false; }
+		present = flag != 0;
+		if (!present){ into.clear(); return true; }
+		uint64_t len = 0;
+		for (int i = 0; i < 8; i++){
+			unsigned char b;
+			if (!byte(b)){ return false; }
+			len |= static_cast<uint64_t>(b) << (8 * i);
+		}
+		if (len > static_cast<uint64_t>(myEnd - myCur)){ return false; }
+		into.assign(myCur, static_cast<size_t>(len));
+		myCur += len;
+		return true;
+	}
+	bool done() const { return myCur == myEnd; }
+private:
+	const char * myCur;
+	const char * myEnd;
+};
+
+}
+
+static void writeBlob(std::string& out, bool present,
+	const std::string& blob){
+	out += static_cast<char>(present ? 1 : 0);
+	if (!present){ return; }
+	uint64_t len = blob.size();
+	for (int i = 0; i < 8; i++){
+		out += static_cast<char>((len >> (8 * i)) & 0xff);
+	}
+	out += blob;
+}
+
+static bool readWhole(const std::string& path, std::string& contents){
+	std::ifstream in(path, std::ios::binary);
+	if (!in.good()){ return false; }
+	std::ostringstream buf;
+	buf << in.rdbuf();
+	contents = buf.str();
+	return true;
+}
+
+/* FNV-1a, a word at a time, then byte by byte for the tail */
+static uint64_t hashBytes(uint64_t h, const char * data, size_t len){
+	const uint64_t prime = 1099511628211ull;
+	size_t i = 0;
+	for (; i + 8 <= len; i += 8){
+		uint64_t word;
+		memcpy(&word, data + i, 8);
+		h = (h ^ word) * prime;
+	}
+	for (; i < len; i++){
+		h = (h ^ static_cast<unsigned char>(data[i])) * prime;
+	}
+	return h;
+}
+
+/* Something that changes whenever cmmc is rebuilt */
+static std::string compilerIdentity(){
+	struct stat info;
+	if (stat("/proc/self/exe", &info) != 0){ return ""; }
+	std::ostringstream id;
+	id << info.st_size << ":" << info.st_mtim.tv_sec << "."
+		<< info.st_mtim.tv_nsec;
+	return id.str();
+}
+
+CompileCache::CompileCache(const std::string& dir, size_t limitBytes)
+: myDir(dir), myLimit(limitBytes){
+	struct stat info;
+	if ((mkdir(dir.c_str(), 0777) != 0 && errno != EEXIST)
+		|| stat(dir.c_str(), &info) != 0 || !S_ISDIR(info.st_mode)
+		|| access(dir.c_str(), R_OK | W_OK | X_OK) != 0){
+		std::string msg = "Cannot use cache directory " + dir;
+		throw new UserError(msg.c_str());
+	}
+}
+
+bool CompileCache::key(const char * inPath, const std::string& request,
+	std::string& keyOut) const{
+	std::string input;
+	if (!readWhole(inPath, input)){ return false; }
+	std::string header = compilerIdentity() + "\n" + request + "\n";
+	uint64_t h = 14695981039346656037ull;
+	h = hashBytes(h, header.data(), header.size());
+	h = hashBytes(h, input.data(), input.size());
+	std::ostringstream hex;
+	hex << std::hex << h << "-" << input.size();
+	keyOut = hex.str();
+	return true;
+}
+
+std::string CompileCache::entryPath(const std::string& key) const{
+	return myDir + "/" + key + entrySuffix;
+}
+
+std::string CompileCache::scratchPath(const std::string& key,
+	const char * suffix) const{
+	std::ostringstream path;
+	path << myDir << "/" << key << "." << getpid() << "." << suffix;
+	return path.str();
+}
+
+bool CompileCache::takeFile(const std::string& path, std::string& contents){
+	if (!readWhole(path, contents)){ return false; }
+	unlink(path.c_str());
+	return true;
+}
+
+bool CompileCache::lookup(const std::string& key, CacheEntry& entry){
+	std::string path = entryPath(key);
+	std::string bytes;
+	bool hit = false;
+	if (readWhole(path, bytes) && bytes.compare(0, 4, "CMMC") == 0){
+		std::string body = bytes.substr(4);
+		EntryReader reader(body);
+		unsigned char version = 0;
+		unsigned char status = 0;
+		bool present;
+		hit = reader.byte(version) && version == CACHE_FORMAT_VERSION
+			&& reader.byte(status)
+			&& reader.blob(present, entry.out)
+			&& reader.blob(present, entry.err)
+			&& reader.blob(entry.haveTokens, entry.tokens)
+			&& reader.blob(entry.haveUnparse, entry.unparse)
+			&& reader.done();
+		entry.status = status;
+	}
+	if (hit){
+		//Now the most recently used
+		utimensat(AT_FDCWD, path.c_str(), nullptr, 0);
+	}
+	count(hit);
+	return hit;
+}
+
+void CompileCache::store(const std::string& key, const CacheEntry& entry){
+	std::string bytes = "CMMC";
+	bytes += static_cast<char>(CACHE_FORMAT_VERSION);
+	bytes += static_cast<char>(entry.status);
+	writeBlob(bytes, true, entry.out);
+	writeBlob(bytes, true, entry.err);
+	writeBlob(bytes, entry.haveTokens, entry.tokens);
+	writeBlob(bytes, entry.haveUnparse, entry.unparse);
+
+	std::string tmp = scratchPath(key, "tmp");
+	{
+		std::ofstream out(tmp, std::ios::binary);
+		out << bytes;
+		if (!out.good()){
+			out.close();
+			unlink(tmp.c_str());
+			return;
+		}
+	}
+	DirLock lock(myDir);
+	if (rename(tmp.c_str(), entryPath(key).c_str()) != 0){
+		unlink(tmp.c_str());
+	}
+	evict();
+}
+
+void CompileCache::count(bool hit){
+	DirLock lock(myDir);
+	std::string path = myDir + "/stats";
+	unsigned long hits = 0;
+	unsigned long misses = 0;
+	{
+		std::ifstream in(path);
+		in >> hits >> misses;
+	}
+	if (hit){ hits++; } else { misses++; }
+	std::ofstream out(path);
+	out << hits << " " << misses << "\n";
+}
+
+namespace {
+struct EntryFile{
+	std::string path;
+	size_t size;
+	struct timespec used;
+};
+}
+
+/* Every entry in dir, with its size and when it was last used */
+static std::vector<EntryFile> listEntries(const std::string& dir){
+	std::vector<EntryFile> entries;
+	DIR * listing = opendir(dir.c_str());
+	if (listing == nullptr){ return entries; }
+	size_t suffixLen = sizeof(entrySuffix) - 1;
+	while (struct dirent * item = readdir(listing)){
+		std::string name = item->d_name;
+		if (name.size() <= suffixLen
+			|| name.compare(name.size() - suffixLen, suffixLen,
+				entrySuffix) != 0){
+			continue;
+		}
+		EntryFile entry;
+		entry.path = dir + "/" + name;
+		struct stat info;
+		if (stat(entry.path.c_str(), &info) != 0){ continue; }
+		entry.size = static_cast<size_t>(info.st_size);
+		entry.used = info.st_mtim;
+		entries.push_back(entry);
+	}
+	closedir(listing);
+	return entries;
+}
+
+void CompileCache::evict(){
+	std::vector<EntryFile> entries = listEntries(myDir);
+	size_t total = 0;
+	for (const EntryFile& entry : entries){ total += entry.size; }
+	if (total <= myLimit){ return; }
+	std::sort(entries.begin(), entries.end(),
+		[](const EntryFile& a, const EntryFile& b){
+			if (a.used.tv_sec != b.used.tv_sec){
+				return a.used.tv_sec < b.used.tv_sec;
+			}
+			return a.used.tv_nsec < b.used.tv_nsec;
+		});
+	for (const EntryFile& entry : entries){
+		if (total <= myLimit){ break; }
+		if (unlink(entry.path.c_str()) == 0){ total -= entry.size; }
+	}
+}
+
+void CompileCache::writeStats(std::ostream& out){
+	DirLock lock(myDir);
+	unsigned long hits = 0;
+	unsigned long misses = 0;
+	{
+		std::ifstream in(myDir + "/stats");
+		in >> hits >> misses;
+	}
+	std::vector<EntryFile> entries = listEntries(myDir);
+	size_t total = 0;
+	for (const EntryFile& entry : entries){ total += entry.size; }
+	out << "Cache " << myDir << ": " << hits << " hits, " << misses
+		<< " misses, " << entries.size() << " entries, " << total
+		<< " of " << myLimit << " bytes\n";
+}
+
+}
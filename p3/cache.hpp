@@ -0,0 +1,97 @@
+#ifndef CMINUSMINUS_CACHE_HPP
+#define CMINUSMINUS_CACHE_HPP
+
+#include <cstddef>
+#include <ostream>
+#include <string>
+
+/*
+An on-disk cache of what cmmc printed and wrote for an input, so that
+compiling the same bytes the same way again needs no lexing or
+parsing. An entry is keyed by a hash of the input, of which outputs
+were asked for, and of the cmmc binary itself (its size and
+modification time), so rebuilding the compiler makes every old entry
+a miss.
+
+Many cmmc processes may share one cache directory. Entries are
+written to a private temporary file and renamed into place, so a
+reader sees a whole entry or none. The hit and miss counts, and
+eviction, are done under an flock on the directory's lock file. The
+cache is kept under a size limit by evicting the least recently used
+entries; a hit counts as a use, and touches the entry's modification
+time.
+
+Entry layout (integers are 8 bytes, little-endian):
+	magic        4 bytes, "CMMC"
+	version      1 byte, CACHE_FORMAT_VERSION
+	status       1 byte, cmmc's exit status
+	blobs        stdout, stderr, token dump, unparse: each a present
+	             byte, then (if present) its length and bytes
+*/
+
+namespace cminusminus{
+
+const unsigned char CACHE_FORMAT_VERSION = 1;
+
+/* Everything a cacheable cmmc run leaves behind */
+struct CacheEntry{
+	int status;
+	std::string out;
+	std::string err;
+	bool haveTokens;
+	std::string tokens;
+	bool haveUnparse;
+	std::string unparse;
+};
+
+/**
+* \class CompileCache
+* One cache directory
+**/
+class CompileCache{
+public:
+	/* Use the cache in dir (made if need be), keeping it under
+	   limitBytes. Throws a UserError if dir cannot be used */
+	CompileCache(const std::string& dir, size_t limitBytes);
+	CompileCache(const CompileCache&) = delete;
+	CompileCache& operator=(const CompileCache&) = delete;
+
+	/* The key for compiling the file at inPath as request (which
+	   names the outputs wanted). False if the file cannot be read */
+	bool key(const char * inPath, const std::string& request,
+		std::string& keyOut) const;
+
+	/* Fill entry from the cache, counting a hit or a miss.
+	   Returns whether there was one */
+	bool lookup(const std::string& key, CacheEntry& entry);
+
+	/* Record entry under key, evicting what has to go */
+	void store(const std::string& key, const CacheEntry& entry);
+
+	/* A path in the cache only this process uses, for an output
+	   file that is to go into the entry under key */
+	std::string scratchPath(const std::string& key,
+		const char * suffix) const;
+
+	/* Read the file at path into contents, and remove it. Returns
+	   false if there was no such file */
+	static bool takeFile(const std::string& path, std::string& contents);
+
+	/* Write the hit and miss counts, and how full the cache is */
+	void writeStats(std::ostream& out);
+
+private:
+	std::string entryPath(const std::string& key) const;
+	/* Add to the hit or miss count */
+	void count(bool hit);
+	/* Remove the least recently used entries until the cache is
+	   under its limit. Must hold the lock */
+	void evict();
+
+	std::string myDir;
+	size_t myLimit;
+};
+
+}
+
+#endif
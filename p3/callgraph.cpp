@@ -0,0 +1,104 @@
+#include "callgraph.hpp"
+
+namespace cminusminus{
+
+/* The name a declaration declares, or nullptr */
+static IDNode * declaredBy(DeclNode * decl){
+	if (FnDeclNode * fn = dynamic_cast<FnDeclNode *>(decl)){
+		return fn->ID();
+	}
+	if (VarDeclNode * var = dynamic_cast<VarDeclNode *>(decl)){
+		return var->ID();
+	}
+	return nullptr;
+}
+
+/* The symbol a declaration introduced, or nullptr */
+static SemSymbol * declared(DeclNode * decl){
+	IDNode * id = declaredBy(decl);
+	return id == nullptr ? nullptr : id->getSymbol();
+}
+
+void CallGraph::addUse(SemSymbol * fn, IDNode * use){
+	myUseNodes.push_back(use);
+	if (fn != nullptr){ myUses[fn].push_back(use->getSymbol()); }
+}
+
+std::unordered_set<SemSymbol *> CallGraph::reachable(SemSymbol * entry) const{
+	std::unordered_set<SemSymbol *> seen;
+	std::vector<SemSymbol *> work;
+	seen.insert(entry);
+	work.push_back(entry);
+	while (!work.empty()){
+		SemSymbol * fn = work.back();
+		work.pop_back();
+		auto uses = myUses.find(fn);
+		if (uses == myUses.end()){ continue; }
+		for (SemSymbol * used : uses->second){
+			if (seen.insert(used).second && used->kind() == SemSymbol::FN){
+				work.push_back(used);
+			}
+		}
+	}
+	return seen;
+}
+
+void CallGraph::detachSymbols() const{
+	for (IDNode * use : myUseNodes){ use->attachSymbol(nullptr); }
+	for (SemSymbol * sym : myDecls){
+		if (IDNode * id = declaredBy(sym->decl())){
+			id->attachSymbol(nullptr);
+		}
+		delete sym;
+	}
+}
+
+PruneCounts pruneUnreachable(ProgramNode * ast, const CallGraph& graph,
+	const ASTInterner * interner){
+	PruneCounts counts = {0, 0, 0, 0};
+	std::list<DeclNode *> * globals = ast->getGlobals();
+	SemSymbol * entry = nullptr;
+	for (DeclNode * decl : *globals){
+		SemSymbol * sym = declared(decl);
+		if (sym == nullptr){ continue; }
+		if (sym->kind() == SemSymbol::FN){
+			counts.fns++;
+			if (sym->name() == "main"){ entry = sym; }
+		} else {
+			counts.globals++;
+		}
+	}
+	if (entry == nullptr){
+		graph.detachSymbols();
+		return counts;
+	}
+
+	std::unordered_set<SemSymbol *> keep = graph.reachable(entry);
+	std::vector<DeclNode *> removed;
+	for (auto it = globals->begin(); it != globals->end(); ){
+		SemSymbol * sym = declared(*it);
+		if (sym == nullptr || keep.count(sym) != 0){
+			++it;
+			continue;
+		}
+		if (sym->kind() == SemSymbol::FN){
+			counts.fnsRemoved++;
+		} else {
+			counts.globalsRemoved++;
+		}
+		removed.push_back(*it);
+		it = globals->erase(it);
+	}
+	//The graph still points into what was removed until this
+	graph.detachSymbols();
+	for (DeclNode * decl : removed){
+		if (interner != nullptr){
+			interner->deleteTree(decl);
+		} else {
+			deleteTree(decl);
+		}
+	}
+	return counts;
+}
+
+}
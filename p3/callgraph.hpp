@@ -0,0 +1,67 @@
+#ifndef CMINUSMINUS_CALLGRAPH_HPP
+#define CMINUSMINUS_CALLGRAPH_HPP
+
+#include <cstddef>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "ast.hpp"
+#include "intern.hpp"
+#include "symbol_table.hpp"
+
+/*
+Dropping the parts of a program that cannot matter. Name analysis,
+given a CallGraph, records every name each function's body uses,
+calls included. Everything main can reach through those uses is
+kept: the functions it calls (and theirs), and the globals any of
+them read or write. The other top-level declarations are removed
+from the tree, before unparsing or anything later sees them. A
+program without a main is a library of sorts, and is left alone.
+*/
+
+namespace cminusminus{
+
+/**
+* \class CallGraph
+* The names used by each function's body, as name analysis resolved
+* them: a call's edge is the callee's symbol, a global's is its own.
+* It also keeps track of every node name analysis attached a symbol
+* to, so that the symbols can be taken off again.
+**/
+class CallGraph{
+public:
+	/* Record that name analysis declared sym */
+	void addDecl(SemSymbol * sym){ myDecls.push_back(sym); }
+	/* Record that use, in the body of fn (nullptr outside any
+	   function), was resolved to use->getSymbol() */
+	void addUse(SemSymbol * fn, IDNode * use);
+	/* The symbols reachable from entry, entry included */
+	std::unordered_set<SemSymbol *> reachable(SemSymbol * entry) const;
+	/* Take the symbols off every declaration and use recorded, as
+	   they were before name analysis, and free them */
+	void detachSymbols() const;
+private:
+	std::unordered_map<SemSymbol *, std::vector<SemSymbol *>> myUses;
+	std::vector<IDNode *> myUseNodes;
+	std::vector<SemSymbol *> myDecls;
+};
+
+/* How many top-level declarations there were and were removed */
+struct PruneCounts{
+	size_t fns;
+	size_t fnsRemoved;
+	size_t globals;
+	size_t globalsRemoved;
+};
+
+/* Remove from ast the functions main cannot reach and the globals
+   none of those it can reach use, and free them (through interner,
+   if ast came from one, else it is nullptr). ast must have passed
+   name analysis with graph recording its uses. What is left has its
+   symbols detached, as it had before name analysis */
+PruneCounts pruneUnreachable(ProgramNode * ast, const CallGraph& graph,
+	const ASTInterner * interner);
+
+}
+
+#endif
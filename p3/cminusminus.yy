@@ -7,17 +7,33 @@
 %define parse.error verbose
 %output "parser.cc"
 %token-table
+%locations
+%define api.location.type {cminusminus::Position}
 
 %code requires{
 	#include <list>
 	#include "tokens.hpp"
 	#include "ast.hpp"
+	#include "intern.hpp"
+	#include "position.hpp"
 	namespace cminusminus {
 		class Scanner;
 	}
 
-//The following definition is required when
-// we don't use the %locations directive (which we won't)
+//Each symbol's location is the span of the source it covers.
+// A nonterminal's default location runs from the start of its
+// first symbol to the end of its last
+# define YYLLOC_DEFAULT(Current, Rhs, N)                              \
+	do {                                                           \
+		if (N){                                                \
+			(Current) = cminusminus::Position(             \
+				YYRHSLOC(Rhs, 1), YYRHSLOC(Rhs, N));   \
+		} else {                                               \
+			(Current) = cminusminus::Position(             \
+				YYRHSLOC(Rhs, 0), YYRHSLOC(Rhs, 0));   \
+		}                                                      \
+	} while (0)
+
 # ifndef YY_NULLPTR
 #  if defined __cplusplus && 201103L <= __cplusplus
 #   define YY_NULLPTR nullptr
@@ -31,6 +47,8 @@
 
 %parse-param { cminusminus::Scanner &scanner }
 %parse-param { cminusminus::ProgramNode** root }
+%parse-param { cminusminus::ASTInterner * interner }
+%parse-param { cminusminus::DeclSink * sink }
 %code{
    // C std code for utility functions
    #include <iostream>
@@ -200,7 +218,11 @@ globals 	: globals decl
 	  	  {
 	  	  $$ = $1;
 	  	  DeclNode * declNode = $2;
-		  $$->push_back(declNode);
+		  if (sink != nullptr){
+			(*sink)(declNode);
+		  } else {
+			$$->push_back(declNode);
+		  }
 	  	  }
 		| /* epsilon */
 		  {
@@ -224,7 +246,8 @@ decl 		: varDecl
 
 varDecl 	: type id SEMICOL
 		  {
-		  Position * p = new Position($1->pos(), $2->pos());
+		  Position * p = new Position(@1, @2);
+		  @$ = *p;
 		  $$ = new VarDeclNode(p, $1, $2);
 		  }
 
@@ -232,21 +255,23 @@ varDecl 	: type id SEMICOL
 type		: primType
 		  { }
 		| PTR primType
-		  { }
+		  {
+		  $$ = interner->ptrType(@$, $2);
+		  }
 primType 	: INT
-	  	  { $$ = new IntTypeNode($1->pos()); }
+	  	  { $$ = interner->intType(@1); }
 		| BOOL
-		  { $$ = new BoolTypeNode($1->pos()); }
+		  { $$ = interner->boolType(@1); }
 		| STRING
-		  { $$ = new StringTypeNode($1->pos()); }
+		  { $$ = interner->stringType(@1); }
 		| SHORT
-		  { $$ = new ShortTypeNode($1->pos()); }
+		  { $$ = interner->shortType(@1); }
 		| VOID
-		  { $$ = new VoidTypeNode($1->pos()); }
+		  { $$ = interner->voidType(@1); }
 
 fnDecl 		: type id LPAREN RPAREN LCURLY stmtList RCURLY
 		  {
-			Position * p = new Position($1->pos(), $7->pos());
+			Position * p = new Position(@1, @7);
 
 			std::list<FormalDeclNode *> * emptyList = new std::list<FormalDeclNode *>();
 
@@ -254,7 +279,7 @@ fnDecl 		: type id LPAREN RPAREN LCURLY stmtList RCURLY
 			}
 		| type id LPAREN formals RPAREN LCURLY stmtList RCURLY
 		  {
-			 Position * p = new Position($1->pos(), $8->pos());
+			 Position * p = new Position(@1, @8);
 
 			 $$ = new FnDeclNode(p, $1, $2, $4, $7);
 			}
@@ -279,7 +304,7 @@ formals 	: formalDecl
 
 formalDecl 	: type id
 		  {
-			Position * p = new Position($1->pos(), $2->pos());
+			Position * p = new Position(@1, @2);
 
 			$$ = new FormalDeclNode(p, $1, $2);
 
@@ -299,56 +324,56 @@ stmtList 	: /* epsilon */
 stmt		: varDecl
 		  { $$ = $1; }
 		| assignExp SEMICOL
-		  { Position * p = new Position($1->pos(), $2 ->pos());
+		  { Position * p = new Position(@1, @2);
 				$$ = new AssignStmtNode(p, $1);}
 		| lval DEC SEMICOL
 		  {
-				Position * p = new Position($1->pos(), $3->pos());
+				Position * p = new Position(@1, @3);
 				$$ = new PostDecStmtNode(p, $1);
 			}
 		| lval INC SEMICOL
 		  {
-				Position * p = new Position($1->pos(), $3->pos());
+				Position * p = new Position(@1, @3);
 				$$ = new PostIncStmtNode(p, $1);
 			}
 		| READ lval SEMICOL
 		  {
-				Position * p = new Position($1->pos(), $3->pos());
+				Position * p = new Position(@1, @3);
 				$$ = new ReadStmtNode(p, $2);
 			}
 		| WRITE exp SEMICOL
 		  {
-				Position * p = new Position($1->pos(), $3->pos());
+				Position * p = new Position(@1, @3);
 				$$ = new WriteStmtNode(p, $2);
 			}
 		| WHILE LPAREN exp RPAREN LCURLY stmtList RCURLY
 		  {
-				Position * p = new Position($1->pos(), $7->pos());
+				Position * p = new Position(@1, @7);
 				$$ = new WhileStmtNode(p, $3, $6);
 			}
 		| IF LPAREN exp RPAREN LCURLY stmtList RCURLY
 		  {
-				Position * p = new Position($1->pos(), $7->pos());
+				Position * p = new Position(@1, @7);
 				$$ = new IfStmtNode(p, $3, $6);
 			}
 		| IF LPAREN exp RPAREN LCURLY stmtList RCURLY ELSE LCURLY stmtList RCURLY
 		  {
-				Position * p = new Position($1->pos(), $11->pos());
+				Position * p = new Position(@1, @11);
 				$$ = new IfElseStmtNode(p, $3, $6, $10);
 			}
 		| RETURN exp SEMICOL
 		  {
-				Position * p = new Position($1->pos(), $3->pos());
+				Position * p = new Position(@1, @3);
 				$$ = new ReturnStmtNode(p, $2);
 			}
 		| RETURN SEMICOL
 		  {
-				Position * p = new Position($1->pos(), $2->pos());
+				Position * p = new Position(@1, @2);
 				$$ = new ReturnStmtNode(p);
 			}
 		| callExp SEMICOL
 		  {
-				Position * p = new Position($1->pos(), $2->pos());
+				Position * p = new Position(@1, @2);
 				$$ = new CallStmtNode(p, $1);
 			}
 
@@ -356,91 +381,89 @@ exp		: assignExp
 		  { $$ = $1; }
 		| exp MINUS exp
 	  	  {
-					Position * p = new Position($1->pos(), $3->pos());
-					$$ = new MinusNode(p, $1, $3);
+					$$ = interner->binary<MinusNode>(NodeKind::MINUS, @$,
+						$1, $3);
 				}
 		| exp PLUS exp
 	  	  {
-					Position * p = new Position($1->pos(), $3->pos());
-					$$ = new PlusNode(p, $1, $3);
+					$$ = interner->binary<PlusNode>(NodeKind::PLUS, @$,
+						$1, $3);
 				 }
 		| exp TIMES exp
 	  	  {
-					Position * p = new Position($1->pos(), $3->pos());
-					$$ = new TimesNode(p, $1, $3);
+					$$ = interner->binary<TimesNode>(NodeKind::TIMES, @$,
+						$1, $3);
 				}
 		| exp DIVIDE exp
 	  	  {
-					Position * p = new Position($1->pos(), $3->pos());
-					$$ = new DivideNode(p, $1, $3);
+					$$ = interner->binary<DivideNode>(NodeKind::DIVIDE, @$,
+						$1, $3);
 				}
 		| exp AND exp
 	  	  {
-					Position * p = new Position($1->pos(), $3->pos());
-					$$ = new AndNode(p, $1, $3);
+					$$ = interner->binary<AndNode>(NodeKind::AND, @$,
+						$1, $3);
 				}
 		| exp OR exp
 	  	  {
-					Position * p = new Position($1->pos(), $3->pos());
-					$$ = new OrNode(p, $1, $3);
+					$$ = interner->binary<OrNode>(NodeKind::OR, @$,
+						$1, $3);
 				}
 		| exp EQUALS exp
 	  	  {
-					Position * p = new Position($1->pos(), $3->pos());
-					$$ = new EqualsNode(p, $1, $3);
+					$$ = interner->binary<EqualsNode>(NodeKind::EQUALS, @$,
+						$1, $3);
 				}
 		| exp NOTEQUALS exp
 	  	  {
-					Position * p = new Position($1->pos(), $3->pos());
-					$$ = new NotEqualsNode(p, $1, $3);
+					$$ = interner->binary<NotEqualsNode>(NodeKind::NOTEQUALS, @$,
+						$1, $3);
 				}
 		| exp GREATER exp
 	  	  {
-					Position * p = new Position($1->pos(), $3->pos());
-					$$ = new GreaterNode(p, $1, $3);
+					$$ = interner->binary<GreaterNode>(NodeKind::GREATER, @$,
+						$1, $3);
 				}
 		| exp GREATEREQ exp
 	  	  {
-					Position * p = new Position($1->pos(), $3->pos());
-					$$ = new GreaterEqNode(p, $1, $3);
+					$$ = interner->binary<GreaterEqNode>(NodeKind::GREATEREQ, @$,
+						$1, $3);
 				}
 		| exp LESS exp
 	  	  {
-					Position * p = new Position($1->pos(), $3->pos());
-					$$ = new LessNode(p, $1, $3);
+					$$ = interner->binary<LessNode>(NodeKind::LESS, @$,
+						$1, $3);
 				}
 		| exp LESSEQ exp
 	  	  {
-					Position * p = new Position($1->pos(), $3->pos());
-					$$ = new LessEqNode(p, $1, $3);
+					$$ = interner->binary<LessEqNode>(NodeKind::LESSEQ, @$,
+						$1, $3);
 				}
 		| NOT exp
 	  	  {
-					Position * p = new Position($1->pos(), $2->pos());
-					$$ = new NotNode(p, $2);
+					$$ = interner->unary<NotNode>(NodeKind::NOT, @$, $2);
 				}
 		| MINUS term
 	  	  {
-					Position * p = new Position($1->pos(), $2->pos());
-					$$ = new NegNode(p, $2);
+					$$ = interner->unary<NegNode>(NodeKind::NEG, @$, $2);
 				}
 		| term
 	  	  { $$ = $1; }
 
 assignExp	: lval ASSIGN exp
 		  {
-				Position * p = new Position($1->pos(), $3->pos());
+				Position * p = new Position(@1, @3);
 				$$ = new AssignExpNode(p, $1, $3);
 			}
 
 callExp		: id LPAREN RPAREN
 		  {
-				Position * p = new Position($1->pos(), $3->pos());
+				Position * p = new Position(@1, @3);
 				$$ = new CallExpNode(p, $1);
 			}
 		| id LPAREN actualsList RPAREN
 		  {
-				Position * p = new Position($1->pos(), $4->pos());
+				Position * p = new Position(@1, @4);
 				$$ = new CallExpNode(p, $1, $3);
 			}
 
@@ -461,27 +484,31 @@ term 		: lval
 		  { $$ = $1; }
 		| INTLITERAL
 		  {
-				Position * pos = $1->pos();
-				$$ = new IntLitNode(pos, $1->num());
+				$$ = interner->intLit(@1, $1->num());
 			}
 		| SHORTLITERAL
 		  {
-				Position * pos = $1->pos();
-				$$ = new ShortLitNode(pos, $1->num());
+				$$ = interner->shortLit(@1, $1->num());
 			}
 		| STRLITERAL
 		  {
-				Position * pos = $1->pos();
-				$$ = new StrLitNode(pos, $1->str());
+				$$ = interner->strLit(@1, $1->str());
 			}
 		| AMP id
-		  {  }
+		  {
+				Position * p = new Position(@1, @2);
+				$$ = new RefNode(p, $2);
+			}
 		| TRUE
-		  { $$ = new TrueNode($1->pos()); }
+		  { $$ = interner->trueLit(@1); }
 		| FALSE
-		  { $$ = new FalseNode($1->pos());}
+		  { $$ = interner->falseLit(@1); }
 		| LPAREN exp RPAREN
-		  { $$ = $2; }
+		  {
+				// Parentheses are not part of the expression's span
+				@$ = @2;
+				$$ = $2;
+		  }
 		| callExp
 		  {
 				$$ = $1;
@@ -490,17 +517,19 @@ term 		: lval
 lval		: id
 		  { $$ = $1; }
 		| AT id
-		  { }
+		  {
+		  Position * p = new Position(@1, @2);
+		  $$ = new DerefNode(p, $2);
+		  }
 
 id		: ID
 		  {
-		  Position * pos = $1->pos();
-		  $$ = new IDNode(pos, $1->value());
+		  //The token's span is @1, and the token is done with it
+		  $$ = new IDNode($1->takePos(), $1->value());
 		  }
 
 %%
 
-void cminusminus::Parser::error(const std::string& msg){
-	std::cout << msg << std::endl;
-	std::cerr << "syntax error" << std::endl;
+void cminusminus::Parser::error(const location_type&, const std::string& msg){
+	scanner.errSyntax(msg);
 }
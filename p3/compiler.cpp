@@ -0,0 +1,312 @@
+#include <algorithm>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <iterator>
+#include <streambuf>
+#include <thread>
+#include "bigstack.hpp"
+#include "compiler.hpp"
+#include "descent.hpp"
+#include "packed.hpp"
+#include "pipeline.hpp"
+#include "scanner.hpp"
+#include "symbol_table.hpp"
+
+namespace cminusminus{
+
+/*
+Reads directly out of an in-memory buffer, so that compiling
+from memory does not copy the source into a stringstream.
+*/
+class MemoryInBuf : public std::streambuf{
+public:
+	MemoryInBuf(const char * src, size_t len){
+		char * begin = const_cast<char *>(src);
+		setg(begin, begin, begin + len);
+	}
+};
+
+/*
+Writes into a fixed caller-provided buffer, discarding (but
+counting) whatever does not fit.
+*/
+class FixedOutBuf : public std::streambuf{
+public:
+	FixedOutBuf(char * buf, size_t cap) : myDropped(0){
+		if (cap > 0){ setp(buf, buf + cap - 1); }
+	}
+	size_t length() const {
+		return static_cast<size_t>(pptr() - pbase()) + myDropped;
+	}
+protected:
+	int_type overflow(int_type ch) override {
+		if (!traits_type::eq_int_type(ch, traits_type::eof())){
+			myDropped++;
+		}
+		return traits_type::not_eof(ch);
+	}
+	std::streamsize xsputn(const char * s, std::streamsize n) override {
+		std::streamsize room = epptr() - pptr();
+		std::streamsize fit = n < room ? n : room;
+		if (fit > 0){
+			traits_type::copy(pptr(), s, static_cast<size_t>(fit));
+			pbump(static_cast<int>(fit));
+		}
+		myDropped += static_cast<size_t>(n - fit);
+		return n;
+	}
+private:
+	size_t myDropped;
+};
+
+Compilation::Compilation(const char * src, size_t len)
+: mySrc(src), myLen(len), myNesting(nestingBound(src, len)),
+  myAST(nullptr), myAborted(false),
+  myShareNodes(false), myDescentParser(false),
+  myPipelined(false), myPacked(false), myBudget(nullptr){
+}
+
+Compilation::~Compilation(){
+	deleteAST();
+}
+
+void Compilation::deleteAST(){
+	//The interner holds the shared nodes, which the tree may repeat
+	myTypes.reset();
+	if (myInterner != nullptr){
+		myInterner->deleteTree(myAST);
+	} else {
+		deleteTree(myAST);
+	}
+	myAST = nullptr;
+}
+
+Compilation * Compilation::fromFile(const char * path){
+	std::ifstream inStream(path, std::ios::binary | std::ios::ate);
+	if (!inStream.good()){ return nullptr; }
+	std::streamoff size = inStream.tellg();
+	if (size < 0){ return nullptr; }
+
+	Compilation * result = new Compilation(nullptr, 0);
+	//Read straight into the buffer the AST will point into
+	result->myOwned.resize(static_cast<size_t>(size));
+	inStream.seekg(0);
+	inStream.read(&result->myOwned[0], size);
+	result->mySrc = result->myOwned.data();
+	result->myLen = result->myOwned.size();
+	result->myNesting = nestingBound(result->mySrc, result->myLen);
+	return result;
+}
+
+bool Compilation::guarded(std::function<bool()> phase){
+	try {
+		//The parser recurses as deep as the source nests (see bigstack.hpp)
+		bool result = false;
+		runWithStack(stackForDepth(myNesting), [&](){ result = phase(); });
+		return result;
+	} catch (ToDoError * e){
+		myDiags.add(Diagnostic(Diagnostic::TODO,
+			Position(0,0,0,0), e->msg()));
+		delete e;
+	} catch (InternalError * e){
+		myDiags.add(Diagnostic(Diagnostic::INTERNAL,
+			Position(0,0,0,0), e->msg()));
+		delete e;
+	} catch (UserError * e){
+		myDiags.add(Diagnostic(Diagnostic::USER,
+			Position(0,0,0,0), e->msg()));
+		delete e;
+	} catch (LimitError * e){
+		myDiags.add(Diagnostic(Diagnostic::LIMIT, e->pos(), e->msg()));
+		delete e;
+	}
+	myAborted = true;
+	return false;
+}
+
+/* The smallest piece of input given a lexer thread of its own. A
+   guess: the split has only been timed on one core, where it loses */
+static const size_t minLexPiece = 64 * 1024;
+
+namespace {
+/* A line-aligned piece of the input, and what lexing it gave */
+struct LexPiece{
+	const char * start;
+	size_t len;
+	size_t line;
+	const Budget * budget;
+	std::vector<TokenInfo> tokens;
+	Diagnostics diags;
+	std::exception_ptr error;
+};
+}
+
+/* Cut src into about count pieces, each starting at the beginning of
+   a line, and numbering its lines on from the piece before */
+static std::vector<LexPiece> linePieces(const char * src, size_t len,
+	size_t count, const Budget * budget){
+	std::vector<LexPiece> pieces;
+	size_t line = 1;
+	size_t start = 0;
+	while (start < len || pieces.empty()){
+		size_t end = len;
+		size_t target = start + len / count;
+		if (pieces.size() + 1 < count && target < len){
+			const void * nl = memchr(src + target, '\n', len - target);
+			if (nl != nullptr){
+				end = static_cast<size_t>(
+					static_cast<const char *>(nl) - src) + 1;
+			}
+		}
+		LexPiece piece;
+		piece.start = src + start;
+		piece.len = end - start;
+		piece.line = line;
+		piece.budget = budget;
+		pieces.push_back(std::move(piece));
+		line += static_cast<size_t>(std::count(src + start, src + end, '\n'));
+		start = end;
+	}
+	return pieces;
+}
+
+static void lexPiece(LexPiece& piece){
+	try {
+		MemoryInBuf buf(piece.start, piece.len);
+		std::istream inStream(&buf);
+		Scanner scanner(&inStream, &piece.diags, piece.start);
+		scanner.startAtLine(piece.line);
+		scanner.setBudget(piece.budget);
+		scanner.lexTokens(piece.tokens);
+	} catch (...){
+		piece.error = std::current_exception();
+	}
+}
+
+bool Compilation::tokenize(unsigned int threads){
+	myTokens.clear();
+	//Pieces past one per core take turns, and cost more than they save
+	unsigned int cores = std::max(1u, std::thread::hardware_concurrency());
+	if (threads == 0 || threads > cores){ threads = cores; }
+	size_t count = std::max<size_t>(1, std::min<size_t>(threads,
+		myLen / minLexPiece));
+	//Only one scanner going through the input in order can count those
+	if (myBudget != nullptr && myBudget->countsLexing()){ count = 1; }
+	return guarded([this, count](){
+		if (myBudget != nullptr){ myBudget->checkInput(myLen); }
+		std::vector<LexPiece> pieces = linePieces(mySrc, myLen, count,
+			myBudget);
+		if (pieces.size() == 1){
+			lexPiece(pieces[0]);
+		} else {
+			std::vector<std::thread> workers;
+			for (LexPiece& piece : pieces){
+				workers.emplace_back([&piece](){ lexPiece(piece); });
+			}
+			for (std::thread& worker : workers){ worker.join(); }
+		}
+		bool clean = true;
+		for (size_t i = 0; i < pieces.size(); i++){
+			LexPiece& piece = pieces[i];
+			for (const Diagnostic& diag : piece.diags.all()){
+				myDiags.add(diag);
+				clean = false;
+			}
+			if (piece.error){ std::rethrow_exception(piece.error); }
+			//Only the last piece's end is the end of the input
+			if (i + 1 < pieces.size()){ piece.tokens.pop_back(); }
+			myTokens.insert(myTokens.end(),
+				std::make_move_iterator(piece.tokens.begin()),
+				std::make_move_iterator(piece.tokens.end()));
+		}
+		return clean;
+	});
+}
+
+bool Compilation::parse(){
+	deleteAST();
+	myInterner.reset(new ASTInterner(myShareNodes));
+	return guarded([this](){
+		if (myBudget != nullptr){ myBudget->checkInput(myLen); }
+		NodeBudget nodes(myBudget);
+		MemoryInBuf buf(mySrc, myLen);
+		std::istream inStream(&buf);
+		Scanner scanner(&inStream, &myDiags, mySrc);
+		scanner.setBudget(myBudget);
+		std::unique_ptr<PackedTokens> packed;
+		std::unique_ptr<TokenPipe> pipe;
+		if (myPacked && PackedTokens::fits(myLen)){
+			packed.reset(new PackedTokens(scanner, mySrc));
+		} else {
+			//The tree keeps nothing of the tokens, so they go with
+			//scanner (packed tokens free their own)
+			scanner.setRecycling(true);
+			if (myPipelined){ pipe.reset(new TokenPipe(scanner)); }
+		}
+		ProgramNode * root = nullptr;
+		int errCode;
+		if (myDescentParser){
+			errCode = parseDescent(scanner, &root, myInterner.get(),
+				nullptr);
+		} else {
+			Parser parser(scanner, &root, myInterner.get(), nullptr);
+			errCode = parser.parse();
+		}
+		classifyAllocations();
+		if (errCode != 0){ return false; }
+		myAST = root;
+		return myAST != nullptr;
+	});
+}
+
+bool Compilation::analyzeNames(){
+	if (myAST == nullptr){ return false; }
+	return guarded([this](){
+		if (myBudget != nullptr){ myBudget->checkClock(); }
+		SymbolTable symTab(&myDiags);
+		return symTab.analyze(myAST);
+	});
+}
+
+bool Compilation::checkTypes(unsigned int threads){
+	if (myAST == nullptr){ return false; }
+	return guarded([this, threads](){
+		if (myBudget != nullptr){ myBudget->checkClock(); }
+		myTypes.reset(TypeAnalysis::build(myAST, &myDiags, threads,
+			myInterner->sharing() ? myInterner.get() : nullptr));
+		return myTypes->passed();
+	});
+}
+
+void Compilation::writeDiagnostics(std::ostream& err,
+	std::ostream& detail) const{
+	for (const Diagnostic& diag : myDiags.all()){
+		if (!diag.detail().empty()){
+			detail << diag.detail() << std::endl;
+		}
+		err << diag.str() << std::endl;
+	}
+}
+
+void Compilation::writeTokens(std::ostream& out) const{
+	for (const TokenInfo& tok : myTokens){
+		out << tok.text << std::endl;
+	}
+}
+
+void Compilation::unparse(std::ostream& out) const{
+	if (myAST != nullptr){ myAST->unparse(out, 0); }
+}
+
+size_t Compilation::unparse(char * buf, size_t cap) const{
+	FixedOutBuf sink(buf, cap);
+	std::ostream out(&sink);
+	if (myAST != nullptr){ myAST->unparse(out, 0); }
+	if (cap > 0){
+		buf[std::min(sink.length(), cap - 1)] = '\0';
+	}
+	return sink.length();
+}
+
+}
@@ -0,0 +1,146 @@
+#ifndef CMINUSMINUS_COMPILER_HPP
+#define CMINUSMINUS_COMPILER_HPP
+
+#include <functional>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "errors.hpp"
+#include "tokens.hpp"
+#include "ast.hpp"
+#include "budget.hpp"
+#include "intern.hpp"
+#include "type_analysis.hpp"
+
+/* The in-process interface to the compiler (libcmmc). cmmc is
+   a thin driver over this; other tools can link against the
+   library and compile without spawning a process. */
+
+namespace cminusminus{
+
+/**
+* \class Compilation
+* One compilation of one source buffer. Instances share no state
+* with one another, so separate Compilations may be used from
+* separate threads. Errors never escape as exceptions: they are
+* recorded as Diagnostics, and the phase that hit them returns
+* false.
+**/
+class Compilation{
+public:
+	/* Compile from a caller-owned buffer, which must outlive
+	   the Compilation and its AST */
+	Compilation(const char * src, size_t len);
+
+	/* Compile the contents of the file at path. Returns
+	   nullptr if the file cannot be read */
+	static Compilation * fromFile(const char * path);
+
+	/* Deletes the AST, before the source buffer it points into */
+	~Compilation();
+
+	Compilation(const Compilation&) = delete;
+	Compilation& operator=(const Compilation&) = delete;
+
+	/* Lex the whole input, filling tokens(). With threads other
+	   than 1, a big input is cut into pieces at line breaks, which
+	   no token spans, and the pieces lexed on up to threads threads
+	   (0 means one per core, and there are never more than that),
+	   for the same tokens and diagnostics. The split is experimental:
+	   runner -bench times it, but it is not yet shown to be faster.
+	   Returns false if any diagnostic was raised */
+	bool tokenize(unsigned int threads = 1);
+
+	/* Parse the whole input, building ast() (and deleting any
+	   earlier one). Returns false if no AST could be built */
+	bool parse();
+
+	/* Resolve every name in ast() to its declaration. Returns
+	   false if any name is undeclared or declared twice */
+	bool analyzeNames();
+
+	/* Type check ast(), which must have passed analyzeNames(),
+	   checking function bodies on up to threads workers (0 means
+	   one per core). Returns false on any type error */
+	bool checkTypes(unsigned int threads = 0);
+	/* The result of the last checkTypes(), or nullptr */
+	const TypeAnalysis * types() const { return myTypes.get(); }
+
+	/* Have parse() hash-cons types, literals and constant
+	   subexpressions (see ASTInterner). Off by default */
+	void setShareNodes(bool share){ myShareNodes = share; }
+	/* Have parse() use the hand-written parser rather than the
+	   bison one (see descent.hpp). Off by default */
+	void setDescentParser(bool descent){ myDescentParser = descent; }
+	/* Have parse() lex on a thread of its own, ahead of the parser
+	   (see pipeline.hpp). Off by default */
+	void setPipelined(bool pipelined){ myPipelined = pipelined; }
+	/* Have parse() lex the whole input into a packed array of
+	   tokens before parsing it (see packed.hpp). Takes the place of
+	   setPipelined. Off by default */
+	void setPackedTokens(bool packed){ myPacked = packed; }
+	/* Hold every phase to budget's limits (see budget.hpp), which
+	   must outlive the Compilation; nullptr (the default) for none.
+	   Going over one stops the phase with a LIMIT diagnostic */
+	void setBudget(const Budget * budget){ myBudget = budget; }
+	/* The interner behind the last parse(), for its sharing
+	   statistics; nullptr before the first parse */
+	const ASTInterner * interner() const { return myInterner.get(); }
+
+	const std::vector<TokenInfo>& tokens() const { return myTokens; }
+	/* String literals in the AST point into the source buffer, so
+	   it is only good for as long as the Compilation is */
+	ProgramNode * ast() const { return myAST; }
+	const std::vector<Diagnostic>& diagnostics() const {
+		return myDiags.all();
+	}
+	/* True when a phase was stopped by an internal, user or
+	   unimplemented-feature error rather than a reported one */
+	bool aborted() const { return myAborted; }
+
+	/* Write the diagnostics as cmmc reports them: each message
+	   to err, and any extra detail (bison's verbose syntax error
+	   message) to detail */
+	void writeDiagnostics(std::ostream& err, std::ostream& detail) const;
+
+	/* Write the -t token dump */
+	void writeTokens(std::ostream& out) const;
+
+	/* Write the canonical program form of ast() */
+	void unparse(std::ostream& out) const;
+
+	/* Unparse into buf, writing at most cap-1 characters and a
+	   terminating NUL (like snprintf). Returns the length of the
+	   full unparse, so a return >= cap means truncation */
+	size_t unparse(char * buf, size_t cap) const;
+
+private:
+	void deleteAST();
+
+	/* Runs one phase, turning any error thrown out of it
+	   into a Diagnostic */
+	bool guarded(std::function<bool()> phase);
+
+	//Declared first, so it is destroyed last
+	std::string myOwned;
+	const char * mySrc;
+	size_t myLen;
+	/* How deeply its source nests (see bigstack.hpp) */
+	size_t myNesting;
+	std::vector<TokenInfo> myTokens;
+	ProgramNode * myAST;
+	std::unique_ptr<ASTInterner> myInterner;
+	std::unique_ptr<TypeAnalysis> myTypes;
+	Diagnostics myDiags;
+	bool myAborted;
+	bool myShareNodes;
+	bool myDescentParser;
+	bool myPipelined;
+	bool myPacked;
+	const Budget * myBudget;
+};
+
+}
+
+#endif
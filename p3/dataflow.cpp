@@ -0,0 +1,179 @@
+#include <algorithm>
+#include "dataflow.hpp"
+
+namespace cminusminus{
+
+void BitSet::fill(){
+	std::fill(myWords.begin(), myWords.end(), ~uint64_t(0));
+	if (mySize % 64 != 0){
+		myWords.back() = (uint64_t(1) << (mySize % 64)) - 1;
+	}
+}
+
+bool BitSet::empty() const{
+	uint64_t any = 0;
+	for (uint64_t word : myWords){ any |= word; }
+	return any == 0;
+}
+
+size_t BitSet::count() const{
+	size_t n = 0;
+	for (uint64_t word : myWords){
+		n += static_cast<size_t>(__builtin_popcountll(word));
+	}
+	return n;
+}
+
+/* The loops below keep to a single pass with no early exit, and fold
+   whether anything changed into one word, so that they vectorize */
+
+bool BitSet::unionWith(const BitSet& other){
+	uint64_t changed = 0;
+	uint64_t * dst = myWords.data();
+	const uint64_t * src = other.myWords.data();
+	for (size_t w = 0, n = myWords.size(); w < n; w++){
+		uint64_t merged = dst[w] | src[w];
+		changed |= merged ^ dst[w];
+		dst[w] = merged;
+	}
+	return changed != 0;
+}
+
+bool BitSet::intersectWith(const BitSet& other){
+	uint64_t changed = 0;
+	uint64_t * dst = myWords.data();
+	const uint64_t * src = other.myWords.data();
+	for (size_t w = 0, n = myWords.size(); w < n; w++){
+		uint64_t merged = dst[w] & src[w];
+		changed |= merged ^ dst[w];
+		dst[w] = merged;
+	}
+	return changed != 0;
+}
+
+void BitSet::subtract(const BitSet& other){
+	uint64_t * dst = myWords.data();
+	const uint64_t * src = other.myWords.data();
+	for (size_t w = 0, n = myWords.size(); w < n; w++){
+		dst[w] &= ~src[w];
+	}
+}
+
+bool BitSet::transfer(const BitSet& gen, const BitSet& in,
+	const BitSet& kill){
+	uint64_t changed = 0;
+	uint64_t * dst = myWords.data();
+	const uint64_t * g = gen.myWords.data();
+	const uint64_t * i = in.myWords.data();
+	const uint64_t * k = kill.myWords.data();
+	for (size_t w = 0, n = myWords.size(); w < n; w++){
+		uint64_t result = g[w] | (i[w] & ~k[w]);
+		changed |= result ^ dst[w];
+		dst[w] = result;
+	}
+	return changed != 0;
+}
+
+/* The blocks reachable from the entry in postorder, then the rest */
+static std::vector<size_t> postorder(
+	const std::vector<std::vector<size_t>>& succs){
+	size_t n = succs.size();
+	std::vector<size_t> order;
+	std::vector<bool> seen(n, false);
+	//Iterative, so that long chains of blocks are fine
+	std::vector<std::pair<size_t, size_t>> stack;
+	if (n > 0){
+		stack.push_back({0, 0});
+		seen[0] = true;
+	}
+	while (!stack.empty()){
+		size_t b = stack.back().first;
+		size_t& next = stack.back().second;
+		if (next < succs[b].size()){
+			size_t s = succs[b][next++];
+			if (!seen[s]){
+				seen[s] = true;
+				stack.push_back({s, 0});
+			}
+		} else {
+			order.push_back(b);
+			stack.pop_back();
+		}
+	}
+	for (size_t b = 0; b < n; b++){
+		if (!seen[b]){ order.push_back(b); }
+	}
+	return order;
+}
+
+DataflowResult solveDataflow(const DataflowProblem& problem){
+	size_t n = problem.succs.size();
+	bool forward = problem.direction == DataflowProblem::FORWARD;
+	std::vector<std::vector<size_t>> preds(n);
+	for (size_t b = 0; b < n; b++){
+		for (size_t s : problem.succs[b]){ preds[s].push_back(b); }
+	}
+	//Where each block's sets come from, and who depends on them
+	const std::vector<std::vector<size_t>>& sources =
+		forward ? preds : problem.succs;
+	const std::vector<std::vector<size_t>>& dependents =
+		forward ? problem.succs : preds;
+
+	DataflowResult result;
+	result.visits = 0;
+	BitSet start(problem.universe);
+	if (problem.meet == DataflowProblem::INTERSECTION){ start.fill(); }
+	result.in.assign(n, start);
+	result.out.assign(n, start);
+	//Met over the sources: in for a forward problem, out for backward
+	std::vector<BitSet>& met = forward ? result.in : result.out;
+	std::vector<BitSet>& made = forward ? result.out : result.in;
+
+	std::vector<size_t> order = postorder(problem.succs);
+	if (forward){ std::reverse(order.begin(), order.end()); }
+	//The worklist, drained in order a sweep at a time: a block pushed
+	//back by one later in the order (along a loop) waits for the next
+	//sweep rather than being chased at once through all it reaches
+	std::vector<bool> listed(n, true);
+	bool pending = n > 0;
+	while (pending){
+		pending = false;
+		for (size_t b : order){
+			if (!listed[b]){ continue; }
+			listed[b] = false;
+			result.visits++;
+
+			BitSet& into = met[b];
+			bool boundary = forward ? b == 0 : sources[b].empty();
+			if (boundary){
+				into = problem.boundary;
+			} else if (problem.meet == DataflowProblem::INTERSECTION){
+				into.fill();
+			} else {
+				into = start;
+			}
+			for (size_t s : sources[b]){
+				if (problem.meet == DataflowProblem::UNION){
+					into.unionWith(made[s]);
+				} else {
+					into.intersectWith(made[s]);
+				}
+			}
+			//A forward entry with predecessors meets them with the boundary
+			if (boundary && !sources[b].empty()
+				&& problem.meet == DataflowProblem::INTERSECTION){
+				into.intersectWith(problem.boundary);
+			}
+
+			if (made[b].transfer(problem.gen[b], into, problem.kill[b])){
+				for (size_t d : dependents[b]){
+					listed[d] = true;
+					pending = true;
+				}
+			}
+		}
+	}
+	return result;
+}
+
+}
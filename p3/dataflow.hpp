@@ -0,0 +1,106 @@
+#ifndef CMINUSMINUS_DATAFLOW_HPP
+#define CMINUSMINUS_DATAFLOW_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*
+Gen/kill dataflow over a control-flow graph, for any analysis whose
+facts are small integers: temps, variables, definition sites. Sets
+are dense bit vectors, and the set operations are plain loops over
+their 64-bit words, which the compiler vectorizes; a block's transfer
+function is computed a word at a time as well, without building any
+temporary set.
+
+The solver keeps a worklist of blocks, drained in reverse postorder
+for a forward problem and postorder for a backward one, so that most
+blocks see their predecessors' (or successors') final sets the first
+time round. A block goes back on the list only when something it
+depends on changed, and the list is drained again, in the same order,
+until it is empty.
+*/
+
+namespace cminusminus{
+
+class BitSet{
+public:
+	BitSet() : mySize(0){ }
+	/* The empty set over 0..size-1 */
+	explicit BitSet(size_t size) : mySize(size), myWords(words(size), 0){ }
+
+	size_t size() const { return mySize; }
+	bool has(size_t i) const {
+		return (myWords[i / 64] >> (i % 64)) & 1;
+	}
+	void add(size_t i){ myWords[i / 64] |= uint64_t(1) << (i % 64); }
+	void remove(size_t i){ myWords[i / 64] &= ~(uint64_t(1) << (i % 64)); }
+	/* Everything in 0..size-1 */
+	void fill();
+	bool empty() const;
+	size_t count() const;
+
+	/* Add everything in other, returning whether that changed this */
+	bool unionWith(const BitSet& other);
+	/* Keep only what is also in other, returning whether that
+	   changed this */
+	bool intersectWith(const BitSet& other);
+	/* Remove everything in other */
+	void subtract(const BitSet& other);
+	/* Become gen | (in & ~kill), returning whether this changed */
+	bool transfer(const BitSet& gen, const BitSet& in, const BitSet& kill);
+
+	bool operator==(const BitSet& other) const {
+		return myWords == other.myWords;
+	}
+
+	/* Call f on each member, in increasing order */
+	template <typename F>
+	void forEach(F f) const {
+		for (size_t w = 0; w < myWords.size(); w++){
+			uint64_t bits = myWords[w];
+			while (bits != 0){
+				f(w * 64 + static_cast<size_t>(__builtin_ctzll(bits)));
+				bits &= bits - 1;
+			}
+		}
+	}
+
+private:
+	static size_t words(size_t size){ return (size + 63) / 64; }
+
+	size_t mySize;
+	std::vector<uint64_t> myWords;
+};
+
+/* A gen/kill problem over blocks 0..succs.size()-1. Block 0 is the
+   entry, and every block without successors is an exit */
+struct DataflowProblem{
+	enum Direction { FORWARD, BACKWARD };
+	enum Meet { UNION, INTERSECTION };
+	Direction direction;
+	Meet meet;
+	/* The facts are 0..universe-1 */
+	size_t universe;
+	std::vector<std::vector<size_t>> succs;
+	/* Per block */
+	std::vector<BitSet> gen;
+	std::vector<BitSet> kill;
+	/* What holds on the way into the entry (forward), or out of
+	   every exit (backward) */
+	BitSet boundary;
+};
+
+/* What holds on the way into and out of each block */
+struct DataflowResult{
+	std::vector<BitSet> in;
+	std::vector<BitSet> out;
+	/* How many times a block's transfer function was applied */
+	size_t visits;
+};
+
+DataflowResult solveDataflow(const DataflowProblem& problem);
+
+}
+
+#endif
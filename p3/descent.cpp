@@ -0,0 +1,575 @@
+#include <vector>
+#include "descent.hpp"
+#include "scanner.hpp"
+
+namespace cminusminus{
+
+namespace {
+
+/* Thrown, once the syntax error has been reported, to abandon the
+   whole parse */
+class SyntaxFailure{ };
+
+/* Binding powers, from the precedence declarations of
+   cminusminus.yy: a binary operator takes as its right operand
+   everything up to the next operator that binds no tighter */
+const int noPower = 0;
+const int orPower = 1;
+const int andPower = 2;
+const int comparePower = 3;
+const int addPower = 4;
+const int mulPower = 5;
+const int notPower = 6;
+
+/* How tightly tag binds as a binary operator, noPower if it is not
+   one. ASSIGN is not among them: only an lval can be assigned to,
+   so assignment is parsed where the lval is */
+int bindingPower(int tag){
+	switch (tag){
+	case TokenKind::OR: return orPower;
+	case TokenKind::AND: return andPower;
+	case TokenKind::LESS:
+	case TokenKind::GREATER:
+	case TokenKind::LESSEQ:
+	case TokenKind::GREATEREQ:
+	case TokenKind::EQUALS:
+	case TokenKind::NOTEQUALS: return comparePower;
+	case TokenKind::MINUS:
+	case TokenKind::PLUS: return addPower;
+	case TokenKind::TIMES:
+	case TokenKind::DIVIDE: return mulPower;
+	default: return noPower;
+	}
+}
+
+/* What an exp being parsed waits on. An EXP of the operators that bind
+   tighter than minPower waits for an operand: its first, or once it
+   has taken op after lhs (spanning span), its right one. A NOT at span
+   or an assignment to dst (spanning span) waits for its operand */
+struct Pending{
+	enum Kind { EXP, NOT, ASSIGN };
+	Kind kind;
+	int minPower;
+	bool hasOp;
+	int op;
+	ExpNode * lhs;
+	LValNode * dst;
+	Position span;
+
+	static Pending exp(int minPower){
+		return Pending{EXP, minPower, false, 0, nullptr, nullptr, Position()};
+	}
+	static Pending prefix(Kind kind, const Position& span, LValNode * dst){
+		return Pending{kind, noPower, false, 0, nullptr, dst, span};
+	}
+};
+
+/*
+Each production returns its node and sets span to the location bison
+would have given it (@$), which is not always the node's own pos():
+a parenthesized expression spans only what is inside the parentheses,
+and a varDecl does not span its semicolon.
+*/
+class DescentParser{
+public:
+	DescentParser(Scanner& scanner, ASTInterner * interner)
+	: myScanner(scanner), myInterner(interner), myHave(false), myTag(0){ }
+
+	ProgramNode * program(DeclSink * sink){
+		std::list<DeclNode *> * globals = new std::list<DeclNode *>();
+		while (peek() != TokenKind::END){
+			if (!startsType(peek())){ unexpected(name(TokenKind::END)); }
+			DeclNode * global = decl();
+			if (sink != nullptr){
+				(*sink)(global);
+			} else {
+				globals->push_back(global);
+			}
+		}
+		return new ProgramNode(globals);
+	}
+
+private:
+	/* The kind of the next token, reading it if need be. Tokens are
+	   read no sooner than bison would, so lexical errors are
+	   reported at the same point */
+	int peek(){
+		if (!myHave){
+			myTag = myScanner.yylex(&myVal, &myLoc);
+			myHave = true;
+		}
+		return myTag;
+	}
+
+	/* Consume the next token, setting pos to its span */
+	Token * take(Position& pos){
+		peek();
+		myHave = false;
+		pos = myLoc;
+		return myVal.lexeme;
+	}
+
+	/* Consume the next token, which must be of kind tag */
+	Token * expect(int tag, Position& pos){
+		if (peek() != tag){ unexpected(name(tag)); }
+		return take(pos);
+	}
+
+	/* Consume the token that ends an expression. Had it been an
+	   operator the expression would have gone on, so there was no
+	   one thing that could have come instead */
+	void endExp(int tag, Position& pos){
+		if (peek() != tag){ unexpected(); }
+		take(pos);
+	}
+
+	static std::string name(int tag){
+		Parser::by_kind kind(static_cast<Parser::token_kind_type>(tag));
+		return Parser::symbol_name(kind.kind());
+	}
+
+	/* Report a syntax error at the next token, saying what was
+	   wanted instead if there was only one thing it could be */
+	[[noreturn]] void unexpected(std::string expecting = ""){
+		std::string msg = "syntax error, unexpected " + name(peek());
+		if (!expecting.empty()){ msg += ", expecting " + expecting; }
+		myScanner.errSyntax(msg);
+		throw new SyntaxFailure();
+	}
+
+	static bool startsType(int tag){
+		switch (tag){
+		case TokenKind::INT:
+		case TokenKind::BOOL:
+		case TokenKind::STRING:
+		case TokenKind::SHORT:
+		case TokenKind::VOID:
+		case TokenKind::PTR: return true;
+		default: return false;
+		}
+	}
+
+	DeclNode * decl(){
+		Position typeSpan, idSpan, pos;
+		TypeNode * type = this->type(typeSpan);
+		IDNode * id = this->id(idSpan);
+		if (peek() == TokenKind::SEMICOL){
+			take(pos);
+			return new VarDeclNode(new Position(typeSpan, idSpan), type, id);
+		}
+		if (peek() != TokenKind::LPAREN){ unexpected("LPAREN or SEMICOL"); }
+		take(pos);
+		std::list<FormalDeclNode *> * formals =
+			new std::list<FormalDeclNode *>();
+		if (peek() != TokenKind::RPAREN){
+			formals->push_back(formalDecl());
+			while (peek() == TokenKind::COMMA){
+				take(pos);
+				formals->push_back(formalDecl());
+			}
+		}
+		expect(TokenKind::RPAREN, pos);
+		std::list<StmtNode *> * body = block(pos);
+		return new FnDeclNode(new Position(typeSpan, pos), type, id,
+			formals, body);
+	}
+
+	FormalDeclNode * formalDecl(){
+		if (!startsType(peek())){ unexpected(); }
+		Position typeSpan, idSpan;
+		TypeNode * type = this->type(typeSpan);
+		IDNode * id = this->id(idSpan);
+		return new FormalDeclNode(new Position(typeSpan, idSpan), type, id);
+	}
+
+	TypeNode * type(Position& span){
+		if (peek() != TokenKind::PTR){ return primType(span); }
+		Position ptrPos, primSpan;
+		take(ptrPos);
+		TypeNode * base = primType(primSpan);
+		span = Position(ptrPos, primSpan);
+		return myInterner->ptrType(span, base);
+	}
+
+	TypeNode * primType(Position& span){
+		switch (peek()){
+		case TokenKind::INT: take(span); return myInterner->intType(span);
+		case TokenKind::BOOL: take(span); return myInterner->boolType(span);
+		case TokenKind::STRING:
+			take(span);
+			return myInterner->stringType(span);
+		case TokenKind::SHORT: take(span); return myInterner->shortType(span);
+		case TokenKind::VOID: take(span); return myInterner->voidType(span);
+		default: unexpected();
+		}
+	}
+
+	IDNode * id(Position& span){
+		IDToken * tok = static_cast<IDToken *>(expect(TokenKind::ID, span));
+		return new IDNode(tok->takePos(), tok->value());
+	}
+
+	/* An lval: id or AT id */
+	LValNode * lval(Position& span){
+		if (peek() == TokenKind::ID){ return id(span); }
+		if (peek() != TokenKind::AT){ unexpected("AT or ID"); }
+		Position atPos, idSpan;
+		take(atPos);
+		IDNode * id = this->id(idSpan);
+		span = Position(atPos, idSpan);
+		return new DerefNode(new Position(span), id);
+	}
+
+	/* LCURLY stmtList RCURLY, setting end to the RCURLY's span */
+	std::list<StmtNode *> * block(Position& end){
+		expect(TokenKind::LCURLY, end);
+		std::list<StmtNode *> * stmts = new std::list<StmtNode *>();
+		while (peek() != TokenKind::RCURLY){
+			stmts->push_back(stmt());
+		}
+		take(end);
+		return stmts;
+	}
+
+	StmtNode * stmt(){
+		Position first, span, end;
+		switch (peek()){
+		case TokenKind::READ: {
+			take(first);
+			LValNode * dst = lval(span);
+			expect(TokenKind::SEMICOL, end);
+			return new ReadStmtNode(new Position(first, end), dst);
+		}
+		case TokenKind::WRITE: {
+			take(first);
+			ExpNode * src = exp(span);
+			endExp(TokenKind::SEMICOL, end);
+			return new WriteStmtNode(new Position(first, end), src);
+		}
+		case TokenKind::WHILE: {
+			take(first);
+			ExpNode * cond = condition();
+			std::list<StmtNode *> * body = block(end);
+			return new WhileStmtNode(new Position(first, end), cond, body);
+		}
+		case TokenKind::IF: {
+			take(first);
+			ExpNode * cond = condition();
+			std::list<StmtNode *> * body = block(end);
+			if (peek() != TokenKind::ELSE){
+				return new IfStmtNode(new Position(first, end), cond, body);
+			}
+			take(span);
+			std::list<StmtNode *> * elseBody = block(end);
+			return new IfElseStmtNode(new Position(first, end), cond,
+				body, elseBody);
+		}
+		case TokenKind::RETURN: {
+			take(first);
+			if (peek() == TokenKind::SEMICOL){
+				take(end);
+				return new ReturnStmtNode(new Position(first, end));
+			}
+			ExpNode * result = exp(span);
+			endExp(TokenKind::SEMICOL, end);
+			return new ReturnStmtNode(new Position(first, end), result);
+		}
+		case TokenKind::ID:
+		case TokenKind::AT:
+			return lvalStmt();
+		default:
+			if (!startsType(peek())){ unexpected(); }
+			TypeNode * type = this->type(first);
+			IDNode * id = this->id(span);
+			expect(TokenKind::SEMICOL, end);
+			return new VarDeclNode(new Position(first, span), type, id);
+		}
+	}
+
+	/* LPAREN exp RPAREN, around the condition of a while or if */
+	ExpNode * condition(){
+		Position pos, span;
+		expect(TokenKind::LPAREN, pos);
+		ExpNode * cond = exp(span);
+		endExp(TokenKind::RPAREN, pos);
+		return cond;
+	}
+
+	/* A statement that starts with an lval: a call, an assignment,
+	   or a post-increment or decrement */
+	StmtNode * lvalStmt(){
+		Position span, end;
+		bool plainID = peek() == TokenKind::ID;
+		LValNode * dst = lval(span);
+		if (plainID && peek() == TokenKind::LPAREN){
+			CallExpNode * call = callExp(static_cast<IDNode *>(dst), span);
+			expect(TokenKind::SEMICOL, end);
+			return new CallStmtNode(new Position(span, end), call);
+		}
+		switch (peek()){
+		case TokenKind::DEC:
+			take(end);
+			expect(TokenKind::SEMICOL, end);
+			return new PostDecStmtNode(new Position(span, end), dst);
+		case TokenKind::INC:
+			take(end);
+			expect(TokenKind::SEMICOL, end);
+			return new PostIncStmtNode(new Position(span, end), dst);
+		case TokenKind::ASSIGN: {
+			AssignExpNode * assign = assignExp(dst, span);
+			endExp(TokenKind::SEMICOL, end);
+			return new AssignStmtNode(new Position(span, end), assign);
+		}
+		default: unexpected("ASSIGN or DEC or INC");
+		}
+	}
+
+	/* The rest of lval ASSIGN exp, given the lval and its span. The
+	   right side is a whole exp, as ASSIGN binds loosest of all; span
+	   becomes that of the assignment */
+	AssignExpNode * assignExp(LValNode * dst, Position& span){
+		Position pos, srcSpan;
+		expect(TokenKind::ASSIGN, pos);
+		ExpNode * src = exp(srcSpan);
+		span = Position(span, srcSpan);
+		return new AssignExpNode(new Position(span), dst, src);
+	}
+
+	/* The rest of id LPAREN actualsList? RPAREN, given the id and its
+	   span; span becomes that of the call */
+	CallExpNode * callExp(IDNode * callee, Position& span){
+		Position pos, argSpan;
+		expect(TokenKind::LPAREN, pos);
+		if (peek() == TokenKind::RPAREN){
+			take(pos);
+			span = Position(span, pos);
+			return new CallExpNode(new Position(span), callee);
+		}
+		std::list<ExpNode *> * args = new std::list<ExpNode *>();
+		args->push_back(exp(argSpan));
+		while (peek() == TokenKind::COMMA){
+			take(pos);
+			args->push_back(exp(argSpan));
+		}
+		if (peek() != TokenKind::RPAREN){ unexpected("COMMA or RPAREN"); }
+		take(pos);
+		span = Position(span, pos);
+		return new CallExpNode(new Position(span), callee, args);
+	}
+
+	/* An expression made of operators that bind tighter than
+	   minPower. Only parentheses recurse: operators, NOTs and
+	   assignments waiting for an operand are kept in a stack of
+	   their own, so no chain of them costs any C++ stack */
+	ExpNode * exp(Position& span, int minPower = noPower){
+		std::vector<Pending> pending;
+		pending.push_back(Pending::exp(minPower));
+		while (true){
+			ExpNode * value = operand(pending, span);
+			if (value == nullptr){ continue; }
+			//Hand the finished operand down until an EXP takes an
+			// operator after it, and so waits for another
+			while (true){
+				Pending& top = pending.back();
+				if (top.kind == Pending::NOT){
+					span = Position(top.span, span);
+					value = myInterner->unary<NotNode>(NodeKind::NOT, span,
+						value);
+					pending.pop_back();
+					continue;
+				}
+				if (top.kind == Pending::ASSIGN){
+					span = Position(top.span, span);
+					value = new AssignExpNode(new Position(span), top.dst,
+						value);
+					pending.pop_back();
+					continue;
+				}
+				if (top.hasOp){
+					span = Position(top.span, span);
+					value = binary(top.op, span, top.lhs, value);
+					//The comparisons are %nonassoc: a < b < c is an error
+					if (bindingPower(top.op) == comparePower
+						&& bindingPower(peek()) == comparePower){
+						unexpected();
+					}
+				}
+				int tag = peek();
+				int power = bindingPower(tag);
+				if (power > top.minPower){
+					Position pos;
+					take(pos);
+					top.hasOp = true;
+					top.op = tag;
+					top.lhs = value;
+					top.span = span;
+					pending.push_back(Pending::exp(power));
+					break;
+				}
+				pending.pop_back();
+				if (pending.empty()){ return value; }
+			}
+		}
+	}
+
+	ExpNode * binary(int tag, const Position& span, ExpNode * lhs,
+		ExpNode * rhs){
+		switch (tag){
+		case TokenKind::MINUS:
+			return myInterner->binary<MinusNode>(NodeKind::MINUS, span,
+				lhs, rhs);
+		case TokenKind::PLUS:
+			return myInterner->binary<PlusNode>(NodeKind::PLUS, span,
+				lhs, rhs);
+		case TokenKind::TIMES:
+			return myInterner->binary<TimesNode>(NodeKind::TIMES, span,
+				lhs, rhs);
+		case TokenKind::DIVIDE:
+			return myInterner->binary<DivideNode>(NodeKind::DIVIDE, span,
+				lhs, rhs);
+		case TokenKind::AND:
+			return myInterner->binary<AndNode>(NodeKind::AND, span,
+				lhs, rhs);
+		case TokenKind::OR:
+			return myInterner->binary<OrNode>(NodeKind::OR, span,
+				lhs, rhs);
+		case TokenKind::EQUALS:
+			return myInterner->binary<EqualsNode>(NodeKind::EQUALS, span,
+				lhs, rhs);
+		case TokenKind::NOTEQUALS:
+			return myInterner->binary<NotEqualsNode>(NodeKind::NOTEQUALS,
+				span, lhs, rhs);
+		case TokenKind::GREATER:
+			return myInterner->binary<GreaterNode>(NodeKind::GREATER, span,
+				lhs, rhs);
+		case TokenKind::GREATEREQ:
+			return myInterner->binary<GreaterEqNode>(NodeKind::GREATEREQ,
+				span, lhs, rhs);
+		case TokenKind::LESS:
+			return myInterner->binary<LessNode>(NodeKind::LESS, span,
+				lhs, rhs);
+		case TokenKind::LESSEQ:
+			return myInterner->binary<LessEqNode>(NodeKind::LESSEQ, span,
+				lhs, rhs);
+		default:
+			throw new InternalError("Not a binary operator");
+		}
+	}
+
+	/* Start an operand for the EXP on top of pending: NOT exp, MINUS
+	   term, an assignExp, or a term. NOT binds tighter than any
+	   binary operator; unary minus applies only to a term, so
+	   - a * b is (-a) * b and - -a is an error. A NOT, or an lval
+	   and its ASSIGN, is pushed to wait for its operand, and nullptr
+	   returned; anything else is read whole, setting span */
+	ExpNode * operand(std::vector<Pending>& pending, Position& span){
+		Position pos, operandSpan;
+		switch (peek()){
+		case TokenKind::NOT:
+			take(pos);
+			pending.push_back(Pending::prefix(Pending::NOT, pos, nullptr));
+			pending.push_back(Pending::exp(notPower));
+			return nullptr;
+		case TokenKind::MINUS: {
+			take(pos);
+			ExpNode * operand = term(operandSpan);
+			span = Position(pos, operandSpan);
+			return myInterner->unary<NegNode>(NodeKind::NEG, span, operand);
+		}
+		case TokenKind::ID:
+		case TokenKind::AT: {
+			//Where bison could reduce an lval to either a term or an
+			// assignExp, the ASSIGN after it decides
+			bool plainID = peek() == TokenKind::ID;
+			LValNode * lval = this->lval(span);
+			if (plainID && peek() == TokenKind::LPAREN){
+				return callExp(static_cast<IDNode *>(lval), span);
+			}
+			if (peek() != TokenKind::ASSIGN){ return lval; }
+			take(pos);
+			pending.push_back(Pending::prefix(Pending::ASSIGN, span, lval));
+			pending.push_back(Pending::exp(noPower));
+			return nullptr;
+		}
+		default:
+			return term(span);
+		}
+	}
+
+	/* A term. An lval followed by ASSIGN is an assignExp only where
+	   operand() reads it, not after a MINUS */
+	ExpNode * term(Position& span){
+		Position pos, idSpan;
+		switch (peek()){
+		case TokenKind::ID:
+		case TokenKind::AT: {
+			bool plainID = peek() == TokenKind::ID;
+			LValNode * lval = this->lval(span);
+			if (plainID && peek() == TokenKind::LPAREN){
+				return callExp(static_cast<IDNode *>(lval), span);
+			}
+			return lval;
+		}
+		case TokenKind::INTLITERAL: {
+			Token * tok = take(span);
+			return myInterner->intLit(span,
+				static_cast<IntLitToken *>(tok)->num());
+		}
+		case TokenKind::SHORTLITERAL: {
+			Token * tok = take(span);
+			return myInterner->shortLit(span,
+				static_cast<ShortLitToken *>(tok)->num());
+		}
+		case TokenKind::STRLITERAL: {
+			Token * tok = take(span);
+			return myInterner->strLit(span,
+				static_cast<StrToken *>(tok)->str());
+		}
+		case TokenKind::AMP: {
+			take(pos);
+			IDNode * id = this->id(idSpan);
+			span = Position(pos, idSpan);
+			return new RefNode(new Position(span), id);
+		}
+		case TokenKind::TRUE:
+			take(span);
+			return myInterner->trueLit(span);
+		case TokenKind::FALSE:
+			take(span);
+			return myInterner->falseLit(span);
+		case TokenKind::LPAREN: {
+			take(pos);
+			//Parentheses are not part of the expression's span
+			ExpNode * inner = exp(span);
+			endExp(TokenKind::RPAREN, pos);
+			return inner;
+		}
+		default:
+			unexpected();
+		}
+	}
+
+	Scanner& myScanner;
+	ASTInterner * myInterner;
+	/* The next token, if it has been read */
+	bool myHave;
+	int myTag;
+	Parser::semantic_type myVal;
+	Position myLoc;
+};
+
+}
+
+int parseDescent(Scanner& scanner, ProgramNode ** root,
+	ASTInterner * interner, DeclSink * sink){
+	DescentParser parser(scanner, interner);
+	try {
+		*root = parser.program(sink);
+	} catch (SyntaxFailure * e){
+		delete e;
+		return 1;
+	}
+	return 0;
+}
+
+}
@@ -0,0 +1,31 @@
+#ifndef CMINUSMINUS_DESCENT_HPP
+#define CMINUSMINUS_DESCENT_HPP
+
+#include "ast.hpp"
+#include "intern.hpp"
+
+/*
+A hand-written parser for the grammar in cminusminus.yy, as an
+alternative to the bison one: recursive descent for declarations
+and statements, and precedence climbing (Pratt) for expressions,
+with the binding powers of the grammar's %left/%right/%nonassoc
+declarations. It builds the same AST, with the same spans, through
+the same ASTInterner calls, so everything downstream sees no
+difference. Only the verbose detail of a syntax error differs: it
+names the unexpected token but not everything bison would have
+accepted in its place.
+*/
+
+namespace cminusminus{
+
+class Scanner;
+
+/* Parse everything scanner produces into *root, as Parser::parse
+   does, handing each declaration to sink instead if there is one.
+   Returns 0 on success, or 1 after reporting a syntax error */
+int parseDescent(Scanner& scanner, ProgramNode ** root,
+	ASTInterner * interner, DeclSink * sink);
+
+}
+
+#endif
@@ -7,6 +7,7 @@
 #define TODO(x) throw new ToDoError(CODELOC #x);
 
 #include <iostream>
+#include <vector>
 #include "position.hpp"
 
 namespace cminusminus{
@@ -33,6 +34,19 @@ private:
 };
 
 
+/* This class is used to denote a compilation stopped for going over
+   one of its resource limits (see budget.hpp) */
+class LimitError{
+public:
+	LimitError(const Position& posIn, std::string msgIn)
+	: myPos(posIn), myMsg(msgIn){}
+	const Position& pos() const { return myPos; }
+	std::string msg(){ return myMsg; }
+private:
+	Position myPos;
+	std::string myMsg;
+};
+
 /* Instances of this class are thrown to denote a situation where you
    (the student) probably need to fill in / change some functionality.
    Note that you may need to fill in / change functionality in 
@@ -45,9 +59,58 @@ private:
 	const char * myMsg;
 };
 
+/* A single message produced during compilation, kept as data
+   so that embedders of the compiler can inspect it rather than
+   scraping stderr. str() gives the line cmmc would print. */
+class Diagnostic{
+public:
+	enum Kind { FATAL, SYNTAX, INTERNAL, USER, TODO, WARNING, LIMIT };
+	Diagnostic(Kind kindIn, const Position& posIn, std::string msgIn)
+	: myKind(kindIn), myPos(posIn), myMsg(msgIn){ }
+	Kind kind() const { return myKind; }
+	const Position& pos() const { return myPos; }
+	std::string msg() const { return myMsg; }
+	/* Extra detail that does not go to stderr, such as bison's
+	   verbose description of a syntax error */
+	std::string detail() const { return myDetail; }
+	void setDetail(std::string detailIn){ myDetail = detailIn; }
+	std::string str() const {
+		switch (myKind){
+		case FATAL: return "FATAL " + myPos.span() + ": " + myMsg;
+		case SYNTAX: return "syntax error";
+		case INTERNAL: return "Something in the compiler is broken: "
+			+ myMsg;
+		case USER: return "The user made a mistake: " + myMsg;
+		case TODO: return "ToDo: " + myMsg;
+		case WARNING: return "WARNING " + myPos.span() + ": " + myMsg;
+		//Limits on the input as a whole are at no place in it
+		case LIMIT: return myPos.line() == 0 ? "LIMIT: " + myMsg
+			: "LIMIT " + myPos.span() + ": " + myMsg;
+		}
+		return myMsg;
+	}
+private:
+	Kind myKind;
+	Position myPos;
+	std::string myMsg;
+	std::string myDetail;
+};
+
+/* An ordered collection of the diagnostics from one compilation */
+class Diagnostics{
+public:
+	void add(Diagnostic d){ myDiags.push_back(d); }
+	const std::vector<Diagnostic>& all() const { return myDiags; }
+	bool empty() const { return myDiags.empty(); }
+	void clear(){ myDiags.clear(); }
+private:
+	std::vector<Diagnostic> myDiags;
+};
+
 /* This class is used to encapsulate error messages that the 
    user of the compiler will see in cases where the spec wants 
-   a specific output format. */
+   a specific output format. When given a Diagnostics sink the
+   message is recorded there instead of being written out. */
 class Report{
 public:
 	static void fatal(
@@ -66,6 +129,44 @@ public:
 	){
 		fatal(pos,msg.c_str());
 	}
+
+	static void fatal(
+		Diagnostics * diags,
+		Position * pos,
+		const std::string msg
+	){
+		if (diags == nullptr){ fatal(pos, msg); return; }
+		diags->add(Diagnostic(Diagnostic::FATAL, *pos, msg));
+	}
+
+	/* Something suspect that does not stop the compilation */
+	static void warning(
+		Diagnostics * diags,
+		Position * pos,
+		const std::string msg
+	){
+		Diagnostic d(Diagnostic::WARNING, *pos, msg);
+		if (diags == nullptr){
+			std::cerr << d.str() << std::endl;
+			return;
+		}
+		diags->add(d);
+	}
+
+	static void syntax(
+		Diagnostics * diags,
+		const std::string msg
+	){
+		if (diags == nullptr){
+			std::cout << msg << std::endl;
+			std::cerr << "syntax error" << std::endl;
+			return;
+		}
+		Diagnostic d(Diagnostic::SYNTAX, Position(0,0,0,0),
+			"syntax error");
+		d.setDetail(msg);
+		diags->add(d);
+	}
 };
 
 }
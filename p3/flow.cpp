@@ -0,0 +1,384 @@
+#include <utility>
+#include "flow.hpp"
+#include "symbol_table.hpp"
+
+namespace cminusminus{
+
+FlowBuilder::FlowBuilder(FnDeclNode * fn) : myCurrent(ENTRY){
+	myFlow.fn = fn;
+	myFlow.blocks.resize(2);
+	if (fn->getFormals() != nullptr){
+		//Each formal is stored into on the way in
+		for (FormalDeclNode * formal : *fn->getFormals()){
+			addVar(formal->ID()->getSymbol());
+			def(formal->ID());
+		}
+	}
+}
+
+FunctionFlow FlowBuilder::finish(){
+	edge(myCurrent, EXIT);
+	return std::move(myFlow);
+}
+
+size_t FlowBuilder::newBlock(){
+	myFlow.blocks.push_back(FlowBlock());
+	return myFlow.blocks.size() - 1;
+}
+
+size_t FlowBuilder::addVar(SemSymbol * sym){
+	size_t index = myFlow.vars.size();
+	myFlow.vars.push_back(sym);
+	myFlow.escaped.push_back(false);
+	myVarIndex[sym] = index;
+	return index;
+}
+
+void FlowBuilder::declare(IDNode * id){
+	addVar(id->getSymbol());
+	event(FlowEvent::DECL, id);
+}
+
+void FlowBuilder::addressOf(IDNode * id){
+	auto found = myVarIndex.find(id->getSymbol());
+	if (found != myVarIndex.end()){ myFlow.escaped[found->second] = true; }
+}
+
+void FlowBuilder::event(FlowEvent::Kind kind, IDNode * id){
+	auto found = myVarIndex.find(id->getSymbol());
+	//A global
+	if (found == myVarIndex.end()){ return; }
+	FlowEvent e{kind, found->second, id->pos(), 0};
+	if (kind == FlowEvent::DEF){
+		e.site = myFlow.sites.size();
+		myFlow.sites.push_back(e);
+	}
+	myFlow.blocks[myCurrent].events.push_back(e);
+}
+
+void FlowBuilder::stmts(std::list<StmtNode *> * list){
+	if (list == nullptr){ return; }
+	for (StmtNode * stmt : *list){
+		myWork.then([this, stmt](){ stmt->flow(*this); });
+	}
+}
+
+void FlowBuilder::body(std::list<StmtNode *> * list){
+	myWork.run([this, list](){ stmts(list); });
+}
+
+FunctionFlow buildFlow(FnDeclNode * fn){
+	FlowBuilder fb(fn);
+	fb.body(fn->getBody());
+	return fb.finish();
+}
+
+void VarDeclNode::flow(FlowBuilder& fb){ fb.declare(myId); }
+
+void AssignStmtNode::flow(FlowBuilder& fb){ assignment->flow(fb); }
+
+void CallStmtNode::flow(FlowBuilder& fb){ Function->flow(fb); }
+
+void WriteStmtNode::flow(FlowBuilder& fb){ fb.exp(expression); }
+
+void ReadStmtNode::flow(FlowBuilder& fb){ variable->flowStore(fb); }
+
+void PostIncStmtNode::flow(FlowBuilder& fb){
+	variable->flow(fb);
+	variable->flowStore(fb);
+}
+
+void PostDecStmtNode::flow(FlowBuilder& fb){
+	variable->flow(fb);
+	variable->flowStore(fb);
+}
+
+void ReturnStmtNode::flow(FlowBuilder& fb){
+	if (expression != nullptr){ fb.exp(expression); }
+	fb.then([&fb](){
+		fb.edge(fb.current(), FlowBuilder::EXIT);
+		//Whatever follows is unreachable
+		fb.enter(fb.newBlock());
+	});
+}
+
+void IfStmtNode::flow(FlowBuilder& fb){
+	fb.exp(condition);
+	fb.then([this, &fb](){
+		size_t test = fb.current();
+		size_t body = fb.newBlock();
+		size_t after = fb.newBlock();
+		fb.edge(test, body);
+		fb.edge(test, after);
+		fb.enter(body);
+		fb.stmts(IfBody);
+		fb.then([&fb, after](){
+			fb.edge(fb.current(), after);
+			fb.enter(after);
+		});
+	});
+}
+
+void IfElseStmtNode::flow(FlowBuilder& fb){
+	fb.exp(condition);
+	fb.then([this, &fb](){
+		size_t test = fb.current();
+		size_t onTrue = fb.newBlock();
+		size_t onFalse = fb.newBlock();
+		size_t after = fb.newBlock();
+		fb.edge(test, onTrue);
+		fb.edge(test, onFalse);
+		fb.enter(onTrue);
+		fb.stmts(IfTrueBody);
+		fb.then([&fb, onFalse, after](){
+			fb.edge(fb.current(), after);
+			fb.enter(onFalse);
+		});
+		fb.stmts(IfFalseBody);
+		fb.then([&fb, after](){
+			fb.edge(fb.current(), after);
+			fb.enter(after);
+		});
+	});
+}
+
+void WhileStmtNode::flow(FlowBuilder& fb){
+	size_t head = fb.newBlock();
+	fb.edge(fb.current(), head);
+	fb.enter(head);
+	fb.exp(condition);
+	fb.then([this, &fb, head](){
+		size_t test = fb.current();
+		size_t body = fb.newBlock();
+		size_t after = fb.newBlock();
+		fb.edge(test, body);
+		fb.edge(test, after);
+		fb.enter(body);
+		fb.stmts(WhileBody);
+		fb.then([&fb, head, after](){
+			fb.edge(fb.current(), head);
+			fb.enter(after);
+		});
+	});
+}
+
+void IDNode::flow(FlowBuilder& fb){ fb.use(this); }
+
+void IDNode::flowStore(FlowBuilder& fb){ fb.def(this); }
+
+void DerefNode::flow(FlowBuilder& fb){ myId->flow(fb); }
+
+//A store through the pointer reads the pointer
+void DerefNode::flowStore(FlowBuilder& fb){ myId->flow(fb); }
+
+void IndexNode::flow(FlowBuilder& fb){ Id_being_accessed->flow(fb); }
+
+void IndexNode::flowStore(FlowBuilder& fb){ Id_being_accessed->flow(fb); }
+
+void UnaryExpNode::flow(FlowBuilder& fb){ fb.exp(expression); }
+
+void RefNode::flow(FlowBuilder& fb){
+	if (IDNode * id = dynamic_cast<IDNode *>(expression)){
+		fb.addressOf(id);
+	} else {
+		fb.exp(expression);
+	}
+}
+
+void CallExpNode::flow(FlowBuilder& fb){
+	if (arguments == nullptr){ return; }
+	for (ExpNode * arg : *arguments){ fb.exp(arg); }
+}
+
+void AssignExpNode::flow(FlowBuilder& fb){
+	fb.exp(expression);
+	fb.then([this, &fb](){ variable->flowStore(fb); });
+}
+
+void BinaryExpNode::flow(FlowBuilder& fb){
+	fb.exp(leftNode);
+	fb.exp(rightNode);
+}
+
+/* The right operand of && or || may not be evaluated */
+static void flowShortCircuit(FlowBuilder& fb, ExpNode * left,
+	ExpNode * right){
+	fb.exp(left);
+	fb.then([&fb, right](){
+		size_t test = fb.current();
+		size_t rhs = fb.newBlock();
+		size_t after = fb.newBlock();
+		fb.edge(test, rhs);
+		fb.edge(test, after);
+		fb.enter(rhs);
+		fb.exp(right);
+		fb.then([&fb, after](){
+			fb.edge(fb.current(), after);
+			fb.enter(after);
+		});
+	});
+}
+
+void AndNode::flow(FlowBuilder& fb){
+	flowShortCircuit(fb, leftNode, rightNode);
+}
+
+void OrNode::flow(FlowBuilder& fb){
+	flowShortCircuit(fb, leftNode, rightNode);
+}
+
+/* A problem over flow's blocks with empty gen, kill and boundary */
+static DataflowProblem emptyProblem(const FunctionFlow& flow,
+	DataflowProblem::Direction direction, size_t universe){
+	DataflowProblem problem;
+	problem.direction = direction;
+	problem.meet = DataflowProblem::UNION;
+	problem.universe = universe;
+	for (const FlowBlock& block : flow.blocks){
+		problem.succs.push_back(block.succs);
+	}
+	problem.gen.assign(flow.blocks.size(), BitSet(universe));
+	problem.kill.assign(flow.blocks.size(), BitSet(universe));
+	problem.boundary = BitSet(universe);
+	return problem;
+}
+
+DataflowResult liveVariables(const FunctionFlow& flow){
+	size_t n = flow.vars.size();
+	DataflowProblem problem = emptyProblem(flow,
+		DataflowProblem::BACKWARD, n);
+	for (size_t b = 0; b < flow.blocks.size(); b++){
+		BitSet& gen = problem.gen[b];
+		BitSet& kill = problem.kill[b];
+		const std::vector<FlowEvent>& events = flow.blocks[b].events;
+		for (size_t i = events.size(); i-- > 0; ){
+			size_t v = events[i].var;
+			if (events[i].kind == FlowEvent::USE){
+				gen.add(v);
+				kill.remove(v);
+			} else if (!flow.escaped[v]){
+				gen.remove(v);
+				kill.add(v);
+			}
+		}
+	}
+	for (size_t v = 0; v < n; v++){
+		if (flow.escaped[v]){ problem.boundary.add(v); }
+	}
+	return solveDataflow(problem);
+}
+
+DataflowResult reachingDefinitions(const FunctionFlow& flow){
+	std::vector<std::vector<size_t>> varSites(flow.vars.size());
+	for (const FlowEvent& site : flow.sites){
+		varSites[site.var].push_back(site.site);
+	}
+	DataflowProblem problem = emptyProblem(flow,
+		DataflowProblem::FORWARD, flow.sites.size());
+	for (size_t b = 0; b < flow.blocks.size(); b++){
+		BitSet& gen = problem.gen[b];
+		BitSet& kill = problem.kill[b];
+		for (const FlowEvent& e : flow.blocks[b].events){
+			if (e.kind == FlowEvent::USE){ continue; }
+			//A store, or a fresh declaration, ends every other store
+			for (size_t site : varSites[e.var]){
+				gen.remove(site);
+				kill.add(site);
+			}
+			if (e.kind == FlowEvent::DEF){ gen.add(e.site); }
+		}
+	}
+	return solveDataflow(problem);
+}
+
+DataflowResult maybeUnset(const FunctionFlow& flow){
+	DataflowProblem problem = emptyProblem(flow,
+		DataflowProblem::FORWARD, flow.vars.size());
+	for (size_t b = 0; b < flow.blocks.size(); b++){
+		BitSet& gen = problem.gen[b];
+		BitSet& kill = problem.kill[b];
+		for (const FlowEvent& e : flow.blocks[b].events){
+			if (e.kind == FlowEvent::DECL){
+				gen.add(e.var);
+				kill.remove(e.var);
+			} else if (e.kind == FlowEvent::DEF){
+				gen.remove(e.var);
+				kill.add(e.var);
+			}
+		}
+	}
+	return solveDataflow(problem);
+}
+
+static void forEachFunction(ProgramNode * prog,
+	std::function<void(FnDeclNode *)> f){
+	for (DeclNode * global : *prog->getGlobals()){
+		if (FnDeclNode * fn = dynamic_cast<FnDeclNode *>(global)){ f(fn); }
+	}
+}
+
+void warnUnsetVariables(ProgramNode * prog, Diagnostics * diags){
+	forEachFunction(prog, [&](FnDeclNode * fn){
+		FunctionFlow flow = buildFlow(fn);
+		DataflowResult unset = maybeUnset(flow);
+		std::vector<bool> warned(flow.vars.size(), false);
+		for (size_t b = 0; b < flow.blocks.size(); b++){
+			BitSet now = unset.in[b];
+			for (const FlowEvent& e : flow.blocks[b].events){
+				if (e.kind == FlowEvent::DECL){
+					now.add(e.var);
+				} else if (e.kind == FlowEvent::DEF){
+					now.remove(e.var);
+				} else if (now.has(e.var) && !flow.escaped[e.var]
+					&& !warned[e.var]){
+					warned[e.var] = true;
+					Report::warning(diags, e.pos, flow.vars[e.var]->name()
+						+ " may be used before it is set");
+				}
+			}
+		}
+	});
+}
+
+static void writeVars(std::ostream& out, const char * label,
+	const FunctionFlow& flow, const BitSet& set){
+	out << "\t" << label << ":";
+	set.forEach([&](size_t v){ out << " " << flow.vars[v]->name(); });
+	out << "\n";
+}
+
+static void writeSites(std::ostream& out, const char * label,
+	const FunctionFlow& flow, const BitSet& set){
+	out << "\t" << label << ":";
+	set.forEach([&](size_t s){
+		const FlowEvent& site = flow.sites[s];
+		out << " " << flow.vars[site.var]->name() << site.pos->begin();
+	});
+	out << "\n";
+}
+
+void dumpFlow(ProgramNode * prog, std::ostream& out){
+	forEachFunction(prog, [&](FnDeclNode * fn){
+		FunctionFlow flow = buildFlow(fn);
+		DataflowResult live = liveVariables(flow);
+		DataflowResult reach = reachingDefinitions(flow);
+		DataflowResult unset = maybeUnset(flow);
+		out << "fn " << fn->ID()->getName() << ": " << flow.blocks.size()
+			<< " blocks, " << flow.vars.size() << " variables, "
+			<< flow.sites.size() << " definitions\n";
+		for (size_t b = 0; b < flow.blocks.size(); b++){
+			out << "block " << b;
+			if (b == FlowBuilder::ENTRY){ out << " (entry)"; }
+			if (b == FlowBuilder::EXIT){ out << " (exit)"; }
+			out << " ->";
+			for (size_t s : flow.blocks[b].succs){ out << " " << s; }
+			out << "\n";
+			writeVars(out, "live in", flow, live.in[b]);
+			writeVars(out, "live out", flow, live.out[b]);
+			writeSites(out, "reaching in", flow, reach.in[b]);
+			writeVars(out, "unset in", flow, unset.in[b]);
+		}
+	});
+}
+
+}
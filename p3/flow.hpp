@@ -0,0 +1,127 @@
+#ifndef CMINUSMINUS_FLOW_HPP
+#define CMINUSMINUS_FLOW_HPP
+
+#include <list>
+#include <ostream>
+#include <unordered_map>
+#include <vector>
+#include "ast.hpp"
+#include "dataflow.hpp"
+#include "errors.hpp"
+#include "workstack.hpp"
+
+/*
+Dataflow over the checked AST of one function, on top of
+dataflow.hpp. The function's statement lists become a flow graph of
+blocks, each a list of the reads (uses), stores (defs) and
+declarations of the function's variables in the order they happen.
+Block 0 is the entry and block 1 the exit: a return jumps to the
+exit, if and while branch the usual way, and && and || branch around
+their right operand. The variables are the formals and locals; a
+global is never tracked.
+
+A variable whose address is taken (&x) can be read and stored
+through a pointer, which the graph does not see. Liveness counts such
+a variable as live everywhere, and no warning is given about it.
+*/
+
+namespace cminusminus{
+
+struct FlowEvent{
+	enum Kind { USE, DEF, DECL };
+	Kind kind;
+	size_t var;
+	Position * pos;
+	/* For a DEF, which definition site it is */
+	size_t site;
+};
+
+struct FlowBlock{
+	std::vector<FlowEvent> events;
+	std::vector<size_t> succs;
+};
+
+/* One function's flow graph */
+struct FunctionFlow{
+	FnDeclNode * fn;
+	/* The formals, then the locals as they are declared */
+	std::vector<SemSymbol *> vars;
+	std::vector<bool> escaped;
+	std::vector<FlowBlock> blocks;
+	/* Every DEF event, by site: the formals' come first, as their
+	   values on entry */
+	std::vector<FlowEvent> sites;
+};
+
+/**
+* \class FlowBuilder
+* Builds a FunctionFlow as the function's statements append to it
+* (see StmtNode::flow and ExpNode::flow). Subtrees are queued rather
+* than walked by recursion, so what follows one goes in a step queued
+* after it.
+**/
+class FlowBuilder{
+public:
+	static const size_t ENTRY = 0;
+	static const size_t EXIT = 1;
+
+	FlowBuilder(FnDeclNode * fn);
+	/* The finished graph. The builder is done with after this */
+	FunctionFlow finish();
+
+	void use(IDNode * id){ event(FlowEvent::USE, id); }
+	void def(IDNode * id){ event(FlowEvent::DEF, id); }
+	/* id is declared, holding nothing yet */
+	void declare(IDNode * id);
+	void addressOf(IDNode * id);
+	/* Queue the flow of a list of statements or an expression, or a
+	   step to follow those queued before it */
+	void stmts(std::list<StmtNode *> * list);
+	void exp(ExpNode * exp){
+		myWork.then([this, exp](){ exp->flow(*this); });
+	}
+	void then(WorkStack::Step step){ myWork.then(std::move(step)); }
+	/* Append the flow of a function body, to the end */
+	void body(std::list<StmtNode *> * list);
+
+	/* The block being appended to */
+	size_t current() const { return myCurrent; }
+	size_t newBlock();
+	void edge(size_t from, size_t to){
+		myFlow.blocks[from].succs.push_back(to);
+	}
+	/* Append to block from now on */
+	void enter(size_t block){ myCurrent = block; }
+
+private:
+	void event(FlowEvent::Kind kind, IDNode * id);
+	size_t addVar(SemSymbol * sym);
+
+	FunctionFlow myFlow;
+	std::unordered_map<SemSymbol *, size_t> myVarIndex;
+	size_t myCurrent;
+	WorkStack myWork;
+};
+
+/* The graph of fn, whose names must have been analyzed */
+FunctionFlow buildFlow(FnDeclNode * fn);
+
+/* Backward, over vars: those whose values may yet be read */
+DataflowResult liveVariables(const FunctionFlow& flow);
+/* Forward, over sites: the stores whose values may still be there */
+DataflowResult reachingDefinitions(const FunctionFlow& flow);
+/* Forward, over vars: those that may have been declared and not yet
+   stored into */
+DataflowResult maybeUnset(const FunctionFlow& flow);
+
+/* Warn, once per variable, about each read of a local that may come
+   before anything is stored in it. The program's names must have
+   been analyzed */
+void warnUnsetVariables(ProgramNode * prog, Diagnostics * diags);
+/* Write each function's flow graph, with the sets every analysis
+   gives at the start and end of each block */
+void dumpFlow(ProgramNode * prog, std::ostream& out);
+
+}
+
+#endif
@@ -0,0 +1,228 @@
+#include <algorithm>
+#include <cstdint>
+#include "inliner.hpp"
+
+namespace cminusminus{
+
+namespace {
+
+struct CallSite{
+	size_t caller;
+	/* Index of the CALL in the caller's code */
+	size_t at;
+	size_t callee;
+	/* How many loops the call is inside */
+	size_t depth;
+	/* What inlining it adds to the program, in instructions */
+	size_t growth;
+	double score;
+};
+
+}
+
+/* No procedure bigger than this is inlined anywhere */
+static const size_t maxCalleeSize = 64;
+/* Outside any loop, only procedures this small are worth inlining */
+static const size_t maxColdSize = 12;
+/* Rounds of inlining, each into the result of the one before */
+static const size_t maxRounds = 3;
+
+/* Instructions in proc, not counting labels */
+static size_t sizeOf(const IRProc& proc){
+	size_t size = 0;
+	for (const Instr& instr : proc.code){
+		if (instr.op != IROp::LABEL){ size++; }
+	}
+	return size;
+}
+
+static size_t sizeOf(const IRProgram& prog){
+	size_t size = 0;
+	for (const IRProc& proc : prog.procs){ size += sizeOf(proc); }
+	return size;
+}
+
+/* The loop nesting depth at each instruction of proc: a branch back
+   to an earlier label closes a loop around everything in between */
+static std::vector<size_t> loopDepths(const IRProc& proc){
+	std::vector<size_t> labelAt(proc.numLabels, 0);
+	for (size_t i = 0; i < proc.code.size(); i++){
+		if (proc.code[i].op == IROp::LABEL){
+			labelAt[proc.code[i].a.idx()] = i;
+		}
+	}
+	std::vector<int64_t> delta(proc.code.size() + 1, 0);
+	for (size_t i = 0; i < proc.code.size(); i++){
+		const Instr& instr = proc.code[i];
+		if (!instr.isBranch()){ continue; }
+		size_t start = labelAt[instr.target()];
+		if (start <= i){
+			delta[start]++;
+			delta[i + 1]--;
+		}
+	}
+	std::vector<size_t> depths(proc.code.size());
+	int64_t depth = 0;
+	for (size_t i = 0; i < proc.code.size(); i++){
+		depth += delta[i];
+		depths[i] = static_cast<size_t>(depth);
+	}
+	return depths;
+}
+
+/* Per procedure, whether it can reach itself through calls */
+static std::vector<bool> findRecursive(const IRProgram& prog){
+	size_t n = prog.procs.size();
+	std::vector<std::vector<size_t>> callees(n);
+	for (size_t p = 0; p < n; p++){
+		for (const Instr& instr : prog.procs[p].code){
+			if (instr.op == IROp::CALL){ callees[p].push_back(instr.a.idx()); }
+		}
+	}
+	std::vector<bool> recursive(n, false);
+	for (size_t p = 0; p < n; p++){
+		std::vector<bool> seen(n, false);
+		std::vector<size_t> work(callees[p]);
+		while (!work.empty() && !recursive[p]){
+			size_t q = work.back();
+			work.pop_back();
+			if (q == p){ recursive[p] = true; }
+			if (seen[q]){ continue; }
+			seen[q] = true;
+			work.insert(work.end(), callees[q].begin(), callees[q].end());
+		}
+	}
+	return recursive;
+}
+
+/* The call sites of prog worth inlining, best first */
+static std::vector<CallSite> findSites(const IRProgram& prog){
+	std::vector<bool> recursive = findRecursive(prog);
+	std::vector<CallSite> sites;
+	for (size_t p = 0; p < prog.procs.size(); p++){
+		const IRProc& proc = prog.procs[p];
+		std::vector<size_t> depths = loopDepths(proc);
+		for (size_t i = 0; i < proc.code.size(); i++){
+			const Instr& instr = proc.code[i];
+			if (instr.op != IROp::CALL){ continue; }
+			size_t q = instr.a.idx();
+			const IRProc& callee = prog.procs[q];
+			if (recursive[q] || static_cast<int64_t>(q) == prog.mainProc){
+				continue;
+			}
+			size_t size = sizeOf(callee);
+			size_t depth = depths[i];
+			if (size > maxCalleeSize || (depth == 0 && size > maxColdSize)){
+				continue;
+			}
+			size_t args = 0;
+			while (args < i && proc.code[i - args - 1].op == IROp::ARG){ args++; }
+			if (args != callee.numParams){ continue; }
+			//The copy replaces the CALL; each ARG becomes a copy
+			size_t growth = size > 0 ? size - 1 : 0;
+			double weight = 1;
+			for (size_t d = 0; d < depth && d < 4; d++){ weight *= 10; }
+			double saved = static_cast<double>(callee.numParams + 2);
+			double score = weight * saved / static_cast<double>(growth + 1);
+			sites.push_back(CallSite{p, i, q, depth, growth, score});
+		}
+	}
+	std::stable_sort(sites.begin(), sites.end(),
+		[](const CallSite& x, const CallSite& y){ return x.score > y.score; });
+	return sites;
+}
+
+/* Replace the CALL at index at of caller, and the ARGs before it,
+   with a copy of callee's body */
+static void inlineAt(IRProc& caller, size_t at, const IRProc& callee){
+	const Instr call = caller.code[at];
+	size_t first = at - callee.numParams;
+	size_t temps = caller.numTemps;
+	size_t slots = caller.numSlots;
+	size_t labels = caller.numLabels;
+	caller.numTemps += callee.numTemps;
+	caller.numSlots += callee.numSlots;
+	caller.numLabels += callee.numLabels;
+	Opd done = caller.newLabel();
+	auto rename = [&](Opd opd){
+		switch (opd.kind){
+		case Opd::TEMP: return Opd::temp(temps + opd.idx());
+		case Opd::SLOT: return Opd(Opd::SLOT, static_cast<int64_t>(slots + opd.idx()));
+		case Opd::LABEL: return Opd::label(labels + opd.idx());
+		default: return opd;
+		}
+	};
+
+	std::vector<Instr> body;
+	//Arguments are evaluated before the callee runs, as for a call
+	std::vector<Opd> args(callee.numParams);
+	for (size_t i = first; i < at; i++){
+		const Instr& arg = caller.code[i];
+		args[arg.b.idx()] = caller.newTemp();
+		body.push_back(Instr{IROp::MOV, arg.type, args[arg.b.idx()], arg.a, Opd()});
+	}
+	for (size_t i = 0; i < callee.code.size(); i++){
+		Instr instr = callee.code[i];
+		instr.dst = rename(instr.dst);
+		instr.a = rename(instr.a);
+		instr.b = rename(instr.b);
+		if (instr.op == IROp::GETARG){
+			body.push_back(Instr{IROp::MOV, instr.type, instr.dst,
+				args[callee.code[i].a.idx()], Opd()});
+		} else if (instr.op == IROp::RET){
+			if (!call.dst.isNone() && !instr.a.isNone()){
+				body.push_back(Instr{IROp::MOV, call.type, call.dst, instr.a, Opd()});
+			}
+			if (i + 1 < callee.code.size()){
+				body.push_back(Instr{IROp::JMP, IRType::INT, Opd(), done, Opd()});
+			}
+		} else {
+			body.push_back(instr);
+		}
+	}
+	body.push_back(Instr{IROp::LABEL, IRType::INT, Opd(), done, Opd()});
+
+	std::vector<Instr>& code = caller.code;
+	code.erase(code.begin() + static_cast<std::ptrdiff_t>(first),
+		code.begin() + static_cast<std::ptrdiff_t>(at + 1));
+	code.insert(code.begin() + static_cast<std::ptrdiff_t>(first),
+		body.begin(), body.end());
+}
+
+void inlineCalls(IRProgram * prog, size_t budget, std::ostream * report){
+	size_t startSize = sizeOf(*prog);
+	size_t inlined = 0;
+	for (size_t round = 0; round < maxRounds; round++){
+		std::vector<CallSite> chosen;
+		for (const CallSite& site : findSites(*prog)){
+			if (site.growth > budget){ continue; }
+			budget -= site.growth;
+			chosen.push_back(site);
+		}
+		if (chosen.empty()){ break; }
+
+		//Later sites first, so the indices of earlier ones hold
+		std::sort(chosen.begin(), chosen.end(),
+			[](const CallSite& x, const CallSite& y){
+				return x.caller != y.caller ? x.caller < y.caller : x.at > y.at;
+			});
+		//Every copy is of a callee as it was when the round began
+		const std::vector<IRProc> callees = prog->procs;
+		for (const CallSite& site : chosen){
+			inlineAt(prog->procs[site.caller], site.at, callees[site.callee]);
+			inlined++;
+			if (report != nullptr){
+				*report << "inlined " << callees[site.callee].name
+					<< " into " << callees[site.caller].name
+					<< " (loop depth " << site.depth << ", +"
+					<< site.growth << " instructions)\n";
+			}
+		}
+	}
+	if (report != nullptr){
+		*report << inlined << " calls inlined; program size "
+			<< startSize << " -> " << sizeOf(*prog) << " instructions\n";
+	}
+}
+
+}
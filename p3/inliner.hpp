@@ -0,0 +1,29 @@
+#ifndef CMINUSMINUS_INLINER_HPP
+#define CMINUSMINUS_INLINER_HPP
+
+#include <ostream>
+#include "ir.hpp"
+
+namespace cminusminus{
+
+/*
+Inlining of calls to small procedures, on the IR. Each call site is
+weighed by how often it is likely to run (the loops around it) against
+how much code copying the callee in would add, and the best sites are
+inlined until the program has grown by budget instructions. A
+procedure that can reach itself through the call graph is never
+inlined into anything, so recursion cannot blow up. Inlined bodies
+may have calls of their own inlined in a later round.
+*/
+
+/* Instructions the program may grow by, if not told otherwise */
+const size_t defaultInlineBudget = 256;
+
+/* Inline call sites of prog in place. With report, each inlined call
+   and the overall change in size are written there. */
+void inlineCalls(IRProgram * prog, size_t budget = defaultInlineBudget,
+	std::ostream * report = nullptr);
+
+}
+
+#endif
@@ -0,0 +1,102 @@
+#include "intern.hpp"
+
+namespace cminusminus{
+
+ASTInterner::~ASTInterner(){
+	//Each on its own: a shared node's children are shared too
+	for (const ASTNode * node : myShared){ delete node; }
+}
+
+void ASTInterner::deleteTree(ASTNode * root) const{
+	std::vector<ASTNode *> work;
+	if (root != nullptr){ work.push_back(root); }
+	while (!work.empty()){
+		ASTNode * node = work.back();
+		work.pop_back();
+		if (isShared(node)){ continue; }
+		node->release(work);
+		delete node;
+	}
+}
+
+const std::vector<Position>& ASTInterner::uses(const ASTNode * node) const{
+	static const std::vector<Position> none;
+	auto found = myUses.find(node);
+	return found == myUses.end() ? none : found->second;
+}
+
+TypeNode * ASTInterner::intType(const Position& pos){
+	return leaf(myInt, pos, [&pos](){
+		return new IntTypeNode(new Position(pos));
+	});
+}
+
+TypeNode * ASTInterner::boolType(const Position& pos){
+	return leaf(myBool, pos, [&pos](){
+		return new BoolTypeNode(new Position(pos));
+	});
+}
+
+TypeNode * ASTInterner::voidType(const Position& pos){
+	return leaf(myVoid, pos, [&pos](){
+		return new VoidTypeNode(new Position(pos));
+	});
+}
+
+TypeNode * ASTInterner::stringType(const Position& pos){
+	return leaf(myString, pos, [&pos](){
+		return new StringTypeNode(new Position(pos));
+	});
+}
+
+TypeNode * ASTInterner::shortType(const Position& pos){
+	return leaf(myShort, pos, [&pos](){
+		return new ShortTypeNode(new Position(pos));
+	});
+}
+
+TypeNode * ASTInterner::ptrType(const Position& pos, TypeNode * base){
+	auto make = [&pos, base](){
+		return new PtrTypeNode(new Position(pos), base);
+	};
+	if (!isShared(base)){ return make(); }
+	return leaf(myPtrs[base], pos, make);
+}
+
+ExpNode * ASTInterner::trueLit(const Position& pos){
+	return leaf(myTrue, pos, [&pos](){
+		return new TrueNode(new Position(pos));
+	});
+}
+
+ExpNode * ASTInterner::falseLit(const Position& pos){
+	return leaf(myFalse, pos, [&pos](){
+		return new FalseNode(new Position(pos));
+	});
+}
+
+ExpNode * ASTInterner::intLit(const Position& pos, int val){
+	auto make = [&pos, val](){
+		return new IntLitNode(new Position(pos), val);
+	};
+	if (!myShare){ return make(); }
+	return leaf(myInts[val], pos, make);
+}
+
+ExpNode * ASTInterner::shortLit(const Position& pos, int val){
+	auto make = [&pos, val](){
+		return new ShortLitNode(new Position(pos), val);
+	};
+	if (!myShare){ return make(); }
+	return leaf(myShorts[val], pos, make);
+}
+
+ExpNode * ASTInterner::strLit(const Position& pos, const StrSlice& val){
+	auto make = [&pos, &val](){
+		return new StrLitNode(new Position(pos), val);
+	};
+	if (!myShare){ return make(); }
+	return leaf(myStrs[val], pos, make);
+}
+
+}
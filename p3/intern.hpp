@@ -0,0 +1,171 @@
+#ifndef CMINUSMINUS_INTERN_HPP
+#define CMINUSMINUS_INTERN_HPP
+
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "ast.hpp"
+#include "serialize.hpp"
+
+namespace cminusminus{
+
+/**
+* \class ASTInterner
+* The parser builds type nodes, literals and operator nodes through
+* this class. With sharing off it simply allocates. With sharing on it
+* hash-conses them: the same type, the same literal, or the same
+* operator applied to shared operands (a constant subexpression like
+* (3 * 4)) is built once and reused. Two nodes it shared are
+* structurally equal exactly when they are the same pointer.
+*
+* A shared node's own pos() is that of its first use. The position of
+* each use is carried on the parser's location stack while the tree is
+* built, so every enclosing node still gets its true span, and is kept
+* afterwards in a side record, uses(), in source order.
+*
+* IDNodes are not shared: each use of a name is later bound to its own
+* declaration, which is per-use information.
+*
+* Shared nodes are owned by the interner, and they appear in the tree
+* once per use, so a tree built with sharing on is freed with the
+* interner's deleteTree, before the interner itself.
+**/
+class ASTInterner{
+public:
+	ASTInterner(bool shareIn) : myShare(shareIn), myReused(0){ }
+	/* Deletes the shared nodes */
+	~ASTInterner();
+	ASTInterner(const ASTInterner&) = delete;
+	ASTInterner& operator=(const ASTInterner&) = delete;
+	bool sharing() const { return myShare; }
+
+	/* True if node is a canonical (shared) instance */
+	bool isShared(const ASTNode * node) const {
+		return myShared.count(node) > 0;
+	}
+	/* Number of constructions answered with an existing node */
+	size_t reused() const { return myReused; }
+	/* Number of distinct shared nodes */
+	size_t sharedCount() const { return myShared.size(); }
+	/* The position of each use of a shared node, in source order.
+	   Empty for nodes that are not shared */
+	const std::vector<Position>& uses(const ASTNode * node) const;
+	/* Delete root and everything under it but the shared nodes, which
+	   are left to ~ASTInterner. Iterative, like cminusminus::deleteTree */
+	void deleteTree(ASTNode * root) const;
+
+	TypeNode * intType(const Position& pos);
+	TypeNode * boolType(const Position& pos);
+	TypeNode * voidType(const Position& pos);
+	TypeNode * stringType(const Position& pos);
+	TypeNode * shortType(const Position& pos);
+	TypeNode * ptrType(const Position& pos, TypeNode * base);
+
+	ExpNode * trueLit(const Position& pos);
+	ExpNode * falseLit(const Position& pos);
+	ExpNode * intLit(const Position& pos, int val);
+	ExpNode * shortLit(const Position& pos, int val);
+	ExpNode * strLit(const Position& pos, const StrSlice& val);
+
+	/* An operator node, shared when all of its operands are */
+	template <typename T>
+	ExpNode * unary(NodeKind kind, const Position& pos, ExpNode * exp){
+		return op<T>(OpKey{kind, exp, nullptr}, pos, exp, nullptr);
+	}
+	template <typename T>
+	ExpNode * binary(NodeKind kind, const Position& pos,
+		ExpNode * lhs, ExpNode * rhs){
+		return op<T>(OpKey{kind, lhs, rhs}, pos, lhs, rhs);
+	}
+
+private:
+	struct OpKey{
+		NodeKind kind;
+		const ExpNode * lhs;
+		const ExpNode * rhs;
+		bool operator==(const OpKey& other) const {
+			return kind == other.kind && lhs == other.lhs
+				&& rhs == other.rhs;
+		}
+	};
+	struct OpKeyHash{
+		size_t operator()(const OpKey& key) const {
+			size_t h = std::hash<const void *>()(key.lhs);
+			h = h * 31 + std::hash<const void *>()(key.rhs);
+			return h * 31 + static_cast<size_t>(key.kind);
+		}
+	};
+
+	template <typename T>
+	ExpNode * op(OpKey key, const Position& pos, ExpNode * lhs, ExpNode * rhs){
+		bool constant = myShare && isShared(lhs)
+			&& (rhs == nullptr || isShared(rhs));
+		if (!constant){ return make<T>(pos, lhs, rhs); }
+		auto found = myOps.find(key);
+		if (found != myOps.end()){
+			myReused++;
+			myUses[found->second].push_back(pos);
+			return found->second;
+		}
+		ExpNode * result = make<T>(pos, lhs, rhs);
+		myOps.emplace(key, result);
+		myShared.insert(result);
+		myUses[result].push_back(pos);
+		return result;
+	}
+
+	template <typename T>
+	static ExpNode * make(const Position& pos, ExpNode * lhs, ExpNode * rhs){
+		return build<T>(new Position(pos), lhs, rhs,
+			std::integral_constant<bool,
+				std::is_base_of<UnaryExpNode, T>::value>());
+	}
+	template <typename T>
+	static ExpNode * build(Position * p, ExpNode * lhs, ExpNode *,
+		std::true_type){
+		return new T(p, lhs);
+	}
+	template <typename T>
+	static ExpNode * build(Position * p, ExpNode * lhs, ExpNode * rhs,
+		std::false_type){
+		return new T(p, lhs, rhs);
+	}
+
+	/* Return slot's node, first filling it from make() */
+	template <typename T, typename Make>
+	T * leaf(T *& slot, const Position& pos, Make make){
+		if (!myShare){ return make(); }
+		if (slot != nullptr){
+			myReused++;
+		} else {
+			slot = make();
+			myShared.insert(slot);
+		}
+		myUses[slot].push_back(pos);
+		return slot;
+	}
+
+	bool myShare;
+	size_t myReused;
+	std::unordered_set<const ASTNode *> myShared;
+	std::unordered_map<const ASTNode *, std::vector<Position>> myUses;
+	TypeNode * myInt = nullptr;
+	TypeNode * myBool = nullptr;
+	TypeNode * myVoid = nullptr;
+	TypeNode * myString = nullptr;
+	TypeNode * myShort = nullptr;
+	ExpNode * myTrue = nullptr;
+	ExpNode * myFalse = nullptr;
+	std::unordered_map<const TypeNode *, TypeNode *> myPtrs;
+	std::unordered_map<int, ExpNode *> myInts;
+	std::unordered_map<int, ExpNode *> myShorts;
+	std::unordered_map<StrSlice, ExpNode *, StrSliceHash> myStrs;
+	std::unordered_map<OpKey, ExpNode *, OpKeyHash> myOps;
+};
+
+}
+
+#endif
@@ -0,0 +1,170 @@
+#include <memory>
+#include "errors.hpp"
+#include "vm.hpp"
+
+namespace cminusminus{
+
+/*
+The reference interpreter: it runs the IR as written, decoding every
+operand as it goes, giving each call a fresh heap frame, and
+formatting I/O through the streams. It is slow on purpose: plain
+enough to trust when the VM or a back end disagrees with it.
+*/
+
+namespace {
+
+struct IRFrame{
+	size_t proc;
+	size_t pc;
+	std::unique_ptr<int64_t[]> cells;
+	/* Where the caller wants the result */
+	Opd dst;
+};
+
+}
+
+void interpretIR(const IRProgram& prog, std::istream& in, std::ostream& out){
+	std::vector<std::string> strings;
+	for (const std::string& literal : prog.strings){
+		strings.push_back(stringValue(literal));
+	}
+	std::vector<std::vector<size_t>> labels(prog.procs.size());
+	for (size_t p = 0; p < prog.procs.size(); p++){
+		const IRProc& proc = prog.procs[p];
+		labels[p].resize(proc.numLabels);
+		for (size_t i = 0; i < proc.code.size(); i++){
+			if (proc.code[i].op == IROp::LABEL){
+				labels[p][proc.code[i].a.idx()] = i;
+			}
+		}
+	}
+	std::vector<int64_t> globals(prog.globals.size(), 0);
+	std::vector<int64_t> args;
+	std::vector<IRFrame> frames;
+
+	auto enter = [&](size_t p, Opd dst){
+		const IRProc& proc = prog.procs[p];
+		size_t cells = proc.numTemps + proc.numSlots;
+		frames.push_back(IRFrame{p, 0,
+			std::unique_ptr<int64_t[]>(new int64_t[cells]()), dst});
+	};
+	auto cell = [&](const Opd& opd) -> int64_t& {
+		IRFrame& frame = frames.back();
+		switch (opd.kind){
+		case Opd::TEMP: return frame.cells[opd.idx()];
+		case Opd::SLOT:
+			return frame.cells[prog.procs[frame.proc].numTemps + opd.idx()];
+		case Opd::GLOBAL: return globals[opd.idx()];
+		default: throw new InternalError("Operand is not a cell");
+		}
+	};
+	auto value = [&](const Opd& opd) -> int64_t {
+		switch (opd.kind){
+		case Opd::IMM: return opd.val;
+		case Opd::STR:
+			return reinterpret_cast<int64_t>(strings[opd.idx()].c_str());
+		default: return cell(opd);
+		}
+	};
+	enter(static_cast<size_t>(prog.mainProc), Opd());
+	while (true){
+		IRFrame& frame = frames.back();
+		const Instr& instr = prog.procs[frame.proc].code[frame.pc++];
+		int64_t a = 0;
+		int64_t b = 0;
+		switch (instr.op){
+		case IROp::MOV:
+			cell(instr.dst) = value(instr.a);
+			break;
+		case IROp::ADD:
+			cell(instr.dst) = wrapTo(instr.type, value(instr.a) + value(instr.b));
+			break;
+		case IROp::SUB:
+			cell(instr.dst) = wrapTo(instr.type, value(instr.a) - value(instr.b));
+			break;
+		case IROp::MUL:
+			cell(instr.dst) = wrapTo(instr.type, value(instr.a) * value(instr.b));
+			break;
+		case IROp::DIV:
+			b = value(instr.b);
+			if (b == 0){ throw new UserError("Division by zero"); }
+			cell(instr.dst) = wrapTo(instr.type, value(instr.a) / b);
+			break;
+		case IROp::NEG:
+			cell(instr.dst) = wrapTo(instr.type, -value(instr.a));
+			break;
+		case IROp::NOT:
+			cell(instr.dst) = !value(instr.a);
+			break;
+		case IROp::SEQ: case IROp::SNE: case IROp::SLT:
+		case IROp::SLE: case IROp::SGT: case IROp::SGE:
+		case IROp::BEQ: case IROp::BNE: case IROp::BLT:
+		case IROp::BLE: case IROp::BGT: case IROp::BGE: {
+			a = value(instr.a);
+			b = value(instr.b);
+			bool holds = false;
+			switch (instr.op){
+			case IROp::SEQ: case IROp::BEQ: holds = a == b; break;
+			case IROp::SNE: case IROp::BNE: holds = a != b; break;
+			case IROp::SLT: case IROp::BLT: holds = a < b; break;
+			case IROp::SLE: case IROp::BLE: holds = a <= b; break;
+			case IROp::SGT: case IROp::BGT: holds = a > b; break;
+			default: holds = a >= b; break;
+			}
+			if (instr.op >= IROp::BEQ){
+				if (holds){ frame.pc = labels[frame.proc][instr.target()]; }
+			} else {
+				cell(instr.dst) = holds;
+			}
+			break;
+		}
+		case IROp::ADDR:
+			cell(instr.dst) = reinterpret_cast<int64_t>(&cell(instr.a));
+			break;
+		case IROp::LOAD:
+			cell(instr.dst) = *reinterpret_cast<int64_t *>(value(instr.a));
+			break;
+		case IROp::STORE:
+			*reinterpret_cast<int64_t *>(value(instr.a)) = value(instr.b);
+			break;
+		case IROp::LABEL:
+			break;
+		case IROp::JMP:
+			frame.pc = labels[frame.proc][instr.target()];
+			break;
+		case IROp::ARG:
+			if (args.size() <= instr.b.idx()){ args.resize(instr.b.idx() + 1); }
+			args[instr.b.idx()] = value(instr.a);
+			break;
+		case IROp::CALL:
+			enter(instr.a.idx(), instr.dst);
+			break;
+		case IROp::GETARG:
+			cell(instr.dst) = args[instr.a.idx()];
+			break;
+		case IROp::RET: {
+			a = instr.a.isNone() ? 0 : value(instr.a);
+			Opd dst = frame.dst;
+			frames.pop_back();
+			if (frames.empty()){ return; }
+			if (!dst.isNone()){ cell(dst) = a; }
+			break;
+		}
+		case IROp::WRITE:
+			if (instr.type == IRType::STR){
+				out << reinterpret_cast<const char *>(value(instr.a));
+			} else {
+				out << value(instr.a);
+			}
+			break;
+		case IROp::READ:
+			a = 0;
+			in >> a;
+			if (instr.type == IRType::BOOL){ a = a != 0; }
+			cell(instr.dst) = wrapTo(instr.type, a);
+			break;
+		}
+	}
+}
+
+}
@@ -0,0 +1,148 @@
+#include "ir.hpp"
+#include "strslice.hpp"
+
+namespace cminusminus{
+
+void Instr::uses(std::vector<size_t>& out) const{
+	if (a.isTemp()){ out.push_back(a.idx()); }
+	if (b.isTemp()){ out.push_back(b.idx()); }
+}
+
+int64_t Instr::def() const{
+	switch (op){
+	case IROp::STORE:
+	case IROp::LABEL:
+	case IROp::JMP:
+	case IROp::BEQ: case IROp::BNE: case IROp::BLT:
+	case IROp::BLE: case IROp::BGT: case IROp::BGE:
+	case IROp::ARG:
+	case IROp::RET:
+	case IROp::WRITE:
+		return -1;
+	default:
+		return dst.isTemp() ? dst.val : -1;
+	}
+}
+
+IROp negatedBranch(IROp op){
+	switch (op){
+	case IROp::BEQ: return IROp::BNE;
+	case IROp::BNE: return IROp::BEQ;
+	case IROp::BLT: return IROp::BGE;
+	case IROp::BLE: return IROp::BGT;
+	case IROp::BGT: return IROp::BLE;
+	case IROp::BGE: return IROp::BLT;
+	default: return op;
+	}
+}
+
+IROp swappedBranch(IROp op){
+	switch (op){
+	case IROp::BLT: return IROp::BGT;
+	case IROp::BLE: return IROp::BGE;
+	case IROp::BGT: return IROp::BLT;
+	case IROp::BGE: return IROp::BLE;
+	default: return op;
+	}
+}
+
+std::string stringValue(const std::string& literal){
+	return StrSlice(literal.data(), literal.size()).unescaped();
+}
+
+static const char * opName(IROp op){
+	switch (op){
+	case IROp::MOV: return "mov";
+	case IROp::ADD: return "add";
+	case IROp::SUB: return "sub";
+	case IROp::MUL: return "mul";
+	case IROp::DIV: return "div";
+	case IROp::NEG: return "neg";
+	case IROp::NOT: return "not";
+	case IROp::SEQ: return "seq";
+	case IROp::SNE: return "sne";
+	case IROp::SLT: return "slt";
+	case IROp::SLE: return "sle";
+	case IROp::SGT: return "sgt";
+	case IROp::SGE: return "sge";
+	case IROp::ADDR: return "addr";
+	case IROp::LOAD: return "load";
+	case IROp::STORE: return "store";
+	case IROp::LABEL: return "label";
+	case IROp::JMP: return "jmp";
+	case IROp::BEQ: return "beq";
+	case IROp::BNE: return "bne";
+	case IROp::BLT: return "blt";
+	case IROp::BLE: return "ble";
+	case IROp::BGT: return "bgt";
+	case IROp::BGE: return "bge";
+	case IROp::ARG: return "arg";
+	case IROp::CALL: return "call";
+	case IROp::GETARG: return "getarg";
+	case IROp::RET: return "ret";
+	case IROp::WRITE: return "write";
+	case IROp::READ: return "read";
+	}
+	return "?";
+}
+
+const char * typeName(IRType type){
+	switch (type){
+	case IRType::INT: return "int";
+	case IRType::SHORT: return "short";
+	case IRType::BOOL: return "bool";
+	case IRType::STR: return "str";
+	case IRType::PTR: return "ptr";
+	}
+	return "?";
+}
+
+static void printOpd(const IRProgram& prog, const Opd& opd, std::ostream& out){
+	switch (opd.kind){
+	case Opd::NONE: out << "_"; return;
+	case Opd::TEMP: out << "t" << opd.val; return;
+	case Opd::IMM: out << opd.val; return;
+	case Opd::GLOBAL: out << "[" << prog.globals[opd.idx()] << "]"; return;
+	case Opd::SLOT: out << "[slot" << opd.val << "]"; return;
+	case Opd::STR: out << "str" << opd.val; return;
+	case Opd::LABEL: out << "L" << opd.val; return;
+	case Opd::PROC: out << prog.procs[opd.idx()].name; return;
+	}
+}
+
+void printInstr(const IRProgram& prog, const Instr& instr, std::ostream& out){
+	if (instr.op == IROp::LABEL){
+		printOpd(prog, instr.a, out);
+		out << ":";
+		return;
+	}
+	out << "\t" << opName(instr.op) << "." << typeName(instr.type);
+	const Opd * opds[3] = { &instr.dst, &instr.a, &instr.b };
+	std::string sep = " ";
+	for (const Opd * opd : opds){
+		if (opd->isNone()){ continue; }
+		out << sep;
+		printOpd(prog, *opd, out);
+		sep = ", ";
+	}
+}
+
+void printIR(const IRProgram& prog, std::ostream& out){
+	for (size_t i = 0; i < prog.globals.size(); i++){
+		out << "global " << prog.globals[i] << "\n";
+	}
+	for (size_t i = 0; i < prog.strings.size(); i++){
+		out << "str" << i << " = " << prog.strings[i] << "\n";
+	}
+	for (const IRProc& proc : prog.procs){
+		out << "\nproc " << proc.name << " (" << proc.numParams
+			<< " params, " << proc.numTemps << " temps, "
+			<< proc.numSlots << " slots)\n";
+		for (const Instr& instr : proc.code){
+			printInstr(prog, instr, out);
+			out << "\n";
+		}
+	}
+}
+
+}
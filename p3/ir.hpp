@@ -0,0 +1,169 @@
+#ifndef CMINUSMINUS_IR_HPP
+#define CMINUSMINUS_IR_HPP
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/*
+A linear three-address IR that the back ends work from. Each
+procedure is a flat list of instructions over an unbounded set of
+virtual registers (temps). Control flow is by labels and jumps.
+
+Every variable occupies one 8-byte cell, and values are held
+sign-extended to 64 bits: an int or short result is renormalized
+after each arithmetic instruction, so overflow wraps at the type's
+width. A local whose address is never taken lives in a temp;
+one whose address is taken (&x) lives in a stack slot instead.
+*/
+
+namespace cminusminus{
+
+class ProgramNode;
+class TypeAnalysis;
+
+/* What a value is, where that matters: arithmetic wraps at INT
+   or SHORT width, and write prints each kind differently */
+enum class IRType : uint8_t { INT, SHORT, BOOL, STR, PTR };
+
+/**
+* \class Opd
+* An instruction operand. GLOBAL and SLOT name memory cells; the
+* others are values.
+**/
+class Opd{
+public:
+	enum Kind : uint8_t {
+		NONE,
+		TEMP,   /* virtual register val */
+		IMM,    /* the constant val */
+		GLOBAL, /* global variable val (an IRProgram::globals index) */
+		SLOT,   /* stack cell val of the current procedure */
+		STR,    /* address of string literal val */
+		LABEL,  /* label val of the current procedure */
+		PROC    /* procedure val (an IRProgram::procs index) */
+	};
+	Opd() : kind(NONE), val(0){ }
+	Opd(Kind kindIn, int64_t valIn) : kind(kindIn), val(valIn){ }
+	static Opd temp(size_t t){ return Opd(TEMP, static_cast<int64_t>(t)); }
+	static Opd imm(int64_t v){ return Opd(IMM, v); }
+	static Opd label(size_t l){ return Opd(LABEL, static_cast<int64_t>(l)); }
+
+	bool isNone() const { return kind == NONE; }
+	bool isTemp() const { return kind == TEMP; }
+	bool isImm() const { return kind == IMM; }
+	bool isMem() const { return kind == GLOBAL || kind == SLOT; }
+	/* The index held by a TEMP, GLOBAL, SLOT, STR, LABEL or PROC */
+	size_t idx() const { return static_cast<size_t>(val); }
+
+	bool operator==(const Opd& other) const {
+		return kind == other.kind && val == other.val;
+	}
+	bool operator!=(const Opd& other) const { return !(*this == other); }
+
+	Kind kind;
+	int64_t val;
+};
+
+enum class IROp : uint8_t {
+	MOV,       /* dst = a. Either side may be a memory cell */
+	ADD, SUB, MUL, DIV,   /* dst = a op b, wrapped to type */
+	NEG,       /* dst = -a, wrapped to type */
+	NOT,       /* dst = !a */
+	SEQ, SNE, SLT, SLE, SGT, SGE,   /* dst = (a cmp b) ? 1 : 0 */
+	ADDR,      /* dst = address of memory cell a */
+	LOAD,      /* dst = *a */
+	STORE,     /* *a = b */
+	LABEL,     /* a is a LABEL */
+	JMP,       /* goto label a */
+	BEQ, BNE, BLT, BLE, BGT, BGE,   /* if (a cmp b) goto label dst */
+	ARG,       /* outgoing argument number b.val is a */
+	CALL,      /* dst = call procedure a (dst may be NONE) */
+	GETARG,    /* dst = incoming argument number a.val */
+	RET,       /* return a (which may be NONE) */
+	WRITE,     /* print a, formatted by type */
+	READ       /* dst = a value of type read from input */
+};
+
+struct Instr{
+	IROp op;
+	IRType type;
+	Opd dst;
+	Opd a;
+	Opd b;
+
+	/* The temps this instruction reads */
+	void uses(std::vector<size_t>& out) const;
+	/* The temp this instruction writes, or -1 */
+	int64_t def() const;
+	bool isBranch() const {
+		return op == IROp::JMP || (op >= IROp::BEQ && op <= IROp::BGE);
+	}
+	/* The label a branch goes to */
+	size_t target() const {
+		return op == IROp::JMP ? a.idx() : dst.idx();
+	}
+};
+
+struct IRProc{
+	std::string name;
+	size_t numParams = 0;
+	size_t numTemps = 0;
+	size_t numSlots = 0;
+	size_t numLabels = 0;
+	bool returnsValue = false;
+	std::vector<Instr> code;
+
+	Opd newTemp(){ return Opd::temp(numTemps++); }
+	Opd newSlot(){ return Opd(Opd::SLOT, static_cast<int64_t>(numSlots++)); }
+	Opd newLabel(){ return Opd::label(numLabels++); }
+	void emit(IROp op, IRType type, Opd dst, Opd a = Opd(), Opd b = Opd()){
+		code.push_back(Instr{op, type, dst, a, b});
+	}
+};
+
+struct IRProgram{
+	std::vector<std::string> globals;
+	/* String literals, as written in the source (quoted) */
+	std::vector<std::string> strings;
+	std::vector<IRProc> procs;
+	/* Index of the procedure named main, or -1 */
+	int64_t mainProc = -1;
+};
+
+/* v wrapped to the width of type */
+inline int64_t wrapTo(IRType type, int64_t v){
+	uint64_t bits = static_cast<uint64_t>(v);
+	if (type == IRType::INT){
+		return static_cast<int32_t>(static_cast<uint32_t>(bits));
+	}
+	if (type == IRType::SHORT){
+		return static_cast<int16_t>(static_cast<uint16_t>(bits));
+	}
+	return v;
+}
+
+/* The branch taken exactly when branch op is not */
+IROp negatedBranch(IROp op);
+/* The branch that tests the same thing as op with a and b swapped */
+IROp swappedBranch(IROp op);
+
+/* The characters a string literal (as in IRProgram::strings)
+   stands for, quotes removed and escapes applied */
+std::string stringValue(const std::string& literal);
+
+/* Lower a program that has passed type analysis. Throws
+   UserError if it has no main function */
+IRProgram * lowerProgram(ProgramNode * ast, const TypeAnalysis * types);
+
+/* Write a readable listing of the IR, one instruction per line */
+void printIR(const IRProgram& prog, std::ostream& out);
+/* Write one instruction of prog as printIR does, without a newline */
+void printInstr(const IRProgram& prog, const Instr& instr, std::ostream& out);
+/* The name printIR gives type */
+const char * typeName(IRType type);
+
+}
+
+#endif
@@ -0,0 +1,261 @@
+#include "lexprof.hpp"
+
+#ifdef CMM_PROFILE_LEXER
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <string>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace cminusminus{
+
+namespace {
+
+struct RuleCounts{
+	uint64_t matches;
+	uint64_t bytes;
+	uint64_t cycles;
+};
+
+#if defined(__x86_64__) || defined(__i386__)
+const char clockUnit[] = "tsc";
+uint64_t readClock(){ return __rdtsc(); }
+#else
+const char clockUnit[] = "ns";
+uint64_t readClock(){
+	return static_cast<uint64_t>(
+		std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+#endif
+
+/* Counts are kept by flex's rule number: slot 0 is unused, the slot
+   after the last rule is for flex's default rule, and the one after
+   that for any number past it, which flex should never give */
+size_t slotCount(){ return lexRuleCount + 3; }
+size_t straySlot(){ return lexRuleCount + 2; }
+
+std::string patternOf(size_t rule){
+	if (rule <= lexRuleCount){ return lexRuleNames[rule - 1]; }
+	return rule < straySlot() ? "(default)" : "(no such rule)";
+}
+
+std::string jsonString(const std::string& text){
+	std::string quoted = "\"";
+	for (char c : text){
+		if (c == '"' || c == '\\'){
+			quoted += '\\';
+			quoted += c;
+		} else if (static_cast<unsigned char>(c) < 0x20){
+			char escape[8];
+			std::snprintf(escape, sizeof(escape), "\\u%04x", c);
+			quoted += escape;
+		} else {
+			quoted += c;
+		}
+	}
+	return quoted + "\"";
+}
+
+double percent(uint64_t part, uint64_t whole){
+	return whole == 0 ? 0.0 : 100.0 * static_cast<double>(part)
+		/ static_cast<double>(whole);
+}
+
+/* The options, and the counts of every thread that has finished */
+class Profile{
+public:
+	Profile() : json(false), cycles(false), myTotals(slotCount()){
+		const char * spec = std::getenv("CMM_LEX_PROFILE");
+		std::string options = spec == nullptr ? "" : spec;
+		size_t start = 0;
+		while (start < options.size()){
+			size_t end = options.find(',', start);
+			if (end == std::string::npos){ end = options.size(); }
+			std::string option = options.substr(start, end - start);
+			if (option == "json"){
+				json = true;
+			} else if (option == "cycles"){
+				cycles = true;
+			} else if (option.compare(0, 4, "out=") == 0){
+				outPath = option.substr(4);
+			} else if (!option.empty()){
+				std::fprintf(stderr, "CMM_LEX_PROFILE: no option %s\n",
+					option.c_str());
+			}
+			start = end + 1;
+		}
+	}
+	~Profile(){ write(); }
+
+	void add(const std::vector<RuleCounts>& counts){
+		std::lock_guard<std::mutex> guard(myLock);
+		for (size_t i = 0; i < counts.size(); i++){
+			myTotals[i].matches += counts[i].matches;
+			myTotals[i].bytes += counts[i].bytes;
+			myTotals[i].cycles += counts[i].cycles;
+		}
+	}
+
+	bool json;
+	bool cycles;
+	std::string outPath;
+private:
+	void write();
+	void writeTable(std::FILE * out, const RuleCounts& total);
+	void writeJSON(std::FILE * out, const RuleCounts& total);
+
+	std::mutex myLock;
+	std::vector<RuleCounts> myTotals;
+};
+
+void Profile::write(){
+	std::FILE * out = stderr;
+	if (!outPath.empty()){
+		out = std::fopen(outPath.c_str(), "w");
+		if (out == nullptr){
+			std::fprintf(stderr, "Cannot write the lexer profile to %s\n",
+				outPath.c_str());
+			out = stderr;
+		}
+	}
+	RuleCounts total{0, 0, 0};
+	for (const RuleCounts& counts : myTotals){
+		total.matches += counts.matches;
+		total.bytes += counts.bytes;
+		total.cycles += counts.cycles;
+	}
+	if (json){
+		writeJSON(out, total);
+	} else {
+		writeTable(out, total);
+	}
+	if (out != stderr){ std::fclose(out); }
+	if (myTotals[straySlot()].matches != 0){
+		std::fprintf(stderr, "The lexer matched rules past those in "
+			"cminusminus.l, so the profile's patterns may be wrong\n");
+	}
+}
+
+void Profile::writeTable(std::FILE * out, const RuleCounts& total){
+	std::vector<size_t> rules;
+	for (size_t rule = 1; rule < myTotals.size(); rule++){
+		//Past the rules, a slot only gets a row if it ever matched
+		if (rule <= lexRuleCount || myTotals[rule].matches != 0){
+			rules.push_back(rule);
+		}
+	}
+	//Busiest first: by cycles if they were counted, else by matches
+	std::stable_sort(rules.begin(), rules.end(), [&](size_t x, size_t y){
+		const RuleCounts& a = myTotals[x];
+		const RuleCounts& b = myTotals[y];
+		if (cycles && a.cycles != b.cycles){ return a.cycles > b.cycles; }
+		return a.matches > b.matches;
+	});
+	std::fprintf(out, "%12s %6s %14s %6s", "matches", "%", "bytes", "%");
+	if (cycles){
+		std::fprintf(out, " %16s %6s %10s", clockUnit, "%", "per match");
+	}
+	std::fprintf(out, " %5s  %s\n", "rule", "pattern");
+	for (size_t rule : rules){
+		const RuleCounts& counts = myTotals[rule];
+		std::fprintf(out, "%12llu %6.2f %14llu %6.2f",
+			static_cast<unsigned long long>(counts.matches),
+			percent(counts.matches, total.matches),
+			static_cast<unsigned long long>(counts.bytes),
+			percent(counts.bytes, total.bytes));
+		if (cycles){
+			double each = counts.matches == 0 ? 0.0
+				: static_cast<double>(counts.cycles)
+				/ static_cast<double>(counts.matches);
+			std::fprintf(out, " %16llu %6.2f %10.1f",
+				static_cast<unsigned long long>(counts.cycles),
+				percent(counts.cycles, total.cycles), each);
+		}
+		std::fprintf(out, " %5zu  %s\n", rule, patternOf(rule).c_str());
+	}
+	std::fprintf(out, "%12llu %6s %14llu %6s",
+		static_cast<unsigned long long>(total.matches), "",
+		static_cast<unsigned long long>(total.bytes), "");
+	if (cycles){
+		std::fprintf(out, " %16llu %6s %10s",
+			static_cast<unsigned long long>(total.cycles), "", "");
+	}
+	std::fprintf(out, " %5s  %s\n", "", "total");
+}
+
+void Profile::writeJSON(std::FILE * out, const RuleCounts& total){
+	std::fprintf(out, "{\n");
+	if (cycles){ std::fprintf(out, "  \"clock\": \"%s\",\n", clockUnit); }
+	std::fprintf(out, "  \"rules\": [");
+	const char * sep = "\n";
+	for (size_t rule = 1; rule < myTotals.size(); rule++){
+		const RuleCounts& counts = myTotals[rule];
+		if (rule > lexRuleCount && counts.matches == 0){ continue; }
+		std::fprintf(out, "%s    {\"rule\": %zu, \"pattern\": %s, "
+			"\"matches\": %llu, \"bytes\": %llu", sep, rule,
+			jsonString(patternOf(rule)).c_str(),
+			static_cast<unsigned long long>(counts.matches),
+			static_cast<unsigned long long>(counts.bytes));
+		if (cycles){
+			std::fprintf(out, ", \"cycles\": %llu",
+				static_cast<unsigned long long>(counts.cycles));
+		}
+		std::fprintf(out, "}");
+		sep = ",\n";
+	}
+	std::fprintf(out, "\n  ],\n  \"total\": {\"matches\": %llu, "
+		"\"bytes\": %llu",
+		static_cast<unsigned long long>(total.matches),
+		static_cast<unsigned long long>(total.bytes));
+	if (cycles){
+		std::fprintf(out, ", \"cycles\": %llu",
+			static_cast<unsigned long long>(total.cycles));
+	}
+	std::fprintf(out, "}\n}\n");
+}
+
+/* Made before main, so it outlives every thread's counts, and reports
+   once they are all in */
+Profile profile;
+
+/* One thread's counts, added to the profile when the thread ends */
+struct ThreadCounts{
+	ThreadCounts() : counts(slotCount()), mark(0){ }
+	~ThreadCounts(){ profile.add(counts); }
+	std::vector<RuleCounts> counts;
+	uint64_t mark;
+};
+
+thread_local ThreadCounts threadCounts;
+
+}
+
+void lexScanStarted(){
+	if (profile.cycles){ threadCounts.mark = readClock(); }
+}
+
+void lexRuleMatched(int rule, size_t bytes){
+	ThreadCounts& mine = threadCounts;
+	size_t slot = rule > 0 && static_cast<size_t>(rule) <= lexRuleCount + 1
+		? static_cast<size_t>(rule) : straySlot();
+	RuleCounts& counts = mine.counts[slot];
+	counts.matches++;
+	counts.bytes += bytes;
+	if (profile.cycles){
+		uint64_t now = readClock();
+		counts.cycles += now - mine.mark;
+		mine.mark = now;
+	}
+}
+
+}
+
+#endif
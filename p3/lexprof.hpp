@@ -0,0 +1,66 @@
+#ifndef CMINUSMINUS_LEXPROF_HPP
+#define CMINUSMINUS_LEXPROF_HPP
+
+#include <cstddef>
+
+/*
+The lexer profiler, built in by make PROFILE_LEXER=1 (which defines
+CMM_PROFILE_LEXER; rebuild from clean when switching). It counts how
+many times each rule of cminusminus.l matched and how many bytes its
+matches took, and at exit writes them to stderr, busiest rule first.
+
+The environment variable CMM_LEX_PROFILE takes a comma-separated list
+of options:
+	json         write JSON rather than a table
+	cycles       also count cycles (the time stamp counter on x86,
+	             nanoseconds elsewhere) for each rule
+	out=<path>   write to the file at path rather than stderr
+
+A rule's cycles are those from where the scanner started looking for
+a match to when it found one: the DFA's walk over the text, plus the
+action of any rule before it that returned no token (whitespace,
+newlines and comments, whose actions are a line or two). Reading the
+counter on every match costs a few dozen cycles, which is why it is
+off unless asked for.
+
+Rules are told apart by flex's number for them (yy_act), which runs
+from 1 in the order of the rules, the default rule last. Their patterns
+are read out of cminusminus.l in that order by lexrules.awk, and the
+build fails unless there is one for each of flex's YY_NUM_RULES. A
+number past them all is counted as "(no such rule)", with a warning.
+
+Lexing on several threads is fine: each counts on its own, and its
+counts are added in when it finishes.
+
+Without CMM_PROFILE_LEXER all of this compiles to nothing.
+*/
+
+#ifdef CMM_PROFILE_LEXER
+
+namespace cminusminus{
+
+/* Each rule's pattern, in the order of the rules, defined with them in
+   cminusminus.l from lexrules.inc. Rule n (flex's yy_act) is
+   lexRuleNames[n - 1] */
+extern const char * const lexRuleNames[];
+extern const size_t lexRuleCount;
+
+/* The scanner is looking for a match, from the start of yylex */
+void lexScanStarted();
+/* Rule matched bytes of input */
+void lexRuleMatched(int rule, size_t bytes);
+
+}
+
+#define CMM_LEX_SCAN_STARTED() cminusminus::lexScanStarted()
+#define CMM_LEX_RULE_MATCHED(rule, bytes) \
+	cminusminus::lexRuleMatched(rule, bytes)
+
+#else
+
+#define CMM_LEX_SCAN_STARTED()
+#define CMM_LEX_RULE_MATCHED(rule, bytes)
+
+#endif
+
+#endif
@@ -0,0 +1,58 @@
+# Writes the patterns of cminusminus.l's rules as C string literals, one per
+# line, in the order flex numbers the rules (see lexprof.hpp). A rule starts
+# in column 0 of the rules section; its pattern ends at the first blank
+# outside brackets and quotes, and its action runs until its braces close.
+
+function cstring(text,    out, i, c){
+	out = ""
+	for (i = 1; i <= length(text); i++){
+		c = substr(text, i, 1)
+		if (c == "\\" || c == "\"") out = out "\\"
+		out = out c
+	}
+	return "\"" out "\""
+}
+
+# The braces an action opens, less those it closes, skipping C literals
+function depth(code,    d, i, c, quote){
+	d = 0
+	quote = ""
+	for (i = 1; i <= length(code); i++){
+		c = substr(code, i, 1)
+		if (quote != ""){
+			if (c == "\\") i++
+			else if (c == quote) quote = ""
+		} else if (c == "\"" || c == "'"){
+			quote = c
+		} else if (c == "{"){
+			d++
+		} else if (c == "}"){
+			d--
+		}
+	}
+	return d
+}
+
+/^%%/ { section++; next }
+section != 1 { next }
+/^%\{/ { code = 1; next }
+/^%\}/ { code = 0; next }
+code { next }
+open > 0 { open += depth($0); next }
+/^[ \t]/ || /^$/ { next }
+{
+	bracket = 0
+	quote = 0
+	for (i = 1; i <= length($0); i++){
+		c = substr($0, i, 1)
+		if (c == "\\"){ i++; continue }
+		if (quote){ if (c == "\"") quote = 0; continue }
+		if (bracket){ if (c == "]") bracket = 0; continue }
+		if (c == "\"") quote = 1
+		else if (c == "[") bracket = 1
+		else if (c == " " || c == "\t") break
+	}
+	pattern = substr($0, 1, i - 1)
+	print "\t" cstring(pattern) ","
+	open = depth(substr($0, i))
+}
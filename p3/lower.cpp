@@ -0,0 +1,604 @@
+#include <unordered_map>
+#include <unordered_set>
+#include "ast.hpp"
+#include "errors.hpp"
+#include "ir.hpp"
+#include "symbol_table.hpp"
+#include "type_analysis.hpp"
+#include "workstack.hpp"
+
+namespace cminusminus{
+
+/*
+Lowering from the checked AST to the IR of ir.hpp. Expressions
+push the operand holding their value onto the builder's value stack;
+conditions in if and while lower straight to compare-and-branch, and
+and/or short-circuit. Subtrees are queued on a WorkStack rather than
+lowered by recursion, so the code that follows one goes in a step
+queued after it.
+
+A local lives in a temp unless its address is taken. That is only
+discovered when the &x is reached, after x may already have been
+used, so a function where it happens is simply lowered again with
+those locals moved to stack slots.
+*/
+
+/**
+* \class IRBuilder
+* The state of lowering: the program being built, the procedure
+* being appended to, where each variable lives, and the walk.
+**/
+class IRBuilder{
+public:
+	IRBuilder(IRProgram * progIn, const TypeAnalysis * typesIn)
+	: prog(progIn), proc(nullptr), myTypes(typesIn), myFnTypes(nullptr){ }
+
+	IRProgram * prog;
+	IRProc * proc;
+
+	void emit(IROp op, IRType type, Opd dst, Opd a = Opd(), Opd b = Opd()){
+		proc->emit(op, type, dst, a, b);
+	}
+
+	IRType typeOf(ExpNode * exp) const {
+		return irType(myFnTypes->nodeType(exp));
+	}
+	static IRType irType(DataType type){
+		if (type.isPtr()){ return IRType::PTR; }
+		switch (type.base()){
+		case DataType::SHORT: return IRType::SHORT;
+		case DataType::BOOL: return IRType::BOOL;
+		case DataType::STRING: return IRType::STR;
+		default: return IRType::INT;
+		}
+	}
+
+	/* Where a variable lives */
+	Opd var(SemSymbol * sym) const {
+		auto found = myVars.find(sym);
+		if (found == myVars.end()){
+			throw new InternalError("Variable used before lowering");
+		}
+		return found->second;
+	}
+	void bindVar(SemSymbol * sym, Opd loc){ myVars[sym] = loc; }
+
+	/* Give a new local a temp, or a slot if its address is taken */
+	void declareLocal(SemSymbol * sym){
+		if (myAddressed.count(sym) > 0){
+			bindVar(sym, proc->newSlot());
+		} else {
+			bindVar(sym, proc->newTemp());
+		}
+	}
+	/* Note that a local in a temp had its address taken, so its
+	   function must be lowered again */
+	void needsSlot(SemSymbol * sym){
+		myAddressed.insert(sym);
+		myRetry = true;
+	}
+
+	Opd procOf(SemSymbol * sym) const {
+		return Opd(Opd::PROC, myProcs.at(sym));
+	}
+	void bindProc(SemSymbol * sym, size_t idx){
+		myProcs[sym] = static_cast<int64_t>(idx);
+	}
+
+	/* Queue the lowering of a subtree, or a step to follow those
+	   queued before it */
+	void value(ExpNode * exp){
+		myWork.then([this, exp](){ exp->lower(*this); });
+	}
+	void branch(ExpNode * exp, Opd label, bool onTrue){
+		myWork.then([this, exp, label, onTrue](){
+			exp->lowerBranch(*this, label, onTrue);
+		});
+	}
+	void stmt(StmtNode * stmt){
+		myWork.then([this, stmt](){ stmt->lower(*this); });
+	}
+	void then(WorkStack::Step step){ myWork.then(std::move(step)); }
+
+	/* The values of lowered expressions, last on top */
+	void push(Opd val){ myValues.push_back(val); }
+	Opd pop(){
+		Opd val = myValues.back();
+		myValues.pop_back();
+		return val;
+	}
+
+	Opd str(const std::string& text){
+		auto found = myStrings.find(text);
+		if (found != myStrings.end()){ return found->second; }
+		Opd result(Opd::STR, static_cast<int64_t>(prog->strings.size()));
+		prog->strings.push_back(text);
+		myStrings.emplace(text, result);
+		return result;
+	}
+
+	/* Lower fn into procs[idx], redoing it if it takes addresses */
+	void lowerFn(FnDeclNode * fn, size_t idx){
+		myFnTypes = myTypes->fnTypes(fn);
+		myAddressed.clear();
+		do {
+			myRetry = false;
+			IRProc fresh;
+			fresh.name = prog->procs[idx].name;
+			prog->procs[idx] = fresh;
+			proc = &prog->procs[idx];
+			myValues.clear();
+			myWork.run([this, fn](){ fn->lower(*this); });
+		} while (myRetry);
+	}
+
+private:
+	const TypeAnalysis * myTypes;
+	const TypeAnalysis * myFnTypes;
+	std::unordered_map<const SemSymbol *, Opd> myVars;
+	std::unordered_map<const SemSymbol *, int64_t> myProcs;
+	std::unordered_map<std::string, Opd> myStrings;
+	std::unordered_set<const SemSymbol *> myAddressed;
+	bool myRetry = false;
+	WorkStack myWork;
+	std::vector<Opd> myValues;
+};
+
+IRProgram * lowerProgram(ProgramNode * ast, const TypeAnalysis * types){
+	IRProgram * prog = new IRProgram();
+	IRBuilder ir(prog, types);
+
+	//Give every global a home first, so that any function may
+	// refer to any other
+	std::vector<std::pair<FnDeclNode *, size_t>> fns;
+	for (DeclNode * global : *ast->getGlobals()){
+		if (FnDeclNode * fn = dynamic_cast<FnDeclNode *>(global)){
+			size_t idx = prog->procs.size();
+			prog->procs.push_back(IRProc());
+			prog->procs[idx].name = fn->ID()->getName();
+			ir.bindProc(fn->ID()->getSymbol(), idx);
+			if (fn->ID()->getName() == "main"){
+				prog->mainProc = static_cast<int64_t>(idx);
+			}
+			fns.emplace_back(fn, idx);
+		} else if (VarDeclNode * var = dynamic_cast<VarDeclNode *>(global)){
+			Opd loc(Opd::GLOBAL, static_cast<int64_t>(prog->globals.size()));
+			prog->globals.push_back(var->ID()->getName());
+			ir.bindVar(var->ID()->getSymbol(), loc);
+		}
+	}
+	if (prog->mainProc < 0){
+		throw new UserError("No main function");
+	}
+	for (auto& fn : fns){
+		ir.lowerFn(fn.first, fn.second);
+	}
+	return prog;
+}
+
+static void lowerBody(std::list<StmtNode *> * body, IRBuilder& ir){
+	if (body == nullptr){ return; }
+	for (StmtNode * stmt : *body){ ir.stmt(stmt); }
+}
+
+void FnDeclNode::lower(IRBuilder& ir){
+	IRType ret = IRBuilder::irType(myType->getType());
+	ir.proc->returnsValue = !myType->getType().isVoid();
+	size_t argIdx = 0;
+	if (parameters != nullptr){
+		for (FormalDeclNode * formal : *parameters){
+			SemSymbol * sym = formal->ID()->getSymbol();
+			ir.declareLocal(sym);
+			Opd loc = ir.var(sym);
+			IRType type = IRBuilder::irType(formal->getTypeNode()->getType());
+			Opd idx = Opd::imm(static_cast<int64_t>(argIdx++));
+			if (loc.isTemp()){
+				ir.emit(IROp::GETARG, type, loc, idx);
+			} else {
+				Opd tmp = ir.proc->newTemp();
+				ir.emit(IROp::GETARG, type, tmp, idx);
+				ir.emit(IROp::MOV, type, loc, tmp);
+			}
+		}
+	}
+	ir.proc->numParams = argIdx;
+	lowerBody(functionBody, ir);
+	//Falling off the end returns (zero, for a non-void function)
+	ir.then([&ir, ret](){
+		ir.emit(IROp::RET, ret, Opd(),
+			ir.proc->returnsValue ? Opd::imm(0) : Opd());
+	});
+}
+
+void VarDeclNode::lower(IRBuilder& ir){
+	ir.declareLocal(myId->getSymbol());
+}
+
+void AssignStmtNode::lower(IRBuilder& ir){
+	assignment->lower(ir);
+	ir.then([&ir](){ ir.pop(); });
+}
+
+void CallStmtNode::lower(IRBuilder& ir){
+	Function->lower(ir);
+	ir.then([&ir](){ ir.pop(); });
+}
+
+/* x++ or x--. A variable held in a temp is stepped in place */
+static void lowerStep(IRBuilder& ir, LValNode * var, IROp op){
+	IRType type = ir.typeOf(var);
+	Opd old = var->lowerLoad(ir);
+	IDNode * id = dynamic_cast<IDNode *>(var);
+	if (id != nullptr && ir.var(id->getSymbol()) == old){
+		ir.emit(op, type, old, old, Opd::imm(1));
+		return;
+	}
+	Opd result = ir.proc->newTemp();
+	ir.emit(op, type, result, old, Opd::imm(1));
+	var->lowerStore(ir, result);
+}
+
+void PostIncStmtNode::lower(IRBuilder& ir){
+	lowerStep(ir, variable, IROp::ADD);
+}
+
+void PostDecStmtNode::lower(IRBuilder& ir){
+	lowerStep(ir, variable, IROp::SUB);
+}
+
+void ReadStmtNode::lower(IRBuilder& ir){
+	Opd val = ir.proc->newTemp();
+	ir.emit(IROp::READ, ir.typeOf(variable), val);
+	variable->lowerStore(ir, val);
+}
+
+void WriteStmtNode::lower(IRBuilder& ir){
+	ir.value(expression);
+	ir.then([this, &ir](){
+		ir.emit(IROp::WRITE, ir.typeOf(expression), Opd(), ir.pop());
+	});
+}
+
+void ReturnStmtNode::lower(IRBuilder& ir){
+	if (expression == nullptr){
+		ir.emit(IROp::RET, IRType::INT, Opd());
+		return;
+	}
+	ir.value(expression);
+	ir.then([this, &ir](){
+		ir.emit(IROp::RET, ir.typeOf(expression), Opd(), ir.pop());
+	});
+}
+
+void WhileStmtNode::lower(IRBuilder& ir){
+	//The test goes at the bottom, so each iteration takes one branch
+	Opd body = ir.proc->newLabel();
+	Opd test = ir.proc->newLabel();
+	ir.emit(IROp::JMP, IRType::INT, Opd(), test);
+	ir.emit(IROp::LABEL, IRType::INT, Opd(), body);
+	lowerBody(WhileBody, ir);
+	ir.then([&ir, test](){
+		ir.emit(IROp::LABEL, IRType::INT, Opd(), test);
+	});
+	ir.branch(condition, body, true);
+}
+
+void IfStmtNode::lower(IRBuilder& ir){
+	Opd end = ir.proc->newLabel();
+	ir.branch(condition, end, false);
+	lowerBody(IfBody, ir);
+	ir.then([&ir, end](){
+		ir.emit(IROp::LABEL, IRType::INT, Opd(), end);
+	});
+}
+
+void IfElseStmtNode::lower(IRBuilder& ir){
+	Opd elseLbl = ir.proc->newLabel();
+	Opd end = ir.proc->newLabel();
+	ir.branch(condition, elseLbl, false);
+	lowerBody(IfTrueBody, ir);
+	ir.then([&ir, elseLbl, end](){
+		ir.emit(IROp::JMP, IRType::INT, Opd(), end);
+		ir.emit(IROp::LABEL, IRType::INT, Opd(), elseLbl);
+	});
+	lowerBody(IfFalseBody, ir);
+	ir.then([&ir, end](){
+		ir.emit(IROp::LABEL, IRType::INT, Opd(), end);
+	});
+}
+
+void ExpNode::lowerBranch(IRBuilder& ir, Opd label, bool onTrue){
+	lower(ir);
+	ir.then([&ir, label, onTrue](){
+		ir.emit(onTrue ? IROp::BNE : IROp::BEQ, IRType::BOOL, label,
+			ir.pop(), Opd::imm(0));
+	});
+}
+
+void TrueNode::lower(IRBuilder& ir){ ir.push(Opd::imm(1)); }
+
+void FalseNode::lower(IRBuilder& ir){ ir.push(Opd::imm(0)); }
+
+void TrueNode::lowerBranch(IRBuilder& ir, Opd label, bool onTrue){
+	if (onTrue){ ir.emit(IROp::JMP, IRType::INT, Opd(), label); }
+}
+
+void FalseNode::lowerBranch(IRBuilder& ir, Opd label, bool onTrue){
+	if (!onTrue){ ir.emit(IROp::JMP, IRType::INT, Opd(), label); }
+}
+
+void IntLitNode::lower(IRBuilder& ir){ ir.push(Opd::imm(numval)); }
+
+void ShortLitNode::lower(IRBuilder& ir){ ir.push(Opd::imm(shortVal)); }
+
+void StrLitNode::lower(IRBuilder& ir){ ir.push(ir.str(stringVal.str())); }
+
+void LValNode::lower(IRBuilder& ir){ ir.push(lowerLoad(ir)); }
+
+Opd IDNode::lowerLoad(IRBuilder& ir){
+	Opd loc = ir.var(mySymbol);
+	if (loc.isTemp()){ return loc; }
+	Opd val = ir.proc->newTemp();
+	ir.emit(IROp::MOV, ir.typeOf(this), val, loc);
+	return val;
+}
+
+void IDNode::lowerStore(IRBuilder& ir, Opd value){
+	ir.emit(IROp::MOV, ir.typeOf(this), ir.var(mySymbol), value);
+}
+
+Opd IDNode::lowerAddr(IRBuilder& ir){
+	Opd loc = ir.var(mySymbol);
+	Opd addr = ir.proc->newTemp();
+	if (loc.isTemp()){
+		ir.needsSlot(mySymbol);
+		return addr;
+	}
+	ir.emit(IROp::ADDR, IRType::PTR, addr, loc);
+	return addr;
+}
+
+Opd DerefNode::lowerLoad(IRBuilder& ir){
+	Opd ptr = myId->lowerLoad(ir);
+	Opd val = ir.proc->newTemp();
+	ir.emit(IROp::LOAD, ir.typeOf(this), val, ptr);
+	return val;
+}
+
+void DerefNode::lowerStore(IRBuilder& ir, Opd value){
+	Opd ptr = myId->lowerLoad(ir);
+	ir.emit(IROp::STORE, ir.typeOf(this), Opd(), ptr, value);
+}
+
+Opd DerefNode::lowerAddr(IRBuilder& ir){
+	return myId->lowerLoad(ir);
+}
+
+Opd IndexNode::lowerLoad(IRBuilder& ir){
+	throw new InternalError("Index expressions cannot be lowered");
+}
+
+void IndexNode::lowerStore(IRBuilder& ir, Opd value){
+	throw new InternalError("Index expressions cannot be lowered");
+}
+
+Opd IndexNode::lowerAddr(IRBuilder& ir){
+	throw new InternalError("Index expressions cannot be lowered");
+}
+
+void RefNode::lower(IRBuilder& ir){
+	LValNode * target = dynamic_cast<LValNode *>(expression);
+	if (target == nullptr){
+		throw new InternalError("Reference to a non-lvalue");
+	}
+	ir.push(target->lowerAddr(ir));
+}
+
+void NegNode::lower(IRBuilder& ir){
+	ir.value(expression);
+	ir.then([this, &ir](){
+		Opd val = ir.pop();
+		Opd result = ir.proc->newTemp();
+		ir.emit(IROp::NEG, ir.typeOf(this), result, val);
+		ir.push(result);
+	});
+}
+
+void NotNode::lower(IRBuilder& ir){
+	ir.value(expression);
+	ir.then([&ir](){
+		Opd val = ir.pop();
+		Opd result = ir.proc->newTemp();
+		ir.emit(IROp::NOT, IRType::BOOL, result, val);
+		ir.push(result);
+	});
+}
+
+void NotNode::lowerBranch(IRBuilder& ir, Opd label, bool onTrue){
+	ir.branch(expression, label, !onTrue);
+}
+
+void AssignExpNode::lower(IRBuilder& ir){
+	ir.value(expression);
+	ir.then([this, &ir](){
+		Opd val = ir.pop();
+		variable->lowerStore(ir, val);
+		ir.push(val);
+	});
+}
+
+void CallExpNode::lower(IRBuilder& ir){
+	//Every argument is computed before any is passed
+	if (arguments != nullptr){
+		for (ExpNode * arg : *arguments){ ir.value(arg); }
+	}
+	ir.then([this, &ir](){
+		std::vector<Opd> args(arguments == nullptr ? 0 : arguments->size());
+		for (size_t i = args.size(); i > 0; i--){ args[i - 1] = ir.pop(); }
+		size_t i = 0;
+		if (arguments != nullptr){
+			for (ExpNode * arg : *arguments){
+				ir.emit(IROp::ARG, ir.typeOf(arg), Opd(), args[i],
+					Opd::imm(static_cast<int64_t>(i)));
+				i++;
+			}
+		}
+		SemSymbol * sym = nameFunc->getSymbol();
+		FnDeclNode * fn = static_cast<FnDeclNode *>(sym->decl());
+		Opd result;
+		if (!fn->getRetTypeNode()->getType().isVoid()){
+			result = ir.proc->newTemp();
+		}
+		Opd callee = ir.procOf(sym);
+		ir.emit(IROp::CALL, ir.typeOf(this), result, callee);
+		ir.push(result);
+	});
+}
+
+static void lowerBinary(IRBuilder& ir, IROp op, IRType type,
+	ExpNode * lhs, ExpNode * rhs){
+	ir.value(lhs);
+	ir.value(rhs);
+	ir.then([&ir, op, type](){
+		Opd r = ir.pop();
+		Opd l = ir.pop();
+		Opd result = ir.proc->newTemp();
+		ir.emit(op, type, result, l, r);
+		ir.push(result);
+	});
+}
+
+void PlusNode::lower(IRBuilder& ir){
+	lowerBinary(ir, IROp::ADD, ir.typeOf(this), leftNode, rightNode);
+}
+
+void MinusNode::lower(IRBuilder& ir){
+	lowerBinary(ir, IROp::SUB, ir.typeOf(this), leftNode, rightNode);
+}
+
+void TimesNode::lower(IRBuilder& ir){
+	lowerBinary(ir, IROp::MUL, ir.typeOf(this), leftNode, rightNode);
+}
+
+void DivideNode::lower(IRBuilder& ir){
+	lowerBinary(ir, IROp::DIV, ir.typeOf(this), leftNode, rightNode);
+}
+
+/* The value of a condition, as 0 or 1 */
+static void lowerCondition(IRBuilder& ir, ExpNode * cond){
+	Opd result = ir.proc->newTemp();
+	Opd done = ir.proc->newLabel();
+	ir.emit(IROp::MOV, IRType::BOOL, result, Opd::imm(0));
+	cond->lowerBranch(ir, done, false);
+	ir.then([&ir, result, done](){
+		ir.emit(IROp::MOV, IRType::BOOL, result, Opd::imm(1));
+		ir.emit(IROp::LABEL, IRType::INT, Opd(), done);
+		ir.push(result);
+	});
+}
+
+void AndNode::lower(IRBuilder& ir){ lowerCondition(ir, this); }
+
+void OrNode::lower(IRBuilder& ir){ lowerCondition(ir, this); }
+
+void AndNode::lowerBranch(IRBuilder& ir, Opd label, bool onTrue){
+	if (!onTrue){
+		ir.branch(leftNode, label, false);
+		ir.branch(rightNode, label, false);
+		return;
+	}
+	Opd skip = ir.proc->newLabel();
+	ir.branch(leftNode, skip, false);
+	ir.branch(rightNode, label, true);
+	ir.then([&ir, skip](){
+		ir.emit(IROp::LABEL, IRType::INT, Opd(), skip);
+	});
+}
+
+void OrNode::lowerBranch(IRBuilder& ir, Opd label, bool onTrue){
+	if (onTrue){
+		ir.branch(leftNode, label, true);
+		ir.branch(rightNode, label, true);
+		return;
+	}
+	Opd skip = ir.proc->newLabel();
+	ir.branch(leftNode, skip, true);
+	ir.branch(rightNode, label, false);
+	ir.then([&ir, skip](){
+		ir.emit(IROp::LABEL, IRType::INT, Opd(), skip);
+	});
+}
+
+/* A comparison, as a value (set) or as a branch */
+static void lowerCompare(IRBuilder& ir, IROp set, ExpNode * lhs, ExpNode * rhs){
+	lowerBinary(ir, set, ir.typeOf(lhs), lhs, rhs);
+}
+
+static void branchCompare(IRBuilder& ir, IROp branch, IROp negated,
+	ExpNode * lhs, ExpNode * rhs, Opd label, bool onTrue){
+	ir.value(lhs);
+	ir.value(rhs);
+	IROp op = onTrue ? branch : negated;
+	IRType type = ir.typeOf(lhs);
+	ir.then([&ir, op, type, label](){
+		Opd r = ir.pop();
+		Opd l = ir.pop();
+		ir.emit(op, type, label, l, r);
+	});
+}
+
+void EqualsNode::lower(IRBuilder& ir){
+	lowerCompare(ir, IROp::SEQ, leftNode, rightNode);
+}
+
+void NotEqualsNode::lower(IRBuilder& ir){
+	lowerCompare(ir, IROp::SNE, leftNode, rightNode);
+}
+
+void LessNode::lower(IRBuilder& ir){
+	lowerCompare(ir, IROp::SLT, leftNode, rightNode);
+}
+
+void LessEqNode::lower(IRBuilder& ir){
+	lowerCompare(ir, IROp::SLE, leftNode, rightNode);
+}
+
+void GreaterNode::lower(IRBuilder& ir){
+	lowerCompare(ir, IROp::SGT, leftNode, rightNode);
+}
+
+void GreaterEqNode::lower(IRBuilder& ir){
+	lowerCompare(ir, IROp::SGE, leftNode, rightNode);
+}
+
+void EqualsNode::lowerBranch(IRBuilder& ir, Opd label, bool onTrue){
+	branchCompare(ir, IROp::BEQ, IROp::BNE, leftNode, rightNode,
+		label, onTrue);
+}
+
+void NotEqualsNode::lowerBranch(IRBuilder& ir, Opd label, bool onTrue){
+	branchCompare(ir, IROp::BNE, IROp::BEQ, leftNode, rightNode,
+		label, onTrue);
+}
+
+void LessNode::lowerBranch(IRBuilder& ir, Opd label, bool onTrue){
+	branchCompare(ir, IROp::BLT, IROp::BGE, leftNode, rightNode,
+		label, onTrue);
+}
+
+void LessEqNode::lowerBranch(IRBuilder& ir, Opd label, bool onTrue){
+	branchCompare(ir, IROp::BLE, IROp::BGT, leftNode, rightNode,
+		label, onTrue);
+}
+
+void GreaterNode::lowerBranch(IRBuilder& ir, Opd label, bool onTrue){
+	branchCompare(ir, IROp::BGT, IROp::BLE, leftNode, rightNode,
+		label, onTrue);
+}
+
+void GreaterEqNode::lowerBranch(IRBuilder& ir, Opd label, bool onTrue){
+	branchCompare(ir, IROp::BGE, IROp::BLT, leftNode, rightNode,
+		label, onTrue);
+}
+
+}
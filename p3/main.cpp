@@ -1,24 +1,145 @@
+#include <algorithm>
+#include <chrono>
 #include <iostream>
 #include <cstdlib>
 #include <cstring>
 #include <fstream>
+#include <memory>
+#include <sstream>
+#include <thread>
+#include "bigstack.hpp"
+#include "budget.hpp"
+#include "cache.hpp"
+#include "callgraph.hpp"
 #include "errors.hpp"
-#include "scanner.hpp"
+#include "flow.hpp"
+#include "inliner.hpp"
+#include "compiler.hpp"
+#include "ir.hpp"
+#include "serialize.hpp"
+#include "ssa.hpp"
+#include "stream.hpp"
+#include "symbol_table.hpp"
+#include "type_analysis.hpp"
+#include "vm.hpp"
+#include "watch.hpp"
+#include "x64.hpp"
 
 using namespace cminusminus;
 
+/* Thrown once the errors that end a compilation have been reported */
+class CompileFailed{ };
+
+static const size_t defaultCacheMegabytes = 256;
+
 static void usageAndDie(){
 	std::cerr << "Usage: cmmc <infile>"
 	<< " [-u <unparseFile>]: Output canonical program form\n"
+	<< " [-s <simplifiedFile>]: Output program form with constants"
+	<< " folded\n"
+	<< " [-n <nameFile>]: Output program form with each name's type\n"
+	<< " [-warn-unset]: Warn about locals that may be read before they"
+	<< " are set\n"
+	<< " [-dump-flow <flowFile>]: Output each function's flow graph, with"
+	<< " its live variables, reaching definitions and unset variables\n"
 	<< " [-p]: Parse the input to check syntax\n"
+	<< " [-c]: Check names and types\n"
 	<< " [-t <tokensFile>]: Output tokens to <tokensFile>\n"
+	<< " [-emit-ast <astFile>]: Output the binary AST to <astFile>\n"
+	<< " [-emit-ir <irFile>]: Output the intermediate code\n"
+	<< " [-a <asmFile>]: Output x86-64 assembly\n"
+	<< " [-o <exeFile>]: Assemble and link an executable\n"
+	<< " [-r]: Run the program on the bytecode VM\n"
+	<< " [-O]: Optimize the intermediate code first\n"
+	<< " [-inline-budget <n>]: Let inlining grow the program by at most"
+	<< " <n> instructions (implies -O)\n"
+	<< " [-inline-report <reportFile>]: Output which calls were inlined"
+	<< " (implies -O)\n"
+	<< " [-dump-ssa <ssaFile>]: Output the SSA form after each"
+	<< " optimization pass (implies -O)\n"
+	<< " [-time-passes]: Report what each optimization pass cost"
+	<< " (implies -O)\n"
+	<< " [-parser <bison|descent>]: Parse with the bison parser (the"
+	<< " default) or the hand-written one\n"
+	<< " [-pipeline]: Experimental: lex on a separate thread, ahead of"
+	<< " the parser (ignored on one core)\n"
+	<< " [-packed-tokens]: Lex the whole input into a compact array"
+	<< " before parsing\n"
+	<< " [-share-nodes]: Build each distinct type, literal and constant"
+	<< " subexpression once, however often it is used (-s still folds"
+	<< " a tree of its own)\n"
+	<< " [-lex-threads <n>]: Experimental: lex for -t on up to n threads,"
+	<< " in pieces cut at line breaks (0: one per core)\n"
+	<< " [-prune]: Drop the functions main cannot reach, and the"
+	<< " global variables they alone use\n"
+	<< " [-prune-report <reportFile>]: Output how much -prune dropped"
+	<< " (implies -prune)\n"
+	<< " [-stream]: Write each declaration for -u as soon as it is"
+	<< " parsed, and free it, to unparse inputs of any size\n"
+	<< " [-watch]: Keep running, and redo the rest whenever the input"
+	<< " is saved. Each save recompiles the whole input, in the same"
+	<< " process; nothing else is kept from one compile to the next\n"
+	<< " [-limit <name>=<n>]: Stop the compilation with an error once"
+	<< " it goes over a limit: bytes of input, tokens, (AST) nodes,"
+	<< " depth of braces and parentheses, (lexical) diagnostics, or ms"
+	<< " of wall-clock time. <n> is at least 1. May be repeated\n"
+	<< " [-cache <dir>]: Reuse what an earlier run printed and wrote for"
+	<< " the same input, when only -t, -u and -p are asked for\n"
+	<< " [-cache-size <megabytes>]: Keep the cache under this size"
+	<< " (default " << defaultCacheMegabytes << ")\n"
+	<< "Or: cmmc -load-ast <astFile> [-u <unparseFile>]"
+	<< " [-s <simplifiedFile>] [-n <nameFile>] [-warn-unset]"
+	<< " [-dump-flow <flowFile>] [-p] [-c]"
+	<< " [-emit-ast <astFile>] [-emit-ir <irFile>] [-a <asmFile>]"
+	<< " [-o <exeFile>] [-r] [-O] [-inline-budget <n>]"
+	<< " [-inline-report <reportFile>] [-dump-ssa <ssaFile>] [-time-passes]"
+	<< " [-prune] [-prune-report <reportFile>] [-limit <name>=<n>]"
+	<< " [-watch]:"
+	<< " Start from a binary AST instead of source\n"
+	<< "Or: cmmc -cache <dir> -cache-stats: Report the cache's hits,"
+	<< " misses and size\n"
 	;
 	exit(1);
 }
 
-static void writeTokenStream(const char * inPath, const char * outPath){
-	std::ifstream inStream(inPath);
-	if (!inStream.good()){
+/* Print what the library recorded the way cmmc always has:
+   messages to stderr, bison's verbose detail to stdout. Errors
+   that stop a phase outright end the compilation. */
+static void reportDiagnostics(const Compilation * comp){
+	comp->writeDiagnostics(std::cerr, std::cout);
+	if (comp->aborted()){ throw new CompileFailed(); }
+}
+
+static size_t inputSize(const char * path){
+	std::ifstream inStream(path, std::ios::binary | std::ios::ate);
+	if (!inStream.good()){ return 0; }
+	return static_cast<size_t>(inStream.tellg());
+}
+
+/* How deeply the source file at path nests (see bigstack.hpp), read
+   a piece at a time as -stream never holds it whole */
+static size_t fileNesting(const char * path){
+	std::ifstream inStream(path, std::ios::binary);
+	NestingScan scan;
+	std::vector<char> piece(1 << 16);
+	while (inStream.read(piece.data(), static_cast<std::streamsize>(
+	  piece.size())) || inStream.gcount() > 0){
+		scan.scan(piece.data(), static_cast<size_t>(inStream.gcount()));
+	}
+	return scan.levels();
+}
+
+/* Hold a compilation to budget, if there is one, from before the
+   file at path is read */
+static void checkInputFile(const Budget * budget, const char * path){
+	if (budget != nullptr){ budget->checkInput(inputSize(path)); }
+}
+
+static void writeTokenStream(const char * inPath, const char * outPath,
+	unsigned int lexThreads, const Budget * budget){
+	checkInputFile(budget, inPath);
+	Compilation * comp = Compilation::fromFile(inPath);
+	if (comp == nullptr){
 		std::string msg = "Bad input stream";
 		msg += inPath;
 		throw new InternalError(msg.c_str());
@@ -28,9 +149,11 @@ static void writeTokenStream(const char * inPath, const char * outPath){
 		throw new InternalError(msg.c_str());
 	}
 
-	Scanner scanner(&inStream);
+	comp->setBudget(budget);
+	comp->tokenize(lexThreads);
+	reportDiagnostics(comp);
 	if (strcmp(outPath, "--") == 0){
-		scanner.outputTokens(std::cout);
+		comp->writeTokens(std::cout);
 	} else {
 		std::ofstream outStream(outPath);
 		if (!outStream.good()){
@@ -38,30 +161,140 @@ static void writeTokenStream(const char * inPath, const char * outPath){
 			msg += outPath;
 			throw new InternalError(msg.c_str());
 		}
-		scanner.outputTokens(outStream);
+		comp->writeTokens(outStream);
 		outStream.close();
 	}
+	delete comp;
 }
 
-static cminusminus::ProgramNode * parse(const char * inFile){
-	std::ifstream inStream(inFile);
-	if (!inStream.good()){
+/* Parse inFile. The AST, if one was built, is comp's: it points into
+   comp's source buffer, and goes with it */
+static std::unique_ptr<Compilation> parse(const char * inFile, bool descent,
+	bool pipelined, bool packed, bool share, const Budget * budget){
+	checkInputFile(budget, inFile);
+	std::unique_ptr<Compilation> comp(Compilation::fromFile(inFile));
+	if (comp == nullptr){
 		std::string msg = "Bad input stream ";
 		msg += inFile;
 		throw new UserError(msg.c_str());
 	}
 
-	//This pointer will be set to the root of the
-	// AST after parsing
-	cminusminus::ProgramNode * root = nullptr;
+	comp->setDescentParser(descent);
+	//With no core to spare, the lexer thread would only get in the way
+	comp->setPipelined(pipelined
+		&& std::thread::hardware_concurrency() > 1);
+	comp->setPackedTokens(packed);
+	comp->setShareNodes(share);
+	comp->setBudget(budget);
+	comp->parse();
+	reportDiagnostics(comp.get());
+	return comp;
+}
+
+/* Where an optional report goes: nowhere without a path, stdout for
+   "--", otherwise the file at path (opened into file) */
+static std::ostream * reportStream(const char * path, std::ofstream& file){
+	if (path == nullptr){ return nullptr; }
+	if (strcmp(path, "--") == 0){ return &std::cout; }
+	file.open(path);
+	if (!file.good()){
+		std::string msg = "Bad output file ";
+		msg += path;
+		throw new InternalError(msg.c_str());
+	}
+	return &file;
+}
+
+/* Remove what main cannot reach from ast (see callgraph.hpp),
+   writing how much went to reportPath if there is one */
+static void pruneAST(ProgramNode * ast, const ASTInterner * interner,
+	const char * reportPath){
+	CallGraph graph;
+	SymbolTable symTab(nullptr);
+	symTab.setCallGraph(&graph);
+	if (!symTab.analyze(ast)){
+		std::cerr << "Name Analysis Failed\n";
+		throw new CompileFailed();
+	}
+	PruneCounts counts = pruneUnreachable(ast, graph, interner);
+	std::ofstream reportFile;
+	std::ostream * report = reportStream(reportPath, reportFile);
+	if (report != nullptr){
+		*report << "Removed " << counts.fnsRemoved << " of "
+			<< counts.fns << " functions and " << counts.globalsRemoved
+			<< " of " << counts.globals << " global variables\n";
+	}
+}
+
+/* Where the program's AST comes from, and what is done to it first */
+struct ASTSource{
+	/* The binary AST file, or nullptr to parse inFile */
+	const char * astFile;
+	const char * inFile;
+	/* Parse with the hand-written parser */
+	bool descent;
+	/* Lex on a thread of its own */
+	bool pipelined;
+	/* Lex everything into packed tokens before parsing */
+	bool packed;
+	/* Share nodes through an ASTInterner */
+	bool share;
+	/* Drop what main cannot reach, reporting to pruneReport if set */
+	bool prune;
+	const char * pruneReport;
+	/* The limits to hold parsing or loading to, or nullptr */
+	const Budget * budget;
 
-	cminusminus::Scanner scanner(&inStream);
-	cminusminus::Parser parser(scanner, &root);
+	/* What each AST built so far belongs to, kept until clear() */
+	std::vector<std::unique_ptr<Compilation>> parsed;
+	std::vector<std::unique_ptr<MappedAST>> loaded;
+	/* Free every AST built so far */
+	void clear(){
+		parsed.clear();
+		loaded.clear();
+	}
+	/* The interner of the AST parsed last, if it shares nodes */
+	const ASTInterner * interner() const {
+		if (parsed.empty() || !parsed.back()->interner()->sharing()){
+			return nullptr;
+		}
+		return parsed.back()->interner();
+	}
+};
 
-	int errCode = parser.parse();
-	if (errCode != 0){ return nullptr; }
+/* Get the program's AST as source says, sharing nodes only if
+   mayShare. It lasts until source.clear() */
+static cminusminus::ProgramNode * buildAST(ASTSource& source,
+	bool mayShare = true){
+	ProgramNode * ast;
+	const ASTInterner * interner = nullptr;
+	if (source.astFile != nullptr){
+		checkInputFile(source.budget, source.astFile);
+		NodeBudget nodes(source.budget);
+		source.loaded.emplace_back(new MappedAST(source.astFile));
+		ast = source.loaded.back()->ast();
+	} else {
+		source.parsed.push_back(parse(source.inFile, source.descent,
+			source.pipelined, source.packed, source.share && mayShare,
+			source.budget));
+		ast = source.parsed.back()->ast();
+		interner = source.parsed.back()->interner();
+	}
+	if (ast != nullptr && source.prune){
+		pruneAST(ast, interner, source.pruneReport);
+	}
+	return ast;
+}
 
-	return root;
+static void emitAST(ProgramNode * ast, const ASTInterner * interner,
+	const char * outPath){
+	std::ofstream outStream(outPath, std::ios::binary);
+	if (!outStream.good()){
+		std::string msg = "Bad output file ";
+		msg += outPath;
+		throw new cminusminus::InternalError(msg.c_str());
+	}
+	writeAST(ast, outStream, interner);
 }
 
 static void outputAST(ASTNode * ast, const char * outPath){
@@ -78,8 +311,8 @@ static void outputAST(ASTNode * ast, const char * outPath){
 	}
 }
 
-static bool doUnparsing(const char * inputPath, const char * outPath){
-	cminusminus::ProgramNode * ast = parse(inputPath);
+static bool doUnparsing(cminusminus::ProgramNode * ast,
+	const char * outPath){
 	if (ast == nullptr){ 
 		std::cerr << "No AST built\n";
 		return false;
@@ -89,6 +322,226 @@ static bool doUnparsing(const char * inputPath, const char * outPath){
 	return true;
 }
 
+/* Unparse inFile to outPath a declaration at a time, never holding
+   the whole AST (see stream.hpp) */
+static void streamUnparsing(const char * inFile, const char * outPath,
+	bool descent, const Budget * budget){
+	std::ifstream inStream(inFile);
+	if (!inStream.good()){
+		std::string msg = "Bad input stream ";
+		msg += inFile;
+		throw new UserError(msg.c_str());
+	}
+	std::ofstream outFile;
+	std::ostream * out = reportStream(outPath, outFile);
+	//Errors are printed as they are found, with no Diagnostics to hold
+	bool parsed = streamDecls(inStream, nullptr, descent, budget,
+		[&](DeclNode * decl){ decl->unparse(*out, 0); });
+	//As -u would have said, though some of the output is written
+	if (!parsed){ std::cerr << "No AST built\n"; }
+}
+
+/* Fold constants and drop dead branches (see simplify.cpp) */
+static cminusminus::ProgramNode * simplifyAST(ProgramNode * ast){
+	if (ast != nullptr){ ast->simplify(); }
+	return ast;
+}
+
+/* Resolve every name to its declaration. Returns nullptr if any
+   name was bad (the errors have been reported) */
+static cminusminus::ProgramNode * nameAnalysis(ProgramNode * ast){
+	if (ast == nullptr){ return nullptr; }
+	SymbolTable symTab(nullptr);
+	if (!symTab.analyze(ast)){
+		std::cerr << "Name Analysis Failed\n";
+		return nullptr;
+	}
+	return ast;
+}
+
+/* Check and lower a program to the IR. Returns nullptr if it had
+   errors (they have been reported) */
+static IRProgram * lowerAST(ProgramNode * ast, const ASTInterner * interner){
+	if (nameAnalysis(ast) == nullptr){ return nullptr; }
+	std::unique_ptr<TypeAnalysis> ta(
+		TypeAnalysis::build(ast, nullptr, 0, interner));
+	if (!ta->passed()){
+		std::cerr << "Type Analysis Failed\n";
+		return nullptr;
+	}
+	return lowerProgram(ast, ta.get());
+}
+
+static void writeFlow(ProgramNode * ast, const char * outPath){
+	if (strcmp(outPath, "--") == 0){
+		dumpFlow(ast, std::cout);
+		return;
+	}
+	std::ofstream outStream(outPath);
+	if (!outStream.good()){
+		std::string msg = "Bad output file ";
+		msg += outPath;
+		throw new InternalError(msg.c_str());
+	}
+	dumpFlow(ast, outStream);
+}
+
+static void writeIR(IRProgram * prog, const char * outPath){
+	if (strcmp(outPath, "--") == 0){
+		printIR(*prog, std::cout);
+		return;
+	}
+	std::ofstream outStream(outPath);
+	if (!outStream.good()){
+		std::string msg = "Bad output file ";
+		msg += outPath;
+		throw new InternalError(msg.c_str());
+	}
+	printIR(*prog, outStream);
+}
+
+/* Inline calls under inlineBudget, reporting them to inlinePath if
+   there is one, then run the SSA optimizer over prog, writing the SSA
+   after each pass to dumpPath if there is one and the pass timings
+   to stderr if timePasses */
+static void optimize(IRProgram * prog, size_t inlineBudget,
+	const char * inlinePath, const char * dumpPath, bool timePasses){
+	std::ofstream inlineFile;
+	inlineCalls(prog, inlineBudget, reportStream(inlinePath, inlineFile));
+	std::ofstream dumpFile;
+	optimizeIR(prog, reportStream(dumpPath, dumpFile),
+		timePasses ? &std::cerr : nullptr);
+}
+
+static void writeAsm(IRProgram * prog, const char * outPath){
+	if (strcmp(outPath, "--") == 0){
+		emitX64(*prog, std::cout);
+		return;
+	}
+	std::ofstream outStream(outPath);
+	if (!outStream.good()){
+		std::string msg = "Bad output file ";
+		msg += outPath;
+		throw new InternalError(msg.c_str());
+	}
+	emitX64(*prog, outStream);
+}
+
+/* Write <exePath>.s and have the system compiler driver assemble
+   and link it against the C library */
+static void buildExecutable(IRProgram * prog, const char * exePath){
+	std::string asmPath = std::string(exePath) + ".s";
+	writeAsm(prog, asmPath.c_str());
+	if (!linkExecutable(asmPath, exePath)){
+		std::string msg = "Could not assemble and link ";
+		msg += asmPath;
+		throw new InternalError(msg.c_str());
+	}
+}
+
+/* Run work, reporting any error that ends it. Returns whether
+   there was none */
+static bool reportingErrors(std::function<void()> work){
+	try {
+		work();
+		return true;
+	} catch (CompileFailed * e){
+		delete e;
+	} catch (ToDoError * e){
+		std::cerr << "ToDo: " << e->msg() << std::endl;
+		delete e;
+	} catch (InternalError * e){
+		std::string msg = "Something in the compiler is broken: ";
+		std::cerr << msg << e->msg() << std::endl;
+		delete e;
+	} catch (UserError * e){
+		std::string msg = "The user made a mistake: ";
+		std::cerr << msg << e->msg() << std::endl;
+		delete e;
+	} catch (LimitError * e){
+		Diagnostic limit(Diagnostic::LIMIT, e->pos(), e->msg());
+		std::cerr << limit.str() << std::endl;
+		delete e;
+	}
+	return false;
+}
+
+/* Write contents where an output file at path would have gone */
+static void replayFile(const char * path, const std::string& contents){
+	if (strcmp(path, "--") == 0){ return; }
+	std::ofstream out(path, std::ios::binary);
+	if (!out.good()){
+		std::string msg = "Bad output file ";
+		msg += path;
+		throw new InternalError(msg.c_str());
+	}
+	out << contents;
+}
+
+/* Do what compile does for the -t/-u/-p run on inFile described by
+   tokensFile, unparseFile and checkParse, through cache: if it has
+   the outputs of the same run, print and write them again, otherwise
+   compile, recording what goes to stdout, stderr and the two files.
+   Returns cmmc's exit status */
+static int compileCached(CompileCache& cache, const char * inFile,
+	const char *& tokensFile, const char *& unparseFile, bool checkParse,
+	std::function<bool()> compile){
+	std::string request;
+	if (tokensFile != nullptr){
+		request += strcmp(tokensFile, "--") == 0 ? "t-- " : "t ";
+	}
+	if (unparseFile != nullptr){
+		request += strcmp(unparseFile, "--") == 0 ? "u-- " : "u ";
+	}
+	if (checkParse){ request += "p"; }
+	std::string key;
+	if (!cache.key(inFile, request, key)){
+		//Let the compiler say what is wrong with it
+		return compile() ? 0 : 1;
+	}
+
+	CacheEntry entry;
+	if (!cache.lookup(key, entry)){
+		//Compile with the output files in the cache, to record them
+		const char * realTokens = tokensFile;
+		const char * realUnparse = unparseFile;
+		std::string tokensScratch = cache.scratchPath(key, "t");
+		std::string unparseScratch = cache.scratchPath(key, "u");
+		if (tokensFile != nullptr && strcmp(tokensFile, "--") != 0){
+			tokensFile = tokensScratch.c_str();
+		}
+		if (unparseFile != nullptr && strcmp(unparseFile, "--") != 0){
+			unparseFile = unparseScratch.c_str();
+		}
+		std::ostringstream out;
+		std::ostringstream err;
+		std::streambuf * realOut = std::cout.rdbuf(out.rdbuf());
+		std::streambuf * realErr = std::cerr.rdbuf(err.rdbuf());
+		bool ok = compile();
+		std::cout.rdbuf(realOut);
+		std::cerr.rdbuf(realErr);
+		tokensFile = realTokens;
+		unparseFile = realUnparse;
+
+		entry.status = ok ? 0 : 1;
+		entry.out = out.str();
+		entry.err = err.str();
+		entry.haveTokens = CompileCache::takeFile(tokensScratch,
+			entry.tokens);
+		entry.haveUnparse = CompileCache::takeFile(unparseScratch,
+			entry.unparse);
+		cache.store(key, entry);
+	}
+
+	std::cout << entry.out;
+	std::cerr << entry.err;
+	bool replayed = reportingErrors([&](){
+		if (entry.haveTokens){ replayFile(tokensFile, entry.tokens); }
+		if (entry.haveUnparse){ replayFile(unparseFile, entry.unparse); }
+	});
+	return replayed ? entry.status : 1;
+}
+
 int 
 main( const int argc, const char **argv )
 {
@@ -98,13 +551,134 @@ main( const int argc, const char **argv )
 	const char * inFile = NULL;
 	const char * tokensFile = NULL;
 	bool checkParse = false;
+	bool checkTypes = false;
 	const char * unparseFile = NULL;
+	const char * simplifyFile = NULL;
+	const char * nameFile = NULL;
+	bool warnUnset = false;
+	const char * flowFile = NULL;
+	const char * emitFile = NULL;
+	const char * astFile = NULL;
+	const char * irFile = NULL;
+	const char * asmFile = NULL;
+	const char * exeFile = NULL;
+	bool run = false;
+	bool opt = false;
+	const char * ssaFile = NULL;
+	bool timePasses = false;
+	size_t inlineBudget = defaultInlineBudget;
+	const char * inlineFile = NULL;
+	bool descent = false;
+	bool pipelined = false;
+	bool packed = false;
+	bool share = false;
+	unsigned int lexThreads = 1;
+	bool watch = false;
+	bool stream = false;
+	bool prune = false;
+	const char * pruneReport = NULL;
+	const char * cacheDir = NULL;
+	size_t cacheMegabytes = defaultCacheMegabytes;
+	bool cacheStats = false;
+	CompileLimits limits;
+	bool limited = false;
 
 	bool useful = false;
 	int i = 1;
 	for (int i = 1 ; i < argc ; i++){
 		if (argv[i][0] == '-'){
-			if (argv[i][1] == 't'){
+			if (strcmp(argv[i], "-emit-ast") == 0){
+				i++;
+				if (i >= argc){ usageAndDie(); }
+				emitFile = argv[i];
+				useful = true;
+			} else if (strcmp(argv[i], "-emit-ir") == 0){
+				i++;
+				if (i >= argc){ usageAndDie(); }
+				irFile = argv[i];
+				useful = true;
+			} else if (strcmp(argv[i], "-load-ast") == 0){
+				i++;
+				if (i >= argc){ usageAndDie(); }
+				astFile = argv[i];
+			} else if (strcmp(argv[i], "-dump-ssa") == 0){
+				i++;
+				if (i >= argc){ usageAndDie(); }
+				ssaFile = argv[i];
+				opt = true;
+				useful = true;
+			} else if (strcmp(argv[i], "-time-passes") == 0){
+				timePasses = true;
+				opt = true;
+				useful = true;
+			} else if (strcmp(argv[i], "-inline-budget") == 0){
+				i++;
+				if (i >= argc){ usageAndDie(); }
+				inlineBudget = strtoul(argv[i], nullptr, 10);
+				opt = true;
+			} else if (strcmp(argv[i], "-inline-report") == 0){
+				i++;
+				if (i >= argc){ usageAndDie(); }
+				inlineFile = argv[i];
+				opt = true;
+				useful = true;
+			} else if (strcmp(argv[i], "-parser") == 0){
+				i++;
+				if (i >= argc){ usageAndDie(); }
+				if (strcmp(argv[i], "descent") == 0){
+					descent = true;
+				} else if (strcmp(argv[i], "bison") == 0){
+					descent = false;
+				} else {
+					usageAndDie();
+				}
+			} else if (strcmp(argv[i], "-pipeline") == 0){
+				pipelined = true;
+			} else if (strcmp(argv[i], "-packed-tokens") == 0){
+				packed = true;
+			} else if (strcmp(argv[i], "-share-nodes") == 0){
+				share = true;
+			} else if (strcmp(argv[i], "-lex-threads") == 0){
+				i++;
+				if (i >= argc){ usageAndDie(); }
+				lexThreads = static_cast<unsigned int>(
+					strtoul(argv[i], nullptr, 10));
+			} else if (strcmp(argv[i], "-prune") == 0){
+				prune = true;
+			} else if (strcmp(argv[i], "-prune-report") == 0){
+				i++;
+				if (i >= argc){ usageAndDie(); }
+				pruneReport = argv[i];
+				prune = true;
+			} else if (strcmp(argv[i], "-stream") == 0){
+				stream = true;
+			} else if (strcmp(argv[i], "-warn-unset") == 0){
+				warnUnset = true;
+				useful = true;
+			} else if (strcmp(argv[i], "-dump-flow") == 0){
+				i++;
+				if (i >= argc){ usageAndDie(); }
+				flowFile = argv[i];
+				useful = true;
+			} else if (strcmp(argv[i], "-watch") == 0){
+				watch = true;
+			} else if (strcmp(argv[i], "-limit") == 0){
+				i++;
+				if (i >= argc || !parseLimit(argv[i], limits)){ usageAndDie(); }
+				limited = true;
+			} else if (strcmp(argv[i], "-cache") == 0){
+				i++;
+				if (i >= argc){ usageAndDie(); }
+				cacheDir = argv[i];
+			} else if (strcmp(argv[i], "-cache-size") == 0){
+				i++;
+				if (i >= argc){ usageAndDie(); }
+				cacheMegabytes = strtoul(argv[i], nullptr, 10);
+			} else if (strcmp(argv[i], "-cache-stats") == 0){
+				cacheStats = true;
+			} else if (strcmp(argv[i], "-O") == 0){
+				opt = true;
+			} else if (argv[i][1] == 't'){
 				i++;
 				tokensFile = argv[i];
 				useful = true;
@@ -112,11 +686,37 @@ main( const int argc, const char **argv )
 				i++;
 				checkParse = true;
 				useful = true;
+			} else if (argv[i][1] == 'c'){
+				checkTypes = true;
+				useful = true;
 			} else if (argv[i][1] == 'u'){
 				i++;
 				if (i >= argc){ usageAndDie(); }
 				unparseFile = argv[i];
 				useful = true;
+			} else if (argv[i][1] == 's'){
+				i++;
+				if (i >= argc){ usageAndDie(); }
+				simplifyFile = argv[i];
+				useful = true;
+			} else if (argv[i][1] == 'n'){
+				i++;
+				if (i >= argc){ usageAndDie(); }
+				nameFile = argv[i];
+				useful = true;
+			} else if (argv[i][1] == 'a'){
+				i++;
+				if (i >= argc){ usageAndDie(); }
+				asmFile = argv[i];
+				useful = true;
+			} else if (argv[i][1] == 'r'){
+				run = true;
+				useful = true;
+			} else if (argv[i][1] == 'o'){
+				i++;
+				if (i >= argc){ usageAndDie(); }
+				exeFile = argv[i];
+				useful = true;
 			} else {
 				std::cerr << "Unrecognized argument: ";
 				std::cerr << argv[i] << std::endl;
@@ -132,7 +732,18 @@ main( const int argc, const char **argv )
 			}
 		}
 	}
-	if (inFile == NULL){
+	if (cacheStats){
+		if (cacheDir == NULL){ usageAndDie(); }
+		return reportingErrors([&](){
+			CompileCache cache(cacheDir, cacheMegabytes << 20);
+			cache.writeStats(std::cout);
+		}) ? 0 : 1;
+	}
+	if (inFile == NULL && astFile == NULL){
+		usageAndDie();
+	}
+	if (astFile != NULL && (inFile != NULL || tokensFile != NULL)){
+		std::cerr << "-load-ast replaces the source input file\n";
 		usageAndDie();
 	}
 	if (!useful){
@@ -140,29 +751,150 @@ main( const int argc, const char **argv )
 		usageAndDie();
 	}
 
-	try {
-		if (tokensFile != NULL){
-			writeTokenStream(inFile, tokensFile);
-		} if (checkParse){
-			bool parsed = parse(inFile);
-			if (!parsed){
-				std::cerr << "Parse failed" << std::endl;
+	//Only unparsing can be done without the whole program at hand
+	if (stream && (inFile == NULL || unparseFile == NULL
+		|| tokensFile != NULL || checkParse || checkTypes
+		|| simplifyFile != NULL || nameFile != NULL || warnUnset
+		|| flowFile != NULL || emitFile != NULL || irFile != NULL
+		|| asmFile != NULL || exeFile != NULL || run
+		|| ssaFile != NULL || timePasses || inlineFile != NULL
+		|| prune || share)){
+		std::cerr << "-stream is only for -u on a source file\n";
+		usageAndDie();
+	}
+
+	const char * inputFile = astFile != NULL ? astFile : inFile;
+	ASTSource source = { astFile, inFile, descent, pipelined, packed, share,
+		prune, pruneReport, nullptr, {}, {} };
+	auto compile = [&](){
+		//Under -watch, the last compile's trees go before the next
+		source.clear();
+		//The clock starts again for each compile under -watch
+		Budget budget(limits);
+		source.budget = limited ? &budget : nullptr;
+		auto checkClock = [&](){
+			if (source.budget != nullptr){ source.budget->checkClock(); }
+		};
+		//The parser recurses as deep as the source nests (see
+		// bigstack.hpp); an AST file is not parsed
+		size_t levels = astFile != NULL ? 0 : fileNesting(inFile);
+		runWithStack(stackForDepth(levels), [&](){
+			if (stream){
+				streamUnparsing(inFile, unparseFile, descent, source.budget);
+				return;
 			}
-		} if (unparseFile != nullptr){
-			doUnparsing(inFile, unparseFile);
-		}
-	} catch (ToDoError * e){
-		std::cerr << "ToDo: " << e->msg() << std::endl;
-		exit(1);
-	} catch (InternalError * e){
-		std::string msg = "Something in the compiler is broken: ";
-		std::cerr << msg << e->msg() << std::endl;
-		exit(1);
-	} catch (UserError * e){
-		std::string msg = "The user made a mistake: ";
-		std::cerr << msg << e->msg() << std::endl;
-		exit(1);
+			if (tokensFile != NULL){
+				writeTokenStream(inFile, tokensFile, lexThreads, source.budget);
+			} if (checkParse){
+				bool parsed = buildAST(source);
+				if (!parsed){
+					std::cerr << "Parse failed" << std::endl;
+				}
+			} if (checkTypes){
+				ProgramNode * ast = nameAnalysis(buildAST(source));
+				if (ast == nullptr){ throw new CompileFailed(); }
+				checkClock();
+				std::unique_ptr<TypeAnalysis> ta(TypeAnalysis::build(ast,
+					nullptr, 0, source.interner()));
+				if (!ta->passed()){
+					std::cerr << "Type Analysis Failed\n";
+					throw new CompileFailed();
+				}
+			} if (unparseFile != nullptr){
+				doUnparsing(buildAST(source), unparseFile);
+			} if (simplifyFile != nullptr){
+				//Folding rewrites nodes in place, which shared ones
+				//cannot be
+				ProgramNode * ast = simplifyAST(buildAST(source, false));
+				doUnparsing(ast, simplifyFile);
+			} if (nameFile != nullptr){
+				ProgramNode * ast = buildAST(source);
+				if (ast == nullptr){
+					std::cerr << "No AST built\n";
+				} else if (nameAnalysis(ast) == nullptr){
+					throw new CompileFailed();
+				} else {
+					outputAST(ast, nameFile);
+				}
+			} if (warnUnset || flowFile != nullptr){
+				ProgramNode * ast = buildAST(source);
+				if (ast == nullptr){
+					std::cerr << "No AST built\n";
+				} else if (nameAnalysis(ast) == nullptr){
+					throw new CompileFailed();
+				} else {
+					if (warnUnset){ warnUnsetVariables(ast, nullptr); }
+					if (flowFile != nullptr){ writeFlow(ast, flowFile); }
+				}
+			} if (emitFile != nullptr){
+				cminusminus::ProgramNode * ast = buildAST(source);
+				if (ast == nullptr){
+					std::cerr << "No AST built\n";
+				} else {
+					emitAST(ast, source.interner(), emitFile);
+				}
+			} if (irFile != nullptr || asmFile != nullptr || exeFile != nullptr
+				|| run || ssaFile != nullptr || timePasses
+				|| inlineFile != nullptr){
+				ProgramNode * ast = buildAST(source);
+				std::unique_ptr<IRProgram> prog(lowerAST(ast,
+					source.interner()));
+				if (prog == nullptr){ throw new CompileFailed(); }
+				checkClock();
+				if (opt){
+					optimize(prog.get(), inlineBudget, inlineFile, ssaFile,
+						timePasses);
+				}
+				if (irFile != nullptr){ writeIR(prog.get(), irFile); }
+				if (asmFile != nullptr){ writeAsm(prog.get(), asmFile); }
+				if (exeFile != nullptr){
+					buildExecutable(prog.get(), exeFile);
+				}
+				if (run){
+					std::unique_ptr<Bytecode> code(compileBytecode(*prog));
+					runBytecode(*code, std::cin, std::cout);
+				}
+			}
+		});
+	};
+
+	//Only runs that stop at parsing are cached, and not under limits:
+	//whether a time limit is hit depends on the run
+	bool cacheable = cacheDir != NULL && inFile != NULL && !watch
+		&& !checkTypes && simplifyFile == NULL && nameFile == NULL
+		&& !warnUnset && flowFile == NULL && emitFile == NULL
+		&& irFile == NULL && asmFile == NULL && exeFile == NULL && !run
+		&& ssaFile == NULL && !timePasses && inlineFile == NULL && !prune
+		&& !stream && !limited;
+	if (cacheable){
+		int status = 1;
+		reportingErrors([&](){
+			CompileCache cache(cacheDir, cacheMegabytes << 20);
+			status = compileCached(cache, inFile, tokensFile, unparseFile,
+				checkParse, [&](){ return reportingErrors(compile); });
+		});
+		return status;
+	}
+	if (!watch){
+		return reportingErrors(compile) ? 0 : 1;
+	}
+	//Each save is a whole compile again: only the process is reused.
+	//Watch from before the first compile, so no save is missed
+	FileWatcher * watcher = nullptr;
+	if (!reportingErrors([&](){ watcher = new FileWatcher(inputFile); })){
+		return 1;
+	}
+	reportingErrors(compile);
+	std::cout.flush();
+	while (true){
+		std::cerr << "Watching " << inputFile << std::endl;
+		watcher->wait();
+		auto start = std::chrono::steady_clock::now();
+		reportingErrors(compile);
+		std::cout.flush();
+		std::chrono::duration<double, std::micro> took =
+			std::chrono::steady_clock::now() - start;
+		std::cerr << "Recompiled " << inputFile << " in "
+			<< static_cast<long>(took.count()) << "us" << std::endl;
 	}
-	
-	return 0;
 }
@@ -0,0 +1,186 @@
+#include "ast.hpp"
+#include "symbol_table.hpp"
+
+namespace cminusminus{
+
+/*
+Name analysis walks the tree in source order, declaring names as it
+meets them and resolving every use against the innermost visible
+declaration. Errors are reported where they are found and analysis
+carries on, so that one run reports every bad name.
+
+The walk keeps its own stack (see workstack.hpp): each node's
+nameAnalysis does the node itself and queues its subtrees, and the
+scope changes between them, on the symbol table. An lval is at most
+an id under a @, so its names are done on the spot.
+*/
+
+bool SymbolTable::analyze(ASTNode * root){
+	myOk = true;
+	myWork.run([this, root](){
+		if (!root->nameAnalysis(this)){ myOk = false; }
+	});
+	return myOk;
+}
+
+void SymbolTable::visit(ASTNode * node){
+	myWork.then([this, node](){
+		if (!node->nameAnalysis(this)){ myOk = false; }
+	});
+}
+
+template <typename T>
+static void listAnalysis(std::list<T *> * nodes, SymbolTable * symTab){
+	if (nodes == nullptr){ return; }
+	for (T * node : *nodes){ symTab->visit(node); }
+}
+
+/* Analyze a body that is its own scope */
+static void scopeAnalysis(std::list<StmtNode *> * body, SymbolTable * symTab){
+	symTab->then([symTab](){ symTab->enterScope(); });
+	listAnalysis(body, symTab);
+	symTab->then([symTab](){ symTab->leaveScope(); });
+}
+
+bool ProgramNode::nameAnalysis(SymbolTable * symTab){
+	listAnalysis(myGlobals, symTab);
+	return true;
+}
+
+bool VarDeclNode::nameAnalysis(SymbolTable * symTab){
+	bool validType = dynamic_cast<VoidTypeNode *>(myType) == nullptr;
+	if (!validType){
+		symTab->errBadVarType(myId->pos());
+	}
+	bool validName = !symTab->clash(myId->getName());
+	if (!validName){
+		symTab->errMultiDecl(myId->pos());
+	}
+	if (!validType || !validName){ return false; }
+
+	SemSymbol * sym = new SemSymbol(SemSymbol::VAR, myId->getName(), this);
+	symTab->insert(sym);
+	myId->attachSymbol(sym);
+	return true;
+}
+
+bool FnDeclNode::nameAnalysis(SymbolTable * symTab){
+	//The function is in scope in its own body, so that it may recurse
+	bool ok = true;
+	if (symTab->clash(myId->getName())){
+		symTab->errMultiDecl(myId->pos());
+		ok = false;
+	} else {
+		SemSymbol * sym = new SemSymbol(SemSymbol::FN,
+			myId->getName(), this);
+		symTab->insert(sym);
+		myId->attachSymbol(sym);
+	}
+
+	//Formals share the scope of the top level of the body
+	symTab->enterScope();
+	symTab->setFunction(myId->getSymbol());
+	listAnalysis(parameters, symTab);
+	listAnalysis(functionBody, symTab);
+	symTab->then([symTab](){
+		symTab->setFunction(nullptr);
+		symTab->leaveScope();
+	});
+	return ok;
+}
+
+bool IDNode::nameAnalysis(SymbolTable * symTab){
+	SemSymbol * sym = symTab->lookup(name);
+	if (sym == nullptr){
+		symTab->errUndeclared(myPos);
+		return false;
+	}
+	attachSymbol(sym);
+	symTab->noteUse(this);
+	return true;
+}
+
+bool DerefNode::nameAnalysis(SymbolTable * symTab){
+	return myId->nameAnalysis(symTab);
+}
+
+bool IndexNode::nameAnalysis(SymbolTable * symTab){
+	//The field name belongs to the record's type, not to any scope
+	return Id_being_accessed->nameAnalysis(symTab);
+}
+
+bool UnaryExpNode::nameAnalysis(SymbolTable * symTab){
+	symTab->visit(expression);
+	return true;
+}
+
+bool BinaryExpNode::nameAnalysis(SymbolTable * symTab){
+	symTab->visit(leftNode);
+	symTab->visit(rightNode);
+	return true;
+}
+
+bool CallExpNode::nameAnalysis(SymbolTable * symTab){
+	bool ok = nameFunc->nameAnalysis(symTab);
+	listAnalysis(arguments, symTab);
+	return ok;
+}
+
+bool AssignExpNode::nameAnalysis(SymbolTable * symTab){
+	bool ok = variable->nameAnalysis(symTab);
+	symTab->visit(expression);
+	return ok;
+}
+
+bool AssignStmtNode::nameAnalysis(SymbolTable * symTab){
+	symTab->visit(assignment);
+	return true;
+}
+
+bool CallStmtNode::nameAnalysis(SymbolTable * symTab){
+	symTab->visit(Function);
+	return true;
+}
+
+bool PostDecStmtNode::nameAnalysis(SymbolTable * symTab){
+	return variable->nameAnalysis(symTab);
+}
+
+bool PostIncStmtNode::nameAnalysis(SymbolTable * symTab){
+	return variable->nameAnalysis(symTab);
+}
+
+bool ReadStmtNode::nameAnalysis(SymbolTable * symTab){
+	return variable->nameAnalysis(symTab);
+}
+
+bool WriteStmtNode::nameAnalysis(SymbolTable * symTab){
+	symTab->visit(expression);
+	return true;
+}
+
+bool ReturnStmtNode::nameAnalysis(SymbolTable * symTab){
+	if (expression != nullptr){ symTab->visit(expression); }
+	return true;
+}
+
+bool WhileStmtNode::nameAnalysis(SymbolTable * symTab){
+	symTab->visit(condition);
+	scopeAnalysis(WhileBody, symTab);
+	return true;
+}
+
+bool IfStmtNode::nameAnalysis(SymbolTable * symTab){
+	symTab->visit(condition);
+	scopeAnalysis(IfBody, symTab);
+	return true;
+}
+
+bool IfElseStmtNode::nameAnalysis(SymbolTable * symTab){
+	symTab->visit(condition);
+	scopeAnalysis(IfTrueBody, symTab);
+	scopeAnalysis(IfFalseBody, symTab);
+	return true;
+}
+
+}
@@ -0,0 +1,668 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <map>
+#include <tuple>
+#include "ssa.hpp"
+
+namespace cminusminus{
+
+/*
+The optimization passes over SSAProc. Each leaves the procedure in
+valid SSA form for the next; optimizeIR runs them in order.
+*/
+
+static const size_t none = SIZE_MAX;
+
+/* No side effects, no reads of memory, and no way to trap: free to
+   delete, merge with an equal instruction or move */
+static bool isPure(const Instr& instr){
+	switch (instr.op){
+	case IROp::MOV:
+		return !instr.dst.isMem() && !instr.a.isMem();
+	case IROp::ADD: case IROp::SUB: case IROp::MUL:
+	case IROp::NEG: case IROp::NOT:
+	case IROp::SEQ: case IROp::SNE: case IROp::SLT:
+	case IROp::SLE: case IROp::SGT: case IROp::SGE:
+	case IROp::ADDR:
+		return true;
+	case IROp::DIV:
+		return instr.b.isImm() && instr.b.val != 0;
+	default:
+		return false;
+	}
+}
+
+/* Whether instr matters even when nothing reads its result */
+static bool hasEffect(const Instr& instr){
+	switch (instr.op){
+	case IROp::MOV:
+		return instr.dst.isMem();
+	case IROp::DIV:
+		return !isPure(instr);
+	case IROp::STORE: case IROp::CALL: case IROp::WRITE: case IROp::READ:
+	case IROp::RET: case IROp::ARG:
+		return true;
+	default:
+		return instr.isBranch();
+	}
+}
+
+static bool isTerminator(const Instr& instr){
+	return instr.isBranch() || instr.op == IROp::RET;
+}
+
+static bool commutes(IROp op){
+	return op == IROp::ADD || op == IROp::MUL
+		|| op == IROp::SEQ || op == IROp::SNE;
+}
+
+/* Whether comparison op (a set or a branch) holds */
+static bool compare(IROp op, int64_t a, int64_t b){
+	switch (op){
+	case IROp::SEQ: case IROp::BEQ: return a == b;
+	case IROp::SNE: case IROp::BNE: return a != b;
+	case IROp::SLT: case IROp::BLT: return a < b;
+	case IROp::SLE: case IROp::BLE: return a <= b;
+	case IROp::SGT: case IROp::BGT: return a > b;
+	default: return a >= b;
+	}
+}
+
+/* Evaluate op on constants as the machine would. False if it cannot
+   be (or, for division by zero, must not be) */
+static bool fold(IROp op, IRType type, int64_t a, int64_t b, int64_t& result){
+	switch (op){
+	case IROp::ADD: result = wrapTo(type, a + b); return true;
+	case IROp::SUB: result = wrapTo(type, a - b); return true;
+	case IROp::MUL: result = wrapTo(type, a * b); return true;
+	case IROp::DIV:
+		if (b == 0){ return false; }
+		result = wrapTo(type, a / b);
+		return true;
+	case IROp::NEG: result = wrapTo(type, -a); return true;
+	case IROp::NOT: result = a == 0; return true;
+	case IROp::SEQ: case IROp::SNE: case IROp::SLT:
+	case IROp::SLE: case IROp::SGT: case IROp::SGE:
+		result = compare(op, a, b);
+		return true;
+	default:
+		return false;
+	}
+}
+
+static bool folds(IROp op){
+	return op >= IROp::ADD && op <= IROp::SGE;
+}
+
+namespace {
+
+struct Lattice{
+	enum Kind { TOP, CONST, BOTTOM };
+	Kind kind;
+	int64_t val;
+};
+
+struct Use{
+	size_t block;
+	size_t idx;
+	bool phi;
+};
+
+Lattice meet(Lattice x, Lattice y){
+	if (x.kind == Lattice::TOP){ return y; }
+	if (y.kind == Lattice::TOP){ return x; }
+	if (x.kind == Lattice::CONST && y.kind == Lattice::CONST && x.val == y.val){
+		return x;
+	}
+	return Lattice{Lattice::BOTTOM, 0};
+}
+
+}
+
+/* Sparse conditional constant propagation (Wegman and Zadeck):
+   find the temps that are constant along the paths that can run,
+   substitute them, and drop the edges and blocks that never run */
+static void sccp(SSAProc& ssa){
+	std::vector<SSABlock>& blocks = ssa.blocks;
+	std::vector<Lattice> lat(ssa.numTemps, Lattice{Lattice::TOP, 0});
+	std::vector<std::vector<Use>> uses(ssa.numTemps);
+	std::vector<std::vector<bool>> edgeRuns(blocks.size());
+	std::vector<bool> runs(blocks.size(), false);
+	for (size_t b = 0; b < blocks.size(); b++){
+		const SSABlock& blk = blocks[b];
+		edgeRuns[b].assign(blk.preds.size(), false);
+		for (size_t i = 0; i < blk.phis.size(); i++){
+			for (const Opd& arg : blk.phis[i].args){
+				if (arg.isTemp()){ uses[arg.idx()].push_back(Use{b, i, true}); }
+			}
+		}
+		for (size_t i = 0; i < blk.code.size(); i++){
+			const Instr& instr = blk.code[i];
+			if (instr.a.isTemp()){ uses[instr.a.idx()].push_back(Use{b, i, false}); }
+			if (instr.b.isTemp()){ uses[instr.b.idx()].push_back(Use{b, i, false}); }
+		}
+	}
+
+	std::vector<std::pair<size_t, size_t>> flowWork;
+	std::vector<size_t> ssaWork;
+	auto valueOf = [&](const Opd& opd){
+		if (opd.isImm()){ return Lattice{Lattice::CONST, opd.val}; }
+		if (opd.isTemp()){ return lat[opd.idx()]; }
+		return Lattice{Lattice::BOTTOM, 0};
+	};
+	auto lower = [&](size_t t, Lattice val){
+		Lattice next = meet(lat[t], val);
+		if (next.kind != lat[t].kind || next.val != lat[t].val){
+			lat[t] = next;
+			ssaWork.push_back(t);
+		}
+	};
+	auto visitPhi = [&](size_t b, size_t i){
+		const SSAPhi& phi = blocks[b].phis[i];
+		Lattice val{Lattice::TOP, 0};
+		for (size_t k = 0; k < phi.args.size(); k++){
+			if (edgeRuns[b][k]){ val = meet(val, valueOf(phi.args[k])); }
+		}
+		lower(phi.dst, val);
+	};
+	auto visit = [&](size_t b, const Instr& instr){
+		if (instr.op == IROp::JMP){
+			flowWork.emplace_back(b, blocks[b].succs[0]);
+			return;
+		}
+		if (instr.isBranch()){
+			Lattice x = valueOf(instr.a);
+			Lattice y = valueOf(instr.b);
+			if (x.kind == Lattice::CONST && y.kind == Lattice::CONST){
+				bool taken = compare(instr.op, x.val, y.val);
+				flowWork.emplace_back(b, blocks[b].succs[taken ? 0 : 1]);
+			} else if (x.kind == Lattice::BOTTOM || y.kind == Lattice::BOTTOM){
+				flowWork.emplace_back(b, blocks[b].succs[0]);
+				flowWork.emplace_back(b, blocks[b].succs[1]);
+			}
+			return;
+		}
+		int64_t d = instr.def();
+		if (d < 0){ return; }
+		Lattice result{Lattice::BOTTOM, 0};
+		if (instr.op == IROp::MOV && (instr.a.isTemp() || instr.a.isImm())){
+			result = valueOf(instr.a);
+		} else if (folds(instr.op)){
+			Lattice x = valueOf(instr.a);
+			Lattice y = instr.b.isNone() ? Lattice{Lattice::CONST, 0}
+				: valueOf(instr.b);
+			int64_t val;
+			if (x.kind == Lattice::TOP || y.kind == Lattice::TOP){
+				result = Lattice{Lattice::TOP, 0};
+				if (x.kind == Lattice::BOTTOM || y.kind == Lattice::BOTTOM){
+					result.kind = Lattice::BOTTOM;
+				}
+			} else if (x.kind == Lattice::CONST && y.kind == Lattice::CONST
+				&& fold(instr.op, instr.type, x.val, y.val, val)){
+				result = Lattice{Lattice::CONST, val};
+			}
+		}
+		lower(static_cast<size_t>(d), result);
+	};
+
+	flowWork.emplace_back(none, 0);
+	while (!flowWork.empty() || !ssaWork.empty()){
+		while (!flowWork.empty()){
+			size_t from = flowWork.back().first;
+			size_t to = flowWork.back().second;
+			flowWork.pop_back();
+			if (from != none){
+				const std::vector<size_t>& preds = blocks[to].preds;
+				size_t k = static_cast<size_t>(std::find(preds.begin(),
+					preds.end(), from) - preds.begin());
+				if (edgeRuns[to][k]){ continue; }
+				edgeRuns[to][k] = true;
+			}
+			for (size_t i = 0; i < blocks[to].phis.size(); i++){
+				visitPhi(to, i);
+			}
+			if (!runs[to]){
+				runs[to] = true;
+				for (const Instr& instr : blocks[to].code){ visit(to, instr); }
+			}
+		}
+		while (!ssaWork.empty()){
+			size_t t = ssaWork.back();
+			ssaWork.pop_back();
+			for (const Use& use : uses[t]){
+				if (!runs[use.block]){ continue; }
+				if (use.phi){
+					visitPhi(use.block, use.idx);
+				} else {
+					visit(use.block, blocks[use.block].code[use.idx]);
+				}
+			}
+		}
+	}
+
+	//Edges out of blocks that never run go with those blocks
+	for (size_t b = 0; b < blocks.size(); b++){
+		for (size_t k = blocks[b].preds.size(); k-- > 0; ){
+			if (!edgeRuns[b][k] && runs[blocks[b].preds[k]]){
+				ssa.removeEdge(b, k);
+			}
+		}
+	}
+	ssa.removeUnreachable();
+	auto substitute = [&](Opd& opd){
+		if (opd.isTemp() && lat[opd.idx()].kind == Lattice::CONST){
+			opd = Opd::imm(lat[opd.idx()].val);
+		}
+	};
+	for (SSABlock& blk : blocks){
+		for (SSAPhi& phi : blk.phis){
+			for (Opd& arg : phi.args){ substitute(arg); }
+		}
+		for (Instr& instr : blk.code){
+			substitute(instr.a);
+			substitute(instr.b);
+		}
+	}
+}
+
+/* Global value numbering over the dominator tree: a pure instruction
+   that repeats one dominating it reuses that result, copies are
+   propagated, and a phi whose arguments all agree is dropped */
+static void gvn(SSAProc& ssa){
+	std::vector<SSABlock>& blocks = ssa.blocks;
+	ssa.computeDominators();
+	std::vector<Opd> repl(ssa.numTemps);
+	auto resolve = [&](Opd opd){
+		while (opd.isTemp() && !repl[opd.idx()].isNone()){
+			opd = repl[opd.idx()];
+		}
+		return opd;
+	};
+	typedef std::tuple<IROp, IRType, int, int64_t, int, int64_t> Key;
+	std::map<Key, size_t> available;
+	std::vector<std::vector<Key>> added(blocks.size());
+
+	std::vector<std::pair<size_t, bool>> work;
+	work.emplace_back(0, false);
+	while (!work.empty()){
+		size_t b = work.back().first;
+		bool leaving = work.back().second;
+		work.pop_back();
+		if (leaving){
+			for (const Key& key : added[b]){ available.erase(key); }
+			continue;
+		}
+		work.emplace_back(b, true);
+		SSABlock& blk = blocks[b];
+
+		std::vector<SSAPhi> phis;
+		for (SSAPhi& phi : blk.phis){
+			Opd same;
+			bool agree = true;
+			for (Opd& arg : phi.args){
+				arg = resolve(arg);
+				if (arg == Opd::temp(phi.dst)){ continue; }
+				if (same.isNone()){
+					same = arg;
+				} else if (arg != same){
+					agree = false;
+				}
+			}
+			if (agree && !same.isNone()){
+				repl[phi.dst] = same;
+			} else {
+				phis.push_back(phi);
+			}
+		}
+		blk.phis.swap(phis);
+
+		std::vector<Instr> code;
+		for (Instr instr : blk.code){
+			instr.a = resolve(instr.a);
+			instr.b = resolve(instr.b);
+			if (!isPure(instr) || !instr.dst.isTemp()){
+				code.push_back(instr);
+				continue;
+			}
+			size_t dst = instr.dst.idx();
+			if (instr.op == IROp::MOV){
+				repl[dst] = instr.a;
+				continue;
+			}
+			int64_t val;
+			bool constant = instr.a.isImm()
+				&& (instr.b.isImm() || instr.b.isNone());
+			if (constant && fold(instr.op, instr.type, instr.a.val,
+				instr.b.val, val)){
+				repl[dst] = Opd::imm(val);
+				continue;
+			}
+			//x + 0, x - 0, x * 1 and x / 1 are x
+			bool identity = instr.b.isImm()
+				&& ((instr.b.val == 0 && (instr.op == IROp::ADD
+					|| instr.op == IROp::SUB))
+				|| (instr.b.val == 1 && (instr.op == IROp::MUL
+					|| instr.op == IROp::DIV)));
+			if (identity && instr.type != IRType::PTR){
+				repl[dst] = instr.a;
+				continue;
+			}
+			Opd a = instr.a;
+			Opd bOpd = instr.b;
+			if (commutes(instr.op) && std::make_pair(a.kind, a.val)
+				> std::make_pair(bOpd.kind, bOpd.val)){
+				std::swap(a, bOpd);
+			}
+			Key key(instr.op, instr.type, a.kind, a.val, bOpd.kind, bOpd.val);
+			auto found = available.find(key);
+			if (found != available.end()){
+				repl[dst] = Opd::temp(found->second);
+				continue;
+			}
+			available.emplace(key, dst);
+			added[b].push_back(key);
+			code.push_back(instr);
+		}
+		blk.code.swap(code);
+		for (size_t child : ssa.domChildren[b]){
+			work.emplace_back(child, false);
+		}
+	}
+
+	//Uses reached over back edges were not seen above
+	for (SSABlock& blk : blocks){
+		for (SSAPhi& phi : blk.phis){
+			for (Opd& arg : phi.args){ arg = resolve(arg); }
+		}
+		for (Instr& instr : blk.code){
+			instr.a = resolve(instr.a);
+			instr.b = resolve(instr.b);
+		}
+	}
+}
+
+/* Give loop header h a preheader: a block that every entry into the
+   loop passes through, and nothing inside the loop reaches */
+static void addPreheader(SSAProc& ssa, size_t h){
+	std::vector<size_t> outside;
+	std::vector<size_t> inside;
+	const std::vector<size_t>& preds = ssa.blocks[h].preds;
+	for (size_t k = 0; k < preds.size(); k++){
+		if (ssa.dominates(h, preds[k])){
+			inside.push_back(k);
+		} else {
+			outside.push_back(k);
+		}
+	}
+	if (outside.size() == 1
+		&& ssa.blocks[preds[outside[0]]].succs.size() == 1){
+		return;
+	}
+
+	size_t pre = ssa.newBlock(h);
+	SSABlock& header = ssa.blocks[h];
+	SSABlock& blk = ssa.blocks[pre];
+	blk.code.push_back(Instr{IROp::JMP, IRType::INT, Opd(),
+		Opd::label(h), Opd()});
+	blk.succs.push_back(h);
+	for (size_t k : outside){
+		size_t p = header.preds[k];
+		blk.preds.push_back(p);
+		std::vector<size_t>& succs = ssa.blocks[p].succs;
+		*std::find(succs.begin(), succs.end(), h) = pre;
+	}
+	std::vector<size_t> newPreds{pre};
+	for (size_t k : inside){ newPreds.push_back(header.preds[k]); }
+	for (SSAPhi& phi : header.phis){
+		std::vector<Opd> args;
+		if (outside.size() == 1){
+			args.push_back(phi.args[outside[0]]);
+		} else {
+			SSAPhi merged{phi.type, ssa.newTemp().idx(), {}};
+			for (size_t k : outside){ merged.args.push_back(phi.args[k]); }
+			args.push_back(Opd::temp(merged.dst));
+			blk.phis.push_back(merged);
+		}
+		for (size_t k : inside){ args.push_back(phi.args[k]); }
+		phi.args.swap(args);
+	}
+	header.preds.swap(newPreds);
+}
+
+/* Loop-invariant code motion: pure instructions in a loop whose
+   operands all come from outside it move to the loop's preheader,
+   innermost loops first */
+static void licm(SSAProc& ssa){
+	ssa.computeDominators();
+	std::vector<size_t> headers;
+	for (size_t b : ssa.rpo){
+		for (size_t s : ssa.blocks[b].succs){
+			if (ssa.dominates(s, b)
+				&& std::find(headers.begin(), headers.end(), s) == headers.end()){
+				headers.push_back(s);
+			}
+		}
+	}
+	if (headers.empty()){ return; }
+	for (size_t h : headers){ addPreheader(ssa, h); }
+	ssa.computeDominators();
+
+	std::vector<SSABlock>& blocks = ssa.blocks;
+	std::vector<std::vector<bool>> bodies;
+	std::vector<size_t> sizes;
+	for (size_t h : headers){
+		std::vector<bool> body(blocks.size(), false);
+		body[h] = true;
+		size_t size = 1;
+		std::vector<size_t> work;
+		for (size_t p : blocks[h].preds){
+			if (ssa.dominates(h, p) && !body[p]){
+				body[p] = true;
+				size++;
+				work.push_back(p);
+			}
+		}
+		while (!work.empty()){
+			size_t b = work.back();
+			work.pop_back();
+			for (size_t p : blocks[b].preds){
+				if (!body[p]){
+					body[p] = true;
+					size++;
+					work.push_back(p);
+				}
+			}
+		}
+		bodies.push_back(body);
+		sizes.push_back(size);
+	}
+	std::vector<size_t> order;
+	for (size_t i = 0; i < headers.size(); i++){ order.push_back(i); }
+	std::sort(order.begin(), order.end(), [&](size_t x, size_t y){
+		return sizes[x] < sizes[y];
+	});
+
+	std::vector<size_t> defBlock(ssa.numTemps, none);
+	for (size_t b = 0; b < blocks.size(); b++){
+		for (const SSAPhi& phi : blocks[b].phis){ defBlock[phi.dst] = b; }
+		for (const Instr& instr : blocks[b].code){
+			int64_t d = instr.def();
+			if (d >= 0){ defBlock[static_cast<size_t>(d)] = b; }
+		}
+	}
+	for (size_t i : order){
+		const std::vector<bool>& body = bodies[i];
+		size_t h = headers[i];
+		//The preheader is the header's one predecessor from outside
+		size_t pre = none;
+		for (size_t p : blocks[h].preds){
+			if (!body[p]){ pre = p; }
+		}
+		auto outside = [&](const Opd& opd){
+			return !opd.isTemp() || !body[defBlock[opd.idx()]];
+		};
+		bool changed = true;
+		while (changed){
+			changed = false;
+			for (size_t b : ssa.rpo){
+				if (!body[b]){ continue; }
+				std::vector<Instr> kept;
+				for (const Instr& instr : blocks[b].code){
+					if (isPure(instr) && instr.dst.isTemp()
+						&& outside(instr.a) && outside(instr.b)){
+						std::vector<Instr>& dest = blocks[pre].code;
+						dest.insert(dest.end() - 1, instr);
+						defBlock[instr.dst.idx()] = pre;
+						changed = true;
+					} else {
+						kept.push_back(instr);
+					}
+				}
+				blocks[b].code.swap(kept);
+			}
+		}
+	}
+}
+
+/* Dead code elimination: keep what has an effect and, transitively,
+   whatever computes its operands */
+static void dce(SSAProc& ssa){
+	std::vector<SSABlock>& blocks = ssa.blocks;
+	//Where each temp is defined: block, index, and whether a phi
+	std::vector<Use> defs(ssa.numTemps, Use{none, 0, false});
+	std::vector<std::vector<bool>> livePhi(blocks.size());
+	std::vector<std::vector<bool>> liveCode(blocks.size());
+	std::vector<size_t> work;
+	auto need = [&](const Opd& opd){
+		if (opd.isTemp()){ work.push_back(opd.idx()); }
+	};
+	for (size_t b = 0; b < blocks.size(); b++){
+		const SSABlock& blk = blocks[b];
+		livePhi[b].assign(blk.phis.size(), false);
+		liveCode[b].assign(blk.code.size(), false);
+		for (size_t i = 0; i < blk.phis.size(); i++){
+			defs[blk.phis[i].dst] = Use{b, i, true};
+		}
+		for (size_t i = 0; i < blk.code.size(); i++){
+			const Instr& instr = blk.code[i];
+			int64_t d = instr.def();
+			if (d >= 0){ defs[static_cast<size_t>(d)] = Use{b, i, false}; }
+			if (hasEffect(instr) || isTerminator(instr)){
+				liveCode[b][i] = true;
+				need(instr.a);
+				need(instr.b);
+			}
+		}
+	}
+	while (!work.empty()){
+		Use def = defs[work.back()];
+		work.pop_back();
+		if (def.block == none){ continue; }
+		if (def.phi){
+			if (livePhi[def.block][def.idx]){ continue; }
+			livePhi[def.block][def.idx] = true;
+			for (const Opd& arg : blocks[def.block].phis[def.idx].args){ need(arg); }
+		} else {
+			if (liveCode[def.block][def.idx]){ continue; }
+			liveCode[def.block][def.idx] = true;
+			need(blocks[def.block].code[def.idx].a);
+			need(blocks[def.block].code[def.idx].b);
+		}
+	}
+	for (size_t b = 0; b < blocks.size(); b++){
+		SSABlock& blk = blocks[b];
+		std::vector<SSAPhi> phis;
+		for (size_t i = 0; i < blk.phis.size(); i++){
+			if (livePhi[b][i]){ phis.push_back(blk.phis[i]); }
+		}
+		blk.phis.swap(phis);
+		std::vector<Instr> code;
+		for (size_t i = 0; i < blk.code.size(); i++){
+			if (liveCode[b][i]){ code.push_back(blk.code[i]); }
+		}
+		blk.code.swap(code);
+	}
+}
+
+namespace {
+
+struct Pass{
+	const char * name;
+	void (*run)(SSAProc&);
+};
+
+struct PassCost{
+	const char * name;
+	double seconds;
+	size_t before;
+	size_t after;
+};
+
+}
+
+void optimizeIR(IRProgram * prog, std::ostream * dump, std::ostream * timing){
+	typedef std::chrono::steady_clock Clock;
+	static const Pass passes[] = {
+		{ "sccp", sccp },
+		{ "gvn", gvn },
+		{ "licm", licm },
+		{ "dce", dce },
+	};
+	const size_t numPasses = sizeof(passes) / sizeof(passes[0]);
+	std::vector<PassCost> costs;
+	costs.push_back(PassCost{"to ssa", 0, 0, 0});
+	for (const Pass& pass : passes){
+		costs.push_back(PassCost{pass.name, 0, 0, 0});
+	}
+	costs.push_back(PassCost{"from ssa", 0, 0, 0});
+	auto charge = [&](PassCost& cost, Clock::time_point start,
+		size_t before, size_t after){
+		cost.seconds += std::chrono::duration<double>(Clock::now() - start).count();
+		cost.before += before;
+		cost.after += after;
+	};
+	auto show = [&](const IRProc& proc, const SSAProc& ssa, const char * stage){
+		if (dump == nullptr){ return; }
+		*dump << "== " << proc.name << " after " << stage << "\n";
+		ssa.print(*prog, *dump);
+		*dump << "\n";
+	};
+
+	for (IRProc& proc : prog->procs){
+		Clock::time_point start = Clock::now();
+		size_t before = proc.code.size();
+		SSAProc ssa(proc);
+		charge(costs[0], start, before, ssa.size());
+		show(proc, ssa, costs[0].name);
+		for (size_t i = 0; i < numPasses; i++){
+			start = Clock::now();
+			before = ssa.size();
+			passes[i].run(ssa);
+			charge(costs[i + 1], start, before, ssa.size());
+			show(proc, ssa, passes[i].name);
+		}
+		start = Clock::now();
+		before = ssa.size();
+		ssa.destroy(proc);
+		charge(costs.back(), start, before, proc.code.size());
+	}
+
+	if (timing == nullptr){ return; }
+	*timing << std::left << std::setw(10) << "pass" << std::right
+		<< std::setw(12) << "ms" << std::setw(10) << "before"
+		<< std::setw(10) << "after" << "\n";
+	double total = 0;
+	for (const PassCost& cost : costs){
+		total += cost.seconds;
+		*timing << std::left << std::setw(10) << cost.name << std::right
+			<< std::setw(12) << std::fixed << std::setprecision(3)
+			<< cost.seconds * 1000 << std::setw(10) << cost.before
+			<< std::setw(10) << cost.after << "\n";
+	}
+	*timing << std::left << std::setw(10) << "total" << std::right
+		<< std::setw(12) << total * 1000 << "\n";
+}
+
+}
@@ -0,0 +1,638 @@
+#include <atomic>
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <spawn.h>
+#include <sstream>
+#include <string>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#include "compiler.hpp"
+#include "inliner.hpp"
+#include "ir.hpp"
+#include "serialize.hpp"
+#include "ssa.hpp"
+#include "vm.hpp"
+#include "x64.hpp"
+
+/*
+In-process golden test runner. Every <name>.cmm test is compiled
+with the equivalent of `cmmc <name>.cmm -u <name>.unparse`, and the
+unparse and stderr output are compared in memory against
+<name>.unparse.expected and <name>.err.expected. Tests run on all
+cores; output files are only written for tests that fail, so they
+can be inspected just as with the serial Makefile rule.
+
+Every test is also parsed with the hand-written parser (descent.hpp),
+which must agree with bison: the same diagnostics, and an AST that
+serializes to the same bytes, spans and all. It is parsed once more
+with the lexer on a thread of its own (pipeline.hpp), and again from
+packed tokens lexed up front (packed.hpp), which must make no
+difference either. So must sharing nodes (intern.hpp): written out
+with its interner, the shared tree must give the same bytes too.
+
+A test with a <name>.check.expected has its names and types checked,
+and what cmmc -c would write to stderr compared with it. The types are
+checked once on one thread and once on eight, which must report the
+very same errors in the very same order, and once more in a tree
+that shares nodes, where each error must still be at its own use.
+One with a <name>.names.expected has its names resolved, and the
+program form that cmmc -n writes compared with it. Likewise
+<name>.simplify.expected for what cmmc -s writes.
+
+A test with a <name>.run.expected is also a program to run, on the
+input in <name>.in if there is one: it is checked and lowered, with
+and without -O, and under -O with no inlining (-inline-budget 0),
+then run on the bytecode VM (as by cmmc -r), by the IR interpreter,
+and as an executable built as by cmmc -o. Each must write
+exactly what <name>.run.expected holds, and the VM and interpreter
+must agree with each other.
+
+A test with a <name>.ssa.expected is optimized as by cmmc -O -dump-ssa,
+and the SSA written after each pass compared with it. Likewise
+<name>.inline.expected for the report of cmmc -O -inline-report.
+
+Usage: runner [-j <threads>] [-bench <reps>] [test.cmm ...]
+With no tests named, every *.cmm in the current directory is run.
+With -bench, the tests are instead parsed reps times over with each
+parser, lexing inline, pipelined and packed, and the time each took
+is reported; then lexed alone, on one thread and cut into pieces for
+as many threads as -j (no more than there are cores).
+*/
+
+using namespace cminusminus;
+
+struct GoldenTest{
+	std::string name;
+	std::string source;
+	bool haveUnparse;
+	std::string expectedUnparse;
+	bool haveErr;
+	std::string expectedErr;
+	bool haveCheck;
+	std::string expectedCheck;
+	bool haveNames;
+	std::string expectedNames;
+	bool haveSimplify;
+	std::string expectedSimplify;
+	bool haveRun;
+	std::string expectedRun;
+	std::string input;
+	bool haveSSA;
+	std::string expectedSSA;
+	bool haveInline;
+	std::string expectedInline;
+
+	std::string actualUnparse;
+	std::string actualErr;
+	bool aborted;
+	bool parsersAgree;
+	/* Why any of the optional goldens failed, one line each */
+	std::vector<std::string> problems;
+	bool passed;
+};
+
+static bool readFile(const std::string& path, std::string& out){
+	std::ifstream in(path, std::ios::binary);
+	if (!in.good()){ return false; }
+	std::ostringstream contents;
+	contents << in.rdbuf();
+	out = contents.str();
+	return true;
+}
+
+static void writeFile(const std::string& path, const std::string& text){
+	std::ofstream out(path, std::ios::binary);
+	out << text;
+}
+
+/*
+The serial runner checks with `diff -B --ignore-all-space`: all
+whitespace within a line is ignored, and lines that are then empty
+are ignored altogether. So two outputs agree when their lists of
+whitespace-stripped, non-empty lines agree. (diff can still flag a
+pair like this if its alignment happens to match blank lines against
+each other instead of matching the content lines; goldens that only
+differ by reordered blank lines are not worth emulating that for.)
+*/
+static std::vector<std::string> significantLines(const std::string& text){
+	std::vector<std::string> lines;
+	std::string line;
+	for (char c : text){
+		if (c == '\n'){
+			if (!line.empty()){ lines.push_back(line); }
+			line.clear();
+		} else if (!isspace(static_cast<unsigned char>(c))){
+			line += c;
+		}
+	}
+	if (!line.empty()){ lines.push_back(line); }
+	return lines;
+}
+
+static bool sameOutput(const std::string& actual, const std::string& expected){
+	return significantLines(actual) == significantLines(expected);
+}
+
+/* The binary AST, which for a tree that shares nodes is still that of
+   the tree without sharing, spans and all */
+static std::string serialized(const Compilation& comp){
+	if (comp.ast() == nullptr){ return ""; }
+	std::ostringstream out;
+	writeAST(comp.ast(), out, comp.interner());
+	return out.str();
+}
+
+static bool sameDiagnostics(const Compilation& x, const Compilation& y){
+	if (x.diagnostics().size() != y.diagnostics().size()){ return false; }
+	for (size_t i = 0; i < x.diagnostics().size(); i++){
+		if (x.diagnostics()[i].str() != y.diagnostics()[i].str()){
+			return false;
+		}
+	}
+	return true;
+}
+
+/* How a test is parsed: by which parser, where its tokens come from,
+   and whether it shares nodes */
+struct ParseMode{
+	bool descent;
+	bool pipelined;
+	bool packed;
+	bool share;
+};
+
+/* Parse test again as mode says, and compare with what bison made of it */
+static bool parseAgrees(const GoldenTest& test, const Compilation& bison,
+	ParseMode mode){
+	Compilation comp(test.source.data(), test.source.size());
+	comp.setDescentParser(mode.descent);
+	comp.setPipelined(mode.pipelined);
+	comp.setPackedTokens(mode.packed);
+	comp.setShareNodes(mode.share);
+	comp.parse();
+	return comp.aborted() == bison.aborted()
+		&& sameDiagnostics(comp, bison)
+		&& serialized(comp) == serialized(bison);
+}
+
+/* Compare what a check of test wrote, as kind (that of a file name),
+   with its <name>.<kind>.expected */
+static void checkGolden(GoldenTest& test, const std::string& kind,
+	const std::string& actual, const std::string& expected){
+	if (sameOutput(actual, expected)){ return; }
+	std::string path = test.name + "." + kind;
+	writeFile(path, actual);
+	test.problems.push_back(kind + " output differs: diff " + path + " "
+		+ path + ".expected");
+}
+
+/* What cmmc -c writes to stderr for test, checking function bodies
+   on up to threads threads, in a tree that shares nodes if share */
+static std::string checked(const GoldenTest& test, unsigned int threads,
+	bool share){
+	Compilation comp(test.source.data(), test.source.size());
+	comp.setShareNodes(share);
+	std::ostringstream err;
+	std::ostringstream detail;
+	if (!comp.parse()){ return ""; }
+	const char * failed = nullptr;
+	if (!comp.analyzeNames()){
+		failed = "Name Analysis Failed";
+	} else if (!comp.checkTypes(threads)){
+		failed = "Type Analysis Failed";
+	}
+	comp.writeDiagnostics(err, detail);
+	if (failed != nullptr){ err << failed << "\n"; }
+	return err.str();
+}
+
+/* What cmmc -n writes for test: nothing if a name is bad */
+static std::string named(const GoldenTest& test){
+	Compilation comp(test.source.data(), test.source.size());
+	std::ostringstream out;
+	if (comp.parse() && comp.analyzeNames()){ comp.unparse(out); }
+	return out.str();
+}
+
+/* What cmmc -s writes for test: its program with constants folded */
+static std::string simplified(const GoldenTest& test){
+	Compilation comp(test.source.data(), test.source.size());
+	std::ostringstream out;
+	if (comp.parse()){
+		comp.ast()->simplify();
+		comp.unparse(out);
+	}
+	return out.str();
+}
+
+/* How a program is lowered: whether it is then optimized as by -O,
+   under what inlining budget, and where the reports of that go */
+struct Lowering{
+	bool opt;
+	size_t inlineBudget;
+	std::ostream * inlineReport;
+	std::ostream * ssaDump;
+};
+
+/* Check and lower test's program, as cmmc does for -r, -a and -o,
+   and optimize it as how says. Returns nullptr, saying why in test's
+   problems, if it has errors */
+static IRProgram * lowered(GoldenTest& test, const Lowering& how){
+	Compilation comp(test.source.data(), test.source.size());
+	if (!comp.parse() || !comp.analyzeNames() || !comp.checkTypes(1)){
+		test.problems.push_back("the program to run has errors");
+		return nullptr;
+	}
+	try {
+		IRProgram * prog = lowerProgram(comp.ast(), comp.types());
+		if (how.opt){
+			inlineCalls(prog, how.inlineBudget, how.inlineReport);
+			optimizeIR(prog, how.ssaDump);
+		}
+		return prog;
+	} catch (UserError * e){
+		test.problems.push_back(std::string("cannot lower: ") + e->msg());
+		delete e;
+	}
+	return nullptr;
+}
+
+/* Run the executable at path, its stdin the file at inPath and its
+   stdout the file at outPath. Returns whether it ran and exited */
+static bool runExecutable(const std::string& path, const std::string& inPath,
+	const std::string& outPath){
+	posix_spawn_file_actions_t files;
+	posix_spawn_file_actions_init(&files);
+	posix_spawn_file_actions_addopen(&files, 0, inPath.c_str(),
+		O_RDONLY, 0);
+	posix_spawn_file_actions_addopen(&files, 1, outPath.c_str(),
+		O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	std::string program = "./" + path;
+	char * argv[] = { &program[0], nullptr };
+	pid_t pid;
+	int spawned = posix_spawn(&pid, program.c_str(), &files, nullptr,
+		argv, environ);
+	posix_spawn_file_actions_destroy(&files);
+	if (spawned != 0){ return false; }
+	int status;
+	while (waitpid(pid, &status, 0) < 0){
+		if (errno != EINTR){ return false; }
+	}
+	return WIFEXITED(status);
+}
+
+/* Build prog into an executable named base, as cmmc -o does, run it
+   on test's input, and compare what it writes with the golden */
+static void checkNative(GoldenTest& test, const IRProgram& prog,
+	const std::string& base){
+	std::string asmPath = base + ".s";
+	std::string outPath = base + ".run";
+	{
+		std::ofstream asmFile(asmPath);
+		emitX64(prog, asmFile);
+	}
+	std::string inPath = test.name + ".in";
+	if (access(inPath.c_str(), R_OK) != 0){ inPath = "/dev/null"; }
+	std::string actual;
+	bool passed = false;
+	if (!linkExecutable(asmPath, base)){
+		test.problems.push_back("cc could not build " + asmPath);
+	} else if (!runExecutable(base, inPath, outPath)
+		|| !readFile(outPath, actual)){
+		test.problems.push_back("could not run " + base);
+	} else if (actual != test.expectedRun){
+		test.problems.push_back("run output differs: diff " + outPath
+			+ " " + test.name + ".run.expected");
+	} else {
+		passed = true;
+	}
+	//The assembly and what it wrote are kept for a look if wrong
+	std::remove(base.c_str());
+	if (passed){
+		std::remove(asmPath.c_str());
+		std::remove(outPath.c_str());
+	}
+}
+
+/* What prog writes when run on input by the bytecode VM, or by the
+   IR interpreter if not bytecode, ending with why it stopped if it
+   did not finish */
+static std::string interpreted(const IRProgram& prog,
+	const std::string& input, bool bytecode){
+	std::istringstream in(input);
+	std::ostringstream out;
+	try {
+		if (bytecode){
+			std::unique_ptr<Bytecode> code(compileBytecode(prog));
+			runBytecode(*code, in, out);
+		} else {
+			interpretIR(prog, in, out);
+		}
+	} catch (UserError * e){
+		out << "\n(stopped: " << e->msg() << ")\n";
+		delete e;
+	}
+	return out.str();
+}
+
+/* Compare what running test's program in-process as base wrote with
+   the golden, leaving it in <base>.run if it differs */
+static void checkOutput(GoldenTest& test, const std::string& base,
+	const std::string& actual){
+	if (actual == test.expectedRun){ return; }
+	writeFile(base + ".run", actual);
+	test.problems.push_back("run output differs: diff " + base + ".run "
+		+ test.name + ".run.expected");
+}
+
+/* Run test's program every way <name>.run.expected is checked */
+static void checkRun(GoldenTest& test){
+	struct Variant{
+		const char * suffix;
+		Lowering how;
+	};
+	const Variant variants[] = {
+		{ "", { false, 0, nullptr, nullptr } },
+		{ ".O", { true, defaultInlineBudget, nullptr, nullptr } },
+		{ ".O.noinline", { true, 0, nullptr, nullptr } },
+	};
+	for (const Variant& variant : variants){
+		std::unique_ptr<IRProgram> prog(lowered(test, variant.how));
+		if (prog == nullptr){ return; }
+		std::string base = test.name + variant.suffix;
+		std::string vm = interpreted(*prog, test.input, true);
+		std::string ir = interpreted(*prog, test.input, false);
+		if (vm != ir){
+			test.problems.push_back("the VM and the IR interpreter"
+				" disagree on " + base);
+		}
+		checkOutput(test, base + ".vm", vm);
+		checkOutput(test, base + ".ir", ir);
+		checkNative(test, *prog, base + ".native");
+	}
+}
+
+/* Optimize test's program as cmmc -O -dump-ssa does, and compare the
+   dump with the golden */
+static void checkSSA(GoldenTest& test){
+	std::ostringstream dump;
+	std::unique_ptr<IRProgram> prog(lowered(test,
+		{ true, defaultInlineBudget, nullptr, &dump }));
+	if (prog == nullptr){ return; }
+	checkGolden(test, "ssa", dump.str(), test.expectedSSA);
+}
+
+/* Inline test's program as cmmc -O -inline-report does, and compare
+   the report with the golden */
+static void checkInline(GoldenTest& test){
+	std::ostringstream report;
+	std::unique_ptr<IRProgram> prog(lowered(test,
+		{ true, defaultInlineBudget, &report, nullptr }));
+	if (prog == nullptr){ return; }
+	checkGolden(test, "inline", report.str(), test.expectedInline);
+}
+
+/* Does what cmmc -u does, capturing stdout-file and stderr */
+static void runTest(GoldenTest& test){
+	Compilation comp(test.source.data(), test.source.size());
+	std::ostringstream err;
+	std::ostringstream detail;
+	bool parsed = comp.parse();
+	comp.writeDiagnostics(err, detail);
+	test.aborted = comp.aborted();
+	if (!test.aborted){
+		if (parsed){
+			std::ostringstream unparsed;
+			comp.unparse(unparsed);
+			test.actualUnparse = unparsed.str();
+		} else {
+			err << "No AST built\n";
+		}
+	}
+	test.actualErr = err.str();
+	test.parsersAgree =
+		parseAgrees(test, comp, {true, false, false, false})
+		&& parseAgrees(test, comp, {false, true, false, false})
+		&& parseAgrees(test, comp, {false, false, true, false})
+		&& parseAgrees(test, comp, {true, false, true, false})
+		&& parseAgrees(test, comp, {false, false, false, true})
+		&& parseAgrees(test, comp, {true, false, true, true});
+	if (test.haveCheck){
+		std::string serial = checked(test, 1, false);
+		checkGolden(test, "check", serial, test.expectedCheck);
+		if (checked(test, 8, false) != serial){
+			test.problems.push_back("checking types on 8 threads reports"
+				" other errors than on 1");
+		}
+		if (checked(test, 8, true) != serial){
+			test.problems.push_back("checking types with shared nodes"
+				" reports other errors than without");
+		}
+	}
+	if (test.haveNames){
+		checkGolden(test, "names", named(test), test.expectedNames);
+	}
+	if (test.haveSimplify){
+		checkGolden(test, "simplify", simplified(test),
+			test.expectedSimplify);
+	}
+	if (test.haveRun){ checkRun(test); }
+	if (test.haveSSA){ checkSSA(test); }
+	if (test.haveInline){ checkInline(test); }
+	test.passed = !test.aborted && test.parsersAgree
+		&& test.problems.empty() && test.haveUnparse && test.haveErr
+		&& sameOutput(test.actualUnparse, test.expectedUnparse)
+		&& sameOutput(test.actualErr, test.expectedErr);
+}
+
+/* Seconds to parse every test reps times over */
+static double timeParses(const std::vector<GoldenTest>& tests, int reps,
+	ParseMode mode){
+	auto start = std::chrono::steady_clock::now();
+	for (int rep = 0; rep < reps; rep++){
+		for (const GoldenTest& test : tests){
+			Compilation comp(test.source.data(), test.source.size());
+			comp.setDescentParser(mode.descent);
+			comp.setPipelined(mode.pipelined);
+			comp.setPackedTokens(mode.packed);
+			comp.setShareNodes(mode.share);
+			comp.parse();
+		}
+	}
+	std::chrono::duration<double> took =
+		std::chrono::steady_clock::now() - start;
+	return took.count();
+}
+
+static double timeLexes(const std::vector<GoldenTest>& tests, int reps,
+	unsigned int threads){
+	auto start = std::chrono::steady_clock::now();
+	for (int rep = 0; rep < reps; rep++){
+		for (const GoldenTest& test : tests){
+			Compilation comp(test.source.data(), test.source.size());
+			comp.tokenize(threads);
+		}
+	}
+	std::chrono::duration<double> took =
+		std::chrono::steady_clock::now() - start;
+	return took.count();
+}
+
+static std::vector<std::string> findTests(){
+	std::vector<std::string> names;
+	DIR * dir = opendir(".");
+	if (dir == nullptr){ return names; }
+	while (struct dirent * entry = readdir(dir)){
+		std::string file = entry->d_name;
+		if (file.size() > 4
+			&& file.compare(file.size() - 4, 4, ".cmm") == 0){
+			names.push_back(file.substr(0, file.size() - 4));
+		}
+	}
+	closedir(dir);
+	std::sort(names.begin(), names.end());
+	return names;
+}
+
+int main(int argc, char ** argv){
+	unsigned int threads = std::thread::hardware_concurrency();
+	int benchReps = 0;
+	std::vector<std::string> names;
+	for (int i = 1; i < argc; i++){
+		if (strcmp(argv[i], "-j") == 0 && i + 1 < argc){
+			threads = static_cast<unsigned int>(atoi(argv[++i]));
+		} else if (strcmp(argv[i], "-bench") == 0 && i + 1 < argc){
+			benchReps = atoi(argv[++i]);
+		} else {
+			std::string name = argv[i];
+			if (name.size() > 4
+				&& name.compare(name.size() - 4, 4, ".cmm") == 0){
+				name = name.substr(0, name.size() - 4);
+			}
+			names.push_back(name);
+		}
+	}
+	if (names.empty()){ names = findTests(); }
+	if (threads == 0){ threads = 1; }
+
+	std::vector<GoldenTest> tests(names.size());
+	for (size_t i = 0; i < names.size(); i++){
+		GoldenTest& test = tests[i];
+		test.name = names[i];
+		test.aborted = false;
+		test.parsersAgree = false;
+		test.passed = false;
+		if (!readFile(test.name + ".cmm", test.source)){
+			std::cerr << "Cannot read " << test.name << ".cmm\n";
+			return 1;
+		}
+		test.haveUnparse = readFile(test.name + ".unparse.expected",
+			test.expectedUnparse);
+		test.haveErr = readFile(test.name + ".err.expected",
+			test.expectedErr);
+		test.haveCheck = readFile(test.name + ".check.expected",
+			test.expectedCheck);
+		test.haveNames = readFile(test.name + ".names.expected",
+			test.expectedNames);
+		test.haveSimplify = readFile(test.name + ".simplify.expected",
+			test.expectedSimplify);
+		test.haveRun = readFile(test.name + ".run.expected",
+			test.expectedRun);
+		readFile(test.name + ".in", test.input);
+		test.haveSSA = readFile(test.name + ".ssa.expected",
+			test.expectedSSA);
+		test.haveInline = readFile(test.name + ".inline.expected",
+			test.expectedInline);
+	}
+
+	if (benchReps > 0){
+		double bison = timeParses(tests, benchReps,
+			{false, false, false, false});
+		double descent = timeParses(tests, benchReps,
+			{true, false, false, false});
+		double bisonPiped = timeParses(tests, benchReps,
+			{false, true, false, false});
+		double descentPiped = timeParses(tests, benchReps,
+			{true, true, false, false});
+		double bisonPacked = timeParses(tests, benchReps,
+			{false, false, true, false});
+		double descentPacked = timeParses(tests, benchReps,
+			{true, false, true, false});
+		std::cout << "bison:              " << bison << "s\n"
+			<< "descent:            " << descent << "s ("
+			<< bison / descent << "x)\n"
+			<< "bison, pipelined:   " << bisonPiped << "s ("
+			<< bison / bisonPiped << "x)\n"
+			<< "descent, pipelined: " << descentPiped << "s ("
+			<< bison / descentPiped << "x)\n"
+			<< "bison, packed:      " << bisonPacked << "s ("
+			<< bison / bisonPacked << "x)\n"
+			<< "descent, packed:    " << descentPacked << "s ("
+			<< bison / descentPacked << "x)" << std::endl;
+		double lexOne = timeLexes(tests, benchReps, 1);
+		double lexMany = timeLexes(tests, benchReps, threads);
+		std::cout << "lex, 1 thread:      " << lexOne << "s\n"
+			<< "lex, " << threads << " threads:     " << lexMany
+			<< "s (" << lexOne / lexMany << "x)" << std::endl;
+		return 0;
+	}
+
+	std::atomic<size_t> next(0);
+	std::vector<std::thread> workers;
+	for (unsigned int t = 0; t < threads; t++){
+		workers.emplace_back([&tests, &next](){
+			size_t i;
+			while ((i = next++) < tests.size()){
+				runTest(tests[i]);
+			}
+		});
+	}
+	for (std::thread& worker : workers){ worker.join(); }
+
+	size_t failures = 0;
+	for (GoldenTest& test : tests){
+		std::cout << "TEST " << test.name << std::endl;
+		if (test.passed){ continue; }
+		failures++;
+		writeFile(test.name + ".unparse", test.actualUnparse);
+		writeFile(test.name + ".err", test.actualErr);
+		if (test.aborted){
+			std::cout << "cmmc error:\n" << test.actualErr;
+			continue;
+		}
+		if (!test.parsersAgree){
+			std::cout << "the hand-written parser, pipelined lexer, packed tokens or shared nodes disagree with bison\n";
+		}
+		for (const std::string& problem : test.problems){
+			std::cout << problem << "\n";
+		}
+		if (!test.haveUnparse){
+			std::cout << "missing " << test.name
+				<< ".unparse.expected\n";
+		} else if (!sameOutput(test.actualUnparse, test.expectedUnparse)){
+			std::cout << "unparse differs: diff " << test.name
+				<< ".unparse " << test.name << ".unparse.expected\n";
+		}
+		if (!test.haveErr){
+			std::cout << "missing " << test.name << ".err.expected\n";
+		} else if (!sameOutput(test.actualErr, test.expectedErr)){
+			std::cout << "stderr differs: diff " << test.name
+				<< ".err " << test.name << ".err.expected\n";
+		}
+	}
+	std::cout << (tests.size() - failures) << "/" << tests.size()
+		<< " tests passed" << std::endl;
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,162 @@
+#include <cstring>
+#include <exception>
+#include <limits>
+#include "packed.hpp"
+#include "tokens.hpp"
+
+namespace cminusminus{
+
+static_assert(TokenKind::WRITE - TokenKind::AMP + 1
+	<= std::numeric_limits<uint8_t>::max(), "token kinds fit a byte");
+
+static uint8_t packKind(int tag){
+	if (tag == TokenKind::END){ return 0; }
+	return static_cast<uint8_t>(tag - TokenKind::AMP + 1);
+}
+
+static int unpackKind(uint8_t kind){
+	if (kind == 0){ return TokenKind::END; }
+	return TokenKind::AMP + kind - 1;
+}
+
+bool PackedTokens::fits(size_t len){
+	return len <= std::numeric_limits<uint32_t>::max();
+}
+
+PackedTokens::PackedTokens(Scanner& scanner, const char * src)
+: myScanner(scanner), mySrc(src), myNext(0), myNextPending(0),
+  myLine(1), myLineStart(0), myCounted(0), myLiveNext(0){
+	for (size_t i = 0; i < liveTokens; i++){ myLive[i] = nullptr; }
+	myScanner.setLexDiagnostics(&myLexDiags);
+	myScanner.setPacking(true);
+	Parser::semantic_type val;
+	Position loc;
+	int tag = TokenKind::END;
+	try {
+		do {
+			tag = myScanner.lexToken(&val, &loc);
+			holdDiagnostics();
+			PackedToken tok;
+			tok.kind = packKind(tag);
+			tok.value = 0;
+			if (tag == TokenKind::END){
+				tok.length = 0;
+			} else {
+				//Every token is on one line
+				tok.length = static_cast<uint32_t>(loc.colEnd() - loc.col());
+				if (tag == TokenKind::INTLITERAL){
+					tok.value = static_cast<IntLitToken *>(val.lexeme)->num();
+				} else if (tag == TokenKind::SHORTLITERAL){
+					tok.value = static_cast<ShortLitToken *>(val.lexeme)->num();
+				}
+				if (val.lexeme != nullptr){
+					delete val.lexeme->pos();
+					delete val.lexeme;
+				}
+			}
+			tok.offset = static_cast<uint32_t>(myScanner.offset() - tok.length);
+			myTokens.push_back(tok);
+		} while (tag != TokenKind::END);
+	} catch (...){
+		//Thrown to the parser when it gets this far, as with the pipe
+		holdDiagnostics();
+		myError = std::current_exception();
+	}
+	myScanner.setPacking(false);
+	myScanner.setLexDiagnostics(myScanner.diagnostics());
+	myScanner.setPacked(this);
+}
+
+void PackedTokens::holdDiagnostics(){
+	for (const Diagnostic& diag : myLexDiags.all()){
+		myPending.push_back(PendingDiag{myTokens.size(), diag});
+	}
+	myLexDiags.clear();
+}
+
+PackedTokens::~PackedTokens(){
+	myScanner.setPacked(nullptr);
+	for (size_t i = 0; i < liveTokens; i++){
+		if (myLive[i] == nullptr){ continue; }
+		delete myLive[i]->pos();
+		delete myLive[i];
+	}
+}
+
+Position PackedTokens::locate(const PackedToken& tok){
+	while (const void * found = memchr(mySrc + myCounted, '\n',
+		tok.offset - myCounted)){
+		myLine++;
+		myCounted = static_cast<size_t>(
+			static_cast<const char *>(found) - mySrc) + 1;
+		myLineStart = myCounted;
+	}
+	myCounted = tok.offset;
+	size_t col = tok.offset - myLineStart + 1;
+	return Position(myLine, col, myLine, col + tok.length);
+}
+
+Token * PackedTokens::materialize(const PackedToken& tok, int tag,
+	const Position& pos){
+	Position * tokPos = new Position(pos);
+	const char * text = mySrc + tok.offset;
+	switch (tag){
+	case TokenKind::ID:
+		return new IDToken(tokPos, std::string(text, tok.length));
+	case TokenKind::STRLITERAL:
+		return new StrToken(tokPos, StrSlice(text, tok.length));
+	case TokenKind::INTLITERAL:
+		return new IntLitToken(tokPos, tok.value);
+	case TokenKind::SHORTLITERAL:
+		return new ShortLitToken(tokPos, tok.value);
+	default:
+		delete tokPos;
+		return nullptr;
+	}
+}
+
+void PackedTokens::reportPending(size_t index){
+	while (myNextPending < myPending.size()
+		&& myPending[myNextPending].before <= index){
+		const Diagnostic& diag = myPending[myNextPending].diag;
+		if (myScanner.diagnostics() == nullptr){
+			std::cerr << diag.str() << std::endl;
+		} else {
+			myScanner.diagnostics()->add(diag);
+		}
+		myNextPending++;
+	}
+}
+
+int PackedTokens::pop(Parser::semantic_type * lval, Position * loc){
+	//Lexing stopped here, on an error
+	if (myNext == myTokens.size()){
+		reportPending(myNext);
+		std::rethrow_exception(myError);
+	}
+	//Past the end, the parser gets the end again, as from flex
+	const PackedToken& tok = myTokens[myNext];
+	if (myNext + 1 < myTokens.size() || myError){ myNext++; }
+	size_t index = static_cast<size_t>(&tok - myTokens.data());
+	reportPending(index);
+	int tag = unpackKind(tok.kind);
+	*loc = locate(tok);
+	lval->lexeme = materialize(tok, tag, *loc);
+	if (lval->lexeme != nullptr){
+		Token *& slot = myLive[myLiveNext];
+		if (slot != nullptr){
+			delete slot->pos();
+			delete slot;
+		}
+		slot = lval->lexeme;
+		myLiveNext = (myLiveNext + 1) % liveTokens;
+	}
+	return tag;
+}
+
+int Scanner::packedToken(Parser::semantic_type * const lval,
+	Position * const loc){
+	return myPacked->pop(lval, loc);
+}
+
+}
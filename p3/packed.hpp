@@ -0,0 +1,104 @@
+#ifndef CMINUSMINUS_PACKED_HPP
+#define CMINUSMINUS_PACKED_HPP
+
+#include <cstdint>
+#include <exception>
+#include <vector>
+#include "scanner.hpp"
+
+/*
+Lexing the whole input up front into one array of small plain
+tokens, for the parser to read from instead of a Token object per
+token. A packed token is a kind, where it is in the source and how
+long, and an integer literal's value: its text and span are worked
+out again from the source buffer when the parser gets to it, keeping
+a running count of the lines passed so far.
+
+Punctuation and keywords carry nothing but their kind and span, so
+no Token is made for them at all, neither while lexing nor for the
+parser (lexeme is null). Identifiers
+and literals do get one, as the grammar's actions read their values,
+but only for as long as the parser needs it: it is done with a token
+by the time it has read the next, so just the last few are kept.
+
+Lexical errors wait alongside the token they came before, and are
+recorded when the parser gets that far, as with the pipe (see
+pipeline.hpp): if the parser stops early, the rest are dropped.
+Anything the lexer throws likewise waits, and is thrown to the parser
+in place of the token it was lexing.
+*/
+
+namespace cminusminus{
+
+struct PackedToken{
+	/* 0 for END, else the tag's place from AMP on */
+	uint8_t kind;
+	/* Where in the source the token starts, and how long it is */
+	uint32_t offset;
+	uint32_t length;
+	/* The value of an integer or short literal */
+	int32_t value;
+};
+
+class PackedTokens{
+public:
+	/* Lex all of scanner's input, which must come from src (see the
+	   Scanner constructor). From now on its yylex(lval, loc) gives
+	   the tokens from here */
+	PackedTokens(Scanner& scanner, const char * src);
+	~PackedTokens();
+	PackedTokens(const PackedTokens&) = delete;
+	PackedTokens& operator=(const PackedTokens&) = delete;
+
+	/* Whether a source of len bytes can be packed: offsets are 32
+	   bits */
+	static bool fits(size_t len);
+
+	/* The next token, as Scanner::lexToken would have given it */
+	int pop(Parser::semantic_type * lval, Position * loc);
+
+	/* How many tokens there are, END included, and the bytes of
+	   the array holding them */
+	size_t count() const { return myTokens.size(); }
+	size_t bytes() const { return myTokens.size() * sizeof(PackedToken); }
+
+private:
+	struct PendingDiag{
+		/* The index of the token it came before */
+		size_t before;
+		Diagnostic diag;
+	};
+
+	/* Move the lexical errors raised so far to myPending, to come
+	   before the next token */
+	void holdDiagnostics();
+	/* Record the errors that come before the token at index */
+	void reportPending(size_t index);
+	/* Where tok is, counting the lines up to it */
+	Position locate(const PackedToken& tok);
+	/* A Token for the parser to read tok's value from */
+	Token * materialize(const PackedToken& tok, int tag, const Position& pos);
+
+	Scanner& myScanner;
+	const char * mySrc;
+	std::vector<PackedToken> myTokens;
+	std::vector<PendingDiag> myPending;
+	/* What stopped the lexer, after the last of myTokens */
+	std::exception_ptr myError;
+	Diagnostics myLexDiags;
+	size_t myNext;
+	size_t myNextPending;
+	/* The line the last token was on, where it starts, and how far
+	   into the source the newlines have been counted */
+	size_t myLine;
+	size_t myLineStart;
+	size_t myCounted;
+	/* The Tokens the parser may still be reading */
+	static const size_t liveTokens = 2;
+	Token * myLive[liveTokens];
+	size_t myLiveNext;
+};
+
+}
+
+#endif
@@ -0,0 +1,131 @@
+#include "pipeline.hpp"
+
+namespace cminusminus{
+
+/* Slots in the ring */
+static const size_t ringSize = 1024;
+/* Slots either side handles before publishing its index */
+static const size_t batchSize = 64;
+
+TokenPipe::TokenPipe(Scanner& scanner)
+: myScanner(scanner), mySlots(ringSize),
+  myWritten(0), myWriteShown(0), myReadSeen(0),
+  myRead(0), myReadShown(0), myWriteSeen(0), myEnded(false),
+  myWriteIndex(0), myReadIndex(0), myStop(false){
+	myScanner.setLexDiagnostics(&myLexDiags);
+	myScanner.setPipe(this);
+	myThread = std::thread([this](){ lex(); });
+}
+
+TokenPipe::~TokenPipe(){
+	myStop.store(true, std::memory_order_release);
+	myThread.join();
+	myScanner.setPipe(nullptr);
+	myScanner.setLexDiagnostics(myScanner.diagnostics());
+	//Errors the parser never got to
+	for (size_t i = myRead; i < myWritten; i++){
+		delete mySlots[i % ringSize].diag;
+	}
+}
+
+void TokenPipe::lex(){
+	Slot slot;
+	slot.diag = nullptr;
+	try {
+		do {
+			slot.kind = TOKEN;
+			slot.tag = myScanner.lexToken(&slot.val, &slot.loc);
+			for (const Diagnostic& diag : myLexDiags.all()){
+				Slot error;
+				error.kind = DIAGNOSTIC;
+				error.tag = 0;
+				error.diag = new Diagnostic(diag);
+				if (!push(error)){
+					delete error.diag;
+					return;
+				}
+			}
+			myLexDiags.clear();
+			if (!push(slot) || myStop.load(std::memory_order_relaxed)){
+				return;
+			}
+		} while (slot.tag != TokenKind::END);
+	} catch (...){
+		myError = std::current_exception();
+		slot.kind = FAILED;
+		push(slot);
+	}
+	publishWrite();
+}
+
+bool TokenPipe::push(const Slot& slot){
+	while (myWritten - myReadSeen == ringSize){
+		//Let the parser at what is there while waiting for room
+		publishWrite();
+		if (myStop.load(std::memory_order_acquire)){ return false; }
+		myReadSeen = myReadIndex.load(std::memory_order_acquire);
+		if (myWritten - myReadSeen == ringSize){ std::this_thread::yield(); }
+	}
+	mySlots[myWritten % ringSize] = slot;
+	myWritten++;
+	if (myWritten - myWriteShown >= batchSize){ publishWrite(); }
+	return true;
+}
+
+void TokenPipe::publishWrite(){
+	myWriteShown = myWritten;
+	myWriteIndex.store(myWritten, std::memory_order_release);
+}
+
+void TokenPipe::publishRead(){
+	myReadShown = myRead;
+	myReadIndex.store(myRead, std::memory_order_release);
+}
+
+int TokenPipe::pop(Parser::semantic_type * lval, Position * loc){
+	//Past the end, the parser gets the end again, as from flex
+	if (myEnded){
+		*loc = myEndLoc;
+		return TokenKind::END;
+	}
+	while (true){
+		while (myRead == myWriteSeen){
+			//Give the lexer its room back while waiting for it
+			publishRead();
+			myWriteSeen = myWriteIndex.load(std::memory_order_acquire);
+			if (myRead == myWriteSeen){ std::this_thread::yield(); }
+		}
+		Slot& slot = mySlots[myRead % ringSize];
+		myRead++;
+		if (myRead - myReadShown >= batchSize){ publishRead(); }
+		switch (slot.kind){
+		case DIAGNOSTIC:
+			if (myScanner.diagnostics() == nullptr){
+				std::cerr << slot.diag->str() << std::endl;
+			} else {
+				myScanner.diagnostics()->add(*slot.diag);
+			}
+			delete slot.diag;
+			slot.diag = nullptr;
+			continue;
+		case FAILED:
+			myEnded = true;
+			std::rethrow_exception(myError);
+		case TOKEN:
+			*lval = slot.val;
+			*loc = slot.loc;
+			if (slot.tag == TokenKind::END){
+				myEnded = true;
+				myEndLoc = slot.loc;
+			}
+			return slot.tag;
+		}
+	}
+}
+
+int Scanner::pipedToken(Parser::semantic_type * const lval,
+	Position * const loc){
+	return myPipe->pop(lval, loc);
+}
+
+}
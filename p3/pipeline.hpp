@@ -0,0 +1,90 @@
+#ifndef CMINUSMINUS_PIPELINE_HPP
+#define CMINUSMINUS_PIPELINE_HPP
+
+#include <atomic>
+#include <exception>
+#include <thread>
+#include <vector>
+#include "scanner.hpp"
+
+/*
+Lexing on a thread of its own, running ahead of the parser. This is
+experimental: it has yet to be shown faster than lexing inline. The
+lexer thread pushes tokens into a fixed ring that the parser's
+yylex hook pops from. There is one producer and one consumer, so
+the ring needs no lock: each side owns one index and publishes it to
+the other, once per batch of tokens rather than per token, to keep
+the two cores from trading the cache line back and forth. A full
+ring holds the lexer back until the parser catches up.
+
+The parser sees exactly what it would have without the pipe. Lexical
+errors are carried in the ring ahead of the token they came before,
+and are recorded when the parser gets that far. If the parser stops
+early, the errors it never got to are dropped. Anything the lexer
+throws is rethrown to the parser in the same place. Once the parser
+is done, whether or not the input was, the lexer thread is stopped.
+*/
+
+namespace cminusminus{
+
+class TokenPipe{
+public:
+	/* Start lexing scanner on a new thread. From now on its
+	   yylex(lval, loc) gives the tokens from the pipe */
+	TokenPipe(Scanner& scanner);
+	/* Stop the lexer thread if it is still going, and wait for it */
+	~TokenPipe();
+	TokenPipe(const TokenPipe&) = delete;
+	TokenPipe& operator=(const TokenPipe&) = delete;
+
+	/* The next token, as Scanner::lexToken would have given it */
+	int pop(Parser::semantic_type * lval, Position * loc);
+
+private:
+	enum SlotKind { TOKEN, DIAGNOSTIC, FAILED };
+	struct Slot{
+		SlotKind kind;
+		int tag;
+		Parser::semantic_type val;
+		Position loc;
+		Diagnostic * diag;
+	};
+
+	void lex();
+	/* Append slot to the ring, waiting for room. False, with the
+	   slot not added, if the parser went away meanwhile */
+	bool push(const Slot& slot);
+	void publishWrite();
+	void publishRead();
+
+	Scanner& myScanner;
+	std::vector<Slot> mySlots;
+	std::exception_ptr myError;
+	std::thread myThread;
+
+	/* Lexer side: slots written, those published, and the last
+	   read index it saw */
+	size_t myWritten;
+	size_t myWriteShown;
+	size_t myReadSeen;
+	Diagnostics myLexDiags;
+	/* Parser side: slots read, those published, and the last
+	   write index it saw */
+	size_t myRead;
+	size_t myReadShown;
+	size_t myWriteSeen;
+	bool myEnded;
+	Position myEndLoc;
+
+	/* The published indices, each on a cache line of its own */
+	char myPadBefore[64];
+	std::atomic<size_t> myWriteIndex;
+	char myPadBetween[64];
+	std::atomic<size_t> myReadIndex;
+	std::atomic<bool> myStop;
+	char myPadAfter[64];
+};
+
+}
+
+#endif
@@ -1,7 +1,9 @@
 #ifndef CMINUSMINUS_POSITION_H
 #define CMINUSMINUS_POSITION_H
 
+#include <ostream>
 #include <string>
+#include "allocprof.hpp"
 
 namespace cminusminus{
 
@@ -10,10 +12,21 @@ public:
 	Position(size_t lineI, size_t colI, size_t lineE, size_t colE)
 	: myLineI(lineI), myColI(colI), myLineE(lineE), myColE(colE){
 	}
+	Position() : Position(0, 0, 0, 0){ }
+	Position(const Position& start, const Position& end)
+	: myLineI(start.myLineI), myColI(start.myColI),
+	  myLineE(end.myLineE),myColE(end.myColE){
+	}
 	Position(Position * start, Position * end)
 	: myLineI(start->myLineI), myColI(start->myColI),
 	  myLineE(end->myLineE),myColE(end->myColE){
 	}
+	virtual ~Position(){ }
+	CMM_PROFILED_CLASS(Position)
+	size_t line() const { return myLineI; }
+	size_t col() const { return myColI; }
+	size_t lineEnd() const { return myLineE; }
+	size_t colEnd() const { return myColE; }
 	virtual void expand(Position * start, Position * end){
 	  myLineI = start->myLineI;
 	  myColI = start->myColI;
@@ -45,6 +58,10 @@ private:
 
 };
 
+inline std::ostream& operator<<(std::ostream& out, const Position& pos){
+	return out << pos.span();
+}
+
 }
 
 #endif
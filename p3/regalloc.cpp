@@ -0,0 +1,211 @@
+#include <algorithm>
+#include <limits>
+#include "dataflow.hpp"
+#include "regalloc.hpp"
+
+namespace cminusminus{
+
+/*
+Positions: instruction i reads its operands at 2i and writes its
+result at 2i+1, so a temp that dies at i can hand its register to
+the one i defines. A call clobbers between 2i and 2i+1.
+*/
+
+namespace {
+
+struct Block{
+	size_t start;
+	size_t end; /* one past the last instruction */
+	std::vector<size_t> succs;
+};
+
+struct Interval{
+	size_t start = std::numeric_limits<size_t>::max();
+	size_t end = 0;
+	bool crossesCall = false;
+};
+
+}
+
+static bool isCall(IROp op){
+	return op == IROp::CALL || op == IROp::READ || op == IROp::WRITE;
+}
+
+static std::vector<Block> buildBlocks(const IRProc& proc){
+	const std::vector<Instr>& code = proc.code;
+	std::vector<Block> blocks;
+	std::vector<size_t> labelBlock(proc.numLabels, 0);
+	size_t start = 0;
+	for (size_t i = 0; i < code.size(); i++){
+		if (code[i].op == IROp::LABEL && i > start){
+			blocks.push_back(Block{start, i, {}});
+			start = i;
+		}
+		if (code[i].op == IROp::LABEL){
+			labelBlock[code[i].a.idx()] = blocks.size();
+		}
+		if (code[i].isBranch() || code[i].op == IROp::RET){
+			blocks.push_back(Block{start, i + 1, {}});
+			start = i + 1;
+		}
+	}
+	if (start < code.size()){
+		blocks.push_back(Block{start, code.size(), {}});
+	}
+	for (size_t b = 0; b < blocks.size(); b++){
+		const Instr& last = code[blocks[b].end - 1];
+		if (last.isBranch()){
+			blocks[b].succs.push_back(labelBlock[last.target()]);
+		}
+		bool fallsThrough = last.op != IROp::JMP && last.op != IROp::RET;
+		if (fallsThrough && b + 1 < blocks.size()){
+			blocks[b].succs.push_back(b + 1);
+		}
+	}
+	return blocks;
+}
+
+/* The temps live out of each block */
+static std::vector<BitSet> liveOut(const IRProc& proc,
+	const std::vector<Block>& blocks){
+	size_t n = proc.numTemps;
+	DataflowProblem problem;
+	problem.direction = DataflowProblem::BACKWARD;
+	problem.meet = DataflowProblem::UNION;
+	problem.universe = n;
+	problem.gen.assign(blocks.size(), BitSet(n));
+	problem.kill.assign(blocks.size(), BitSet(n));
+	problem.boundary = BitSet(n);
+	std::vector<size_t> temps;
+	for (size_t b = 0; b < blocks.size(); b++){
+		problem.succs.push_back(blocks[b].succs);
+		BitSet& use = problem.gen[b];
+		BitSet& def = problem.kill[b];
+		for (size_t i = blocks[b].start; i < blocks[b].end; i++){
+			temps.clear();
+			proc.code[i].uses(temps);
+			for (size_t t : temps){
+				if (!def.has(t)){ use.add(t); }
+			}
+			int64_t d = proc.code[i].def();
+			if (d >= 0){ def.add(static_cast<size_t>(d)); }
+		}
+	}
+	return solveDataflow(problem).out;
+}
+
+static std::vector<Interval> buildIntervals(const IRProc& proc){
+	std::vector<Block> blocks = buildBlocks(proc);
+	std::vector<BitSet> out = liveOut(proc, blocks);
+	std::vector<Interval> intervals(proc.numTemps);
+	auto touch = [&](size_t t, size_t pos){
+		intervals[t].start = std::min(intervals[t].start, pos);
+		intervals[t].end = std::max(intervals[t].end, pos);
+	};
+
+	std::vector<size_t> calls;
+	std::vector<size_t> temps;
+	for (size_t b = 0; b < blocks.size(); b++){
+		out[b].forEach([&](size_t t){ touch(t, 2 * blocks[b].end); });
+		for (size_t i = blocks[b].start; i < blocks[b].end; i++){
+			temps.clear();
+			proc.code[i].uses(temps);
+			for (size_t t : temps){ touch(t, 2 * i); }
+			int64_t d = proc.code[i].def();
+			if (d >= 0){ touch(static_cast<size_t>(d), 2 * i + 1); }
+			if (isCall(proc.code[i].op)){ calls.push_back(i); }
+		}
+	}
+	//Whatever is live into a block is live out of each predecessor
+	for (size_t b = 0; b < blocks.size(); b++){
+		for (size_t s : blocks[b].succs){
+			out[b].forEach([&](size_t t){ touch(t, 2 * blocks[s].start); });
+		}
+	}
+
+	for (Interval& iv : intervals){
+		for (size_t c : calls){
+			if (iv.start <= 2 * c && iv.end >= 2 * c + 1){
+				iv.crossesCall = true;
+				break;
+			}
+		}
+	}
+	return intervals;
+}
+
+Allocation allocateRegisters(const IRProc& proc, unsigned int numRegs,
+	unsigned int numPreserved){
+	std::vector<Interval> intervals = buildIntervals(proc);
+	Allocation result;
+	result.reg.assign(proc.numTemps, -1);
+	result.spill.assign(proc.numTemps, 0);
+	result.used.assign(numRegs, false);
+
+	std::vector<size_t> order;
+	for (size_t t = 0; t < intervals.size(); t++){
+		if (intervals[t].start <= intervals[t].end){ order.push_back(t); }
+	}
+	std::sort(order.begin(), order.end(), [&](size_t x, size_t y){
+		return intervals[x].start < intervals[y].start;
+	});
+
+	auto spill = [&](size_t t){
+		result.reg[t] = -1;
+		result.spill[t] = result.numSpills++;
+	};
+
+	std::vector<size_t> active;
+	std::vector<bool> taken(numRegs, false);
+	for (size_t t : order){
+		const Interval& cur = intervals[t];
+		//Expire whatever ended before this starts
+		for (size_t k = 0; k < active.size(); ){
+			size_t other = active[k];
+			if (intervals[other].end < cur.start){
+				taken[static_cast<size_t>(result.reg[other])] = false;
+				active[k] = active.back();
+				active.pop_back();
+			} else {
+				k++;
+			}
+		}
+
+		//Call-clobbered registers first, for temps that may use them,
+		// so that preserved ones need saving less often
+		unsigned int limit = cur.crossesCall ? numPreserved : numRegs;
+		int chosen = -1;
+		for (unsigned int r = limit; r-- > 0; ){
+			if (!taken[r]){
+				chosen = static_cast<int>(r);
+				break;
+			}
+		}
+		if (chosen < 0){
+			size_t victim = proc.numTemps;
+			for (size_t other : active){
+				if (static_cast<unsigned int>(result.reg[other]) >= limit){
+					continue;
+				}
+				if (victim == proc.numTemps
+					|| intervals[other].end > intervals[victim].end){
+					victim = other;
+				}
+			}
+			if (victim == proc.numTemps || intervals[victim].end <= cur.end){
+				spill(t);
+				continue;
+			}
+			chosen = result.reg[victim];
+			spill(victim);
+			active.erase(std::find(active.begin(), active.end(), victim));
+		}
+		result.reg[t] = chosen;
+		taken[static_cast<size_t>(chosen)] = true;
+		result.used[static_cast<size_t>(chosen)] = true;
+		active.push_back(t);
+	}
+	return result;
+}
+
+}
@@ -0,0 +1,38 @@
+#ifndef CMINUSMINUS_REGALLOC_HPP
+#define CMINUSMINUS_REGALLOC_HPP
+
+#include <vector>
+#include "ir.hpp"
+
+namespace cminusminus{
+
+/*
+Linear-scan register allocation (Poletto and Sarkar) over the temps
+of one IRProc. Liveness is computed per basic block, and each temp
+gets one interval spanning everywhere it is live. Intervals are
+visited by start point; when no register is free, whichever of the
+current interval and the active ones ends last is spilled for its
+whole life.
+
+The allocator does not know the target. It hands out register
+numbers 0..numRegs-1, of which the first numPreserved survive calls;
+a temp live across a call (CALL, READ or WRITE) only gets one of
+those.
+*/
+
+struct Allocation{
+	/* Per temp: a register number, or -1 if spilled */
+	std::vector<int> reg;
+	/* Per spilled temp: its spill cell number */
+	std::vector<size_t> spill;
+	size_t numSpills = 0;
+	/* Per register: whether any temp was given it */
+	std::vector<bool> used;
+};
+
+Allocation allocateRegisters(const IRProc& proc, unsigned int numRegs,
+	unsigned int numPreserved);
+
+}
+
+#endif
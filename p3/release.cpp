@@ -0,0 +1,151 @@
+#include "ast.hpp"
+#include "symbol_table.hpp"
+
+namespace cminusminus{
+
+/*
+Freeing trees. A node's destructor deletes only what is its alone
+(its position, its name), and a declaration also the symbol name
+analysis made for it; release() hands its children over to
+deleteTree, which deletes them in turn from a worklist rather than
+by recursion, as deep trees would overflow the stack.
+*/
+
+ASTNode::~ASTNode(){
+	delete myPos;
+}
+
+void deleteTree(ASTNode * root){
+	std::vector<ASTNode *> work;
+	if (root != nullptr){ work.push_back(root); }
+	while (!work.empty()){
+		ASTNode * node = work.back();
+		work.pop_back();
+		node->release(work);
+		delete node;
+	}
+}
+
+/* Take child, if there is one */
+template <typename T>
+static void take(std::vector<ASTNode *>& children, T *& child){
+	if (child != nullptr){ children.push_back(child); }
+	child = nullptr;
+}
+
+/* Take every node of list, and delete the list itself */
+template <typename T>
+static void takeList(std::vector<ASTNode *>& children,
+	std::list<T *> *& list){
+	if (list == nullptr){ return; }
+	for (T * child : *list){ take(children, child); }
+	delete list;
+	list = nullptr;
+}
+
+void ProgramNode::release(std::vector<ASTNode *>& children){
+	takeList(children, myGlobals);
+}
+
+void UnaryExpNode::release(std::vector<ASTNode *>& children){
+	take(children, expression);
+}
+
+void BinaryExpNode::release(std::vector<ASTNode *>& children){
+	take(children, leftNode);
+	take(children, rightNode);
+}
+
+void CallExpNode::release(std::vector<ASTNode *>& children){
+	take(children, nameFunc);
+	takeList(children, arguments);
+}
+
+void CallStmtNode::release(std::vector<ASTNode *>& children){
+	take(children, Function);
+}
+
+void PostDecStmtNode::release(std::vector<ASTNode *>& children){
+	take(children, variable);
+}
+
+void PostIncStmtNode::release(std::vector<ASTNode *>& children){
+	take(children, variable);
+}
+
+void ReadStmtNode::release(std::vector<ASTNode *>& children){
+	take(children, variable);
+}
+
+void WriteStmtNode::release(std::vector<ASTNode *>& children){
+	take(children, expression);
+}
+
+void ReturnStmtNode::release(std::vector<ASTNode *>& children){
+	take(children, expression);
+}
+
+void WhileStmtNode::release(std::vector<ASTNode *>& children){
+	take(children, condition);
+	takeList(children, WhileBody);
+}
+
+void IfStmtNode::release(std::vector<ASTNode *>& children){
+	take(children, condition);
+	takeList(children, IfBody);
+}
+
+void IfElseStmtNode::release(std::vector<ASTNode *>& children){
+	take(children, condition);
+	takeList(children, IfTrueBody);
+	takeList(children, IfFalseBody);
+}
+
+void DerefNode::release(std::vector<ASTNode *>& children){
+	take(children, myId);
+}
+
+void IndexNode::release(std::vector<ASTNode *>& children){
+	take(children, Id_being_accessed);
+	take(children, field_Name_being_accessed);
+}
+
+/* Delete the symbol that declaring id made, if name analysis made one:
+   the ids that use the name only point to it */
+static void dropSymbol(IDNode * id, const DeclNode * decl){
+	if (id == nullptr){ return; }
+	SemSymbol * sym = id->getSymbol();
+	if (sym != nullptr && sym->decl() == decl){
+		id->attachSymbol(nullptr);
+		delete sym;
+	}
+}
+
+void VarDeclNode::release(std::vector<ASTNode *>& children){
+	dropSymbol(myId, this);
+	take(children, myType);
+	take(children, myId);
+}
+
+void FnDeclNode::release(std::vector<ASTNode *>& children){
+	dropSymbol(myId, this);
+	take(children, myType);
+	take(children, myId);
+	takeList(children, parameters);
+	takeList(children, functionBody);
+}
+
+void AssignExpNode::release(std::vector<ASTNode *>& children){
+	take(children, variable);
+	take(children, expression);
+}
+
+void AssignStmtNode::release(std::vector<ASTNode *>& children){
+	take(children, assignment);
+}
+
+void PtrTypeNode::release(std::vector<ASTNode *>& children){
+	take(children, myBase);
+}
+
+}
@@ -6,6 +6,56 @@ using namespace cminusminus;
 using TokenKind = cminusminus::Parser::token;
 using Lexeme = cminusminus::Parser::semantic_type;
 
+Scanner::~Scanner(){
+	for (Token * tok : myIssued){
+		delete tok->pos();
+		delete tok;
+	}
+	for (std::string * text : myTexts){ delete text; }
+}
+
+void Scanner::releaseTokens(){
+	if (myIssued.empty()){ return; }
+	Token * latest = myIssued.back();
+	myIssued.pop_back();
+	for (Token * tok : myIssued){
+		delete tok->pos();
+		delete tok;
+	}
+	myIssued.clear();
+	myIssued.push_back(latest);
+	for (size_t i = 0; i < myLatestTexts; i++){ delete myTexts[i]; }
+	myTexts.erase(myTexts.begin(),
+		myTexts.begin() + static_cast<std::ptrdiff_t>(myLatestTexts));
+	myLatestTexts = 0;
+}
+
+void Scanner::charge(int tag, const Position& pos){
+	myTokenCount++;
+	myBudget->checkTokens(pos, myTokenCount);
+	myBudget->checkInput(myOffset, pos);
+	switch (tag){
+	case TokenKind::LCURLY:
+	case TokenKind::LPAREN:
+		myDepth++;
+		myBudget->checkDepth(pos, myDepth);
+		break;
+	case TokenKind::RCURLY:
+	case TokenKind::RPAREN:
+		if (myDepth > 0){ myDepth--; }
+		break;
+	default:
+		break;
+	}
+	if (myTokenCount % clockInterval == 0){ myBudget->checkClock(pos); }
+}
+
+void Scanner::chargeError(const Position& pos){
+	myLexErrors++;
+	myBudget->checkDiagnostics(pos, myLexErrors);
+	myBudget->checkClock(pos);
+}
+
 void Scanner::outputTokens(std::ostream& outstream){
 	Lexeme lex;
 	int tokenKind;
@@ -23,3 +73,53 @@ void Scanner::outputTokens(std::ostream& outstream){
 		}
 	}
 }
+
+void Scanner::lexTokens(std::vector<TokenInfo>& out){
+	Lexeme lex;
+	int tokenKind;
+	while(true){
+		tokenKind = this->yylex(&lex);
+		if (tokenKind == TokenKind::END){
+			TokenInfo info;
+			info.kind = tokenKind;
+			info.line = this->lineNum;
+			info.col = this->colNum;
+			info.text = "EOF [" + std::to_string(lineNum)
+			  + "," + std::to_string(colNum) + "]";
+			if (myBudget != nullptr){
+				charge(tokenKind, Position(lineNum, colNum, lineNum, colNum));
+			}
+			out.push_back(info);
+			return;
+		}
+		Token * tok = lex.lexeme;
+		if (myBudget != nullptr){ charge(tokenKind, *tok->pos()); }
+		TokenInfo info;
+		info.kind = tokenKind;
+		info.line = tok->line();
+		info.col = tok->col();
+		info.text = tok->toString();
+		switch (tokenKind){
+		case TokenKind::ID:
+			info.value = static_cast<IDToken *>(tok)->value();
+			break;
+		case TokenKind::STRLITERAL:
+			info.value = static_cast<StrToken *>(tok)->str().str();
+			break;
+		case TokenKind::INTLITERAL:
+			info.value = std::to_string(
+			  static_cast<IntLitToken *>(tok)->num());
+			break;
+		case TokenKind::SHORTLITERAL:
+			info.value = std::to_string(
+			  static_cast<ShortLitToken *>(tok)->num());
+			break;
+		default:
+			break;
+		}
+		out.push_back(info);
+		classifyAllocations();
+		delete tok->pos();
+		delete tok;
+	}
+}
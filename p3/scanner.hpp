@@ -5,23 +5,43 @@
 #include <FlexLexer.h>
 #endif
 
+#include <vector>
+#include "budget.hpp"
 #include "grammar.hh"
 #include "errors.hpp"
+#include "strslice.hpp"
 
 using TokenKind = cminusminus::Parser::token;
 
 namespace cminusminus{
 
+class PackedTokens;
+class TokenPipe;
+
 class Scanner : public yyFlexLexer{
 public:
    
-   Scanner(std::istream *in) : yyFlexLexer(in)
+   Scanner(std::istream *in) : Scanner(in, nullptr){ }
+
+   /* Diagnostics are recorded in diagsIn rather than written
+      to stderr when it is non-null */
+   Scanner(std::istream *in, Diagnostics * diagsIn)
+   : Scanner(in, diagsIn, nullptr){ }
+
+   /* sourceIn, if non-null, is the buffer that in reads from (from
+      its start), and outlives every token: string literal tokens
+      then point into it instead of holding a copy */
+   Scanner(std::istream *in, Diagnostics * diagsIn, const char * sourceIn)
+   : yyFlexLexer(in), myDiags(diagsIn), myLexDiags(diagsIn),
+     myPipe(nullptr), myPacked(nullptr), myPacking(false), mySource(sourceIn), myOffset(0), myRecycle(false),
+     myLatestTexts(0), myBudget(nullptr), myTokenCount(0), myDepth(0),
+     myLexErrors(0)
    {
 	lineNum = 1;
 	colNum = 1;
    };
-   virtual ~Scanner() {
-   };
+   /* Frees whatever lexToken handed out while recycling */
+   virtual ~Scanner();
 
    //get rid of override virtual function warning
    using FlexLexer::yylex;
@@ -29,8 +49,57 @@ public:
    // YY_DECL defined in the flex cminusminus.l
    virtual int yylex( cminusminus::Parser::semantic_type * const lval);
 
+   /* The parser's entry point: the next token, plus its span. With
+      a pipe, the token is one lexed ahead on another thread; with
+      packed tokens, one lexed before parsing began */
+   int yylex(cminusminus::Parser::semantic_type * const lval,
+     cminusminus::Parser::location_type * const loc){
+	if (myPipe != nullptr){ return pipedToken(lval, loc); }
+	if (myPacked != nullptr){ return packedToken(lval, loc); }
+	return lexToken(lval, loc);
+   }
+
+   /* The next token and its span, lexed here and now */
+   int lexToken(cminusminus::Parser::semantic_type * const lval,
+     cminusminus::Parser::location_type * const loc){
+	size_t texts = myTexts.size();
+	int tag = yylex(lval);
+	if (tag == TokenKind::END){
+		*loc = Position(lineNum, colNum, lineNum, colNum);
+	} else if (lval->lexeme == nullptr){
+		//A bare token, lexed for packing
+		size_t len = static_cast<size_t>(yyleng);
+		*loc = Position(lineNum, colNum - len, lineNum, colNum);
+	} else {
+		*loc = *lval->lexeme->pos();
+		if (myRecycle){
+			myIssued.push_back(lval->lexeme);
+			myLatestTexts = texts;
+		}
+	}
+	if (myBudget != nullptr){ charge(tag, *loc); }
+	return tag;
+   }
+
+   /* Where the text just matched is in the source. With no
+      source buffer it is copied, to storage as long-lived */
+   StrSlice matchedText(){
+	size_t len = static_cast<size_t>(yyleng);
+	if (mySource == nullptr){
+		std::string * text = new std::string(yytext, len);
+		if (myRecycle){ myTexts.push_back(text); }
+		return StrSlice(text->data(), len);
+	}
+	return StrSlice(mySource + myOffset - len, len);
+   }
+
    int makeBareToken(int tagIn){
 	size_t len = static_cast<size_t>(yyleng);
+	if (myPacking){
+		this->yylval->lexeme = nullptr;
+		colNum += len;
+		return tagIn;
+	}
 	Position * pos = new Position(
 	  this->lineNum, this->colNum,
 	  this->lineNum, this->colNum+len);
@@ -39,40 +108,76 @@ public:
         return tagIn;
    }
 
+   /* Keep track of the tokens lexToken hands out, and of copied
+      text, so that releaseTokens and the destructor can free them.
+      Off by default, as tokens are otherwise never freed. With a
+      pipe, only the destructor may free them */
+   void setRecycling(bool recycle){ myRecycle = recycle; }
+   /* Free what lexToken has handed out, but for the latest token,
+      which the parser may not have got to yet. Nothing may still
+      point into the rest */
+   void releaseTokens();
+
+   /* Have yylex(lval, loc) take its tokens from pipeIn (see
+      pipeline.hpp), or lex them itself again if it is null */
+   void setPipe(TokenPipe * pipeIn){ myPipe = pipeIn; }
+   /* Likewise from packedIn (see packed.hpp) */
+   void setPacked(PackedTokens * packedIn){ myPacked = packedIn; }
+   /* Have lexToken give punctuation and keywords no Token (lexeme
+      is null), as packing them needs nothing but their span */
+   void setPacking(bool packing){ myPacking = packing; }
+
+   /* Hold the input to budget's limits on bytes, tokens, nesting and
+      lexical errors (see budget.hpp), or to none if it is null */
+   void setBudget(const Budget * budget){ myBudget = budget; }
+
+   /* Number the lines from line on, for input that starts at the
+      beginning of that line of a bigger file */
+   void startAtLine(size_t line){ lineNum = line; }
+
+   /* Bytes of input matched so far */
+   size_t offset() const { return myOffset; }
+
+   /* Where errors are recorded: syntax errors, and lexical ones
+      unless redirected by setLexDiagnostics */
+   Diagnostics * diagnostics() const { return myDiags; }
+   void setLexDiagnostics(Diagnostics * diagsIn){ myLexDiags = diagsIn; }
+
    void errIllegal(Position * pos, std::string match){
-	cminusminus::Report::fatal(pos, "Illegal character "
-		+ match);
+	lexError(pos, "Illegal character " + match);
    }
 
    void errStrEsc(Position * pos){
-	cminusminus::Report::fatal(pos, "String literal with bad"
-	" escape sequence ignored");
+	lexError(pos, "String literal with bad escape sequence ignored");
    }
 
    void errStrUnterm(Position * pos){
-	cminusminus::Report::fatal(pos, "Unterminated string"
-	" literal ignored");
+	lexError(pos, "Unterminated string literal ignored");
    }
 
    void errStrEscAndUnterm(Position * pos){
-	cminusminus::Report::fatal(pos, "Unterminated string literal"
+	lexError(pos, "Unterminated string literal"
 	" with bad escape sequence ignored");
    }
 
    void errIntOverflow(Position * pos){
-	cminusminus::Report::fatal(pos, "Integer literal overflow");
+	lexError(pos, "Integer literal overflow");
    }
 
    void errIntUnderflow(Position * pos){
-	cminusminus::Report::fatal(pos, "Integer literal underflow");
+	lexError(pos, "Integer literal underflow");
    }
 
    void errShortOverflow(Position * pos){
-	cminusminus::Report::fatal(pos, "Short literal overflow");
+	lexError(pos, "Short literal overflow");
    }
 
    void errShortUnderflow(Position * pos){
-	cminusminus::Report::fatal(pos, "Short literal underflow");
+	lexError(pos, "Short literal underflow");
+   }
+
+   void errSyntax(std::string msg){
+	cminusminus::Report::syntax(myDiags, msg);
    }
 
 /*
@@ -91,8 +196,46 @@ public:
 
    void outputTokens(std::ostream& outstream);
 
+   /* Lex the rest of the input into plain token records,
+      ending with the END token */
+   void lexTokens(std::vector<TokenInfo>& out);
+
 private:
+   void lexError(Position * pos, std::string msg){
+	if (myBudget != nullptr){ chargeError(*pos); }
+	cminusminus::Report::fatal(myLexDiags, pos, msg);
+   }
+   /* Count the token tag, at pos, and the lexical error at pos,
+      against myBudget */
+   void charge(int tag, const Position& pos);
+   void chargeError(const Position& pos);
+
+   int pipedToken(cminusminus::Parser::semantic_type * const lval,
+     cminusminus::Parser::location_type * const loc);
+   int packedToken(cminusminus::Parser::semantic_type * const lval,
+     cminusminus::Parser::location_type * const loc);
+
    cminusminus::Parser::semantic_type *yylval = nullptr;
+   Diagnostics * myDiags;
+   Diagnostics * myLexDiags;
+   TokenPipe * myPipe;
+   PackedTokens * myPacked;
+   bool myPacking;
+   const char * mySource;
+   /* Bytes of input matched so far, this match included */
+   size_t myOffset;
+   bool myRecycle;
+   /* With recycling, the tokens and copied text not yet released,
+      and how much of the text came before the latest token */
+   std::vector<Token *> myIssued;
+   std::vector<std::string *> myTexts;
+   size_t myLatestTexts;
+   const Budget * myBudget;
+   /* What has been counted against myBudget: tokens, how many braces
+      and parentheses are open, and lexical errors */
+   size_t myTokenCount;
+   size_t myDepth;
+   size_t myLexErrors;
    size_t lineNum;
    size_t colNum;
 };
@@ -0,0 +1,759 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <memory>
+#include "serialize.hpp"
+#include "errors.hpp"
+#include "intern.hpp"
+
+namespace cminusminus{
+
+static const char AST_MAGIC[4] = {'C', 'M', 'M', 'A'};
+
+void ASTWriter::varint(uint64_t n){
+	while (n >= 0x80){
+		myNodes.push_back(static_cast<uint8_t>(n | 0x80));
+		n >>= 7;
+	}
+	myNodes.push_back(static_cast<uint8_t>(n));
+}
+
+void ASTWriter::node(NodeKind kind, Position * ownPos){
+	const Position * pos = myUsePos != nullptr ? myUsePos : ownPos;
+	myUsePos = nullptr;
+	myNodes.push_back(static_cast<uint8_t>(kind));
+	num(static_cast<int64_t>(pos->line() - myLastLine));
+	varint(pos->col());
+	num(static_cast<int64_t>(pos->lineEnd() - pos->line()));
+	varint(pos->colEnd());
+	myLastLine = pos->line();
+}
+
+void ASTWriter::tree(ASTNode * root){
+	myWork.run([this, root](){ record(root); });
+}
+
+void ASTWriter::record(ASTNode * node){
+	if (node == nullptr){
+		myNodes.push_back(static_cast<uint8_t>(NodeKind::NONE));
+		return;
+	}
+	if (myInterner != nullptr && myInterner->isShared(node)){
+		//The tree is written in source order, as the uses were made
+		const std::vector<Position>& uses = myInterner->uses(node);
+		size_t use = myUses[node]++;
+		if (use < uses.size()){ myUsePos = &uses[use]; }
+	}
+	node->serialize(*this);
+}
+
+void ASTWriter::str(const std::string& s){
+	auto found = myStringIds.find(s);
+	if (found != myStringIds.end()){
+		varint(found->second);
+		return;
+	}
+	uint64_t id = myStrings.size();
+	auto inserted = myStringIds.emplace(s, id);
+	myStrings.push_back(&inserted.first->first);
+	varint(id);
+}
+
+void ASTWriter::num(int64_t n){
+	uint64_t bits = static_cast<uint64_t>(n);
+	varint((bits << 1) ^ (n < 0 ? ~uint64_t(0) : 0));
+}
+
+void ASTWriter::finish(std::ostream& out){
+	std::vector<uint8_t> nodes;
+	nodes.swap(myNodes);
+
+	myNodes.insert(myNodes.end(), AST_MAGIC, AST_MAGIC + 4);
+	myNodes.push_back(AST_FORMAT_VERSION);
+	varint(myStrings.size());
+	for (const std::string * s : myStrings){
+		varint(s->size());
+		myNodes.insert(myNodes.end(), s->begin(), s->end());
+	}
+	out.write(reinterpret_cast<const char *>(myNodes.data()),
+		static_cast<std::streamsize>(myNodes.size()));
+	out.write(reinterpret_cast<const char *>(nodes.data()),
+		static_cast<std::streamsize>(nodes.size()));
+	myNodes.clear();
+}
+
+void writeAST(ProgramNode * root, std::ostream& out,
+	const ASTInterner * interner){
+	ASTWriter writer(interner);
+	writer.tree(root);
+	writer.finish(out);
+}
+
+/*
+Each node writes its own record. The child order written here is
+the order ASTReader::node reads them back in.
+*/
+
+void ProgramNode::serialize(ASTWriter& out){
+	out.node(NodeKind::PROGRAM, myPos);
+	out.children(myGlobals);
+}
+
+void VarDeclNode::serialize(ASTWriter& out){
+	out.node(NodeKind::VARDECL, myPos);
+	out.child(myType);
+	out.child(myId);
+}
+
+void FormalDeclNode::serialize(ASTWriter& out){
+	out.node(NodeKind::FORMALDECL, myPos);
+	out.child(myType);
+	out.child(myId);
+}
+
+void FnDeclNode::serialize(ASTWriter& out){
+	out.node(NodeKind::FNDECL, myPos);
+	out.child(myType);
+	out.child(myId);
+	out.children(parameters);
+	out.children(functionBody);
+}
+
+void IntTypeNode::serialize(ASTWriter& out){
+	out.node(NodeKind::INTTYPE, myPos);
+}
+
+void BoolTypeNode::serialize(ASTWriter& out){
+	out.node(NodeKind::BOOLTYPE, myPos);
+}
+
+void VoidTypeNode::serialize(ASTWriter& out){
+	out.node(NodeKind::VOIDTYPE, myPos);
+}
+
+void StringTypeNode::serialize(ASTWriter& out){
+	out.node(NodeKind::STRINGTYPE, myPos);
+}
+
+void ShortTypeNode::serialize(ASTWriter& out){
+	out.node(NodeKind::SHORTTYPE, myPos);
+}
+
+void PtrTypeNode::serialize(ASTWriter& out){
+	out.node(NodeKind::PTRTYPE, myPos);
+	out.child(myBase);
+}
+
+void AssignStmtNode::serialize(ASTWriter& out){
+	out.node(NodeKind::ASSIGNSTMT, myPos);
+	out.child(assignment);
+}
+
+void PostDecStmtNode::serialize(ASTWriter& out){
+	out.node(NodeKind::POSTDECSTMT, myPos);
+	out.child(variable);
+}
+
+void PostIncStmtNode::serialize(ASTWriter& out){
+	out.node(NodeKind::POSTINCSTMT, myPos);
+	out.child(variable);
+}
+
+void ReadStmtNode::serialize(ASTWriter& out){
+	out.node(NodeKind::READSTMT, myPos);
+	out.child(variable);
+}
+
+void WriteStmtNode::serialize(ASTWriter& out){
+	out.node(NodeKind::WRITESTMT, myPos);
+	out.child(expression);
+}
+
+void ReturnStmtNode::serialize(ASTWriter& out){
+	out.node(NodeKind::RETURNSTMT, myPos);
+	out.child(expression);
+}
+
+void WhileStmtNode::serialize(ASTWriter& out){
+	out.node(NodeKind::WHILESTMT, myPos);
+	out.child(condition);
+	out.children(WhileBody);
+}
+
+void IfStmtNode::serialize(ASTWriter& out){
+	out.node(NodeKind::IFSTMT, myPos);
+	out.child(condition);
+	out.children(IfBody);
+}
+
+void IfElseStmtNode::serialize(ASTWriter& out){
+	out.node(NodeKind::IFELSESTMT, myPos);
+	out.child(condition);
+	out.children(IfTrueBody);
+	out.children(IfFalseBody);
+}
+
+void CallStmtNode::serialize(ASTWriter& out){
+	out.node(NodeKind::CALLSTMT, myPos);
+	out.child(Function);
+}
+
+void TrueNode::serialize(ASTWriter& out){
+	out.node(NodeKind::TRUE, myPos);
+}
+
+void FalseNode::serialize(ASTWriter& out){
+	out.node(NodeKind::FALSE, myPos);
+}
+
+void StrLitNode::serialize(ASTWriter& out){
+	out.node(NodeKind::STRLIT, myPos);
+	out.str(stringVal.str());
+}
+
+void IntLitNode::serialize(ASTWriter& out){
+	out.node(NodeKind::INTLIT, myPos);
+	out.num(numval);
+}
+
+void ShortLitNode::serialize(ASTWriter& out){
+	out.node(NodeKind::SHORTLIT, myPos);
+	out.num(shortVal);
+}
+
+void NegNode::serialize(ASTWriter& out){
+	out.node(NodeKind::NEG, myPos);
+	out.child(expression);
+}
+
+void NotNode::serialize(ASTWriter& out){
+	out.node(NodeKind::NOT, myPos);
+	out.child(expression);
+}
+
+void RefNode::serialize(ASTWriter& out){
+	out.node(NodeKind::REF, myPos);
+	out.child(expression);
+}
+
+void CallExpNode::serialize(ASTWriter& out){
+	out.node(NodeKind::CALLEXP, myPos);
+	out.child(nameFunc);
+	out.children(arguments);
+}
+
+void AssignExpNode::serialize(ASTWriter& out){
+	out.node(NodeKind::ASSIGNEXP, myPos);
+	out.child(variable);
+	out.child(expression);
+}
+
+void AndNode::serialize(ASTWriter& out){
+	out.node(NodeKind::AND, myPos);
+	out.child(leftNode);
+	out.child(rightNode);
+}
+
+void DivideNode::serialize(ASTWriter& out){
+	out.node(NodeKind::DIVIDE, myPos);
+	out.child(leftNode);
+	out.child(rightNode);
+}
+
+void EqualsNode::serialize(ASTWriter& out){
+	out.node(NodeKind::EQUALS, myPos);
+	out.child(leftNode);
+	out.child(rightNode);
+}
+
+void GreaterEqNode::serialize(ASTWriter& out){
+	out.node(NodeKind::GREATEREQ, myPos);
+	out.child(leftNode);
+	out.child(rightNode);
+}
+
+void GreaterNode::serialize(ASTWriter& out){
+	out.node(NodeKind::GREATER, myPos);
+	out.child(leftNode);
+	out.child(rightNode);
+}
+
+void LessEqNode::serialize(ASTWriter& out){
+	out.node(NodeKind::LESSEQ, myPos);
+	out.child(leftNode);
+	out.child(rightNode);
+}
+
+void LessNode::serialize(ASTWriter& out){
+	out.node(NodeKind::LESS, myPos);
+	out.child(leftNode);
+	out.child(rightNode);
+}
+
+void MinusNode::serialize(ASTWriter& out){
+	out.node(NodeKind::MINUS, myPos);
+	out.child(leftNode);
+	out.child(rightNode);
+}
+
+void NotEqualsNode::serialize(ASTWriter& out){
+	out.node(NodeKind::NOTEQUALS, myPos);
+	out.child(leftNode);
+	out.child(rightNode);
+}
+
+void OrNode::serialize(ASTWriter& out){
+	out.node(NodeKind::OR, myPos);
+	out.child(leftNode);
+	out.child(rightNode);
+}
+
+void PlusNode::serialize(ASTWriter& out){
+	out.node(NodeKind::PLUS, myPos);
+	out.child(leftNode);
+	out.child(rightNode);
+}
+
+void TimesNode::serialize(ASTWriter& out){
+	out.node(NodeKind::TIMES, myPos);
+	out.child(leftNode);
+	out.child(rightNode);
+}
+
+void IDNode::serialize(ASTWriter& out){
+	out.node(NodeKind::ID, myPos);
+	out.str(name);
+}
+
+void DerefNode::serialize(ASTWriter& out){
+	out.node(NodeKind::DEREF, myPos);
+	out.child(myId);
+}
+
+void IndexNode::serialize(ASTWriter& out){
+	out.node(NodeKind::INDEX, myPos);
+	out.child(Id_being_accessed);
+	out.child(field_Name_being_accessed);
+}
+
+/*
+Decodes a serialized tree straight out of the caller's buffer
+(typically a read-only mapping of the file), checking every read
+against the end of the buffer.
+
+The tree is read without recursing: each node whose children are
+still being read waits on a stack, holding its span and the children
+read so far, and is built once its last child is in. Whatever is on
+the stack when a read fails is freed before the error goes on.
+*/
+class ASTReader{
+public:
+	ASTReader(const uint8_t * data, size_t len)
+	: myCur(data), myEnd(data + len), myLastLine(0){ }
+
+	~ASTReader(){
+		for (Pending& pending : myPending){
+			delete pending.pos;
+			for (ASTNode * kid : pending.kids){ deleteTree(kid); }
+		}
+	}
+
+	ProgramNode * program(){
+		if (static_cast<size_t>(myEnd - myCur) < 5
+		  || !std::equal(AST_MAGIC, AST_MAGIC + 4, myCur)){
+			malformed("not an AST file");
+		}
+		myCur += 4;
+		if (*myCur++ != AST_FORMAT_VERSION){
+			malformed("unsupported AST format version");
+		}
+		uint64_t count = varint();
+		for (uint64_t i = 0; i < count; i++){
+			uint64_t len = varint();
+			if (len > static_cast<uint64_t>(myEnd - myCur)){
+				malformed("truncated string table");
+			}
+			const char * chars = reinterpret_cast<const char *>(myCur);
+			myStrings.emplace_back(chars, len);
+			mySlices.emplace_back(chars, len);
+			myCur += len;
+		}
+		if (static_cast<NodeKind>(byte()) != NodeKind::PROGRAM){
+			malformed("not a program");
+		}
+		open(NodeKind::PROGRAM);
+		ProgramNode * result = static_cast<ProgramNode *>(tree());
+		if (myCur != myEnd){
+			deleteTree(result);
+			malformed("trailing bytes");
+		}
+		return result;
+	}
+
+private:
+	/* A node whose children are being read */
+	struct Pending{
+		NodeKind kind;
+		Position * pos;
+		/* The slots still to read: n a child, o a child that may
+		   be missing, l a list of children */
+		const char * slots;
+		/* Every child read so far, those of lists included */
+		std::vector<ASTNode *> kids;
+		/* For each list read so far, its length + 1 (0: absent) */
+		std::vector<uint64_t> lists;
+		/* How many children of the list being read are to come */
+		uint64_t listLeft;
+		int64_t value;
+		uint64_t str;
+	};
+
+	[[noreturn]] void malformed(const char * why){
+		std::string msg = "Malformed AST file: ";
+		msg += why;
+		throw new UserError(msg.c_str());
+	}
+
+	uint8_t byte(){
+		if (myCur == myEnd){ malformed("unexpected end of data"); }
+		return *myCur++;
+	}
+
+	uint64_t varint(){
+		uint64_t result = 0;
+		for (unsigned int shift = 0; shift < 64; shift += 7){
+			uint8_t b = byte();
+			result |= static_cast<uint64_t>(b & 0x7f) << shift;
+			if ((b & 0x80) == 0){ return result; }
+		}
+		malformed("bad varint");
+	}
+
+	int64_t num(){
+		uint64_t bits = varint();
+		return static_cast<int64_t>(bits >> 1) ^ -static_cast<int64_t>(bits & 1);
+	}
+
+	/* The children of a node of kind, in the order they are written,
+	   or nullptr if there is no such kind */
+	static const char * slotsOf(NodeKind kind){
+		switch (kind){
+		case NodeKind::PROGRAM:
+			return "l";
+		case NodeKind::INTTYPE: case NodeKind::BOOLTYPE:
+		case NodeKind::VOIDTYPE: case NodeKind::STRINGTYPE:
+		case NodeKind::SHORTTYPE: case NodeKind::TRUE:
+		case NodeKind::FALSE: case NodeKind::STRLIT:
+		case NodeKind::INTLIT: case NodeKind::SHORTLIT:
+		case NodeKind::ID:
+			return "";
+		case NodeKind::PTRTYPE: case NodeKind::ASSIGNSTMT:
+		case NodeKind::POSTDECSTMT: case NodeKind::POSTINCSTMT:
+		case NodeKind::READSTMT: case NodeKind::WRITESTMT:
+		case NodeKind::CALLSTMT: case NodeKind::NEG: case NodeKind::NOT:
+		case NodeKind::REF: case NodeKind::DEREF:
+			return "n";
+		case NodeKind::RETURNSTMT:
+			return "o";
+		case NodeKind::WHILESTMT: case NodeKind::IFSTMT:
+		case NodeKind::CALLEXP:
+			return "nl";
+		case NodeKind::IFELSESTMT:
+			return "nll";
+		case NodeKind::FNDECL:
+			return "nnll";
+		case NodeKind::VARDECL: case NodeKind::FORMALDECL:
+		case NodeKind::ASSIGNEXP: case NodeKind::AND:
+		case NodeKind::DIVIDE: case NodeKind::EQUALS:
+		case NodeKind::GREATEREQ: case NodeKind::GREATER:
+		case NodeKind::LESSEQ: case NodeKind::LESS: case NodeKind::MINUS:
+		case NodeKind::NOTEQUALS: case NodeKind::OR: case NodeKind::PLUS:
+		case NodeKind::TIMES: case NodeKind::INDEX:
+			return "nn";
+		case NodeKind::NONE:
+		case NodeKind::END_OF_KINDS:
+			break;
+		}
+		return nullptr;
+	}
+
+	/* Start a node of kind, whose kind byte has been read: its span
+	   and payload, and then (from tree) its children */
+	void open(NodeKind kind){
+		const char * slots = slotsOf(kind);
+		if (slots == nullptr){ malformed("unknown node kind"); }
+		size_t lineI = myLastLine + static_cast<size_t>(num());
+		size_t colI = varint();
+		size_t lineE = lineI + static_cast<size_t>(num());
+		size_t colE = varint();
+		myLastLine = lineI;
+		myPending.push_back(Pending{kind, nullptr, slots, {}, {}, 0, 0, 0});
+		Pending& pending = myPending.back();
+		pending.pos = new Position(lineI, colI, lineE, colE);
+		switch (kind){
+		case NodeKind::STRLIT:
+			pending.str = varint();
+			if (pending.str >= mySlices.size()){
+				malformed("bad string index");
+			}
+			break;
+		case NodeKind::ID:
+			pending.str = varint();
+			if (pending.str >= myStrings.size()){
+				malformed("bad string index");
+			}
+			break;
+		case NodeKind::INTLIT:
+		case NodeKind::SHORTLIT:
+			pending.value = num();
+			break;
+		default:
+			break;
+		}
+	}
+
+	/* Read the child in the next slot of the innermost pending node */
+	void child(bool required){
+		NodeKind kind = static_cast<NodeKind>(byte());
+		if (kind != NodeKind::NONE){
+			open(kind);
+		} else if (required){
+			malformed("missing child");
+		} else {
+			myPending.back().kids.push_back(nullptr);
+		}
+	}
+
+	/* Read until the pending nodes are all built, and return the
+	   outermost */
+	ASTNode * tree(){
+		while (true){
+			Pending& top = myPending.back();
+			if (top.listLeft > 0){
+				top.listLeft--;
+				child(true);
+				continue;
+			}
+			char slot = *top.slots;
+			if (slot == 'l'){
+				top.slots++;
+				uint64_t count = varint();
+				top.lists.push_back(count);
+				if (count > 0){ top.listLeft = count - 1; }
+				continue;
+			}
+			if (slot != '\0'){
+				top.slots++;
+				child(slot == 'n');
+				continue;
+			}
+			ASTNode * built = build(top);
+			//The node owns its span and children now
+			top.pos = nullptr;
+			top.kids.clear();
+			myPending.pop_back();
+			if (myPending.empty()){ return built; }
+			myPending.back().kids.push_back(built);
+		}
+	}
+
+	/* The next child of pending, which must be a T if it is there */
+	template <typename T>
+	T * take(Pending& pending, size_t& kid){
+		ASTNode * node = pending.kids[kid++];
+		if (node == nullptr){ return nullptr; }
+		T * result = dynamic_cast<T *>(node);
+		if (result == nullptr){ malformed("unexpected node kind"); }
+		return result;
+	}
+
+	/* The next list of pending, each of which must be a T */
+	template <typename T>
+	std::unique_ptr<std::list<T *>> takeList(Pending& pending,
+		size_t& kid, size_t& list){
+		uint64_t count = pending.lists[list++];
+		std::unique_ptr<std::list<T *>> result;
+		if (count == 0){ return result; }
+		result.reset(new std::list<T *>());
+		for (uint64_t i = 1; i < count; i++){
+			result->push_back(take<T>(pending, kid));
+		}
+		return result;
+	}
+
+	/* The node pending stands for, from its children. Throws, leaving
+	   pending as it was, if they are not of the kinds it takes */
+	ASTNode * build(Pending& pending){
+		Position * p = pending.pos;
+		size_t kid = 0;
+		size_t list = 0;
+		switch (pending.kind){
+		case NodeKind::PROGRAM: {
+			auto globals = takeList<DeclNode>(pending, kid, list);
+			if (globals == nullptr){ malformed("missing child"); }
+			ProgramNode * result = new ProgramNode(globals.release());
+			delete p;
+			return result;
+		}
+		case NodeKind::VARDECL: {
+			TypeNode * type = take<TypeNode>(pending, kid);
+			return new VarDeclNode(p, type, take<IDNode>(pending, kid));
+		}
+		case NodeKind::FORMALDECL: {
+			TypeNode * type = take<TypeNode>(pending, kid);
+			return new FormalDeclNode(p, type, take<IDNode>(pending, kid));
+		}
+		case NodeKind::FNDECL: {
+			TypeNode * type = take<TypeNode>(pending, kid);
+			IDNode * id = take<IDNode>(pending, kid);
+			auto formals = takeList<FormalDeclNode>(pending, kid, list);
+			auto body = takeList<StmtNode>(pending, kid, list);
+			return new FnDeclNode(p, type, id, formals.release(),
+				body.release());
+		}
+		case NodeKind::INTTYPE: return new IntTypeNode(p);
+		case NodeKind::BOOLTYPE: return new BoolTypeNode(p);
+		case NodeKind::VOIDTYPE: return new VoidTypeNode(p);
+		case NodeKind::STRINGTYPE: return new StringTypeNode(p);
+		case NodeKind::SHORTTYPE: return new ShortTypeNode(p);
+		case NodeKind::PTRTYPE:
+			return new PtrTypeNode(p, take<TypeNode>(pending, kid));
+		case NodeKind::ASSIGNSTMT:
+			return new AssignStmtNode(p, take<AssignExpNode>(pending, kid));
+		case NodeKind::POSTDECSTMT:
+			return new PostDecStmtNode(p, take<LValNode>(pending, kid));
+		case NodeKind::POSTINCSTMT:
+			return new PostIncStmtNode(p, take<LValNode>(pending, kid));
+		case NodeKind::READSTMT:
+			return new ReadStmtNode(p, take<LValNode>(pending, kid));
+		case NodeKind::WRITESTMT:
+			return new WriteStmtNode(p, take<ExpNode>(pending, kid));
+		case NodeKind::RETURNSTMT: {
+			ExpNode * exp = take<ExpNode>(pending, kid);
+			if (exp == nullptr){ return new ReturnStmtNode(p); }
+			return new ReturnStmtNode(p, exp);
+		}
+		case NodeKind::WHILESTMT: {
+			ExpNode * cond = take<ExpNode>(pending, kid);
+			auto body = takeList<StmtNode>(pending, kid, list);
+			return new WhileStmtNode(p, cond, body.release());
+		}
+		case NodeKind::IFSTMT: {
+			ExpNode * cond = take<ExpNode>(pending, kid);
+			auto body = takeList<StmtNode>(pending, kid, list);
+			return new IfStmtNode(p, cond, body.release());
+		}
+		case NodeKind::IFELSESTMT: {
+			ExpNode * cond = take<ExpNode>(pending, kid);
+			auto tbody = takeList<StmtNode>(pending, kid, list);
+			auto fbody = takeList<StmtNode>(pending, kid, list);
+			return new IfElseStmtNode(p, cond, tbody.release(),
+				fbody.release());
+		}
+		case NodeKind::CALLSTMT:
+			return new CallStmtNode(p, take<CallExpNode>(pending, kid));
+		case NodeKind::TRUE: return new TrueNode(p);
+		case NodeKind::FALSE: return new FalseNode(p);
+		case NodeKind::STRLIT: return new StrLitNode(p, mySlices[pending.str]);
+		case NodeKind::INTLIT:
+			return new IntLitNode(p, static_cast<int>(pending.value));
+		case NodeKind::SHORTLIT:
+			return new ShortLitNode(p, static_cast<int>(pending.value));
+		case NodeKind::NEG: return new NegNode(p, take<ExpNode>(pending, kid));
+		case NodeKind::NOT: return new NotNode(p, take<ExpNode>(pending, kid));
+		case NodeKind::REF: return new RefNode(p, take<ExpNode>(pending, kid));
+		case NodeKind::CALLEXP: {
+			IDNode * name = take<IDNode>(pending, kid);
+			auto args = takeList<ExpNode>(pending, kid, list);
+			if (args == nullptr){ return new CallExpNode(p, name); }
+			return new CallExpNode(p, name, args.release());
+		}
+		case NodeKind::ASSIGNEXP: {
+			LValNode * lval = take<LValNode>(pending, kid);
+			return new AssignExpNode(p, lval, take<ExpNode>(pending, kid));
+		}
+		case NodeKind::ID: return new IDNode(p, myStrings[pending.str]);
+		case NodeKind::DEREF: return new DerefNode(p, take<IDNode>(pending, kid));
+		case NodeKind::INDEX: {
+			IDNode * base = take<IDNode>(pending, kid);
+			return new IndexNode(p, base, take<IDNode>(pending, kid));
+		}
+		default:
+			break;
+		}
+		//The rest are binary operators
+		ExpNode * lhs = take<ExpNode>(pending, kid);
+		ExpNode * rhs = take<ExpNode>(pending, kid);
+		switch (pending.kind){
+		case NodeKind::AND: return new AndNode(p, lhs, rhs);
+		case NodeKind::DIVIDE: return new DivideNode(p, lhs, rhs);
+		case NodeKind::EQUALS: return new EqualsNode(p, lhs, rhs);
+		case NodeKind::GREATEREQ: return new GreaterEqNode(p, lhs, rhs);
+		case NodeKind::GREATER: return new GreaterNode(p, lhs, rhs);
+		case NodeKind::LESSEQ: return new LessEqNode(p, lhs, rhs);
+		case NodeKind::LESS: return new LessNode(p, lhs, rhs);
+		case NodeKind::MINUS: return new MinusNode(p, lhs, rhs);
+		case NodeKind::NOTEQUALS: return new NotEqualsNode(p, lhs, rhs);
+		case NodeKind::OR: return new OrNode(p, lhs, rhs);
+		case NodeKind::PLUS: return new PlusNode(p, lhs, rhs);
+		case NodeKind::TIMES: return new TimesNode(p, lhs, rhs);
+		default:
+			malformed("unknown node kind");
+		}
+	}
+
+	const uint8_t * myCur;
+	const uint8_t * myEnd;
+	size_t myLastLine;
+	std::vector<std::string> myStrings;
+	std::vector<StrSlice> mySlices;
+	std::vector<Pending> myPending;
+};
+
+ProgramNode * readAST(const uint8_t * data, size_t len){
+	ASTReader reader(data, len);
+	return reader.program();
+}
+
+MappedAST::MappedAST(const char * path) : myMap(nullptr), myLen(0),
+  myAST(nullptr){
+	int fd = open(path, O_RDONLY);
+	if (fd < 0){
+		std::string msg = "Bad AST file ";
+		msg += path;
+		throw new UserError(msg.c_str());
+	}
+	struct stat info;
+	if (fstat(fd, &info) != 0 || info.st_size == 0){
+		close(fd);
+		std::string msg = "Bad AST file ";
+		msg += path;
+		throw new UserError(msg.c_str());
+	}
+	size_t len = static_cast<size_t>(info.st_size);
+	void * mapped = mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (mapped == MAP_FAILED){
+		std::string msg = "Cannot map AST file ";
+		msg += path;
+		throw new UserError(msg.c_str());
+	}
+	try {
+		myAST = readAST(static_cast<const uint8_t *>(mapped), len);
+	} catch (...){
+		munmap(mapped, len);
+		throw;
+	}
+	myMap = mapped;
+	myLen = len;
+}
+
+MappedAST::~MappedAST(){
+	//The tree first: its string literals point into the mapping
+	deleteTree(myAST);
+	munmap(myMap, myLen);
+}
+
+}
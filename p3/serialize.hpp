@@ -0,0 +1,138 @@
+#ifndef CMINUSMINUS_SERIALIZE_HPP
+#define CMINUSMINUS_SERIALIZE_HPP
+
+#include <cstdint>
+#include <list>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "ast.hpp"
+#include "workstack.hpp"
+
+/*
+A compact binary form of the AST, so that later stages can load a
+ProgramNode without lexing or parsing the source again.
+
+Layout (all integers are LEB128 varints unless noted, signed values
+zigzag-encoded):
+	magic        4 bytes, "CMMA"
+	version      1 byte, AST_FORMAT_VERSION
+	strings      count, then (length, bytes) for each distinct
+	             identifier name and string literal
+	nodes        the tree in pre-order. Each node is its NodeKind
+	             byte, its span, its payload (a string index or a
+	             literal value) and then its children in a fixed
+	             per-kind order. A missing child is the byte NONE;
+	             a list is its length + 1, with 0 meaning the list
+	             itself is absent. A span is the signed change in
+	             start line from the previous node, the start
+	             column, the signed number of lines spanned and the
+	             end column.
+*/
+
+namespace cminusminus{
+
+class ASTInterner;
+
+const uint8_t AST_FORMAT_VERSION = 3;
+
+/* Tags for the node records. These are part of the file format:
+   append new kinds at the end and never renumber. */
+enum class NodeKind : uint8_t {
+	NONE = 0,
+	PROGRAM, VARDECL, FORMALDECL, FNDECL,
+	INTTYPE, BOOLTYPE, VOIDTYPE, STRINGTYPE, SHORTTYPE, PTRTYPE,
+	ASSIGNSTMT, POSTDECSTMT, POSTINCSTMT, READSTMT, WRITESTMT,
+	RETURNSTMT, WHILESTMT, IFSTMT, IFELSESTMT, CALLSTMT,
+	TRUE, FALSE, STRLIT, INTLIT, SHORTLIT,
+	NEG, NOT, REF, CALLEXP, ASSIGNEXP,
+	AND, DIVIDE, EQUALS, GREATEREQ, GREATER, LESSEQ, LESS,
+	MINUS, NOTEQUALS, OR, PLUS, TIMES,
+	ID, DEREF, INDEX,
+	END_OF_KINDS
+};
+
+/**
+* \class ASTWriter
+* Accumulates the serialized form of a tree. Nodes write themselves
+* through ASTNode::serialize, which calls back into this class; their
+* children are queued, and written in turn without recursing. Given
+* the interner a tree was built through, each use of a shared node
+* is written with its own span, so the file is what the tree would
+* have been without sharing.
+**/
+class ASTWriter{
+public:
+	ASTWriter(const ASTInterner * internerIn = nullptr)
+	: myInterner(internerIn), myUsePos(nullptr), myLastLine(0){ }
+	/* Write the whole tree under root */
+	void tree(ASTNode * root);
+	/* Start the record for a node */
+	void node(NodeKind kind, Position * pos);
+	/* Queue a (possibly null) child subtree, to be written after
+	   the rest of this node's record */
+	void child(ASTNode * node){
+		myWork.then([this, node](){ record(node); });
+	}
+	template <typename T>
+	void children(std::list<T *> * nodes){
+		uint64_t count = nodes == nullptr ? 0 : nodes->size() + 1;
+		myWork.then([this, count](){ varint(count); });
+		if (nodes == nullptr){ return; }
+		for (T * elt : *nodes){ child(elt); }
+	}
+	void str(const std::string& s);
+	void num(int64_t n);
+
+	/* Write the complete file: header, strings, then nodes */
+	void finish(std::ostream& out);
+private:
+	void varint(uint64_t n);
+	/* Write node's record, and queue its children */
+	void record(ASTNode * node);
+	const ASTInterner * myInterner;
+	/* The span to write for the next node, if not its own */
+	const Position * myUsePos;
+	/* How many uses of each shared node have been written */
+	std::unordered_map<const ASTNode *, size_t> myUses;
+	size_t myLastLine;
+	WorkStack myWork;
+	std::vector<uint8_t> myNodes;
+	std::vector<const std::string *> myStrings;
+	std::unordered_map<std::string, uint64_t> myStringIds;
+};
+
+/* Serialize a whole program to out. interner is the one it was built
+   through, if it shares nodes */
+void writeAST(ProgramNode * root, std::ostream& out,
+	const ASTInterner * interner = nullptr);
+
+/* Rebuild a program from a serialized buffer. Throws UserError if
+   the buffer is not a well-formed AST file of this version. String
+   literals point into the buffer, which must outlive the program */
+ProgramNode * readAST(const uint8_t * data, size_t len);
+
+/**
+* \class MappedAST
+* A binary AST file mapped into memory, and the program rebuilt from
+* it, whose string literals point into the mapping. Both go with it
+**/
+class MappedAST{
+public:
+	/* Throws UserError if the file is missing or malformed */
+	MappedAST(const char * path);
+	~MappedAST();
+	MappedAST(const MappedAST&) = delete;
+	MappedAST& operator=(const MappedAST&) = delete;
+
+	ProgramNode * ast() const { return myAST; }
+private:
+	void * myMap;
+	size_t myLen;
+	ProgramNode * myAST;
+};
+
+}
+
+#endif
@@ -0,0 +1,409 @@
+#include <cstdint>
+#include <memory>
+#include "ast.hpp"
+#include "workstack.hpp"
+
+namespace cminusminus{
+
+/*
+Constant folding and algebraic simplification. Expressions are
+rebuilt bottom-up: simplify() walks the operands with a stack of its
+own, and once a node's are simplified, folds it if they are now
+literals. Statement lists are rebuilt so that a branch which can never
+run disappears, and one which always runs is spliced into the
+enclosing list; nested bodies are queued on a WorkStack. Whatever is
+folded away is freed.
+
+Arithmetic follows the machine: int is 32 bits and short 16, both
+wrapping on overflow. An operation on two shorts yields a short;
+mixing a short with an int widens it to int. Division by zero and
+the one overflowing division (MIN / -1) trap at runtime, so they are
+left unfolded. An identity (x + 0, x * 1) only drops the literal when
+that cannot narrow the result: s + 0 is an int, which s is not.
+*/
+
+namespace{
+
+/* The value of a literal expression, if it is one */
+struct Constant{
+	enum Kind { NONE, INT, SHORT, BOOL };
+	Kind kind;
+	int32_t val;
+
+	bool isNum() const { return kind == INT || kind == SHORT; }
+	bool is(int32_t v) const { return isNum() && val == v; }
+};
+
+}
+
+/* exp folded to with, which is none of exp's: free exp */
+static ExpNode * replaced(ExpNode * exp, ExpNode * with){
+	deleteTree(exp);
+	return with;
+}
+
+/* exp folded to its child: free exp but for the child */
+static ExpNode * collapsed(ExpNode * exp, ExpNode *& child){
+	ExpNode * kept = child;
+	child = nullptr;
+	deleteTree(exp);
+	return kept;
+}
+
+static Constant constOf(ExpNode * exp){
+	if (auto lit = dynamic_cast<IntLitNode *>(exp)){
+		return Constant{Constant::INT, lit->num()};
+	}
+	if (auto lit = dynamic_cast<ShortLitNode *>(exp)){
+		return Constant{Constant::SHORT, lit->num()};
+	}
+	if (dynamic_cast<TrueNode *>(exp)){
+		return Constant{Constant::BOOL, 1};
+	}
+	if (dynamic_cast<FalseNode *>(exp)){
+		return Constant{Constant::BOOL, 0};
+	}
+	return Constant{Constant::NONE, 0};
+}
+
+/* Is exp an int, as far as can be told without type analysis? An
+   arithmetic operator with an int literal operand is, whatever the
+   other operand is, since mixing widens to int */
+static bool knownInt(ExpNode * exp){
+	while (NegNode * neg = dynamic_cast<NegNode *>(exp)){
+		exp = neg->getExp();
+	}
+	if (constOf(exp).kind == Constant::INT){ return true; }
+	BinaryExpNode * bin = dynamic_cast<BinaryExpNode *>(exp);
+	if (bin == nullptr || !(dynamic_cast<PlusNode *>(exp)
+	  || dynamic_cast<MinusNode *>(exp) || dynamic_cast<TimesNode *>(exp)
+	  || dynamic_cast<DivideNode *>(exp))){
+		return false;
+	}
+	return constOf(bin->getLeft()).kind == Constant::INT
+		|| constOf(bin->getRight()).kind == Constant::INT;
+}
+
+/* Can x op c fold to x, c being op's identity? Only if that keeps the
+   type: an int c makes the result an int, which a short x is not */
+static bool keepsType(const Constant& c, ExpNode * x){
+	return c.kind == Constant::SHORT || knownInt(x);
+}
+
+static ExpNode * boolLit(Position * pos, bool val){
+	if (val){ return new TrueNode(new Position(*pos)); }
+	return new FalseNode(new Position(*pos));
+}
+
+/* A literal holding val truncated to kind's width (two's complement) */
+static ExpNode * numLit(Position * pos, Constant::Kind kind, int64_t val){
+	uint64_t bits = static_cast<uint64_t>(val);
+	if (kind == Constant::SHORT){
+		int16_t s = static_cast<int16_t>(static_cast<uint16_t>(bits));
+		return new ShortLitNode(new Position(*pos), s);
+	}
+	int32_t i = static_cast<int32_t>(static_cast<uint32_t>(bits));
+	return new IntLitNode(new Position(*pos), i);
+}
+
+static Constant::Kind widen(const Constant& l, const Constant& r){
+	if (l.kind == Constant::SHORT && r.kind == Constant::SHORT){
+		return Constant::SHORT;
+	}
+	return Constant::INT;
+}
+
+/* Two boolean or two numeric literals */
+static bool comparable(const Constant& l, const Constant& r){
+	if (l.kind == Constant::BOOL){ return r.kind == Constant::BOOL; }
+	return l.isNum() && r.isNum();
+}
+
+ExpNode * ExpNode::simplify(){
+	//Each operand slot, and whether its operands are queued yet
+	ExpNode * root = this;
+	std::vector<std::pair<ExpNode **, bool>> stack;
+	stack.emplace_back(&root, false);
+	std::vector<ExpNode **> slots;
+	while (!stack.empty()){
+		ExpNode ** slot = stack.back().first;
+		if (stack.back().second){
+			stack.pop_back();
+			*slot = (*slot)->fold();
+			continue;
+		}
+		stack.back().second = true;
+		slots.clear();
+		(*slot)->operands(slots);
+		//Reversed, so the first is simplified first
+		for (auto it = slots.rbegin(); it != slots.rend(); ++it){
+			stack.emplace_back(*it, false);
+		}
+	}
+	return root;
+}
+
+void UnaryExpNode::operands(std::vector<ExpNode **>& slots){
+	slots.push_back(&expression);
+}
+
+void BinaryExpNode::operands(std::vector<ExpNode **>& slots){
+	slots.push_back(&leftNode);
+	slots.push_back(&rightNode);
+}
+
+/* Queue the simplifying of body's statements, then a step putting
+   what they become in its place */
+static void simplifyBody(std::list<StmtNode *> * body, WorkStack& work){
+	if (body == nullptr){ return; }
+	auto result = std::make_shared<std::list<StmtNode *>>();
+	for (StmtNode * stmt : *body){
+		work.then([stmt, result, &work](){ stmt->simplify(*result, work); });
+	}
+	work.then([body, result](){ body->swap(*result); });
+}
+
+/* Put the statements of a branch that always runs in place of the
+   branch, leaving body empty. A body that declares variables keeps its
+   own scope, so it stays behind an if (true). Returns false if it
+   could not be spliced */
+static bool splice(std::list<StmtNode *> * body, std::list<StmtNode *>& out){
+	if (body == nullptr){ return true; }
+	for (StmtNode * stmt : *body){
+		if (dynamic_cast<VarDeclNode *>(stmt)){ return false; }
+	}
+	out.splice(out.end(), *body);
+	return true;
+}
+
+void ProgramNode::simplify(){
+	WorkStack work;
+	for (DeclNode * global : *myGlobals){
+		std::list<StmtNode *> ignored;
+		work.run([&](){ global->simplify(ignored, work); });
+	}
+}
+
+void FnDeclNode::simplify(std::list<StmtNode *>& out, WorkStack& work){
+	simplifyBody(functionBody, work);
+	out.push_back(this);
+}
+
+void AssignStmtNode::simplify(std::list<StmtNode *>& out, WorkStack& work){
+	assignment->simplify();
+	out.push_back(this);
+}
+
+void CallStmtNode::simplify(std::list<StmtNode *>& out, WorkStack& work){
+	Function->simplify();
+	out.push_back(this);
+}
+
+void WriteStmtNode::simplify(std::list<StmtNode *>& out, WorkStack& work){
+	expression = expression->simplify();
+	out.push_back(this);
+}
+
+void ReturnStmtNode::simplify(std::list<StmtNode *>& out, WorkStack& work){
+	if (expression != nullptr){
+		expression = expression->simplify();
+	}
+	out.push_back(this);
+}
+
+void WhileStmtNode::simplify(std::list<StmtNode *>& out, WorkStack& work){
+	condition = condition->simplify();
+	Constant c = constOf(condition);
+	if (c.kind == Constant::BOOL && c.val == 0){
+		deleteTree(this);
+		return;
+	}
+	simplifyBody(WhileBody, work);
+	out.push_back(this);
+}
+
+void IfStmtNode::simplify(std::list<StmtNode *>& out, WorkStack& work){
+	condition = condition->simplify();
+	Constant c = constOf(condition);
+	if (c.kind == Constant::BOOL && c.val == 0){
+		deleteTree(this);
+		return;
+	}
+	simplifyBody(IfBody, work);
+	work.then([this, c, &out](){
+		if (c.kind == Constant::BOOL && splice(IfBody, out)){
+			deleteTree(this);
+			return;
+		}
+		out.push_back(this);
+	});
+}
+
+void IfElseStmtNode::simplify(std::list<StmtNode *>& out, WorkStack& work){
+	condition = condition->simplify();
+	Constant c = constOf(condition);
+	if (c.kind != Constant::BOOL){
+		simplifyBody(IfTrueBody, work);
+		simplifyBody(IfFalseBody, work);
+		out.push_back(this);
+		return;
+	}
+	std::list<StmtNode *> *& taken = c.val ? IfTrueBody : IfFalseBody;
+	simplifyBody(taken, work);
+	work.then([this, &taken, &out](){
+		if (!splice(taken, out)){
+			out.push_back(new IfStmtNode(new Position(*myPos),
+				boolLit(condition->pos(), true), taken));
+			taken = nullptr;
+		}
+		deleteTree(this);
+	});
+}
+
+void CallExpNode::operands(std::vector<ExpNode **>& slots){
+	if (arguments == nullptr){ return; }
+	for (ExpNode *& arg : *arguments){ slots.push_back(&arg); }
+}
+
+void AssignExpNode::operands(std::vector<ExpNode **>& slots){
+	slots.push_back(&expression);
+}
+
+ExpNode * NegNode::fold(){
+	Constant c = constOf(expression);
+	if (!c.isNum()){ return this; }
+	return replaced(this,
+		numLit(myPos, c.kind, -static_cast<int64_t>(c.val)));
+}
+
+ExpNode * NotNode::fold(){
+	Constant c = constOf(expression);
+	if (c.kind != Constant::BOOL){ return this; }
+	return replaced(this, boolLit(myPos, !c.val));
+}
+
+ExpNode * PlusNode::fold(){
+	Constant l = constOf(leftNode);
+	Constant r = constOf(rightNode);
+	if (l.isNum() && r.isNum()){
+		return replaced(this, numLit(myPos, widen(l, r),
+			static_cast<int64_t>(l.val) + r.val));
+	}
+	if (r.is(0) && keepsType(r, leftNode)){
+		return collapsed(this, leftNode);
+	}
+	if (l.is(0) && keepsType(l, rightNode)){
+		return collapsed(this, rightNode);
+	}
+	return this;
+}
+
+ExpNode * MinusNode::fold(){
+	Constant l = constOf(leftNode);
+	Constant r = constOf(rightNode);
+	if (l.isNum() && r.isNum()){
+		return replaced(this, numLit(myPos, widen(l, r),
+			static_cast<int64_t>(l.val) - r.val));
+	}
+	if (r.is(0) && keepsType(r, leftNode)){
+		return collapsed(this, leftNode);
+	}
+	return this;
+}
+
+ExpNode * TimesNode::fold(){
+	Constant l = constOf(leftNode);
+	Constant r = constOf(rightNode);
+	if (l.isNum() && r.isNum()){
+		return replaced(this, numLit(myPos, widen(l, r),
+			static_cast<int64_t>(l.val) * r.val));
+	}
+	if (r.is(1) && keepsType(r, leftNode)){
+		return collapsed(this, leftNode);
+	}
+	if (l.is(1) && keepsType(l, rightNode)){
+		return collapsed(this, rightNode);
+	}
+	return this;
+}
+
+ExpNode * DivideNode::fold(){
+	Constant l = constOf(leftNode);
+	Constant r = constOf(rightNode);
+	if (l.isNum() && r.isNum() && r.val != 0){
+		Constant::Kind kind = widen(l, r);
+		int32_t min = kind == Constant::SHORT ? INT16_MIN : INT32_MIN;
+		if (!(l.val == min && r.val == -1)){
+			return replaced(this, numLit(myPos, kind, l.val / r.val));
+		}
+	}
+	if (r.is(1) && keepsType(r, leftNode)){
+		return collapsed(this, leftNode);
+	}
+	return this;
+}
+
+ExpNode * AndNode::fold(){
+	Constant l = constOf(leftNode);
+	Constant r = constOf(rightNode);
+	if (l.kind == Constant::BOOL){
+		//The right side only runs when the left is true
+		return collapsed(this, l.val ? rightNode : leftNode);
+	}
+	if (r.kind == Constant::BOOL && r.val){ return collapsed(this, leftNode); }
+	return this;
+}
+
+ExpNode * OrNode::fold(){
+	Constant l = constOf(leftNode);
+	Constant r = constOf(rightNode);
+	if (l.kind == Constant::BOOL){
+		return collapsed(this, l.val ? leftNode : rightNode);
+	}
+	if (r.kind == Constant::BOOL && !r.val){ return collapsed(this, leftNode); }
+	return this;
+}
+
+ExpNode * EqualsNode::fold(){
+	Constant l = constOf(leftNode);
+	Constant r = constOf(rightNode);
+	if (!comparable(l, r)){ return this; }
+	return replaced(this, boolLit(myPos, l.val == r.val));
+}
+
+ExpNode * NotEqualsNode::fold(){
+	Constant l = constOf(leftNode);
+	Constant r = constOf(rightNode);
+	if (!comparable(l, r)){ return this; }
+	return replaced(this, boolLit(myPos, l.val != r.val));
+}
+
+ExpNode * LessNode::fold(){
+	Constant l = constOf(leftNode);
+	Constant r = constOf(rightNode);
+	if (!l.isNum() || !r.isNum()){ return this; }
+	return replaced(this, boolLit(myPos, l.val < r.val));
+}
+
+ExpNode * LessEqNode::fold(){
+	Constant l = constOf(leftNode);
+	Constant r = constOf(rightNode);
+	if (!l.isNum() || !r.isNum()){ return this; }
+	return replaced(this, boolLit(myPos, l.val <= r.val));
+}
+
+ExpNode * GreaterNode::fold(){
+	Constant l = constOf(leftNode);
+	Constant r = constOf(rightNode);
+	if (!l.isNum() || !r.isNum()){ return this; }
+	return replaced(this, boolLit(myPos, l.val > r.val));
+}
+
+ExpNode * GreaterEqNode::fold(){
+	Constant l = constOf(leftNode);
+	Constant r = constOf(rightNode);
+	if (!l.isNum() || !r.isNum()){ return this; }
+	return replaced(this, boolLit(myPos, l.val >= r.val));
+}
+
+}
@@ -0,0 +1,516 @@
+#include <algorithm>
+#include <cstdint>
+#include "ssa.hpp"
+
+namespace cminusminus{
+
+/*
+Construction follows Cytron et al.: dominators (by the iterative
+algorithm of Cooper, Harvey and Kennedy), dominance frontiers, phis
+for each temp that is live into some block placed on the iterated
+frontier of its definitions, then renaming down the dominator tree.
+A temp read where no definition reaches reads 0.
+
+Destruction splits the critical edges into blocks with phis and puts
+the phis' copies at the end of each predecessor, as a parallel copy.
+*/
+
+static const size_t none = SIZE_MAX;
+
+static bool isTerminator(const Instr& instr){
+	return instr.isBranch() || instr.op == IROp::RET;
+}
+
+static bool isCondBranch(const Instr& instr){
+	return instr.isBranch() && instr.op != IROp::JMP;
+}
+
+static Instr jumpTo(size_t block){
+	return Instr{IROp::JMP, IRType::INT, Opd(), Opd::label(block), Opd()};
+}
+
+static size_t indexOf(const std::vector<size_t>& vec, size_t val){
+	return static_cast<size_t>(std::find(vec.begin(), vec.end(), val)
+		- vec.begin());
+}
+
+SSAProc::SSAProc(const IRProc& proc){
+	split(proc);
+	removeUnreachable();
+	computeDominators();
+
+	std::vector<std::vector<size_t>> frontier(blocks.size());
+	for (size_t b : rpo){
+		if (blocks[b].preds.size() < 2){ continue; }
+		for (size_t p : blocks[b].preds){
+			for (size_t runner = p; runner != idom[b]; runner = idom[runner]){
+				if (frontier[runner].empty() || frontier[runner].back() != b){
+					frontier[runner].push_back(b);
+				}
+			}
+		}
+	}
+
+	//Only temps read in a block other than the one defining them
+	// need phis
+	size_t numVars = proc.numTemps;
+	std::vector<bool> crosses(numVars, false);
+	std::vector<std::vector<size_t>> defSites(numVars);
+	std::vector<IRType> types(numVars, IRType::INT);
+	std::vector<size_t> definedIn(numVars, none);
+	std::vector<size_t> used;
+	for (size_t b : rpo){
+		for (const Instr& instr : blocks[b].code){
+			used.clear();
+			instr.uses(used);
+			for (size_t t : used){
+				if (definedIn[t] != b){ crosses[t] = true; }
+			}
+			int64_t d = instr.def();
+			if (d < 0){ continue; }
+			size_t v = static_cast<size_t>(d);
+			if (definedIn[v] != b){
+				definedIn[v] = b;
+				defSites[v].push_back(b);
+			}
+			types[v] = instr.type;
+		}
+	}
+
+	std::vector<std::vector<size_t>> phiVars(blocks.size());
+	std::vector<size_t> hasPhi(blocks.size(), none);
+	std::vector<size_t> queued(blocks.size(), none);
+	std::vector<size_t> work;
+	for (size_t v = 0; v < numVars; v++){
+		if (!crosses[v]){ continue; }
+		work = defSites[v];
+		for (size_t b : work){ queued[b] = v; }
+		while (!work.empty()){
+			size_t d = work.back();
+			work.pop_back();
+			for (size_t y : frontier[d]){
+				if (hasPhi[y] == v){ continue; }
+				hasPhi[y] = v;
+				blocks[y].phis.push_back(SSAPhi{types[v], v,
+					std::vector<Opd>(blocks[y].preds.size())});
+				phiVars[y].push_back(v);
+				if (queued[y] != v){
+					queued[y] = v;
+					work.push_back(y);
+				}
+			}
+		}
+	}
+	numTemps = numVars;
+	rename(phiVars);
+}
+
+void SSAProc::split(const IRProc& proc){
+	std::vector<size_t> labelBlock(proc.numLabels, none);
+	blocks.assign(1, SSABlock());
+	size_t cur = 0;
+	bool ended = false;
+	for (const Instr& instr : proc.code){
+		if (instr.op == IROp::LABEL){
+			if (cur == 0 || ended || !blocks[cur].code.empty()){
+				blocks.emplace_back();
+				cur = blocks.size() - 1;
+				ended = false;
+			}
+			labelBlock[instr.a.idx()] = cur;
+			continue;
+		}
+		if (ended){
+			blocks.emplace_back();
+			cur = blocks.size() - 1;
+			ended = false;
+		}
+		blocks[cur].code.push_back(instr);
+		ended = isTerminator(instr);
+	}
+
+	for (size_t b = 0; b < blocks.size(); b++){
+		SSABlock& blk = blocks[b];
+		bool hasNext = b + 1 < blocks.size();
+		if (blk.code.empty() || !isTerminator(blk.code.back())){
+			if (hasNext){
+				blk.code.push_back(jumpTo(b + 1));
+				blk.succs.push_back(b + 1);
+			} else {
+				blk.code.push_back(Instr{IROp::RET, IRType::INT, Opd(), Opd(), Opd()});
+			}
+			continue;
+		}
+		Instr& last = blk.code.back();
+		if (last.op == IROp::JMP){
+			blk.succs.push_back(labelBlock[last.a.idx()]);
+		} else if (isCondBranch(last)){
+			size_t taken = labelBlock[last.dst.idx()];
+			size_t fall = hasNext ? b + 1 : taken;
+			if (taken == fall){
+				last = jumpTo(taken);
+				blk.succs.push_back(taken);
+			} else {
+				blk.succs.push_back(taken);
+				blk.succs.push_back(fall);
+			}
+		}
+	}
+	for (size_t b = 0; b < blocks.size(); b++){
+		for (size_t s : blocks[b].succs){ blocks[s].preds.push_back(b); }
+	}
+	layout.clear();
+	for (size_t b = 0; b < blocks.size(); b++){ layout.push_back(b); }
+}
+
+void SSAProc::rename(std::vector<std::vector<size_t>>& phiVars){
+	std::vector<std::vector<size_t>> stacks(numTemps);
+	auto top = [&](size_t v){
+		return stacks[v].empty() ? Opd::imm(0) : Opd::temp(stacks[v].back());
+	};
+	numTemps = 0;
+
+	//Walk the dominator tree without recursion; each block is
+	// visited on the way down and again on the way back up
+	std::vector<std::pair<size_t, bool>> work;
+	std::vector<std::vector<size_t>> pushed(blocks.size());
+	work.emplace_back(0, false);
+	while (!work.empty()){
+		size_t b = work.back().first;
+		bool leaving = work.back().second;
+		work.pop_back();
+		if (leaving){
+			for (size_t v : pushed[b]){ stacks[v].pop_back(); }
+			continue;
+		}
+		work.emplace_back(b, true);
+		SSABlock& blk = blocks[b];
+		for (size_t i = 0; i < blk.phis.size(); i++){
+			size_t v = phiVars[b][i];
+			blk.phis[i].dst = newTemp().idx();
+			stacks[v].push_back(blk.phis[i].dst);
+			pushed[b].push_back(v);
+		}
+		for (Instr& instr : blk.code){
+			if (instr.a.isTemp()){ instr.a = top(instr.a.idx()); }
+			if (instr.b.isTemp()){ instr.b = top(instr.b.idx()); }
+			int64_t d = instr.def();
+			if (d < 0){ continue; }
+			size_t v = static_cast<size_t>(d);
+			instr.dst = newTemp();
+			stacks[v].push_back(instr.dst.idx());
+			pushed[b].push_back(v);
+		}
+		for (size_t s : blk.succs){
+			size_t k = indexOf(blocks[s].preds, b);
+			for (size_t i = 0; i < blocks[s].phis.size(); i++){
+				blocks[s].phis[i].args[k] = top(phiVars[s][i]);
+			}
+		}
+		for (size_t child : domChildren[b]){
+			work.emplace_back(child, false);
+		}
+	}
+}
+
+size_t SSAProc::newBlock(size_t before){
+	blocks.emplace_back();
+	size_t b = blocks.size() - 1;
+	layout.insert(std::find(layout.begin(), layout.end(), before), b);
+	return b;
+}
+
+void SSAProc::removeEdge(size_t to, size_t k){
+	SSABlock& blk = blocks[to];
+	size_t from = blk.preds[k];
+	blk.preds.erase(blk.preds.begin() + static_cast<std::ptrdiff_t>(k));
+	for (SSAPhi& phi : blk.phis){
+		phi.args.erase(phi.args.begin() + static_cast<std::ptrdiff_t>(k));
+	}
+	SSABlock& src = blocks[from];
+	src.succs.erase(std::find(src.succs.begin(), src.succs.end(), to));
+	if (src.succs.size() == 1 && isCondBranch(src.code.back())){
+		src.code.back() = jumpTo(src.succs[0]);
+	}
+}
+
+void SSAProc::removeUnreachable(){
+	std::vector<bool> seen(blocks.size(), false);
+	std::vector<size_t> work{0};
+	seen[0] = true;
+	while (!work.empty()){
+		size_t b = work.back();
+		work.pop_back();
+		for (size_t s : blocks[b].succs){
+			if (!seen[s]){
+				seen[s] = true;
+				work.push_back(s);
+			}
+		}
+	}
+	for (size_t b = 0; b < blocks.size(); b++){
+		if (seen[b] || blocks[b].dead){ continue; }
+		std::vector<size_t> succs = blocks[b].succs;
+		for (size_t s : succs){
+			if (seen[s]){ removeEdge(s, indexOf(blocks[s].preds, b)); }
+		}
+		blocks[b] = SSABlock();
+		blocks[b].dead = true;
+	}
+}
+
+void SSAProc::computeDominators(){
+	size_t n = blocks.size();
+	std::vector<size_t> post;
+	std::vector<bool> seen(n, false);
+	std::vector<std::pair<size_t, size_t>> stack;
+	stack.emplace_back(0, 0);
+	seen[0] = true;
+	while (!stack.empty()){
+		size_t b = stack.back().first;
+		size_t& next = stack.back().second;
+		if (next < blocks[b].succs.size()){
+			size_t s = blocks[b].succs[next++];
+			if (!seen[s]){
+				seen[s] = true;
+				stack.emplace_back(s, 0);
+			}
+		} else {
+			post.push_back(b);
+			stack.pop_back();
+		}
+	}
+	rpo.assign(post.rbegin(), post.rend());
+
+	std::vector<size_t> order(n, none);
+	for (size_t i = 0; i < rpo.size(); i++){ order[rpo[i]] = i; }
+	idom.assign(n, none);
+	idom[0] = 0;
+	bool changed = true;
+	while (changed){
+		changed = false;
+		for (size_t b : rpo){
+			if (b == 0){ continue; }
+			size_t best = none;
+			for (size_t p : blocks[b].preds){
+				if (idom[p] == none){ continue; }
+				if (best == none){
+					best = p;
+					continue;
+				}
+				size_t x = p;
+				while (x != best){
+					while (order[x] > order[best]){ x = idom[x]; }
+					while (order[best] > order[x]){ best = idom[best]; }
+				}
+			}
+			if (idom[b] != best){
+				idom[b] = best;
+				changed = true;
+			}
+		}
+	}
+	domChildren.assign(n, std::vector<size_t>());
+	for (size_t b : rpo){
+		if (b != 0){ domChildren[idom[b]].push_back(b); }
+	}
+}
+
+bool SSAProc::dominates(size_t a, size_t b) const{
+	while (b != a){
+		if (b == 0 || idom[b] == none){ return false; }
+		b = idom[b];
+	}
+	return true;
+}
+
+size_t SSAProc::size() const{
+	size_t total = 0;
+	for (const SSABlock& blk : blocks){
+		total += blk.phis.size() + blk.code.size();
+	}
+	return total;
+}
+
+void SSAProc::print(const IRProgram& prog, std::ostream& out) const{
+	for (size_t b : layout){
+		const SSABlock& blk = blocks[b];
+		if (blk.dead){ continue; }
+		out << "L" << b << ":";
+		if (!blk.preds.empty()){
+			out << "\t\t\t; from";
+			for (size_t p : blk.preds){ out << " L" << p; }
+		}
+		out << "\n";
+		for (const SSAPhi& phi : blk.phis){
+			out << "\tphi." << typeName(phi.type) << " t" << phi.dst;
+			for (size_t k = 0; k < phi.args.size(); k++){
+				out << (k == 0 ? " " : ", ") << "[";
+				if (phi.args[k].isImm()){
+					out << phi.args[k].val;
+				} else {
+					out << "t" << phi.args[k].val;
+				}
+				out << " L" << blk.preds[k] << "]";
+			}
+			out << "\n";
+		}
+		for (const Instr& instr : blk.code){
+			Instr shown = instr;
+			if (instr.op == IROp::JMP){
+				shown.a = Opd::label(blk.succs[0]);
+			} else if (isCondBranch(instr)){
+				shown.dst = Opd::label(blk.succs[0]);
+			}
+			printInstr(prog, shown, out);
+			if (isCondBranch(instr)){ out << " else L" << blk.succs[1]; }
+			out << "\n";
+		}
+	}
+}
+
+/* Fold a copy x = t into the definition of t, where t is used only
+   there and x is not touched in between: t = a + b; x = t becomes
+   x = a + b. Out of SSA, this turns a loop's i2 = i1 + 1; i1 = i2
+   back into i1 = i1 + 1 */
+static void coalesceCopies(IRProc& proc){
+	std::vector<size_t> uses(proc.numTemps, 0);
+	std::vector<size_t> defs(proc.numTemps, 0);
+	std::vector<size_t> used;
+	for (const Instr& instr : proc.code){
+		used.clear();
+		instr.uses(used);
+		for (size_t t : used){ uses[t]++; }
+		int64_t d = instr.def();
+		if (d >= 0){ defs[static_cast<size_t>(d)]++; }
+	}
+	std::vector<bool> drop(proc.code.size(), false);
+	for (size_t i = 0; i < proc.code.size(); i++){
+		const Instr& copy = proc.code[i];
+		if (copy.op != IROp::MOV || !copy.dst.isTemp() || !copy.a.isTemp()
+			|| copy.dst == copy.a || uses[copy.a.idx()] != 1
+			|| defs[copy.a.idx()] != 1){
+			continue;
+		}
+		for (size_t j = i; j-- > 0; ){
+			Instr& prev = proc.code[j];
+			if (drop[j]){ continue; }
+			if (prev.op == IROp::LABEL || isTerminator(prev)){ break; }
+			if (prev.def() == copy.a.val){
+				prev.dst = copy.dst;
+				drop[i] = true;
+				break;
+			}
+			if (prev.a == copy.dst || prev.b == copy.dst
+				|| prev.def() == copy.dst.val){
+				break;
+			}
+		}
+	}
+	std::vector<Instr> kept;
+	for (size_t i = 0; i < proc.code.size(); i++){
+		if (!drop[i]){ kept.push_back(proc.code[i]); }
+	}
+	proc.code.swap(kept);
+}
+
+void SSAProc::destroy(IRProc& proc){
+	size_t count = blocks.size();
+	for (size_t b = 0; b < count; b++){
+		if (blocks[b].dead || blocks[b].phis.empty()){ continue; }
+		for (size_t k = 0; k < blocks[b].preds.size(); k++){
+			size_t p = blocks[b].preds[k];
+			if (blocks[p].succs.size() < 2){ continue; }
+			size_t edge = newBlock(b);
+			blocks[edge].code.push_back(jumpTo(b));
+			blocks[edge].succs.push_back(b);
+			blocks[edge].preds.push_back(p);
+			*std::find(blocks[p].succs.begin(), blocks[p].succs.end(), b) = edge;
+			blocks[b].preds[k] = edge;
+		}
+	}
+
+	for (SSABlock& blk : blocks){
+		if (blk.dead || blk.phis.empty()){ continue; }
+		for (size_t k = 0; k < blk.preds.size(); k++){
+			std::vector<Instr> copies;
+			bool overlaps = false;
+			for (const SSAPhi& phi : blk.phis){
+				for (const SSAPhi& other : blk.phis){
+					if (other.args[k] == Opd::temp(phi.dst)){ overlaps = true; }
+				}
+			}
+			//When a phi reads another's result, go through fresh
+			// temps so every phi sees the values from before
+			std::vector<Opd> staged;
+			for (const SSAPhi& phi : blk.phis){
+				Opd src = phi.args[k];
+				if (overlaps){
+					Opd tmp = newTemp();
+					copies.push_back(Instr{IROp::MOV, phi.type, tmp, src, Opd()});
+					src = tmp;
+				}
+				staged.push_back(src);
+			}
+			for (size_t i = 0; i < blk.phis.size(); i++){
+				copies.push_back(Instr{IROp::MOV, blk.phis[i].type,
+					Opd::temp(blk.phis[i].dst), staged[i], Opd()});
+			}
+			std::vector<Instr>& pred = blocks[blk.preds[k]].code;
+			pred.insert(pred.end() - 1, copies.begin(), copies.end());
+		}
+		blk.phis.clear();
+	}
+
+	std::vector<size_t> order;
+	for (size_t b : layout){
+		if (!blocks[b].dead){ order.push_back(b); }
+	}
+	std::vector<bool> targeted(blocks.size(), false);
+	std::vector<std::vector<Instr>> tails(blocks.size());
+	for (size_t i = 0; i < order.size(); i++){
+		size_t b = order[i];
+		size_t next = i + 1 < order.size() ? order[i + 1] : none;
+		const SSABlock& blk = blocks[b];
+		Instr last = blk.code.back();
+		std::vector<Instr>& tail = tails[b];
+		if (last.op == IROp::JMP){
+			if (blk.succs[0] != next){
+				tail.push_back(jumpTo(blk.succs[0]));
+				targeted[blk.succs[0]] = true;
+			}
+		} else if (isCondBranch(last)){
+			size_t taken = blk.succs[0];
+			size_t fall = blk.succs[1];
+			if (taken == next){
+				last.op = negatedBranch(last.op);
+				std::swap(taken, fall);
+			}
+			last.dst = Opd::label(taken);
+			tail.push_back(last);
+			targeted[taken] = true;
+			if (fall != next){
+				tail.push_back(jumpTo(fall));
+				targeted[fall] = true;
+			}
+		} else {
+			tail.push_back(last);
+		}
+	}
+
+	proc.code.clear();
+	for (size_t b : order){
+		if (targeted[b]){
+			proc.code.push_back(Instr{IROp::LABEL, IRType::INT, Opd(),
+				Opd::label(b), Opd()});
+		}
+		const std::vector<Instr>& code = blocks[b].code;
+		proc.code.insert(proc.code.end(), code.begin(), code.end() - 1);
+		proc.code.insert(proc.code.end(), tails[b].begin(), tails[b].end());
+	}
+	proc.numTemps = numTemps;
+	proc.numLabels = blocks.size();
+	coalesceCopies(proc);
+}
+
+}
@@ -0,0 +1,89 @@
+#ifndef CMINUSMINUS_SSA_HPP
+#define CMINUSMINUS_SSA_HPP
+
+#include <ostream>
+#include <vector>
+#include "ir.hpp"
+
+/*
+SSA form of an IRProc, for optimization. The code is split into basic
+blocks, and every temp is renamed so that it has a single definition,
+with phi nodes where control flow merges. Stack slots and globals stay
+memory and are not renamed, so any instruction touching them keeps its
+place.
+
+A block's code ends with its terminator: JMP, a branch or RET. Its
+successors are in succs, which is what is believed; for a branch the
+first is taken and the second is not. Each phi has one argument per
+predecessor, in the order of preds.
+*/
+
+namespace cminusminus{
+
+struct SSAPhi{
+	IRType type;
+	size_t dst;
+	std::vector<Opd> args;
+};
+
+struct SSABlock{
+	std::vector<SSAPhi> phis;
+	std::vector<Instr> code;
+	std::vector<size_t> preds;
+	std::vector<size_t> succs;
+	bool dead = false;
+};
+
+class SSAProc{
+public:
+	/* Put proc into SSA form */
+	explicit SSAProc(const IRProc& proc);
+
+	/* Write the code back out of SSA form, over proc */
+	void destroy(IRProc& proc);
+
+	Opd newTemp(){ return Opd::temp(numTemps++); }
+	/* A new block, written out just before block before */
+	size_t newBlock(size_t before);
+
+	/* Forget the edge into block to from its k'th predecessor */
+	void removeEdge(size_t to, size_t k);
+	/* Drop blocks that cannot be reached from the entry */
+	void removeUnreachable();
+
+	/* Fill in idom, domChildren and rpo from the current edges */
+	void computeDominators();
+	bool dominates(size_t a, size_t b) const;
+
+	/* Instructions and phis, over every live block */
+	size_t size() const;
+
+	void print(const IRProgram& prog, std::ostream& out) const;
+
+	std::vector<SSABlock> blocks;
+	size_t numTemps = 0;
+	/* The live blocks in reverse postorder, and the dominator tree */
+	std::vector<size_t> rpo;
+	std::vector<size_t> idom;
+	std::vector<std::vector<size_t>> domChildren;
+
+private:
+	/* The order blocks are written out in */
+	std::vector<size_t> layout;
+
+	void split(const IRProc& proc);
+	void rename(std::vector<std::vector<size_t>>& phiVars);
+};
+
+/* Optimize every procedure of prog in place, through SSA: sparse
+   conditional constant propagation, global value numbering,
+   loop-invariant code motion and dead code elimination. With dump,
+   each procedure's SSA is written there after construction and after
+   each pass. With timing, a table of what each pass cost and how much
+   code it removed is written there at the end. */
+void optimizeIR(IRProgram * prog, std::ostream * dump = nullptr,
+	std::ostream * timing = nullptr);
+
+}
+
+#endif
@@ -0,0 +1,34 @@
+#include "descent.hpp"
+#include "intern.hpp"
+#include "scanner.hpp"
+#include "stream.hpp"
+
+namespace cminusminus{
+
+bool streamDecls(std::istream& in, Diagnostics * diags, bool descent,
+	const Budget * budget, std::function<void(DeclNode *)> each){
+	//No source buffer: the tokens copy their text, to be freed with them
+	Scanner scanner(&in, diags, nullptr);
+	scanner.setRecycling(true);
+	scanner.setBudget(budget);
+	NodeBudget nodes(budget);
+	//Shared nodes would outlive the declaration they were made for
+	ASTInterner interner(false);
+	DeclSink sink = [&](DeclNode * decl){
+		each(decl);
+		deleteTree(decl);
+		scanner.releaseTokens();
+	};
+	ProgramNode * root = nullptr;
+	int errCode;
+	if (descent){
+		errCode = parseDescent(scanner, &root, &interner, &sink);
+	} else {
+		Parser parser(scanner, &root, &interner, &sink);
+		errCode = parser.parse();
+	}
+	deleteTree(root);
+	return errCode == 0;
+}
+
+}
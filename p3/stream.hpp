@@ -0,0 +1,37 @@
+#ifndef CMINUSMINUS_STREAM_HPP
+#define CMINUSMINUS_STREAM_HPP
+
+#include <istream>
+#include "ast.hpp"
+#include "budget.hpp"
+#include "errors.hpp"
+
+/*
+Parsing a program one top-level declaration at a time, for inputs too
+big to hold as a whole AST. Each declaration goes to the caller as
+soon as the parser has it, and once the caller is done with it the
+declaration, and the tokens and text it was parsed from, are freed.
+So memory is bounded by the biggest declaration rather than the whole
+program, as long as the input is read as a stream rather than into
+one buffer.
+
+Nothing that needs the whole program can be done this way: there is
+no name or type analysis, as a use may come before (or without) its
+declaration. Declarations before a syntax error have already been
+handed out by the time it is found.
+*/
+
+namespace cminusminus{
+
+/* Parse in (with the hand-written parser if descent), calling each
+   on every top-level declaration in turn. The declaration is deleted
+   when each returns, so it must keep no pointer into it. Errors go
+   to diags, or are printed as they are found if it is null. The
+   parse is held to budget's limits if it is not null, counting every
+   declaration's nodes. Returns false on a syntax error */
+bool streamDecls(std::istream& in, Diagnostics * diags, bool descent,
+	const Budget * budget, std::function<void(DeclNode *)> each);
+
+}
+
+#endif
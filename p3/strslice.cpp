@@ -0,0 +1,29 @@
+#include "strslice.hpp"
+
+namespace cminusminus{
+
+std::string StrSlice::unescaped() const{
+	std::string result;
+	for (size_t i = 1; i + 1 < myLen; i++){
+		char ch = myData[i];
+		if (ch == '\\' && i + 2 < myLen){
+			ch = myData[++i];
+			if (ch == 'n'){ ch = '\n'; }
+			else if (ch == 't'){ ch = '\t'; }
+		}
+		result += ch;
+	}
+	return result;
+}
+
+/* FNV-1a */
+size_t StrSliceHash::operator()(const StrSlice& slice) const{
+	size_t h = 14695981039346656037ull;
+	for (size_t i = 0; i < slice.size(); i++){
+		h ^= static_cast<unsigned char>(slice.data()[i]);
+		h *= 1099511628211ull;
+	}
+	return h;
+}
+
+}
@@ -0,0 +1,48 @@
+#ifndef CMINUSMINUS_STRSLICE_HPP
+#define CMINUSMINUS_STRSLICE_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <ostream>
+#include <string>
+
+namespace cminusminus{
+
+/**
+* \class StrSlice
+* A string literal as it appears in a buffer owned elsewhere (the
+* source being compiled, or a loaded AST file), quotes and escapes
+* included. Nothing is copied until somebody asks for a string, so
+* the buffer has to outlive every slice of it.
+**/
+class StrSlice{
+public:
+	StrSlice() : myData(nullptr), myLen(0){ }
+	StrSlice(const char * data, size_t len) : myData(data), myLen(len){ }
+	const char * data() const { return myData; }
+	size_t size() const { return myLen; }
+	/* A copy of the literal as written */
+	std::string str() const { return std::string(myData, myLen); }
+	/* The characters the literal stands for: quotes removed and
+	   escapes applied */
+	std::string unescaped() const;
+	bool operator==(const StrSlice& other) const {
+		return myLen == other.myLen
+			&& std::equal(myData, myData + myLen, other.myData);
+	}
+private:
+	const char * myData;
+	size_t myLen;
+};
+
+struct StrSliceHash{
+	size_t operator()(const StrSlice& slice) const;
+};
+
+inline std::ostream& operator<<(std::ostream& out, const StrSlice& slice){
+	return out.write(slice.data(), static_cast<std::streamsize>(slice.size()));
+}
+
+}
+
+#endif
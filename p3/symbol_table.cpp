@@ -0,0 +1,120 @@
+#include <functional>
+#include <sstream>
+#include "symbol_table.hpp"
+#include "ast.hpp"
+#include "callgraph.hpp"
+
+namespace cminusminus{
+
+static std::string typeName(TypeNode * type){
+	std::ostringstream out;
+	type->unparse(out, 0);
+	return out.str();
+}
+
+std::string SemSymbol::typeStr() const{
+	if (myKind == VAR){
+		return typeName(static_cast<VarDeclNode *>(myDecl)->getTypeNode());
+	}
+	FnDeclNode * fn = static_cast<FnDeclNode *>(myDecl);
+	std::string result;
+	if (fn->getFormals() != nullptr){
+		std::string comma = "";
+		for (FormalDeclNode * formal : *fn->getFormals()){
+			result += comma + typeName(formal->getTypeNode());
+			comma = ",";
+		}
+	}
+	return result + "->" + typeName(fn->getRetTypeNode());
+}
+
+SymbolTable::SymbolTable(Diagnostics * diagsIn)
+: myDiags(diagsIn), myBuckets(64, Bucket{0, 0}), myGraph(nullptr),
+  myFunction(nullptr), myOk(true){
+	//The global scope
+	enterScope();
+}
+
+void SymbolTable::enterScope(){
+	myScopeMarks.push_back(myUndo.size());
+}
+
+void SymbolTable::leaveScope(){
+	size_t mark = myScopeMarks.back();
+	myScopeMarks.pop_back();
+	while (myUndo.size() > mark){
+		const Undo& undo = myUndo.back();
+		Entry& entry = myEntries[undo.entry];
+		entry.sym = undo.sym;
+		entry.depth = undo.depth;
+		myUndo.pop_back();
+	}
+}
+
+uint32_t SymbolTable::hashOf(const std::string& name){
+	size_t h = std::hash<std::string>()(name);
+	return static_cast<uint32_t>(h ^ (h >> 32));
+}
+
+int64_t SymbolTable::find(const std::string& name, uint32_t hash) const{
+	size_t mask = myBuckets.size() - 1;
+	for (size_t i = hash & mask; ; i = (i + 1) & mask){
+		const Bucket& bucket = myBuckets[i];
+		if (bucket.entry == 0){ return -1; }
+		if (bucket.hash == hash
+			&& myEntries[bucket.entry - 1].name == name){
+			return bucket.entry - 1;
+		}
+	}
+}
+
+void SymbolTable::place(uint32_t hash, uint32_t entry){
+	size_t mask = myBuckets.size() - 1;
+	size_t i = hash & mask;
+	while (myBuckets[i].entry != 0){ i = (i + 1) & mask; }
+	myBuckets[i] = Bucket{hash, entry + 1};
+}
+
+void SymbolTable::grow(){
+	std::vector<Bucket> old(myBuckets.size() * 2, Bucket{0, 0});
+	old.swap(myBuckets);
+	for (const Bucket& bucket : old){
+		if (bucket.entry != 0){ place(bucket.hash, bucket.entry - 1); }
+	}
+}
+
+SemSymbol * SymbolTable::lookup(const std::string& name) const{
+	int64_t idx = find(name, hashOf(name));
+	if (idx < 0){ return nullptr; }
+	return myEntries[static_cast<size_t>(idx)].sym;
+}
+
+bool SymbolTable::clash(const std::string& name) const{
+	int64_t idx = find(name, hashOf(name));
+	if (idx < 0){ return false; }
+	const Entry& entry = myEntries[static_cast<size_t>(idx)];
+	return entry.sym != nullptr && entry.depth == depth();
+}
+
+void SymbolTable::insert(SemSymbol * sym){
+	uint32_t hash = hashOf(sym->name());
+	int64_t idx = find(sym->name(), hash);
+	if (idx < 0){
+		//Keep the buckets at most half full
+		if ((myEntries.size() + 1) * 2 > myBuckets.size()){ grow(); }
+		idx = static_cast<int64_t>(myEntries.size());
+		myEntries.push_back(Entry{sym->name(), nullptr, 0});
+		place(hash, static_cast<uint32_t>(idx));
+	}
+	Entry& entry = myEntries[static_cast<size_t>(idx)];
+	myUndo.push_back(Undo{static_cast<uint32_t>(idx), entry.sym, entry.depth});
+	entry.sym = sym;
+	entry.depth = depth();
+	if (myGraph != nullptr){ myGraph->addDecl(sym); }
+}
+
+void SymbolTable::noteUse(IDNode * use){
+	if (myGraph != nullptr){ myGraph->addUse(myFunction, use); }
+}
+
+}
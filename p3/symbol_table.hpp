@@ -0,0 +1,131 @@
+#ifndef CMINUSMINUS_SYMBOL_TABLE_HPP
+#define CMINUSMINUS_SYMBOL_TABLE_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "errors.hpp"
+#include "workstack.hpp"
+
+namespace cminusminus{
+
+class ASTNode;
+class DeclNode;
+class CallGraph;
+class IDNode;
+
+/**
+* \class SemSymbol
+* What a name means: the declaration that introduced it. Name
+* analysis attaches one to every IDNode.
+**/
+class SemSymbol{
+public:
+	enum Kind { VAR, FN };
+	SemSymbol(Kind kindIn, std::string nameIn, DeclNode * declIn)
+	: myKind(kindIn), myName(nameIn), myDecl(declIn){ }
+	Kind kind() const { return myKind; }
+	const std::string& name() const { return myName; }
+	/* The VarDeclNode (or FormalDeclNode) or FnDeclNode */
+	DeclNode * decl() const { return myDecl; }
+	/* The declared type, as in "int", "ptr short" or, for a
+	   function, "int,bool->void" */
+	std::string typeStr() const;
+private:
+	Kind myKind;
+	std::string myName;
+	DeclNode * myDecl;
+};
+
+/**
+* \class SymbolTable
+* Maps each name to its innermost declaration while the tree is
+* walked in scope order. Every distinct name gets one flat entry,
+* found through an open-addressing (linear probing) hash of entry
+* indices. Declaring a name overwrites its entry and pushes an undo
+* record; leaving a scope replays the undo records back to the
+* scope's mark, which restores whatever the names meant outside it.
+* Lookup is a single probe sequence, however deep the nesting.
+**/
+class SymbolTable{
+public:
+	/* Errors are recorded in diagsIn rather than written to
+	   stderr when it is non-null */
+	SymbolTable(Diagnostics * diagsIn);
+
+	void enterScope();
+	void leaveScope();
+	size_t depth() const { return myScopeMarks.size(); }
+
+	/* The innermost declaration of name, or nullptr */
+	SemSymbol * lookup(const std::string& name) const;
+	/* True if name is already declared in the current scope */
+	bool clash(const std::string& name) const;
+	/* Declare sym in the current scope, shadowing outer ones */
+	void insert(SemSymbol * sym);
+
+	/* Analyze the names in the tree under root (name_analysis.cpp).
+	   Returns false if any was bad */
+	bool analyze(ASTNode * root);
+	/* Queue the analysis of node's subtree, to follow that of the
+	   node being analyzed */
+	void visit(ASTNode * node);
+	/* Queue step, to run in turn with the subtrees queued */
+	void then(WorkStack::Step step){ myWork.then(std::move(step)); }
+
+	/* Record in graph each name used in a function body, as a use
+	   by that function (see callgraph.hpp). Off unless set */
+	void setCallGraph(CallGraph * graph){ myGraph = graph; }
+	/* The function whose body is being analyzed, or nullptr */
+	void setFunction(SemSymbol * fn){ myFunction = fn; }
+	/* use was just resolved */
+	void noteUse(IDNode * use);
+
+	void errUndeclared(Position * pos){
+		Report::fatal(myDiags, pos, "Undeclared identifier");
+	}
+	void errMultiDecl(Position * pos){
+		Report::fatal(myDiags, pos, "Multiply declared identifier");
+	}
+	void errBadVarType(Position * pos){
+		Report::fatal(myDiags, pos, "Invalid type in declaration");
+	}
+
+private:
+	struct Entry{
+		std::string name;
+		SemSymbol * sym;
+		size_t depth;
+	};
+	struct Bucket{
+		uint32_t hash;
+		/* Index into myEntries plus one; zero marks an empty bucket */
+		uint32_t entry;
+	};
+	struct Undo{
+		uint32_t entry;
+		SemSymbol * sym;
+		size_t depth;
+	};
+
+	static uint32_t hashOf(const std::string& name);
+	/* The index of name's entry, or -1 if it has none */
+	int64_t find(const std::string& name, uint32_t hash) const;
+	void place(uint32_t hash, uint32_t entry);
+	void grow();
+
+	Diagnostics * myDiags;
+	std::vector<Entry> myEntries;
+	std::vector<Bucket> myBuckets;
+	std::vector<Undo> myUndo;
+	std::vector<size_t> myScopeMarks;
+	CallGraph * myGraph;
+	SemSymbol * myFunction;
+	WorkStack myWork;
+	/* Whether the names analyzed so far were all good */
+	bool myOk;
+};
+
+}
+
+#endif
@@ -66,6 +66,14 @@ std::string Token::toString(){
 	+ " " + myPos->begin();
 }
 
+size_t Token::line() const {
+	return myPos->line();
+}
+
+size_t Token::col() const {
+	return myPos->col();
+}
+
 int Token::kind() const { 
 	return this->myKind; 
 }
@@ -74,6 +82,12 @@ Position * Token::pos() const {
 	return myPos;
 }
 
+Position * Token::takePos(){
+	Position * pos = myPos;
+	myPos = nullptr;
+	return pos;
+}
+
 IDToken::IDToken(Position * posIn, std::string vIn)
   : Token(posIn, TokenKind::ID), myValue(vIn){ 
 }
@@ -87,16 +101,16 @@ const std::string IDToken::value() const {
 	return this->myValue; 
 }
 
-StrToken::StrToken(Position * posIn, std::string sIn)
+StrToken::StrToken(Position * posIn, StrSlice sIn)
   : Token(posIn, TokenKind::STRLITERAL), myStr(sIn){
 }
 
 std::string StrToken::toString(){
 	return tokenKindString(kind()) + ":"
-	+ this->myStr + " " + myPos->begin();
+	+ this->myStr.str() + " " + myPos->begin();
 }
 
-const std::string StrToken::str() const {
+const StrSlice& StrToken::str() const {
 	return this->myStr;
 }
 
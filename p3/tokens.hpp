@@ -3,17 +3,22 @@
 
 #include <string>
 #include "position.hpp"
+#include "strslice.hpp"
 
 namespace cminusminus{
 
 class Token{
 public:
 	Token(Position * pos, int kindIn);
+	virtual ~Token(){ }
+	CMM_PROFILED_CLASS(Token)
 	virtual std::string toString();
 	size_t line() const;
 	size_t col() const;
 	int kind() const;
 	Position * pos() const;
+	/* Hand pos() over to the caller, who then owns it */
+	Position * takePos();
 protected:
 	Position * myPos;
 private:
@@ -32,11 +37,12 @@ private:
 
 class StrToken : public Token{
 public:
-	StrToken(Position * posIn, std::string valIn);
+	StrToken(Position * posIn, StrSlice valIn);
 	virtual std::string toString() override;
-	const std::string str() const;
+	/* The literal as written, still in the source buffer */
+	const StrSlice& str() const;
 private:
-	const std::string myStr;
+	const StrSlice myStr;
 };
 
 class IntLitToken : public Token{
@@ -57,6 +63,17 @@ private:
 	const int myNum;
 };
 
+/* Plain-data copy of a token, safe to hand out of the compiler.
+   text is the token's line in the -t dump, value its payload (the
+   identifier name, string literal or number) if it has one. */
+struct TokenInfo{
+	int kind;
+	size_t line;
+	size_t col;
+	std::string value;
+	std::string text;
+};
+
 }
 
 #endif
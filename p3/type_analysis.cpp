@@ -0,0 +1,566 @@
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "intern.hpp"
+#include "type_analysis.hpp"
+#include "symbol_table.hpp"
+
+namespace cminusminus{
+
+/*
+Each check records its node's type in the TypeAnalysis. An operand
+of type ERROR had its error reported already, so checks over it
+report nothing more and yield ERROR themselves. Operands are checked
+through TypeAnalysis::check, which says where that use of the operand
+is, for errors about it. Errors come out in the order a recursive
+walk would give them: a node's own come after its operands', and a
+statement's about its condition before any in its body. An lval is at
+most an id under a @, so it is checked on the spot.
+*/
+
+TypeAnalysis * TypeAnalysis::build(ProgramNode * ast, Diagnostics * diags,
+	unsigned int threads, const ASTInterner * interner){
+	std::vector<FnDeclNode *> fns;
+	for (DeclNode * global : *ast->getGlobals()){
+		if (FnDeclNode * fn = dynamic_cast<FnDeclNode *>(global)){
+			fns.push_back(fn);
+		}
+	}
+
+	std::vector<std::unique_ptr<TypeAnalysis>> parts(fns.size());
+	if (threads == 0){ threads = std::thread::hardware_concurrency(); }
+	threads = std::max(1u, std::min(threads,
+		static_cast<unsigned int>(fns.size())));
+	std::atomic<size_t> next(0);
+	auto work = [&fns, &parts, &next, interner](){
+		size_t i;
+		while ((i = next++) < fns.size()){
+			parts[i].reset(checkFn(fns[i], interner));
+		}
+	};
+	if (threads == 1){
+		work();
+	} else {
+		std::vector<std::thread> workers;
+		for (unsigned int t = 0; t < threads; t++){
+			workers.emplace_back(work);
+		}
+		for (std::thread& worker : workers){ worker.join(); }
+	}
+
+	TypeAnalysis * result = new TypeAnalysis(DataType(), nullptr,
+		*ast->pos());
+	for (size_t i = 0; i < fns.size(); i++){
+		for (const Diagnostic& d : parts[i]->myErrors.all()){
+			result->myErrors.add(d);
+			Position pos = d.pos();
+			Report::fatal(diags, &pos, d.msg());
+		}
+		result->myFns[fns[i]] = std::move(parts[i]);
+	}
+	return result;
+}
+
+TypeAnalysis * TypeAnalysis::checkFn(FnDeclNode * fn,
+	const ASTInterner * interner){
+	TypeAnalysis * ta = new TypeAnalysis(fn->getRetTypeNode()->getType(),
+		interner, *fn->pos());
+	ta->myWork.run([fn, ta](){ fn->typeAnalysis(ta); });
+	return ta;
+}
+
+/* Does position a start before b does? */
+static bool startsBefore(const Position& a, const Position& b){
+	return a.line() < b.line() || (a.line() == b.line() && a.col() < b.col());
+}
+
+void TypeAnalysis::check(ASTNode * node){
+	myWork.then([this, node](){
+		if (myInterner == nullptr || !myInterner->isShared(node)){
+			myChecked.push_back(node->pos());
+			node->typeAnalysis(this);
+			return;
+		}
+		//The walk meets the uses in source order, starting from this
+		//function's first. None of them is under this one
+		const std::vector<Position>& uses = myInterner->uses(node);
+		auto found = myUses.find(node);
+		size_t use;
+		if (found == myUses.end()){
+			use = static_cast<size_t>(std::lower_bound(uses.begin(),
+				uses.end(), myStart, startsBefore) - uses.begin());
+		} else {
+			use = found->second + 1;
+		}
+		myUses[node] = use;
+		myChecked.push_back(usePos(node));
+		node->typeAnalysis(this);
+	});
+}
+
+const Position * TypeAnalysis::checked(){
+	const Position * pos = myChecked.back();
+	myChecked.pop_back();
+	return pos;
+}
+
+const Position * TypeAnalysis::usePos(ASTNode * node) const{
+	if (myInterner == nullptr){ return node->pos(); }
+	auto found = myUses.find(node);
+	if (found == myUses.end()){ return node->pos(); }
+	const std::vector<Position>& uses = myInterner->uses(node);
+	if (found->second >= uses.size()){ return node->pos(); }
+	return &uses[found->second];
+}
+
+DataType IntTypeNode::getType(){ return DataType(DataType::INT); }
+DataType BoolTypeNode::getType(){ return DataType(DataType::BOOL); }
+DataType VoidTypeNode::getType(){ return DataType(DataType::VOID); }
+DataType StringTypeNode::getType(){ return DataType(DataType::STRING); }
+DataType ShortTypeNode::getType(){ return DataType(DataType::SHORT); }
+DataType PtrTypeNode::getType(){
+	//A loaded AST file may nest pointer types as deep as it likes
+	size_t ptrs = 1;
+	TypeNode * base = myBase;
+	while (PtrTypeNode * ptr = dynamic_cast<PtrTypeNode *>(base)){
+		ptrs++;
+		base = ptr->myBase;
+	}
+	DataType type = base->getType();
+	for (size_t i = 0; i < ptrs; i++){ type = DataType::ptrTo(type); }
+	return type;
+}
+
+/* Can a value of type from be stored where a to is expected? A short
+   widens to an int; otherwise the types must match */
+static bool assignable(DataType to, DataType from){
+	if (to == from){ return !to.isFn() && !to.isVoid(); }
+	return to == DataType(DataType::INT) && from == DataType(DataType::SHORT);
+}
+
+static void checkBody(std::list<StmtNode *> * body, TypeAnalysis * ta){
+	if (body == nullptr){ return; }
+	for (StmtNode * stmt : *body){ ta->visit(stmt); }
+}
+
+void FnDeclNode::typeAnalysis(TypeAnalysis * ta){
+	checkBody(functionBody, ta);
+}
+
+void IDNode::typeAnalysis(TypeAnalysis * ta){
+	SemSymbol * sym = getSymbol();
+	if (sym == nullptr){
+		ta->nodeType(this, DataType());
+	} else if (sym->kind() == SemSymbol::FN){
+		ta->nodeType(this, DataType(DataType::FN));
+	} else {
+		VarDeclNode * decl = static_cast<VarDeclNode *>(sym->decl());
+		ta->nodeType(this, decl->getTypeNode()->getType());
+	}
+}
+
+void DerefNode::typeAnalysis(TypeAnalysis * ta){
+	myId->typeAnalysis(ta);
+	DataType ptr = ta->nodeType(myId);
+	if (ptr.isError()){
+		ta->nodeType(this, ptr);
+	} else if (!ptr.isPtr()){
+		ta->err(myId->pos(), "Invalid operand for dereference");
+		ta->nodeType(this, DataType());
+	} else {
+		ta->nodeType(this, ptr.deref());
+	}
+}
+
+void IndexNode::typeAnalysis(TypeAnalysis * ta){
+	//There are no record types to index into
+	ta->err(myPos, "Invalid operand for index");
+	ta->nodeType(this, DataType());
+}
+
+void TrueNode::typeAnalysis(TypeAnalysis * ta){
+	ta->nodeType(this, DataType(DataType::BOOL));
+}
+
+void FalseNode::typeAnalysis(TypeAnalysis * ta){
+	ta->nodeType(this, DataType(DataType::BOOL));
+}
+
+void StrLitNode::typeAnalysis(TypeAnalysis * ta){
+	ta->nodeType(this, DataType(DataType::STRING));
+}
+
+void IntLitNode::typeAnalysis(TypeAnalysis * ta){
+	ta->nodeType(this, DataType(DataType::INT));
+}
+
+void ShortLitNode::typeAnalysis(TypeAnalysis * ta){
+	ta->nodeType(this, DataType(DataType::SHORT));
+}
+
+void NegNode::typeAnalysis(TypeAnalysis * ta){
+	ta->check(expression);
+	ta->then([this, ta](){
+		const Position * pos = ta->checked();
+		DataType t = ta->nodeType(expression);
+		if (t.isError() || t.isNumeric()){
+			ta->nodeType(this, t);
+			return;
+		}
+		ta->err(pos,
+			"Arithmetic operator applied to invalid operand");
+		ta->nodeType(this, DataType());
+	});
+}
+
+void NotNode::typeAnalysis(TypeAnalysis * ta){
+	ta->check(expression);
+	ta->then([this, ta](){
+		const Position * pos = ta->checked();
+		DataType t = ta->nodeType(expression);
+		if (t.isError() || t.isBool()){
+			ta->nodeType(this, t);
+			return;
+		}
+		ta->err(pos,
+			"Logical operator applied to non-bool operand");
+		ta->nodeType(this, DataType());
+	});
+}
+
+void RefNode::typeAnalysis(TypeAnalysis * ta){
+	ta->check(expression);
+	ta->then([this, ta](){
+		const Position * pos = ta->checked();
+		DataType t = ta->nodeType(expression);
+		if (t.isError()){
+			ta->nodeType(this, t);
+		} else if (t.isFn()){
+			ta->err(pos, "Invalid operand for ref");
+			ta->nodeType(this, DataType());
+		} else {
+			ta->nodeType(this, DataType::ptrTo(t));
+		}
+	});
+}
+
+static bool numeric(DataType t){ return t.isNumeric(); }
+static bool boolean(DataType t){ return t.isBool(); }
+static bool comparable(DataType t){ return !t.isVoid() && !t.isFn(); }
+
+/* Once both operands of a binary operator are checked, report each
+   one that is not good. Returns whether both are usable */
+static bool operandsOk(TypeAnalysis * ta, ExpNode * lhs, ExpNode * rhs,
+	bool (*good)(DataType), const char * msg){
+	const Position * rhsPos = ta->checked();
+	const Position * lhsPos = ta->checked();
+	DataType l = ta->nodeType(lhs);
+	DataType r = ta->nodeType(rhs);
+	bool ok = !l.isError() && !r.isError();
+	if (!l.isError() && !good(l)){
+		ta->err(lhsPos, msg);
+		ok = false;
+	}
+	if (!r.isError() && !good(r)){
+		ta->err(rhsPos, msg);
+		ok = false;
+	}
+	return ok;
+}
+
+static void arithmetic(TypeAnalysis * ta, ExpNode * node,
+	ExpNode * lhs, ExpNode * rhs){
+	if (!operandsOk(ta, lhs, rhs, numeric,
+		"Arithmetic operator applied to invalid operand")){
+		ta->nodeType(node, DataType());
+		return;
+	}
+	//Two shorts make a short; anything else widens to int
+	DataType l = ta->nodeType(lhs);
+	DataType r = ta->nodeType(rhs);
+	DataType shortT(DataType::SHORT);
+	if (l == shortT && r == shortT){
+		ta->nodeType(node, shortT);
+	} else {
+		ta->nodeType(node, DataType(DataType::INT));
+	}
+}
+
+static void logical(TypeAnalysis * ta, ExpNode * node,
+	ExpNode * lhs, ExpNode * rhs){
+	if (!operandsOk(ta, lhs, rhs, boolean,
+		"Logical operator applied to non-bool operand")){
+		ta->nodeType(node, DataType());
+		return;
+	}
+	ta->nodeType(node, DataType(DataType::BOOL));
+}
+
+static void relational(TypeAnalysis * ta, ExpNode * node,
+	ExpNode * lhs, ExpNode * rhs){
+	if (!operandsOk(ta, lhs, rhs, numeric,
+		"Relational operator applied to non-numeric operand")){
+		ta->nodeType(node, DataType());
+		return;
+	}
+	ta->nodeType(node, DataType(DataType::BOOL));
+}
+
+static void equality(TypeAnalysis * ta, ExpNode * node,
+	ExpNode * lhs, ExpNode * rhs){
+	if (!operandsOk(ta, lhs, rhs, comparable,
+		"Invalid equality operand")){
+		ta->nodeType(node, DataType());
+		return;
+	}
+	DataType l = ta->nodeType(lhs);
+	DataType r = ta->nodeType(rhs);
+	if (l != r && !(l.isNumeric() && r.isNumeric())){
+		ta->err(ta->usePos(node), "Invalid equality operation");
+		ta->nodeType(node, DataType());
+		return;
+	}
+	ta->nodeType(node, DataType(DataType::BOOL));
+}
+
+/* Queue checks of a binary operator's operands, left first */
+static void checkOperands(TypeAnalysis * ta, ExpNode * lhs, ExpNode * rhs){
+	ta->check(lhs);
+	ta->check(rhs);
+}
+
+void PlusNode::typeAnalysis(TypeAnalysis * ta){
+	checkOperands(ta, leftNode, rightNode);
+	ta->then([this, ta](){ arithmetic(ta, this, leftNode, rightNode); });
+}
+
+void MinusNode::typeAnalysis(TypeAnalysis * ta){
+	checkOperands(ta, leftNode, rightNode);
+	ta->then([this, ta](){ arithmetic(ta, this, leftNode, rightNode); });
+}
+
+void TimesNode::typeAnalysis(TypeAnalysis * ta){
+	checkOperands(ta, leftNode, rightNode);
+	ta->then([this, ta](){ arithmetic(ta, this, leftNode, rightNode); });
+}
+
+void DivideNode::typeAnalysis(TypeAnalysis * ta){
+	checkOperands(ta, leftNode, rightNode);
+	ta->then([this, ta](){ arithmetic(ta, this, leftNode, rightNode); });
+}
+
+void AndNode::typeAnalysis(TypeAnalysis * ta){
+	checkOperands(ta, leftNode, rightNode);
+	ta->then([this, ta](){ logical(ta, this, leftNode, rightNode); });
+}
+
+void OrNode::typeAnalysis(TypeAnalysis * ta){
+	checkOperands(ta, leftNode, rightNode);
+	ta->then([this, ta](){ logical(ta, this, leftNode, rightNode); });
+}
+
+void LessNode::typeAnalysis(TypeAnalysis * ta){
+	checkOperands(ta, leftNode, rightNode);
+	ta->then([this, ta](){ relational(ta, this, leftNode, rightNode); });
+}
+
+void LessEqNode::typeAnalysis(TypeAnalysis * ta){
+	checkOperands(ta, leftNode, rightNode);
+	ta->then([this, ta](){ relational(ta, this, leftNode, rightNode); });
+}
+
+void GreaterNode::typeAnalysis(TypeAnalysis * ta){
+	checkOperands(ta, leftNode, rightNode);
+	ta->then([this, ta](){ relational(ta, this, leftNode, rightNode); });
+}
+
+void GreaterEqNode::typeAnalysis(TypeAnalysis * ta){
+	checkOperands(ta, leftNode, rightNode);
+	ta->then([this, ta](){ relational(ta, this, leftNode, rightNode); });
+}
+
+void EqualsNode::typeAnalysis(TypeAnalysis * ta){
+	checkOperands(ta, leftNode, rightNode);
+	ta->then([this, ta](){ equality(ta, this, leftNode, rightNode); });
+}
+
+void NotEqualsNode::typeAnalysis(TypeAnalysis * ta){
+	checkOperands(ta, leftNode, rightNode);
+	ta->then([this, ta](){ equality(ta, this, leftNode, rightNode); });
+}
+
+void AssignExpNode::typeAnalysis(TypeAnalysis * ta){
+	variable->typeAnalysis(ta);
+	ta->check(expression);
+	ta->then([this, ta](){
+		const Position * pos = ta->checked();
+		DataType l = ta->nodeType(variable);
+		DataType r = ta->nodeType(expression);
+		bool ok = !l.isError() && !r.isError();
+		if (l.isFn()){
+			ta->err(variable->pos(), "Invalid assignment operand");
+			ok = false;
+		}
+		if (r.isFn() || r.isVoid()){
+			ta->err(pos, "Invalid assignment operand");
+			ok = false;
+		}
+		if (ok && !assignable(l, r)){
+			ta->err(myPos, "Invalid assignment operation");
+			ok = false;
+		}
+		ta->nodeType(this, ok ? l : DataType());
+	});
+}
+
+void CallExpNode::typeAnalysis(TypeAnalysis * ta){
+	nameFunc->typeAnalysis(ta);
+	if (arguments != nullptr){
+		for (ExpNode * arg : *arguments){ ta->check(arg); }
+	}
+	ta->then([this, ta](){
+		size_t numActuals = arguments == nullptr ? 0 : arguments->size();
+		std::vector<const Position *> argPos(numActuals);
+		for (size_t i = numActuals; i > 0; i--){
+			argPos[i - 1] = ta->checked();
+		}
+		SemSymbol * sym = nameFunc->getSymbol();
+		if (sym == nullptr){
+			ta->nodeType(this, DataType());
+			return;
+		}
+		if (sym->kind() != SemSymbol::FN){
+			ta->err(nameFunc->pos(), "Attempt to call a non-function");
+			ta->nodeType(this, DataType());
+			return;
+		}
+		FnDeclNode * fn = static_cast<FnDeclNode *>(sym->decl());
+		DataType ret = fn->getRetTypeNode()->getType();
+		std::list<FormalDeclNode *> * formals = fn->getFormals();
+		size_t numFormals = formals == nullptr ? 0 : formals->size();
+		if (numFormals != numActuals){
+			ta->err(nameFunc->pos(), "Function call with wrong number of args");
+			ta->nodeType(this, ret);
+			return;
+		}
+		if (arguments != nullptr){
+			auto formal = formals->begin();
+			size_t i = 0;
+			for (ExpNode * arg : *arguments){
+				DataType actualT = ta->nodeType(arg);
+				DataType formalT = (*formal)->getTypeNode()->getType();
+				if (!actualT.isError() && !assignable(formalT, actualT)){
+					ta->err(argPos[i],
+						"Type of actual does not match type of formal");
+				}
+				++formal;
+				++i;
+			}
+		}
+		ta->nodeType(this, ret);
+	});
+}
+
+void AssignStmtNode::typeAnalysis(TypeAnalysis * ta){
+	assignment->typeAnalysis(ta);
+}
+
+void CallStmtNode::typeAnalysis(TypeAnalysis * ta){
+	Function->typeAnalysis(ta);
+}
+
+static void incDec(TypeAnalysis * ta, LValNode * variable){
+	variable->typeAnalysis(ta);
+	DataType t = ta->nodeType(variable);
+	if (!t.isError() && !t.isNumeric()){
+		ta->err(variable->pos(),
+			"Arithmetic operator applied to invalid operand");
+	}
+}
+
+void PostDecStmtNode::typeAnalysis(TypeAnalysis * ta){
+	incDec(ta, variable);
+}
+
+void PostIncStmtNode::typeAnalysis(TypeAnalysis * ta){
+	incDec(ta, variable);
+}
+
+void ReadStmtNode::typeAnalysis(TypeAnalysis * ta){
+	variable->typeAnalysis(ta);
+	DataType t = ta->nodeType(variable);
+	if (t.isFn()){
+		ta->err(variable->pos(), "Attempt to read a function");
+	} else if (t.isPtr()){
+		ta->err(variable->pos(), "Attempt to read a raw pointer");
+	}
+}
+
+void WriteStmtNode::typeAnalysis(TypeAnalysis * ta){
+	ta->check(expression);
+	ta->then([this, ta](){
+		const Position * pos = ta->checked();
+		DataType t = ta->nodeType(expression);
+		if (t.isFn()){
+			ta->err(pos, "Attempt to output a function");
+		} else if (t.isVoid()){
+			ta->err(pos, "Attempt to output void");
+		} else if (t.isPtr()){
+			ta->err(pos, "Attempt to output a raw pointer");
+		}
+	});
+}
+
+void ReturnStmtNode::typeAnalysis(TypeAnalysis * ta){
+	DataType want = ta->currentFnReturn();
+	if (expression == nullptr){
+		if (!want.isVoid()){
+			ta->err(myPos, "Missing return value");
+		}
+		return;
+	}
+	ta->check(expression);
+	ta->then([this, ta, want](){
+		const Position * pos = ta->checked();
+		DataType got = ta->nodeType(expression);
+		if (want.isVoid()){
+			ta->err(pos, "Extra return value");
+		} else if (!got.isError() && !assignable(want, got)){
+			ta->err(pos, "Bad return value");
+		}
+	});
+}
+
+static void checkCondition(TypeAnalysis * ta, ExpNode * cond, const char * msg){
+	ta->check(cond);
+	ta->then([ta, cond, msg](){
+		const Position * pos = ta->checked();
+		DataType t = ta->nodeType(cond);
+		if (!t.isError() && !t.isBool()){
+			ta->err(pos, msg);
+		}
+	});
+}
+
+void WhileStmtNode::typeAnalysis(TypeAnalysis * ta){
+	checkCondition(ta, condition,
+		"Non-bool expression used as a loop guard");
+	checkBody(WhileBody, ta);
+}
+
+void IfStmtNode::typeAnalysis(TypeAnalysis * ta){
+	checkCondition(ta, condition,
+		"Non-bool expression used as an if condition");
+	checkBody(IfBody, ta);
+}
+
+void IfElseStmtNode::typeAnalysis(TypeAnalysis * ta){
+	checkCondition(ta, condition,
+		"Non-bool expression used as an if condition");
+	checkBody(IfTrueBody, ta);
+	checkBody(IfFalseBody, ta);
+}
+
+}
@@ -0,0 +1,115 @@
+#ifndef CMINUSMINUS_TYPE_ANALYSIS_HPP
+#define CMINUSMINUS_TYPE_ANALYSIS_HPP
+
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include "ast.hpp"
+#include "errors.hpp"
+#include "types.hpp"
+#include "workstack.hpp"
+
+namespace cminusminus{
+
+class ASTInterner;
+
+/**
+* \class TypeAnalysis
+* Type checking, run after name analysis. Once the global signatures
+* are known (they are written in the FnDeclNodes), each function body
+* can be checked on its own, so bodies are checked in parallel. Each
+* function is checked into its own TypeAnalysis, holding the types of
+* its expressions and its errors. The program's TypeAnalysis keeps
+* those per function, and reports their errors in source order, so
+* the output does not depend on scheduling.
+*
+* A tree built sharing nodes (see ASTInterner) has one node for
+* every use of, say, the literal true. Given the interner, errors
+* about such a node are at the use being checked, as they would be
+* in a tree that shared nothing.
+*
+* The walk keeps its own stack (see workstack.hpp). A node's
+* typeAnalysis queues checks of its operands and a step to finish
+* it once they are done, which takes where each operand's use was
+* from checked(), last operand first.
+**/
+class TypeAnalysis{
+public:
+	/* Check ast, which must have passed name analysis, on up to
+	   threads workers (0 means one per core). Errors go to diags,
+	   or to stderr when it is null. interner is the one ast was
+	   built through, if it shares nodes */
+	static TypeAnalysis * build(ProgramNode * ast, Diagnostics * diags,
+		unsigned int threads = 0, const ASTInterner * interner = nullptr);
+
+	bool passed() const { return myErrors.empty(); }
+
+	/* The analysis of one function's body, or nullptr if fn is not
+	   part of the checked program */
+	const TypeAnalysis * fnTypes(const FnDeclNode * fn) const {
+		auto found = myFns.find(fn);
+		if (found == myFns.end()){ return nullptr; }
+		return found->second.get();
+	}
+
+	/* The type of an expression in this function, ERROR if it has
+	   none */
+	DataType nodeType(const ASTNode * node) const {
+		auto found = myTypes.find(node);
+		if (found == myTypes.end()){ return DataType(); }
+		return found->second;
+	}
+	void nodeType(const ASTNode * node, DataType type){
+		myTypes[node] = type;
+	}
+
+	/* The return type of the function being checked */
+	DataType currentFnReturn() const { return myReturn; }
+
+	void err(const Position * pos, const std::string& msg){
+		myErrors.add(Diagnostic(Diagnostic::FATAL, *pos, msg));
+	}
+
+	/* Queue a check of node. Once it is done, checked() gives where
+	   this use of it is: its pos(), but for a shared node, the
+	   position of the use */
+	void check(ASTNode * node);
+	/* Where the operand whose check finished last was used, which is
+	   then forgotten */
+	const Position * checked();
+	/* Queue a check of a statement, which has no use to place */
+	void visit(StmtNode * stmt){
+		myWork.then([this, stmt](){ stmt->typeAnalysis(this); });
+	}
+	/* Queue step, to run once everything queued before it is done */
+	void then(WorkStack::Step step){ myWork.then(std::move(step)); }
+	/* Where the use of node being checked, or checked last, is */
+	const Position * usePos(ASTNode * node) const;
+
+private:
+	TypeAnalysis(DataType returnIn, const ASTInterner * internerIn,
+		const Position& startIn)
+	: myReturn(returnIn), myInterner(internerIn), myStart(startIn){ }
+	/* Check one function into its own analysis */
+	static TypeAnalysis * checkFn(FnDeclNode * fn,
+		const ASTInterner * interner);
+
+	DataType myReturn;
+	const ASTInterner * myInterner;
+	/* Where the function starts: uses of shared nodes before it
+	   are not its own */
+	Position myStart;
+	/* For each shared node, which of its uses is being checked */
+	std::unordered_map<const ASTNode *, size_t> myUses;
+	std::unordered_map<const ASTNode *, DataType> myTypes;
+	WorkStack myWork;
+	/* Where each operand checked and not yet finished with was used */
+	std::vector<const Position *> myChecked;
+	std::unordered_map<const FnDeclNode *,
+		std::unique_ptr<TypeAnalysis>> myFns;
+	Diagnostics myErrors;
+};
+
+}
+
+#endif
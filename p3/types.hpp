@@ -0,0 +1,74 @@
+#ifndef CMINUSMINUS_TYPES_HPP
+#define CMINUSMINUS_TYPES_HPP
+
+#include <string>
+
+namespace cminusminus{
+
+/**
+* \class DataType
+* The type of a value. Pointer types are the base type plus the
+* number of ptr levels over it. DataTypes are plain values, so they
+* can be compared and copied freely, including across threads.
+* ERROR is the type of anything whose type is already known to be
+* wrong; it lets checks skip errors that were reported further in.
+**/
+class DataType{
+public:
+	enum Base { ERROR, VOID, BOOL, INT, SHORT, STRING, FN };
+
+	DataType() : myBase(ERROR), myPtrs(0){ }
+	DataType(Base baseIn) : myBase(baseIn), myPtrs(0){ }
+	static DataType ptrTo(DataType target){
+		DataType result = target;
+		result.myPtrs++;
+		return result;
+	}
+
+	Base base() const { return myBase; }
+	unsigned int ptrDepth() const { return myPtrs; }
+	/* The type a pointer points to */
+	DataType deref() const {
+		DataType result = *this;
+		if (result.myPtrs > 0){ result.myPtrs--; }
+		return result;
+	}
+
+	bool isError() const { return myBase == ERROR; }
+	bool isPtr() const { return myPtrs > 0; }
+	bool isVoid() const { return is(VOID); }
+	bool isBool() const { return is(BOOL); }
+	bool isString() const { return is(STRING); }
+	bool isFn() const { return is(FN); }
+	bool isNumeric() const { return is(INT) || is(SHORT); }
+
+	bool operator==(const DataType& other) const {
+		return myBase == other.myBase && myPtrs == other.myPtrs;
+	}
+	bool operator!=(const DataType& other) const {
+		return !(*this == other);
+	}
+
+	std::string str() const {
+		std::string result;
+		for (unsigned int i = 0; i < myPtrs; i++){ result += "ptr "; }
+		switch (myBase){
+		case ERROR: return result + "ERROR";
+		case VOID: return result + "void";
+		case BOOL: return result + "bool";
+		case INT: return result + "int";
+		case SHORT: return result + "short";
+		case STRING: return result + "string";
+		case FN: return result + "fn";
+		}
+		return result;
+	}
+private:
+	bool is(Base b) const { return myBase == b && myPtrs == 0; }
+	Base myBase;
+	unsigned int myPtrs;
+};
+
+}
+
+#endif
@@ -1,4 +1,5 @@
 #include "ast.hpp"
+#include "symbol_table.hpp"
 
 namespace cminusminus{
 
@@ -21,8 +22,32 @@ defined in the same file as DeclNode::unparse, the unparse method
 of DeclNodes.
 */
 
+/*
+Unparsing keeps its own stack rather than recursing, so a left-deep
+chain like a - b - c - ... or deeply nested blocks cannot overflow
+the C++ stack. Each node's unparseStep writes what comes before its
+first subtree and queues the rest; the queued items go on the stack
+in reverse, so they come off it in order.
+*/
+void ASTNode::unparse(std::ostream& out, int indent){
+	std::vector<UnparseWork::Item> stack;
+	stack.push_back(UnparseWork::Item{this, indent, nullptr});
+	UnparseWork rest;
+	while (!stack.empty()){
+		UnparseWork::Item item = stack.back();
+		stack.pop_back();
+		if (item.node == nullptr){
+			out << item.text;
+			continue;
+		}
+		item.node->unparseStep(out, rest, item.indent);
+		stack.insert(stack.end(), rest.items.rbegin(), rest.items.rend());
+		rest.items.clear();
+	}
+}
 
-void ProgramNode::unparse(std::ostream& out, int indent){
+void ProgramNode::unparseStep(std::ostream& out,
+	UnparseWork& rest, int indent){
 	/* Oh, hey it's a for-each loop in C++!
 	   The loop iterates over each element in a collection
 	   without that gross i++ nonsense.
@@ -36,343 +61,404 @@ void ProgramNode::unparse(std::ostream& out, int indent){
 		   pretty clear that global is of
 		   type DeclNode *.
 		*/
-		global->unparse(out, indent);
+		rest.node(global, indent);
 	}
 }
 
-void VarDeclNode::unparse(std::ostream& out, int indent){
+void VarDeclNode::unparseStep(std::ostream& out,
+	UnparseWork& rest, int indent){
 	doIndent(out, indent);
-	this->myType->unparse(out, 0);
-	out << " ";
-	this->myId->unparse(out, 0);
-	out << ";\n";
+	rest.node(this->myType);
+	rest.text(" ");
+	rest.node(this->myId);
+	rest.text(";\n");
 }
 
-void FormalDeclNode::unparse(std::ostream& out, int indent){
+void FormalDeclNode::unparseStep(std::ostream& out,
+	UnparseWork& rest, int indent){
 	doIndent(out, indent);
-	this->myType->unparse(out, 0);
-	out << " ";
-	this->myId->unparse(out, 0);
+	rest.node(this->myType);
+	rest.text(" ");
+	rest.node(this->myId);
 }
 
-void IDNode::unparse(std::ostream& out, int indent){
+void IDNode::unparseStep(std::ostream& out,
+	UnparseWork& rest, int indent){
 	out << this->name;
+	//After name analysis, each name shows the type it resolved to
+	if (mySymbol != nullptr){
+		out << "{" << mySymbol->typeStr() << "}";
+	}
 }
 
-void IntTypeNode::unparse(std::ostream& out, int indent){
+void IntTypeNode::unparseStep(std::ostream& out,
+	UnparseWork& rest, int indent){
 	out << "int";
 }
 
-void BoolTypeNode::unparse(std::ostream& out, int indent){
+void BoolTypeNode::unparseStep(std::ostream& out,
+	UnparseWork& rest, int indent){
 	doIndent(out, indent);
 	out << "bool";
 }
 
-void VoidTypeNode::unparse(std::ostream& out, int indent){
+void VoidTypeNode::unparseStep(std::ostream& out,
+	UnparseWork& rest, int indent){
 	doIndent(out, indent);
 	out << "void";
 }
 
-void StringTypeNode::unparse(std::ostream& out, int indent){
+void StringTypeNode::unparseStep(std::ostream& out,
+	UnparseWork& rest, int indent){
 	doIndent(out, indent);
 	out << "string";
 }
 
-void ShortTypeNode::unparse(std::ostream& out, int indent){
+void ShortTypeNode::unparseStep(std::ostream& out,
+	UnparseWork& rest, int indent){
 	doIndent(out, indent);
 	out << "short";
 }
 
-void PtrTypeNode::unparse(std::ostream& out, int indent){
+void PtrTypeNode::unparseStep(std::ostream& out,
+	UnparseWork& rest, int indent){
 	doIndent(out, indent);
-	out << "ptr";
+	rest.text("ptr ");
+	rest.node(this->myBase);
 }
 
-void WriteStmtNode::unparse(std::ostream& out, int indent){
+void WriteStmtNode::unparseStep(std::ostream& out,
+	UnparseWork& rest, int indent){
 	doIndent(out, indent);
-	out << "report ";
-	this->expression->unparse(out, 0);
-	out << "; \n";
+	rest.text("report ");
+	rest.node(this->expression);
+	rest.text("; \n");
 }
 
-void NotNode::unparse(std::ostream& out, int indent){
+void NotNode::unparseStep(std::ostream& out,
+	UnparseWork& rest, int indent){
 	doIndent(out, indent);
 	out << "not";
 }
 
-void NegNode::unparse(std::ostream& out, int indent){
+void NegNode::unparseStep(std::ostream& out,
+	UnparseWork& rest, int indent){
 	doIndent(out, indent);
 	out << "neg";
 }
 
-void TrueNode::unparse(std::ostream& out, int indent){
+void RefNode::unparseStep(std::ostream& out,
+	UnparseWork& rest, int indent){
+	doIndent(out, indent);
+	rest.text("&");
+	rest.node(this->expression);
+}
+
+void DerefNode::unparseStep(std::ostream& out,
+	UnparseWork& rest, int indent){
+	doIndent(out, indent);
+	rest.text("@");
+	rest.node(this->myId);
+}
+
+void TrueNode::unparseStep(std::ostream& out,
+	UnparseWork& rest, int indent){
 	doIndent(out, indent);
 	out << "true";
 }
 
-void FalseNode::unparse(std::ostream& out, int indent){
+void FalseNode::unparseStep(std::ostream& out,
+	UnparseWork& rest, int indent){
 	doIndent(out, indent);
 	out << "false";
 }
 
-void StrLitNode::unparse(std::ostream& out, int indent){
+void StrLitNode::unparseStep(std::ostream& out,
+	UnparseWork& rest, int indent){
 	doIndent(out, indent);
   out << this->stringVal;
 
 }
 
-void IntLitNode::unparse(std::ostream& out, int indent){
+void IntLitNode::unparseStep(std::ostream& out,
+	UnparseWork& rest, int indent){
 	doIndent(out, indent);
   out << this->numval;
 }
 
-void ShortLitNode::unparse(std::ostream& out, int indent){
+void ShortLitNode::unparseStep(std::ostream& out,
+	UnparseWork& rest, int indent){
 	doIndent(out, indent);
   out << this->shortVal;
 }
 
-void TimesNode::unparse(std::ostream& out, int indent){
+void TimesNode::unparseStep(std::ostream& out,
+	UnparseWork& rest, int indent){
 	doIndent(out, indent);
-  out << "(";
-  this->leftNode->unparse(out, 0);
-  out << " * ";
-  this->rightNode->unparse(out, 0);
-  out << ")";
+  rest.text("(");
+  rest.node(this->leftNode);
+  rest.text(" * ");
+  rest.node(this->rightNode);
+  rest.text(")");
 }
 
-void PlusNode::unparse(std::ostream& out, int indent){
+void PlusNode::unparseStep(std::ostream& out,
+	UnparseWork& rest, int indent){
 	doIndent(out, indent);
-  out << "(";
-	this->leftNode->unparse(out, 0);
-  out << " + ";
-  this->rightNode->unparse(out, 0);
-  out << ")";
+  rest.text("(");
+	rest.node(this->leftNode);
+  rest.text(" + ");
+  rest.node(this->rightNode);
+  rest.text(")");
 }
 
-void OrNode::unparse(std::ostream& out, int indent){
+void OrNode::unparseStep(std::ostream& out,
+	UnparseWork& rest, int indent){
 	doIndent(out, indent);
-  out << "(";
-  this->leftNode->unparse(out, 0);
-  out << " || ";
-  this->rightNode->unparse(out, 0);
-  out << ")";
+  rest.text("(");
+  rest.node(this->leftNode);
+  rest.text(" || ");
+  rest.node(this->rightNode);
+  rest.text(")");
 }
 
-void NotEqualsNode::unparse(std::ostream& out, int indent){
+void NotEqualsNode::unparseStep(std::ostream& out,
+	UnparseWork& rest, int indent){
 	doIndent(out, indent);
-  out << "(";
-  this->leftNode->unparse(out, 0);
-  out << " != ";
-  this->rightNode->unparse(out, 0);
-  out << ")";
+  rest.text("(");
+  rest.node(this->leftNode);
+  rest.text(" != ");
+  rest.node(this->rightNode);
+  rest.text(")");
 }
 
-void MinusNode::unparse(std::ostream& out, int indent){
+void MinusNode::unparseStep(std::ostream& out,
+	UnparseWork& rest, int indent){
 	doIndent(out, indent);
-  out << "(";
-  this->leftNode->unparse(out, 0);
-  out << " - ";
-  this->rightNode->unparse(out, 0);
-  out << ")";
+  rest.text("(");
+  rest.node(this->leftNode);
+  rest.text(" - ");
+  rest.node(this->rightNode);
+  rest.text(")");
 }
 
-void LessNode::unparse(std::ostream& out, int indent){
+void LessNode::unparseStep(std::ostream& out,
+	UnparseWork& rest, int indent){
 	doIndent(out, indent);
-  out << "(";
-  this->leftNode->unparse(out, 0);
-  out << " < ";
-  this->rightNode->unparse(out, 0);
-  out << ")";
+  rest.text("(");
+  rest.node(this->leftNode);
+  rest.text(" < ");
+  rest.node(this->rightNode);
+  rest.text(")");
 }
 
-void LessEqNode::unparse(std::ostream& out, int indent){
+void LessEqNode::unparseStep(std::ostream& out,
+	UnparseWork& rest, int indent){
 	doIndent(out, indent);
-  out << "(";
-  this->leftNode->unparse(out, 0);
-  out << " <= ";
-  this->rightNode->unparse(out, 0);
-  out << ")";
+  rest.text("(");
+  rest.node(this->leftNode);
+  rest.text(" <= ");
+  rest.node(this->rightNode);
+  rest.text(")");
 }
 
-void GreaterNode::unparse(std::ostream& out, int indent){
+void GreaterNode::unparseStep(std::ostream& out,
+	UnparseWork& rest, int indent){
 	doIndent(out, indent);
-  out << "(";
-  this->leftNode->unparse(out, 0);
-  out << " > ";
-  this->rightNode->unparse(out, 0);
-  out << ")";
+  rest.text("(");
+  rest.node(this->leftNode);
+  rest.text(" > ");
+  rest.node(this->rightNode);
+  rest.text(")");
 }
 
-void GreaterEqNode::unparse(std::ostream& out, int indent){
+void GreaterEqNode::unparseStep(std::ostream& out,
+	UnparseWork& rest, int indent){
 	doIndent(out, indent);
-  out << "(";
-  this->leftNode->unparse(out, 0);
-  out << " >= ";
-  this->rightNode->unparse(out, 0);
-  out << ")";
+  rest.text("(");
+  rest.node(this->leftNode);
+  rest.text(" >= ");
+  rest.node(this->rightNode);
+  rest.text(")");
 }
 
-void EqualsNode::unparse(std::ostream& out, int indent){
+void EqualsNode::unparseStep(std::ostream& out,
+	UnparseWork& rest, int indent){
 	doIndent(out, indent);
-  out << "(";
-  this->leftNode->unparse(out, 0);
-  out << " == ";
-  this->rightNode->unparse(out, 0);
-  out << ")";
+  rest.text("(");
+  rest.node(this->leftNode);
+  rest.text(" == ");
+  rest.node(this->rightNode);
+  rest.text(")");
 }
 
-void DivideNode::unparse(std::ostream& out, int indent){
+void DivideNode::unparseStep(std::ostream& out,
+	UnparseWork& rest, int indent){
 	doIndent(out, indent);
-  out << "(";
-  this->leftNode->unparse(out, 0);
-  out << " / ";
-  this->rightNode->unparse(out, 0);
-  out << ")";
+  rest.text("(");
+  rest.node(this->leftNode);
+  rest.text(" / ");
+  rest.node(this->rightNode);
+  rest.text(")");
 }
 
-void AndNode::unparse(std::ostream& out, int indent){
+void AndNode::unparseStep(std::ostream& out,
+	UnparseWork& rest, int indent){
 	doIndent(out, indent);
-  out << "(";
-	this->leftNode->unparse(out, 0);
-  out << " && ";
-  this->rightNode->unparse(out, 0);
-  out << ")";
+  rest.text("(");
+	rest.node(this->leftNode);
+  rest.text(" && ");
+  rest.node(this->rightNode);
+  rest.text(")");
 }
 
-void AssignExpNode::unparse(std::ostream& out, int indent){
+void AssignExpNode::unparseStep(std::ostream& out,
+	UnparseWork& rest, int indent){
 	doIndent(out, indent);
-  this->variable->unparse(out, 0);
-  out << " = ";
-  this->expression->unparse(out, 0);
-  out << "; \n";
+  rest.node(this->variable);
+  rest.text(" = ");
+  rest.node(this->expression);
+  rest.text("; \n");
 }
 
-void IndexNode::unparse(std::ostream& out, int indent){
+void IndexNode::unparseStep(std::ostream& out,
+	UnparseWork& rest, int indent){
 	doIndent(out, indent);
-  this->Id_being_accessed->unparse(out, 0);
-  out << "[";
-	this->field_Name_being_accessed->unparse(out, 0);
-  out << "]";
+  rest.node(this->Id_being_accessed);
+  rest.text("[");
+	rest.node(this->field_Name_being_accessed);
+  rest.text("]");
 }
 
-void CallStmtNode::unparse(std::ostream& out, int indent){
+void CallStmtNode::unparseStep(std::ostream& out,
+	UnparseWork& rest, int indent){
 	doIndent(out, indent);
-  this->Function->unparse(out, 0);
-	out << ";\n";
+  rest.node(this->Function);
+	rest.text(";\n");
 }
 
-void AssignStmtNode::unparse(std::ostream& out, int indent){
+void AssignStmtNode::unparseStep(std::ostream& out,
+	UnparseWork& rest, int indent){
 	doIndent(out, indent);
-  this->assignment->unparse(out, 0);
+  rest.node(this->assignment);
 }
 
-void PostDecStmtNode::unparse(std::ostream& out, int indent){
+void PostDecStmtNode::unparseStep(std::ostream& out,
+	UnparseWork& rest, int indent){
 	doIndent(out, indent);
-  this->variable->unparse(out, 0);
-  out << "--; \n";
+  rest.node(this->variable);
+  rest.text("--; \n");
 }
 
-void PostIncStmtNode::unparse(std::ostream& out, int indent){
+void PostIncStmtNode::unparseStep(std::ostream& out,
+	UnparseWork& rest, int indent){
 	doIndent(out, indent);
-  this->variable->unparse(out, 0);
-  out << "++; \n";
+  rest.node(this->variable);
+  rest.text("++; \n");
 }
 
-void ReadStmtNode::unparse(std::ostream& out, int indent){
+void ReadStmtNode::unparseStep(std::ostream& out,
+	UnparseWork& rest, int indent){
 	doIndent(out, indent);
-  out << "receive ";
-  this->variable->unparse(out, 0);
-  out << "; \n";
+  rest.text("receive ");
+  rest.node(this->variable);
+  rest.text("; \n");
 }
 
-void ReturnStmtNode::unparse(std::ostream& out, int indent){
+void ReturnStmtNode::unparseStep(std::ostream& out,
+	UnparseWork& rest, int indent){
 	doIndent(out, indent);
-  out << "return";
+  rest.text("return");
 	if( expression != nullptr)
 	{
-		out << " ";
-		this->expression->unparse(out, 0);
+		rest.text(" ");
+		rest.node(this->expression);
 	}
-	out << "; \n";
+	rest.text("; \n");
 }
 
-void FnDeclNode::unparse(std::ostream& out, int indent) {
+void FnDeclNode::unparseStep(std::ostream& out,
+	UnparseWork& rest, int indent) {
 	doIndent(out, indent);
-  this->myType->unparse(out, 0);
-  out << " ";
-  this->myId->unparse(out, 0);
-  out << "(";
+  rest.node(this->myType);
+  rest.text(" ");
+  rest.node(this->myId);
+  rest.text("(");
   if (parameters != nullptr)
   {
-		std::string comma = "";
+		const char * comma = "";
    	for (auto param: *parameters)
    	{
-			out << comma;
-     	param->unparse(out, 0);
+			rest.text(comma);
+     	rest.node(param);
      	comma = ", ";
    	}
   }
-  out << ") {\n";
+  rest.text(") {\n");
   for (auto stmt: *functionBody)
   {
-		stmt->unparse(out, indent + 1);
+		rest.node(stmt, indent + 1);
   }
-  out << "\n}\n";
+  rest.text("\n}\n");
 }
 
-void IfStmtNode::unparse(std::ostream& out, int indent) {
+void IfStmtNode::unparseStep(std::ostream& out,
+	UnparseWork& rest, int indent) {
 	doIndent(out, indent);
-  out << "if (";
-  this->condition->unparse(out, 0);
-  out << ") {\n";
+  rest.text("if (");
+  rest.node(this->condition);
+  rest.text(") {\n");
   for (auto stmt: *IfBody)
   {
-		stmt->unparse(out, indent);
+		rest.node(stmt, indent);
   }
-  out << "\n}\n";
+  rest.text("\n}\n");
 }
 
-void IfElseStmtNode::unparse(std::ostream& out, int indent) {
+void IfElseStmtNode::unparseStep(std::ostream& out,
+	UnparseWork& rest, int indent) {
 	doIndent(out, indent);
-  out << "if (";
-  this->condition->unparse(out, 0);
-  out << ") {\n";
+  rest.text("if (");
+  rest.node(this->condition);
+  rest.text(") {\n");
   for (auto stmt: *IfTrueBody)
   {
-		stmt->unparse(out, indent + 1);
+		rest.node(stmt, indent + 1);
   }
-	out << "\n}\n else {\n";
+	rest.text("\n}\n else {\n");
   for (auto stmt: *IfFalseBody)
   {
-		stmt->unparse(out, indent + 1);
+		rest.node(stmt, indent + 1);
   }
-  out << "\n}\n";
+  rest.text("\n}\n");
 }
 
-void WhileStmtNode::unparse(std::ostream& out, int indent) {
+void WhileStmtNode::unparseStep(std::ostream& out,
+	UnparseWork& rest, int indent) {
 	doIndent(out, indent);
-  out << "while ";
-  this->condition->unparse(out, 0);
-  out << " {\n";
+  rest.text("while ");
+  rest.node(this->condition);
+  rest.text(" {\n");
   for (auto stmt: *WhileBody)
   {
-		stmt->unparse(out, indent + 1);
+		rest.node(stmt, indent + 1);
   }
-  out << "\n}\n";
+  rest.text("\n}\n");
 }
 
-void CallExpNode::unparse(std::ostream& out, int indent) {
+void CallExpNode::unparseStep(std::ostream& out,
+	UnparseWork& rest, int indent) {
 	doIndent(out, indent);
-  this->nameFunc->unparse(out, 0);
-  out << "(";
+  rest.node(this->nameFunc);
+  rest.text("(");
 	if (!(arguments == nullptr))
   {
 		for (auto args: *arguments)
 		{
-			args->unparse(out, 0);
+			rest.node(args);
      }
 	 }
-	 out << ")";
+	 rest.text(")");
 }
 
 } // End namespace cminusminus
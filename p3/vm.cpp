@@ -0,0 +1,544 @@
+#include <algorithm>
+#include <memory>
+#include <unordered_map>
+#include "errors.hpp"
+#include "vm.hpp"
+
+/*
+The dispatch loop is threaded with computed gotos (a GNU extension,
+so this file alone is built without -pedantic): each handler jumps
+straight to the next one through a table of label addresses, instead
+of returning to a central switch.
+
+Superinstructions cover the common shapes: compare-and-branch
+against a register or a small constant, and stepping a variable by
+one in place (x++ and x--).
+*/
+
+namespace cminusminus{
+
+namespace {
+
+enum BOp : uint16_t {
+	MOV,      /* a = b */
+	GLOAD,    /* a = global bc */
+	GSTORE,   /* global bc = a */
+	ADDI, SUBI, MULI, DIVI,   /* a = b op c, wrapped to int */
+	ADDS, SUBS, MULS, DIVS,   /* a = b op c, wrapped to short */
+	NEGI, NEGS,               /* a = -b */
+	NOT,                      /* a = !b */
+	SEQ, SNE, SLT, SLE, SGT, SGE,   /* a = b cmp c */
+	ADDRG,    /* a = address of global bc */
+	ADDRR,    /* a = address of register b */
+	LOAD,     /* a = *b */
+	STORE,    /* *a = b */
+	JMP,      /* go to instruction bc of this procedure */
+	BEQ, BNE, BLT, BLE, BGT, BGE,         /* if a cmp b, go c ahead */
+	BEQK, BNEK, BLTK, BLEK, BGTK, BGEK,   /* if a cmp the constant b, go c ahead */
+	INCI, DECI, INCS, DECS,   /* a = a +/- 1, wrapped */
+	ARG,      /* outgoing argument b = a */
+	GETARG,   /* a = incoming argument b */
+	CALL,     /* a = call procedure bc (a may be NOREG) */
+	RET,      /* return a (which may be NOREG) */
+	WRITEI, WRITES,           /* print a */
+	READI, READS, READB,      /* a = a value read from input */
+	NUM_OPS
+};
+
+const uint16_t NOREG = 0xFFFF;
+
+/* Registers the VM's stack holds, across all frames */
+const size_t stackRegs = size_t(1) << 22;
+
+uint16_t hi16(size_t v){ return static_cast<uint16_t>(v >> 16); }
+uint16_t lo16(size_t v){ return static_cast<uint16_t>(v & 0xFFFF); }
+
+bool fitsK(const Opd& opd){
+	return opd.isImm() && opd.val >= INT16_MIN && opd.val <= INT16_MAX;
+}
+
+/**
+* \class ProcCompiler
+* Translates one IRProc
+**/
+class ProcCompiler{
+public:
+	ProcCompiler(const IRProc& procIn, BProc& outIn, size_t& maxArgsIn)
+	: proc(procIn), out(outIn), maxArgs(maxArgsIn),
+	  scratch(proc.numTemps + proc.numSlots),
+	  labelPos(proc.numLabels, 0){
+		out.name = proc.name;
+		out.firstConst = static_cast<uint32_t>(scratch + 2);
+		checkReg(out.firstConst);
+		//Offsets are 16 bits, so a large procedure branches by
+		// jumping over an absolute jump instead
+		longBranches = 3 * proc.code.size() + 8 > INT16_MAX;
+	}
+
+	void compile(){
+		for (const Instr& instr : proc.code){
+			translate(instr);
+		}
+		for (const auto& fix : fixups){
+			size_t target = labelPos[fix.second];
+			BInsn& insn = out.code[fix.first];
+			if (insn.op == JMP){
+				insn.b = hi16(target);
+				insn.c = lo16(target);
+			} else {
+				int64_t offset = static_cast<int64_t>(target)
+					- static_cast<int64_t>(fix.first);
+				insn.c = static_cast<uint16_t>(static_cast<int16_t>(offset));
+			}
+		}
+		out.numRegs = out.firstConst + static_cast<uint32_t>(out.consts.size());
+	}
+
+private:
+	const IRProc& proc;
+	BProc& out;
+	size_t& maxArgs;
+	size_t scratch;
+	std::vector<size_t> labelPos;
+	/* (instruction, label) pairs to patch once labels are placed */
+	std::vector<std::pair<size_t, size_t>> fixups;
+	std::unordered_map<int64_t, uint16_t> immRegs;
+	std::unordered_map<size_t, uint16_t> strRegs;
+	bool longBranches;
+
+	void checkReg(size_t reg){
+		if (reg >= NOREG){
+			throw new UserError(("Procedure " + proc.name
+				+ " is too large for the VM").c_str());
+		}
+	}
+
+	void emit(BOp op, size_t a = 0, size_t b = 0, size_t c = 0){
+		out.code.push_back(BInsn{op, static_cast<uint16_t>(a),
+			static_cast<uint16_t>(b), static_cast<uint16_t>(c)});
+	}
+
+	uint16_t constReg(int64_t val){
+		size_t reg = out.firstConst + out.consts.size();
+		checkReg(reg);
+		out.consts.push_back(val);
+		return static_cast<uint16_t>(reg);
+	}
+
+	/* The register holding opd's value, loading a global into scratch
+	   register k */
+	size_t reg(const Opd& opd, size_t k = 0){
+		switch (opd.kind){
+		case Opd::TEMP: return opd.idx();
+		case Opd::SLOT: return proc.numTemps + opd.idx();
+		case Opd::GLOBAL:
+			emit(GLOAD, scratch + k, hi16(opd.idx()), lo16(opd.idx()));
+			return scratch + k;
+		case Opd::IMM: {
+			auto found = immRegs.find(opd.val);
+			if (found != immRegs.end()){ return found->second; }
+			uint16_t r = constReg(opd.val);
+			immRegs.emplace(opd.val, r);
+			return r;
+		}
+		case Opd::STR: {
+			auto found = strRegs.find(opd.idx());
+			if (found != strRegs.end()){ return found->second; }
+			out.strConsts.push_back(static_cast<uint32_t>(out.consts.size()));
+			uint16_t r = constReg(opd.val);
+			strRegs.emplace(opd.idx(), r);
+			return r;
+		}
+		default:
+			throw new InternalError("Operand has no value");
+		}
+	}
+
+	/* The register to compute dst into; a global is stored by done() */
+	size_t dstReg(const Opd& dst){
+		return dst.kind == Opd::GLOBAL ? scratch : reg(dst);
+	}
+	void done(const Opd& dst){
+		if (dst.kind == Opd::GLOBAL){
+			emit(GSTORE, scratch, hi16(dst.idx()), lo16(dst.idx()));
+		}
+	}
+
+	void jumpTo(const Opd& label){
+		fixups.emplace_back(out.code.size(), label.idx());
+		emit(JMP);
+	}
+
+	void branch(IROp op, const Opd& label, size_t a, size_t b, bool isK){
+		BOp base = isK ? BEQK : BEQ;
+		if (longBranches){
+			IROp skip = negatedBranch(op);
+			emit(static_cast<BOp>(base + (static_cast<int>(skip)
+				- static_cast<int>(IROp::BEQ))), a, b, 2);
+			jumpTo(label);
+			return;
+		}
+		fixups.emplace_back(out.code.size(), label.idx());
+		emit(static_cast<BOp>(base + (static_cast<int>(op)
+			- static_cast<int>(IROp::BEQ))), a, b);
+	}
+
+	void translate(const Instr& instr){
+		bool isShort = instr.type == IRType::SHORT;
+		switch (instr.op){
+		case IROp::MOV:
+			if (instr.a.kind == Opd::GLOBAL && instr.dst.kind != Opd::GLOBAL){
+				emit(GLOAD, reg(instr.dst), hi16(instr.a.idx()),
+					lo16(instr.a.idx()));
+			} else if (instr.dst.kind == Opd::GLOBAL){
+				emit(GSTORE, reg(instr.a), hi16(instr.dst.idx()),
+					lo16(instr.dst.idx()));
+			} else {
+				emit(MOV, reg(instr.dst), reg(instr.a));
+			}
+			return;
+		case IROp::ADD:
+		case IROp::SUB:
+			if (instr.dst == instr.a && instr.dst.isTemp()
+				&& instr.b.isImm() && instr.b.val == 1){
+				bool up = instr.op == IROp::ADD;
+				emit(isShort ? (up ? INCS : DECS) : (up ? INCI : DECI),
+					reg(instr.dst));
+				return;
+			}
+			//fallthrough
+		case IROp::MUL:
+		case IROp::DIV: {
+			size_t a = reg(instr.a, 0);
+			size_t b = reg(instr.b, 1);
+			int which = static_cast<int>(instr.op) - static_cast<int>(IROp::ADD);
+			emit(static_cast<BOp>((isShort ? ADDS : ADDI) + which),
+				dstReg(instr.dst), a, b);
+			done(instr.dst);
+			return;
+		}
+		case IROp::NEG: {
+			size_t a = reg(instr.a);
+			emit(isShort ? NEGS : NEGI, dstReg(instr.dst), a);
+			done(instr.dst);
+			return;
+		}
+		case IROp::NOT: {
+			size_t a = reg(instr.a);
+			emit(NOT, dstReg(instr.dst), a);
+			done(instr.dst);
+			return;
+		}
+		case IROp::SEQ: case IROp::SNE: case IROp::SLT:
+		case IROp::SLE: case IROp::SGT: case IROp::SGE: {
+			size_t a = reg(instr.a, 0);
+			size_t b = reg(instr.b, 1);
+			int which = static_cast<int>(instr.op) - static_cast<int>(IROp::SEQ);
+			emit(static_cast<BOp>(SEQ + which), dstReg(instr.dst), a, b);
+			done(instr.dst);
+			return;
+		}
+		case IROp::ADDR:
+			if (instr.a.kind == Opd::GLOBAL){
+				emit(ADDRG, dstReg(instr.dst), hi16(instr.a.idx()),
+					lo16(instr.a.idx()));
+			} else {
+				emit(ADDRR, dstReg(instr.dst), reg(instr.a));
+			}
+			done(instr.dst);
+			return;
+		case IROp::LOAD: {
+			size_t a = reg(instr.a);
+			emit(LOAD, dstReg(instr.dst), a);
+			done(instr.dst);
+			return;
+		}
+		case IROp::STORE:
+			emit(STORE, reg(instr.a, 0), reg(instr.b, 1));
+			return;
+		case IROp::LABEL:
+			labelPos[instr.a.idx()] = out.code.size();
+			return;
+		case IROp::JMP:
+			jumpTo(instr.a);
+			return;
+		case IROp::BEQ: case IROp::BNE: case IROp::BLT:
+		case IROp::BLE: case IROp::BGT: case IROp::BGE:
+			if (fitsK(instr.b) && !instr.a.isImm()){
+				branch(instr.op, instr.dst, reg(instr.a),
+					static_cast<uint16_t>(instr.b.val), true);
+			} else if (fitsK(instr.a) && !instr.b.isImm()){
+				branch(swappedBranch(instr.op), instr.dst, reg(instr.b),
+					static_cast<uint16_t>(instr.a.val), true);
+			} else {
+				size_t a = reg(instr.a, 0);
+				size_t b = reg(instr.b, 1);
+				branch(instr.op, instr.dst, a, b, false);
+			}
+			return;
+		case IROp::ARG:
+			maxArgs = std::max(maxArgs, instr.b.idx() + 1);
+			emit(ARG, reg(instr.a), instr.b.idx());
+			return;
+		case IROp::CALL:
+			emit(CALL, instr.dst.isNone() ? NOREG : dstReg(instr.dst),
+				hi16(instr.a.idx()), lo16(instr.a.idx()));
+			done(instr.dst);
+			return;
+		case IROp::GETARG:
+			emit(GETARG, dstReg(instr.dst), instr.a.idx());
+			done(instr.dst);
+			return;
+		case IROp::RET:
+			emit(RET, instr.a.isNone() ? NOREG : reg(instr.a));
+			return;
+		case IROp::WRITE:
+			emit(instr.type == IRType::STR ? WRITES : WRITEI, reg(instr.a));
+			return;
+		case IROp::READ:
+			emit(isShort ? READS : instr.type == IRType::BOOL ? READB : READI,
+				dstReg(instr.dst));
+			done(instr.dst);
+			return;
+		}
+	}
+};
+
+/* Writes go through a buffer, flushed when it fills, before each
+   read, and at the end of the run */
+class OutBuf{
+public:
+	explicit OutBuf(std::ostream& outIn) : out(outIn), len(0){ }
+	~OutBuf(){ flush(); }
+	void flush(){
+		out.write(buf, static_cast<std::streamsize>(len));
+		out.flush();
+		len = 0;
+	}
+	void put(const char * str){
+		for (; *str != '\0'; str++){
+			if (len == sizeof(buf)){ flush(); }
+			buf[len++] = *str;
+		}
+	}
+	void put(int64_t val){
+		char digits[24];
+		size_t n = 0;
+		uint64_t mag = val < 0 ? 0 - static_cast<uint64_t>(val)
+			: static_cast<uint64_t>(val);
+		do {
+			digits[n++] = static_cast<char>('0' + mag % 10);
+			mag /= 10;
+		} while (mag != 0);
+		if (len + n + 1 > sizeof(buf)){ flush(); }
+		if (val < 0){ buf[len++] = '-'; }
+		while (n > 0){ buf[len++] = digits[--n]; }
+	}
+private:
+	std::ostream& out;
+	char buf[1 << 16];
+	size_t len;
+};
+
+/* Reads an integer (0 at end of input) */
+int64_t readInt(std::istream& in){
+	std::streambuf * sb = in.rdbuf();
+	int ch = sb->sgetc();
+	while (ch == ' ' || ch == '\n' || ch == '\t' || ch == '\r'){
+		ch = sb->snextc();
+	}
+	bool neg = ch == '-';
+	if (neg){ ch = sb->snextc(); }
+	uint64_t mag = 0;
+	while (ch >= '0' && ch <= '9'){
+		mag = mag * 10 + static_cast<uint64_t>(ch - '0');
+		ch = sb->snextc();
+	}
+	int64_t val = static_cast<int64_t>(mag);
+	return neg ? -val : val;
+}
+
+inline int64_t wrapInt(int64_t v){
+	return static_cast<int32_t>(static_cast<uint32_t>(static_cast<uint64_t>(v)));
+}
+
+inline int64_t wrapShort(int64_t v){
+	return static_cast<int16_t>(static_cast<uint16_t>(static_cast<uint64_t>(v)));
+}
+
+struct Frame{
+	const BInsn * pc; /* the CALL to return past */
+	const BInsn * base;
+	int64_t * regs;
+	uint32_t numRegs;
+};
+
+}
+
+Bytecode * compileBytecode(const IRProgram& prog){
+	Bytecode * code = new Bytecode();
+	for (const std::string& literal : prog.strings){
+		code->strings.push_back(stringValue(literal));
+	}
+	code->numGlobals = prog.globals.size();
+	code->mainProc = static_cast<uint32_t>(prog.mainProc);
+	code->procs.resize(prog.procs.size());
+	for (size_t i = 0; i < prog.procs.size(); i++){
+		ProcCompiler(prog.procs[i], code->procs[i], code->maxArgs).compile();
+	}
+	return code;
+}
+
+void runBytecode(const Bytecode& code, std::istream& in, std::ostream& out){
+	static const void * const handlers[NUM_OPS] = {
+		&&op_MOV, &&op_GLOAD, &&op_GSTORE,
+		&&op_ADDI, &&op_SUBI, &&op_MULI, &&op_DIVI,
+		&&op_ADDS, &&op_SUBS, &&op_MULS, &&op_DIVS,
+		&&op_NEGI, &&op_NEGS, &&op_NOT,
+		&&op_SEQ, &&op_SNE, &&op_SLT, &&op_SLE, &&op_SGT, &&op_SGE,
+		&&op_ADDRG, &&op_ADDRR, &&op_LOAD, &&op_STORE,
+		&&op_JMP,
+		&&op_BEQ, &&op_BNE, &&op_BLT, &&op_BLE, &&op_BGT, &&op_BGE,
+		&&op_BEQK, &&op_BNEK, &&op_BLTK, &&op_BLEK, &&op_BGTK, &&op_BGEK,
+		&&op_INCI, &&op_DECI, &&op_INCS, &&op_DECS,
+		&&op_ARG, &&op_GETARG, &&op_CALL, &&op_RET,
+		&&op_WRITEI, &&op_WRITES, &&op_READI, &&op_READS, &&op_READB,
+	};
+
+	//Each procedure's constants, with string literals made pointers
+	std::vector<std::vector<int64_t>> consts;
+	for (const BProc& proc : code.procs){
+		consts.push_back(proc.consts);
+		for (uint32_t k : proc.strConsts){
+			const std::string& str = code.strings[static_cast<size_t>(proc.consts[k])];
+			consts.back()[k] = reinterpret_cast<int64_t>(str.c_str());
+		}
+	}
+	std::vector<int64_t> globals(code.numGlobals, 0);
+	std::vector<int64_t> args(code.maxArgs + 1, 0);
+	std::unique_ptr<int64_t[]> stack(new int64_t[stackRegs]);
+	const int64_t * stackEnd = stack.get() + stackRegs;
+	std::vector<Frame> frames;
+	OutBuf outBuf(out);
+
+	const BProc& entry = code.procs[code.mainProc];
+	int64_t * regs = stack.get();
+	uint32_t numRegs = entry.numRegs;
+	if (regs + numRegs > stackEnd){ throw new UserError("Stack overflow"); }
+	std::copy(consts[code.mainProc].begin(), consts[code.mainProc].end(),
+		regs + entry.firstConst);
+	const BInsn * base = entry.code.data();
+	const BInsn * pc = base;
+
+	#define R(x) regs[pc->x]
+	#define DISPATCH() goto *handlers[pc->op]
+	#define NEXT() do { ++pc; DISPATCH(); } while (0)
+	#define GLOBAL_IDX() ((static_cast<size_t>(pc->b) << 16) | pc->c)
+	#define BRANCH(cond) do { \
+		if (cond){ pc += static_cast<int16_t>(pc->c); } else { ++pc; } \
+		DISPATCH(); } while (0)
+	#define K() static_cast<int16_t>(pc->b)
+
+	DISPATCH();
+
+op_MOV: R(a) = R(b); NEXT();
+op_GLOAD: R(a) = globals[GLOBAL_IDX()]; NEXT();
+op_GSTORE: globals[GLOBAL_IDX()] = R(a); NEXT();
+op_ADDI: R(a) = wrapInt(R(b) + R(c)); NEXT();
+op_SUBI: R(a) = wrapInt(R(b) - R(c)); NEXT();
+op_MULI: R(a) = wrapInt(R(b) * R(c)); NEXT();
+op_DIVI:
+	if (R(c) == 0){ throw new UserError("Division by zero"); }
+	R(a) = wrapInt(R(b) / R(c));
+	NEXT();
+op_ADDS: R(a) = wrapShort(R(b) + R(c)); NEXT();
+op_SUBS: R(a) = wrapShort(R(b) - R(c)); NEXT();
+op_MULS: R(a) = wrapShort(R(b) * R(c)); NEXT();
+op_DIVS:
+	if (R(c) == 0){ throw new UserError("Division by zero"); }
+	R(a) = wrapShort(R(b) / R(c));
+	NEXT();
+op_NEGI: R(a) = wrapInt(-R(b)); NEXT();
+op_NEGS: R(a) = wrapShort(-R(b)); NEXT();
+op_NOT: R(a) = R(b) ^ 1; NEXT();
+op_SEQ: R(a) = R(b) == R(c); NEXT();
+op_SNE: R(a) = R(b) != R(c); NEXT();
+op_SLT: R(a) = R(b) < R(c); NEXT();
+op_SLE: R(a) = R(b) <= R(c); NEXT();
+op_SGT: R(a) = R(b) > R(c); NEXT();
+op_SGE: R(a) = R(b) >= R(c); NEXT();
+op_ADDRG: R(a) = reinterpret_cast<int64_t>(&globals[GLOBAL_IDX()]); NEXT();
+op_ADDRR: R(a) = reinterpret_cast<int64_t>(&R(b)); NEXT();
+op_LOAD: R(a) = *reinterpret_cast<int64_t *>(R(b)); NEXT();
+op_STORE: *reinterpret_cast<int64_t *>(R(a)) = R(b); NEXT();
+op_JMP: pc = base + GLOBAL_IDX(); DISPATCH();
+op_BEQ: BRANCH(R(a) == R(b));
+op_BNE: BRANCH(R(a) != R(b));
+op_BLT: BRANCH(R(a) < R(b));
+op_BLE: BRANCH(R(a) <= R(b));
+op_BGT: BRANCH(R(a) > R(b));
+op_BGE: BRANCH(R(a) >= R(b));
+op_BEQK: BRANCH(R(a) == K());
+op_BNEK: BRANCH(R(a) != K());
+op_BLTK: BRANCH(R(a) < K());
+op_BLEK: BRANCH(R(a) <= K());
+op_BGTK: BRANCH(R(a) > K());
+op_BGEK: BRANCH(R(a) >= K());
+op_INCI: R(a) = wrapInt(R(a) + 1); NEXT();
+op_DECI: R(a) = wrapInt(R(a) - 1); NEXT();
+op_INCS: R(a) = wrapShort(R(a) + 1); NEXT();
+op_DECS: R(a) = wrapShort(R(a) - 1); NEXT();
+op_ARG: args[pc->b] = R(a); NEXT();
+op_GETARG: R(a) = args[pc->b]; NEXT();
+op_CALL: {
+	size_t idx = GLOBAL_IDX();
+	const BProc& callee = code.procs[idx];
+	int64_t * next = regs + numRegs;
+	if (next + callee.numRegs > stackEnd){
+		throw new UserError("Stack overflow");
+	}
+	std::copy(consts[idx].begin(), consts[idx].end(),
+		next + callee.firstConst);
+	frames.push_back(Frame{pc, base, regs, numRegs});
+	regs = next;
+	numRegs = callee.numRegs;
+	base = callee.code.data();
+	pc = base;
+	DISPATCH();
+}
+op_RET: {
+	int64_t val = pc->a == NOREG ? 0 : R(a);
+	if (frames.empty()){ return; }
+	const Frame& frame = frames.back();
+	pc = frame.pc;
+	base = frame.base;
+	regs = frame.regs;
+	numRegs = frame.numRegs;
+	frames.pop_back();
+	if (pc->a != NOREG){ R(a) = val; }
+	NEXT();
+}
+op_WRITEI: outBuf.put(R(a)); NEXT();
+op_WRITES: outBuf.put(reinterpret_cast<const char *>(R(a))); NEXT();
+op_READI:
+	outBuf.flush();
+	R(a) = wrapInt(readInt(in));
+	NEXT();
+op_READS:
+	outBuf.flush();
+	R(a) = wrapShort(readInt(in));
+	NEXT();
+op_READB:
+	outBuf.flush();
+	R(a) = readInt(in) != 0;
+	NEXT();
+
+	#undef R
+	#undef DISPATCH
+	#undef NEXT
+	#undef GLOBAL_IDX
+	#undef BRANCH
+	#undef K
+}
+
+}
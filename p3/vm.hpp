@@ -0,0 +1,62 @@
+#ifndef CMINUSMINUS_VM_HPP
+#define CMINUSMINUS_VM_HPP
+
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "ir.hpp"
+
+/*
+A register bytecode for running programs without a native toolchain,
+translated from the IR. Every operand is a 16-bit register number:
+a procedure's temps, then its stack slots, then two scratch
+registers, then its constants, which are copied into each new frame.
+Branches carry a 16-bit offset relative to themselves.
+*/
+
+namespace cminusminus{
+
+struct BInsn{
+	uint16_t op;
+	uint16_t a;
+	uint16_t b;
+	uint16_t c;
+};
+
+struct BProc{
+	std::string name;
+	uint32_t numRegs = 0;
+	uint32_t firstConst = 0;
+	std::vector<int64_t> consts;
+	/* Which consts are string literals, their value a strings index */
+	std::vector<uint32_t> strConsts;
+	std::vector<BInsn> code;
+};
+
+struct Bytecode{
+	std::vector<BProc> procs;
+	/* String literals, escapes already applied */
+	std::vector<std::string> strings;
+	size_t numGlobals = 0;
+	size_t maxArgs = 0;
+	uint32_t mainProc = 0;
+};
+
+/* Translate prog. Throws UserError if a procedure needs more
+   registers than an operand can name */
+Bytecode * compileBytecode(const IRProgram& prog);
+
+/* Run a program to completion, with buffered reads from in and
+   writes to out. Throws UserError on division by zero or when the
+   stack runs out */
+void runBytecode(const Bytecode& code, std::istream& in, std::ostream& out);
+
+/* Run the IR directly, one instruction at a time. Slow, and kept as
+   a reference to check the VM and back ends against */
+void interpretIR(const IRProgram& prog, std::istream& in, std::ostream& out);
+
+}
+
+#endif
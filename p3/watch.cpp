@@ -0,0 +1,75 @@
+#include <fstream>
+#include <iterator>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#include "errors.hpp"
+#include "watch.hpp"
+
+namespace cminusminus{
+
+static std::string fileContents(const std::string& path){
+	std::ifstream in(path, std::ios::binary);
+	return std::string(std::istreambuf_iterator<char>(in),
+		std::istreambuf_iterator<char>());
+}
+
+FileWatcher::FileWatcher(const char * path)
+: myPath(path), myContents(fileContents(path)){
+	size_t slash = myPath.rfind('/');
+	std::string dir = slash == std::string::npos ? "."
+		: myPath.substr(0, slash + 1);
+	myName = slash == std::string::npos ? myPath
+		: myPath.substr(slash + 1);
+	myFd = inotify_init1(IN_CLOEXEC);
+	if (myFd < 0
+		|| inotify_add_watch(myFd, dir.c_str(),
+			IN_CLOSE_WRITE | IN_MOVED_TO) < 0){
+		if (myFd >= 0){ close(myFd); }
+		std::string msg = "Cannot watch ";
+		msg += path;
+		throw new UserError(msg.c_str());
+	}
+}
+
+FileWatcher::~FileWatcher(){
+	close(myFd);
+}
+
+void FileWatcher::wait(){
+	while (true){
+		readEvents(-1);
+		//The rest of the burst, if it is already here
+		while (readEvents(0)){ }
+		std::string contents = fileContents(myPath);
+		if (contents != myContents){
+			myContents.swap(contents);
+			return;
+		}
+	}
+}
+
+bool FileWatcher::readEvents(int timeoutMs){
+	bool saved = false;
+	struct pollfd ready = { myFd, POLLIN, 0 };
+	while (!saved){
+		int n = poll(&ready, 1, timeoutMs);
+		if (n == 0){ return false; }
+		if (n < 0){ continue; }
+		alignas(struct inotify_event) char buf[4096];
+		ssize_t len = read(myFd, buf, sizeof(buf));
+		if (len <= 0){ continue; }
+		for (ssize_t i = 0; i < len; ){
+			const struct inotify_event * event =
+				reinterpret_cast<const struct inotify_event *>(buf + i);
+			if (event->len > 0 && myName == event->name){
+				saved = true;
+			}
+			i += static_cast<ssize_t>(sizeof(struct inotify_event)
+				+ event->len);
+		}
+	}
+	return true;
+}
+
+}
@@ -0,0 +1,46 @@
+#ifndef CMINUSMINUS_WATCH_HPP
+#define CMINUSMINUS_WATCH_HPP
+
+#include <string>
+
+/*
+Waiting for edits to a file, for cmmc -watch. The watch is on the
+file's directory rather than the file itself: most editors save by
+writing a new file and renaming it over the old one, which would
+leave a watch on the old file looking at nothing. A save usually
+comes as a burst of events, and some saves (or a touch) leave the
+contents as they were, so a change only counts once the burst is
+over and the contents really differ from last time.
+*/
+
+namespace cminusminus{
+
+/**
+* \class FileWatcher
+* Uses inotify, so Linux only
+**/
+class FileWatcher{
+public:
+	/* Start watching the file at path, as its contents are now */
+	FileWatcher(const char * path);
+	~FileWatcher();
+	FileWatcher(const FileWatcher&) = delete;
+	FileWatcher& operator=(const FileWatcher&) = delete;
+
+	/* Block until the file has been saved with new contents */
+	void wait();
+private:
+	/* Read the events that come within timeoutMs (-1 to wait for
+	   as long as it takes), returning whether any were a save of
+	   the file */
+	bool readEvents(int timeoutMs);
+
+	std::string myPath;
+	std::string myName;
+	std::string myContents;
+	int myFd;
+};
+
+}
+
+#endif
@@ -0,0 +1,29 @@
+#include "workstack.hpp"
+
+namespace cminusminus{
+
+void WorkStack::run(Step first){
+	//A walk may run another to the end within one of its steps
+	std::vector<Step> outer;
+	outer.swap(myQueued);
+	std::vector<Step> stack;
+	stack.push_back(std::move(first));
+	try {
+		while (!stack.empty()){
+			Step step = std::move(stack.back());
+			stack.pop_back();
+			step();
+			//Reversed, so they come off the stack in order
+			for (auto it = myQueued.rbegin(); it != myQueued.rend(); ++it){
+				stack.push_back(std::move(*it));
+			}
+			myQueued.clear();
+		}
+	} catch (...){
+		myQueued.swap(outer);
+		throw;
+	}
+	myQueued.swap(outer);
+}
+
+}
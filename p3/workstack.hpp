@@ -0,0 +1,35 @@
+#ifndef CMINUSMINUS_WORKSTACK_HPP
+#define CMINUSMINUS_WORKSTACK_HPP
+
+#include <functional>
+#include <vector>
+
+namespace cminusminus{
+
+/**
+* \class WorkStack
+* The steps of a tree walk, kept on the heap rather than the C++ stack,
+* so that no depth of nesting can overflow it. A step does what comes
+* before a node's first subtree and queues the rest: the subtrees, and
+* steps for what comes between and after them. What a step queues runs
+* in the order it was queued, before anything queued earlier, just as
+* the calls a recursive walk makes would return before it went on.
+**/
+class WorkStack{
+public:
+	typedef std::function<void()> Step;
+
+	/* Queue step, to run once the running step and those it queued
+	   before this one are done */
+	void then(Step step){ myQueued.push_back(std::move(step)); }
+
+	/* Run first, and all it queues, to the end. If a step throws, the
+	   steps left are dropped */
+	void run(Step first);
+private:
+	std::vector<Step> myQueued;
+};
+
+}
+
+#endif
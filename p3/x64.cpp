@@ -0,0 +1,440 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <string>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "errors.hpp"
+#include "regalloc.hpp"
+#include "x64.hpp"
+
+namespace cminusminus{
+
+/*
+Frame layout, growing down from %rbp:
+	16+8i(%rbp)   incoming argument i (the caller's outgoing area)
+	8(%rbp)       return address
+	0(%rbp)       caller's %rbp
+	below that    callee-saved registers this procedure uses, then
+	              its stack slots, spill cells and a cell for read
+	8i(%rsp)      outgoing argument i
+%rsp is kept 16-byte aligned at every call. A procedure's result
+comes back in %rax.
+
+%rax, %rcx, %rdx and %r11 are never allocated: instructions use them
+as scratch.
+*/
+
+namespace {
+
+enum Reg { RAX, RCX, RDX, RBX, RSI, RDI, R8, R9, R10, R11, R12, R13,
+	R14, R15 };
+
+struct RegNames{
+	const char * q;
+	const char * l;
+	const char * w;
+	const char * b;
+};
+
+const RegNames regNames[] = {
+	{ "%rax", "%eax", "%ax", "%al" },
+	{ "%rcx", "%ecx", "%cx", "%cl" },
+	{ "%rdx", "%edx", "%dx", "%dl" },
+	{ "%rbx", "%ebx", "%bx", "%bl" },
+	{ "%rsi", "%esi", "%si", "%sil" },
+	{ "%rdi", "%edi", "%di", "%dil" },
+	{ "%r8", "%r8d", "%r8w", "%r8b" },
+	{ "%r9", "%r9d", "%r9w", "%r9b" },
+	{ "%r10", "%r10d", "%r10w", "%r10b" },
+	{ "%r11", "%r11d", "%r11w", "%r11b" },
+	{ "%r12", "%r12d", "%r12w", "%r12b" },
+	{ "%r13", "%r13d", "%r13w", "%r13b" },
+	{ "%r14", "%r14d", "%r14w", "%r14b" },
+	{ "%r15", "%r15d", "%r15w", "%r15b" },
+};
+
+/* What the allocator's register numbers stand for: the
+   callee-saved ones first */
+const Reg allocatable[] = { RBX, R12, R13, R14, R15,
+	RSI, RDI, R8, R9, R10 };
+const unsigned int numAllocatable = 10;
+const unsigned int numPreserved = 5;
+
+/**
+* \class ProcEmitter
+* Emits one procedure, given where its temps were put
+**/
+class ProcEmitter{
+public:
+	ProcEmitter(const IRProgram& progIn, size_t idxIn, std::ostream& outIn,
+		bool allocate)
+	: prog(progIn), proc(progIn.procs[idxIn]), idx(idxIn), out(outIn){
+		if (allocate){
+			alloc = allocateRegisters(proc, numAllocatable, numPreserved);
+		} else {
+			alloc.reg.assign(proc.numTemps, -1);
+			alloc.used.assign(numAllocatable, false);
+			for (size_t t = 0; t < proc.numTemps; t++){
+				alloc.spill.push_back(alloc.numSpills++);
+			}
+		}
+		for (unsigned int r = 0; r < numPreserved; r++){
+			if (alloc.used[r]){ saved.push_back(allocatable[r]); }
+		}
+	}
+
+	void emit(){
+		size_t outgoing = 0;
+		for (const Instr& instr : proc.code){
+			if (instr.op == IROp::ARG){
+				outgoing = std::max(outgoing, instr.b.idx() + 1);
+			}
+		}
+		size_t cells = proc.numSlots + alloc.numSpills + 1;
+		size_t frame = 8 * (cells + outgoing);
+		if ((8 * saved.size() + frame) % 16 != 0){ frame += 8; }
+
+		out << "\n\t.text\n"
+			<< "fun_" << proc.name << ":\n"
+			<< "\tpushq %rbp\n"
+			<< "\tmovq %rsp, %rbp\n";
+		for (Reg r : saved){ out << "\tpushq " << regNames[r].q << "\n"; }
+		if (frame > 0){ out << "\tsubq $" << frame << ", %rsp\n"; }
+
+		for (const Instr& instr : proc.code){
+			emitInstr(instr);
+		}
+
+		out << ".L" << idx << "_ret:\n";
+		if (!saved.empty()){
+			out << "\tleaq -" << 8 * saved.size() << "(%rbp), %rsp\n";
+		}
+		for (size_t i = saved.size(); i-- > 0; ){
+			out << "\tpopq " << regNames[saved[i]].q << "\n";
+		}
+		out << "\tleave\n\tret\n";
+	}
+
+private:
+	const IRProgram& prog;
+	const IRProc& proc;
+	size_t idx;
+	std::ostream& out;
+	Allocation alloc;
+	std::vector<Reg> saved;
+
+	std::string cell(size_t n) const {
+		return "-" + std::to_string(8 * (saved.size() + n + 1)) + "(%rbp)";
+	}
+	std::string readCell() const {
+		return cell(proc.numSlots + alloc.numSpills);
+	}
+
+	bool inReg(const Opd& opd) const {
+		return opd.isTemp() && alloc.reg[opd.idx()] >= 0;
+	}
+	Reg regOf(const Opd& opd) const {
+		return allocatable[static_cast<size_t>(alloc.reg[opd.idx()])];
+	}
+	static bool smallImm(const Opd& opd){
+		return opd.isImm() && opd.val >= INT32_MIN && opd.val <= INT32_MAX;
+	}
+
+	/* Where opd is, for a register, memory or immediate operand */
+	std::string loc(const Opd& opd) const {
+		switch (opd.kind){
+		case Opd::TEMP:
+			if (inReg(opd)){ return regNames[regOf(opd)].q; }
+			return cell(proc.numSlots + alloc.spill[opd.idx()]);
+		case Opd::IMM:
+			return "$" + std::to_string(opd.val);
+		case Opd::GLOBAL:
+			return "gbl_" + prog.globals[opd.idx()] + "(%rip)";
+		case Opd::SLOT:
+			return cell(opd.idx());
+		default:
+			throw new InternalError("Operand has no location");
+		}
+	}
+
+	void load(const Opd& opd, Reg reg){
+		const char * r = regNames[reg].q;
+		if (opd.kind == Opd::STR){
+			out << "\tleaq .Lstr" << opd.val << "(%rip), " << r << "\n";
+		} else if (opd.isImm() && !smallImm(opd)){
+			out << "\tmovabsq $" << opd.val << ", " << r << "\n";
+		} else if (!(inReg(opd) && regOf(opd) == reg)){
+			out << "\tmovq " << loc(opd) << ", " << r << "\n";
+		}
+	}
+
+	/* opd as a source operand, going through scratch if it cannot
+	   be one directly */
+	std::string src(const Opd& opd, Reg scratch){
+		if (opd.kind == Opd::STR || (opd.isImm() && !smallImm(opd))){
+			load(opd, scratch);
+			return regNames[scratch].q;
+		}
+		return loc(opd);
+	}
+
+	/* opd in some register: its own, or scratch */
+	Reg inRegister(const Opd& opd, Reg scratch){
+		if (inReg(opd)){ return regOf(opd); }
+		load(opd, scratch);
+		return scratch;
+	}
+
+	/* The register to compute dst in: its own, or %rax */
+	Reg target(const Opd& dst) const {
+		return inReg(dst) ? regOf(dst) : RAX;
+	}
+
+	void store(Reg reg, const Opd& dst){
+		if (dst.isNone()){ return; }
+		if (inReg(dst) && regOf(dst) == reg){ return; }
+		out << "\tmovq " << regNames[reg].q << ", " << loc(dst) << "\n";
+	}
+
+	/* Wrap to the width of type */
+	void normalize(Reg reg, IRType type){
+		if (type == IRType::INT){
+			out << "\tmovslq " << regNames[reg].l << ", " << regNames[reg].q << "\n";
+		} else if (type == IRType::SHORT){
+			out << "\tmovswq " << regNames[reg].w << ", " << regNames[reg].q << "\n";
+		}
+	}
+
+	std::string label(const Opd& lbl) const {
+		return ".L" + std::to_string(idx) + "_" + std::to_string(lbl.val);
+	}
+
+	static const char * condition(IROp op){
+		switch (op){
+		case IROp::SEQ: case IROp::BEQ: return "e";
+		case IROp::SNE: case IROp::BNE: return "ne";
+		case IROp::SLT: case IROp::BLT: return "l";
+		case IROp::SLE: case IROp::BLE: return "le";
+		case IROp::SGT: case IROp::BGT: return "g";
+		default: return "ge";
+		}
+	}
+
+	void compare(const Instr& instr){
+		Reg a = inRegister(instr.a, RCX);
+		out << "\tcmpq " << src(instr.b, RDX) << ", " << regNames[a].q << "\n";
+	}
+
+	void arith(const Instr& instr){
+		Opd a = instr.a;
+		Opd b = instr.b;
+		Reg r = target(instr.dst);
+		bool commutes = instr.op == IROp::ADD || instr.op == IROp::MUL;
+		if (inReg(b) && regOf(b) == r && a != b){
+			if (commutes){
+				std::swap(a, b);
+			} else {
+				r = RAX;
+			}
+		}
+		load(a, r);
+		const char * mnemonic = instr.op == IROp::ADD ? "addq"
+			: instr.op == IROp::SUB ? "subq" : "imulq";
+		out << "\t" << mnemonic << " " << src(b, RCX) << ", "
+			<< regNames[r].q << "\n";
+		normalize(r, instr.type);
+		store(r, instr.dst);
+	}
+
+	void callRuntime(const char * fn){
+		out << "\txorl %eax, %eax\n"
+			<< "\tcall " << fn << "@PLT\n";
+	}
+
+	void emitInstr(const Instr& instr){
+		switch (instr.op){
+		case IROp::MOV:
+			if (inReg(instr.dst)){
+				load(instr.a, regOf(instr.dst));
+			} else if (inReg(instr.a) || smallImm(instr.a)){
+				out << "\tmovq " << loc(instr.a) << ", " << loc(instr.dst) << "\n";
+			} else {
+				load(instr.a, RAX);
+				store(RAX, instr.dst);
+			}
+			return;
+		case IROp::ADD:
+		case IROp::SUB:
+		case IROp::MUL:
+			arith(instr);
+			return;
+		case IROp::DIV: {
+			load(instr.a, RAX);
+			out << "\tcqto\n";
+			if (instr.b.isImm() || instr.b.kind == Opd::STR){
+				load(instr.b, RCX);
+				out << "\tidivq %rcx\n";
+			} else {
+				out << "\tidivq " << loc(instr.b) << "\n";
+			}
+			normalize(RAX, instr.type);
+			store(RAX, instr.dst);
+			return;
+		}
+		case IROp::NEG: {
+			Reg r = target(instr.dst);
+			load(instr.a, r);
+			out << "\tnegq " << regNames[r].q << "\n";
+			normalize(r, instr.type);
+			store(r, instr.dst);
+			return;
+		}
+		case IROp::NOT: {
+			Reg r = target(instr.dst);
+			load(instr.a, r);
+			out << "\txorq $1, " << regNames[r].q << "\n";
+			store(r, instr.dst);
+			return;
+		}
+		case IROp::SEQ: case IROp::SNE: case IROp::SLT:
+		case IROp::SLE: case IROp::SGT: case IROp::SGE:
+			compare(instr);
+			out << "\tset" << condition(instr.op) << " %al\n"
+				<< "\tmovzbq %al, %rax\n";
+			store(RAX, instr.dst);
+			return;
+		case IROp::ADDR: {
+			Reg r = target(instr.dst);
+			out << "\tleaq " << loc(instr.a) << ", " << regNames[r].q << "\n";
+			store(r, instr.dst);
+			return;
+		}
+		case IROp::LOAD: {
+			Reg ptr = inRegister(instr.a, RCX);
+			Reg r = target(instr.dst);
+			out << "\tmovq (" << regNames[ptr].q << "), " << regNames[r].q << "\n";
+			store(r, instr.dst);
+			return;
+		}
+		case IROp::STORE: {
+			Reg ptr = inRegister(instr.a, RCX);
+			std::string val = inReg(instr.b) || smallImm(instr.b)
+				? loc(instr.b) : regNames[inRegister(instr.b, RAX)].q;
+			out << "\tmovq " << val << ", (" << regNames[ptr].q << ")\n";
+			return;
+		}
+		case IROp::LABEL:
+			out << label(instr.a) << ":\n";
+			return;
+		case IROp::JMP:
+			out << "\tjmp " << label(instr.a) << "\n";
+			return;
+		case IROp::BEQ: case IROp::BNE: case IROp::BLT:
+		case IROp::BLE: case IROp::BGT: case IROp::BGE:
+			compare(instr);
+			out << "\tj" << condition(instr.op) << " " << label(instr.dst) << "\n";
+			return;
+		case IROp::ARG: {
+			std::string val = inReg(instr.a) || smallImm(instr.a)
+				? loc(instr.a) : regNames[inRegister(instr.a, RAX)].q;
+			out << "\tmovq " << val << ", " << 8 * instr.b.val << "(%rsp)\n";
+			return;
+		}
+		case IROp::CALL:
+			out << "\tcall fun_" << prog.procs[instr.a.idx()].name << "\n";
+			store(RAX, instr.dst);
+			return;
+		case IROp::GETARG: {
+			Reg r = target(instr.dst);
+			out << "\tmovq " << 16 + 8 * instr.a.val << "(%rbp), "
+				<< regNames[r].q << "\n";
+			store(r, instr.dst);
+			return;
+		}
+		case IROp::RET:
+			if (!instr.a.isNone()){ load(instr.a, RAX); }
+			out << "\tjmp .L" << idx << "_ret\n";
+			return;
+		case IROp::WRITE:
+			load(instr.a, RSI);
+			out << "\tleaq .Lfmt_" << (instr.type == IRType::STR ? "s" : "d")
+				<< "(%rip), %rdi\n";
+			callRuntime("printf");
+			return;
+		case IROp::READ:
+			out << "\tleaq " << readCell() << ", %rsi\n"
+				<< "\tleaq .Lfmt_d(%rip), %rdi\n";
+			callRuntime("scanf");
+			out << "\tmovq " << readCell() << ", %rax\n";
+			if (instr.type == IRType::BOOL){
+				out << "\ttestq %rax, %rax\n"
+					<< "\tsetne %al\n"
+					<< "\tmovzbq %al, %rax\n";
+			}
+			normalize(RAX, instr.type);
+			store(RAX, instr.dst);
+			return;
+		}
+	}
+};
+
+}
+
+void emitX64(const IRProgram& prog, std::ostream& out, bool allocate){
+	out << "\t.section .rodata\n"
+		<< ".Lfmt_d:\n\t.string \"%ld\"\n"
+		<< ".Lfmt_s:\n\t.string \"%s\"\n";
+	for (size_t i = 0; i < prog.strings.size(); i++){
+		out << ".Lstr" << i << ":\n\t.string " << prog.strings[i] << "\n";
+	}
+	if (!prog.globals.empty()){
+		out << "\n\t.bss\n\t.align 8\n";
+		for (const std::string& name : prog.globals){
+			out << "gbl_" << name << ":\n\t.zero 8\n";
+		}
+	}
+
+	//A C-- program's main returns whatever it likes; the process
+	// exits with 0
+	out << "\n\t.text\n"
+		<< "\t.globl main\n"
+		<< "main:\n"
+		<< "\tpushq %rbp\n"
+		<< "\tmovq %rsp, %rbp\n"
+		<< "\tcall fun_main\n"
+		<< "\txorl %eax, %eax\n"
+		<< "\tpopq %rbp\n"
+		<< "\tret\n";
+
+	for (size_t i = 0; i < prog.procs.size(); i++){
+		ProcEmitter(prog, i, out, allocate).emit();
+	}
+	out << "\n\t.section .note.GNU-stack,\"\",@progbits\n";
+}
+
+/* path, in a form cc will not take for an option */
+static std::string plainPath(const std::string& path){
+	return !path.empty() && path[0] == '-' ? "./" + path : path;
+}
+
+bool linkExecutable(const std::string& asmPath, const std::string& exePath){
+	//No shell in between: the paths reach cc as they are
+	std::string exe = plainPath(exePath);
+	std::string asmFile = plainPath(asmPath);
+	char cc[] = "cc";
+	char output[] = "-o";
+	char * argv[] = { cc, output, &exe[0], &asmFile[0], nullptr };
+	pid_t pid;
+	if (posix_spawnp(&pid, cc, nullptr, nullptr, argv, environ) != 0){
+		return false;
+	}
+	int status;
+	while (waitpid(pid, &status, 0) < 0){
+		if (errno != EINTR){ return false; }
+	}
+	return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+}
@@ -0,0 +1,24 @@
+#ifndef CMINUSMINUS_X64_HPP
+#define CMINUSMINUS_X64_HPP
+
+#include <ostream>
+#include <string>
+#include "ir.hpp"
+
+namespace cminusminus{
+
+/* Write prog as x86-64 assembly (AT&T syntax, System V, for the
+   system assembler). The output defines main, calling the program's
+   main, and uses printf and scanf from the C library for write and
+   read. With allocate false, every temp lives on the stack; that is
+   only useful for measuring what register allocation buys. */
+void emitX64(const IRProgram& prog, std::ostream& out, bool allocate = true);
+
+/* Have the system compiler driver (cc) assemble the file at asmPath
+   and link it against the C library into exePath. Returns false if cc
+   could not be started or failed */
+bool linkExecutable(const std::string& asmPath, const std::string& exePath);
+
+}
+
+#endif